@@ -37,13 +37,15 @@ public:
             name_ = "";
         return is_open();
     }
-    void close()
+    int close()
     {
+        int result = 0;
         if(file_)
             {
-                std::fclose(file_);
+                result = std::fclose(file_);
                 file_ = nullptr;
             }
+        return result;
     }
     bool is_open() const
     {
@@ -31,8 +31,11 @@
 #define USE_STRING_LITERAL // --- //
 
 namespace {
-    std::unordered_set<std::string> variables;
-    bool                            all_arduino_pins_are_mapped;
+    std::unordered_set<std::string>      variables;
+    bool                                 all_arduino_pins_are_mapped;
+    std::unordered_map<std::string, int> packedBits; // relay -> 32 * word + bit
+    std::vector<std::string>             benchInputs;  // Read_ functions the user provides
+    std::vector<std::string>             benchOutputs; // Write_ functions the user provides
 } // namespace
 
 static int mcu_ISA = -1;
@@ -60,6 +63,34 @@ static int  PWM_MaxCs[MAX_PWM_C]; // PWM Max prediv choices
 static int  countpwm = 0;
 /////
 
+//-----------------------------------------------------------------------------
+// When optimizing for speed on the 32-bit targets (ARM and plain ANSI C for a
+// PC) the internal relays are packed 32 to a word instead of one BOOLEAN_t
+// each, and simple IF/SET/CLEAR sequences are lowered to branchless AND/OR.
+// The 8-bit targets keep the one byte per relay layout.
+//-----------------------------------------------------------------------------
+static bool PackRelays()
+{
+    return (Prog.optimize == OPTIMIZE_SPEED) && ((compiler_variant == MNU_COMPILE_ANSIC) || (compiler_variant == MNU_COMPILE_ARMGCC));
+}
+
+//-----------------------------------------------------------------------------
+// The PlcCycle() benchmark, asked for with /b on the command line, is written
+// only for the plain ANSI C target without a microcontroller; that output
+// runs on the host.
+//-----------------------------------------------------------------------------
+bool AnsiCBenchmark = false;
+
+static bool WriteBenchmark()
+{
+    return AnsiCBenchmark && (compiler_variant == MNU_COMPILE_ANSIC) && !Prog.mcu();
+}
+
+static bool IsPackedBit(const char *str)
+{
+    return packedBits.count(str) != 0;
+}
+
 //-----------------------------------------------------------------------------
 // Have we seen a variable before? If not then no need to generate code for
 // it, otherwise we will have to make a declaration, and mark it as seen.
@@ -332,6 +363,7 @@ static void DeclareBit(FILE *f, FILE *fh, FILE *flh, const char *str, int set1)
                 fprintf(f, "// You provide this function.\n");
                 fprintf(f, "LDSTUB%d( BOOLEAN_t Read_%s(void) )\n", set1, str);
                 fprintf(f, "\n");
+                benchInputs.emplace_back(str);
             }
         }
     } else if(type == IO_TYPE_DIG_OUTPUT) {
@@ -502,6 +534,7 @@ static void DeclareBit(FILE *f, FILE *fh, FILE *flh, const char *str, int set1)
                 fprintf(f, "LDSTUB%d( BOOLEAN_t Read_%s(void) )\n", set1, str);
                 fprintf(f, "LDSTUB( void Write_%s(BOOLEAN_t v) )\n", str);
                 fprintf(f, "\n");
+                benchOutputs.emplace_back(str);
             }
         }
     } else if(type == IO_TYPE_PWM_OUTPUT) {
@@ -792,6 +825,20 @@ static void DeclareBit(FILE *f, FILE *fh, FILE *flh, const char *str, int set1)
             fprintf(f, "  return 0;\n");
             fprintf(f, "}\n");
         }
+    } else if(PackRelays()) {
+        int n = packedBits.size();
+        int word = n / 32;
+        int bit = n % 32;
+        packedBits.emplace(str, n);
+        if(bit == 0) {
+            fprintf(f, "_STATIC_ unsigned long PlcRelays%d = 0;\n", word);
+            fprintf(fh, "#ifdef EXTERN_EVERYTHING\n  extern unsigned long PlcRelays%d;\n#endif\n", word);
+        }
+        fprintf(fh, "#define Read_%s() ((PlcRelays%d >> %d) & 1)\n", str, word, bit);
+        fprintf(fh, "#define Write_%s(x) (PlcRelays%d = (PlcRelays%d & ~(1UL << %d)) | ((unsigned long)((x) != 0) << %d))\n", str, word, word, bit, bit);
+        fprintf(fh, "#define Write0_%s() (PlcRelays%d &= ~(1UL << %d))\n", str, word, bit);
+        fprintf(fh, "#define Write1_%s() (PlcRelays%d |= (1UL << %d))\n", str, word, bit);
+        fprintf(fh, "\n");
     } else {
         fprintf(f, "_STATIC_ BOOLEAN_t %s = 0;\n", str);
         fprintf(fh, "#ifdef EXTERN_EVERYTHING\n  extern BOOLEAN_t %s;\n#endif\n", str);
@@ -1348,12 +1395,24 @@ static void GenerateAnsiC(FILE *f, int begin, int end)
                 break;
 
             case INT_IF_BIT_SET:
-                fprintf(f, "if(Read_%s()) {\n", MapSym(IntCode[i].name1, ASBIT));
-                indent++;
-                break;
-
             case INT_IF_BIT_CLEAR:
-                fprintf(f, "if(!Read_%s()) {\n", MapSym(IntCode[i].name1, ASBIT));
+                // if(a) { b = 0/1; } on a packed relay b becomes b = b & !a or
+                // b = b | a, so the rung compiles without a branch.
+                if((i + 2 <= end) && (IntCode[i + 2].op == INT_END_IF)
+                   && ((IntCode[i + 1].op == INT_SET_BIT) || (IntCode[i + 1].op == INT_CLEAR_BIT))
+                   && IsPackedBit(MapSym(IntCode[i + 1].name1, ASBIT))) {
+                    bool        set = IntCode[i + 1].op == INT_SET_BIT;
+                    bool        ifSet = IntCode[i].op == INT_IF_BIT_SET;
+                    const char *a = MapSym(IntCode[i].name1, ASBIT);
+                    const char *b = MapSym(IntCode[i + 1].name1, ASBIT);
+                    fprintf(f, "Write_%s(Read_%s() %c %sRead_%s());\n", b, b, set ? '|' : '&', (set == ifSet) ? "!!" : "!", a);
+                    i += 2;
+                    break;
+                }
+                if(IntCode[i].op == INT_IF_BIT_SET)
+                    fprintf(f, "if(Read_%s()) {\n", MapSym(IntCode[i].name1, ASBIT));
+                else
+                    fprintf(f, "if(!Read_%s()) {\n", MapSym(IntCode[i].name1, ASBIT));
                 indent++;
                 break;
 
@@ -1607,15 +1666,15 @@ static void GenerateAnsiC(FILE *f, int begin, int end)
                 break;
 */
             case INT_UART_RECV_AVAIL:
-                fprintf(f, "%s = UART_Receive_Avail();\n", MapSym(IntCode[i].name1, ASBIT));
+                fprintf(f, "Write_%s(UART_Receive_Avail());\n", MapSym(IntCode[i].name1, ASBIT));
                 break;
 
             case INT_UART_SEND_READY:
-                fprintf(f, "%s = UART_Transmit_Ready();\n", MapSym(IntCode[i].name1, ASBIT));
+                fprintf(f, "Write_%s(UART_Transmit_Ready());\n", MapSym(IntCode[i].name1, ASBIT));
                 break;
 
             case INT_UART_SEND_BUSY:
-                fprintf(f, "%s = UART_Transmit_Busy();\n", MapSym(IntCode[i].name1, ASBIT));
+                fprintf(f, "Write_%s(UART_Transmit_Busy());\n", MapSym(IntCode[i].name1, ASBIT));
                 break;
 
             case INT_EEPROM_BUSY:
@@ -1623,7 +1682,7 @@ static void GenerateAnsiC(FILE *f, int begin, int end)
                 if(compiler_variant == MNU_COMPILE_ARDUINO) {
                     fprintf(f, "Write0_%s(); // dummy // 0 = EEPROM is ready\n", MapSym(IntCode[i].name1, ASBIT));
                 } else {
-                    fprintf(f, "%s = EEPROM_busy(); // 0 = EEPROM is ready\n", MapSym(IntCode[i].name1, ASBIT));
+                    fprintf(f, "Write_%s(EEPROM_busy()); // 0 = EEPROM is ready\n", MapSym(IntCode[i].name1, ASBIT));
                 }
                 break;
 
@@ -2085,6 +2144,94 @@ static void GenerateAnsiC_flash_eeprom(FILE *f)
 #endif
 }
 
+//-----------------------------------------------------------------------------
+// Write a host-runnable benchmark for the generated PlcCycle(). It provides
+// the I/O functions that the user would otherwise provide, feeds the inputs
+// with pseudo-random bits every cycle and prints ns/cycle and a checksum of
+// the outputs, so that two builds of the same ladder can be compared.
+//-----------------------------------------------------------------------------
+static void GenerateBenchmark(const char *benchFile, const char *ldName)
+{
+    FileTracker f(benchFile, "w");
+    if(!f) {
+        THROW_COMPILER_EXCEPTION_FMT(_("Couldn't open file '%s'"), benchFile);
+    }
+    int nIn = std::max<int>(1, (benchInputs.size() + 31) / 32);
+    int nOut = std::max<int>(1, (benchOutputs.size() + 31) / 32);
+
+    fprintf(f,
+            "/* This is auto-generated benchmark harness for %s.c from LDmicro.\n"
+            "   Build and run it on the host with:\n"
+            "       gcc -O2 -DLDBENCH %s.c %s_bench.c -o %s_bench\n"
+            "       ./%s_bench [cycles]\n"
+            "   Library functions (UART, ADC, ...) used by the ladder must be provided. */\n"
+            "\n"
+            "#include <stdio.h>\n"
+            "#include <stdlib.h>\n"
+            "#include <time.h>\n"
+            "#include \"ladder.h\"\n"
+            "#include \"%s.h\"\n"
+            "\n"
+            "static unsigned long bench_seed = 2463534242UL;\n"
+            "static unsigned long bench_in[%d];\n"
+            "static unsigned long bench_out[%d];\n"
+            "\n"
+            "static unsigned long bench_rand(void) {\n"
+            "    bench_seed ^= (bench_seed << 13) & 0xFFFFFFFFUL;\n"
+            "    bench_seed ^= bench_seed >> 17;\n"
+            "    bench_seed ^= (bench_seed << 5) & 0xFFFFFFFFUL;\n"
+            "    return bench_seed;\n"
+            "}\n"
+            "\n",
+            ldName,
+            ldName,
+            ldName,
+            ldName,
+            ldName,
+            ldName,
+            nIn,
+            nOut);
+
+    for(size_t i = 0; i < benchInputs.size(); i++) {
+        fprintf(f, "BOOLEAN_t Read_%s(void) { return (bench_in[%d] >> %d) & 1; }\n", benchInputs[i].c_str(), (int)i / 32, (int)i % 32);
+    }
+    for(size_t i = 0; i < benchOutputs.size(); i++) {
+        const char *s = benchOutputs[i].c_str();
+        int         w = (int)i / 32;
+        int         b = (int)i % 32;
+        fprintf(f, "BOOLEAN_t Read_%s(void) { return (bench_out[%d] >> %d) & 1; }\n", s, w, b);
+        fprintf(f, "void Write1_%s(void) { bench_out[%d] |= 1UL << %d; }\n", s, w, b);
+        fprintf(f, "void Write0_%s(void) { bench_out[%d] &= ~(1UL << %d); }\n", s, w, b);
+        fprintf(f, "void Write_%s(BOOLEAN_t v) { if(v) Write1_%s(); else Write0_%s(); }\n", s, s, s);
+    }
+
+    fprintf(f,
+            "\n"
+            "int main(int argc, char **argv) {\n"
+            "    long cycles = (argc > 1) ? atol(argv[1]) : 10000000L;\n"
+            "    unsigned long sum = 0;\n"
+            "    clock_t start, stop;\n"
+            "    long i;\n"
+            "    int j;\n"
+            "\n"
+            "    start = clock();\n"
+            "    for(i = 0; i < cycles; i++) {\n"
+            "        for(j = 0; j < %d; j++)\n"
+            "            bench_in[j] = bench_rand();\n"
+            "        PlcCycle();\n"
+            "        for(j = 0; j < %d; j++)\n"
+            "            sum = (sum * 31 + bench_out[j]) & 0xFFFFFFFFUL;\n"
+            "    }\n"
+            "    stop = clock();\n"
+            "\n"
+            "    printf(\"%%ld cycles, %%.1f ns/cycle, checksum %%08lX\\n\",\n"
+            "           cycles, (double)(stop - start) * 1e9 / CLOCKS_PER_SEC / (cycles ? cycles : 1), sum);\n"
+            "    return 0;\n"
+            "}\n",
+            nIn,
+            nOut);
+}
+
 bool CompileAnsiC(const char *outFile, int MNU)
 {
     if(Prog.mcu())
@@ -2095,6 +2242,9 @@ bool CompileAnsiC(const char *outFile, int MNU)
         THROW_COMPILER_EXCEPTION_FMT(_("Invalid MENU:%i"), MNU);
 
     variables.clear();
+    packedBits.clear();
+    benchInputs.clear();
+    benchOutputs.clear();
 
     for(int i = 0; i < MAX_ADC_C; i++) {
         ADC_Used[i] = 0;
@@ -2342,7 +2492,11 @@ bool CompileAnsiC(const char *outFile, int MNU)
                 "\n");
     }
 
+    if(WriteBenchmark())
+        fprintf(flh, "#ifndef LDBENCH\n");
     fprintf(flh,"#include \"UsrLib.h\"\n");
+    if(WriteBenchmark())
+        fprintf(flh, "#endif\n");
     if(AdcFunctionUsed())
         fprintf(flh, "#include \"AdcLib.h\"\n");
     if(PwmFunctionUsed())
@@ -3790,6 +3944,8 @@ bool CompileAnsiC(const char *outFile, int MNU)
                 "\n");
 
 
+        if(WriteBenchmark())
+            fprintf(f, "#ifndef LDBENCH // %s_bench.c has its own main()\n", CurrentLdName);
         if(compiler_variant == MNU_COMPILE_CODEVISIONAVR)
             fprintf(f,
                 "// You can use main() as is.\n"
@@ -3806,6 +3962,8 @@ bool CompileAnsiC(const char *outFile, int MNU)
                 "    mainPlc();\n"
                 "    return 0;\n"
                 "}\n");
+        if(WriteBenchmark())
+            fprintf(f, "#endif\n");
     }
 
     fprintf(fh, "#endif\n");
@@ -3850,5 +4008,11 @@ bool CompileAnsiC(const char *outFile, int MNU)
                 CurrentLdName);
     }
 
+    if(WriteBenchmark()) {
+        char benchFile[MAX_PATH];
+        SetExt(benchFile, outFile, "_bench.c");
+        GenerateBenchmark(benchFile, CurrentLdName);
+    }
+
     return true;
 }
@@ -363,6 +363,86 @@ static uint32_t IntPc;
 static uint32_t IntPcNow = UINT_MAX; //must be static
 
 static void CompileFromIntermediate();
+#ifdef USE_MUL
+static void MultiplyBody8();
+static void MultiplyBody();
+static void MultiplyBody24();
+#endif
+
+//-----------------------------------------------------------------------------
+// Register cache. Remembers which variables are still held in registers after
+// CopyVarToReg/CopyRegToVar/CopyLitToReg, so that a following load of the
+// same variable can be dropped or turned into MOVs. The cache is only valid
+// while nothing but those loads and stores was emitted since it was updated;
+// any other instruction, label or call spills it, so an entry never outlives
+// the straight-line code of one basic block. Only used when the project asks
+// for an optimization, the default code is the same as without the cache.
+//-----------------------------------------------------------------------------
+typedef struct RegCacheEntryTag {
+    NameArray var;
+    int       reg;
+    int       sov;
+} RegCacheEntry;
+
+static std::vector<RegCacheEntry> RegCache;
+static uint32_t                   RegCacheValidAt = UINT_MAX;
+
+static void RegCacheFlush()
+{
+    RegCache.clear();
+    RegCacheValidAt = UINT_MAX;
+}
+
+static bool RegCacheIsValid()
+{
+    if(RegCacheValidAt != AvrProg.size())
+        RegCache.clear();
+    return !RegCache.empty();
+}
+
+// Forget every entry that lives in any of the registers reg..reg+sov-1.
+static void RegCacheClobber(int reg, int sov)
+{
+    for(auto it = RegCache.begin(); it != RegCache.end();) {
+        if((it->reg < reg + sov) && (reg < it->reg + it->sov))
+            it = RegCache.erase(it);
+        else
+            ++it;
+    }
+}
+
+static void RegCacheForget(const char *var)
+{
+    for(auto it = RegCache.begin(); it != RegCache.end();) {
+        if(strcmp(it->var.c_str(), var) == 0)
+            it = RegCache.erase(it);
+        else
+            ++it;
+    }
+}
+
+// Called right after the load or store that left var in reg..reg+sov-1.
+static void RegCacheRecord(const char *var, int reg, int sov)
+{
+    if(var && (Prog.optimize != OPTIMIZE_DEFAULT)) {
+        RegCacheEntry e;
+        e.var = var;
+        e.reg = reg;
+        e.sov = sov;
+        RegCache.push_back(e);
+    }
+    RegCacheValidAt = AvrProg.size();
+}
+
+static const RegCacheEntry *RegCacheFind(const char *var, int sov)
+{
+    if(!RegCacheIsValid())
+        return nullptr;
+    for(const auto &e : RegCache)
+        if((e.sov == sov) && (strcmp(e.var.c_str(), var) == 0))
+            return &e;
+    return nullptr;
+}
 
 //-----------------------------------------------------------------------------
 // Wipe the program and set the write pointer back to the beginning. Also
@@ -371,6 +451,7 @@ static void CompileFromIntermediate();
 static void WipeMemory()
 {
     AvrProg.clear();
+    RegCacheFlush();
 }
 
 //-----------------------------------------------------------------------------
@@ -513,6 +594,8 @@ static void FwdAddrIsNow(ADDR_T addr)
     if(!(addr & FWD(0)))
         ooops("addr=0x%X", addr);
 
+    RegCacheFlush(); // other paths join here
+
     WORD     seen = 0;
     uint32_t AvrProgWriteP = AvrProg.size();
     for(uint32_t i = 0; i < AvrProg.size(); i++) {
@@ -578,6 +661,213 @@ static void AddrCheckForErrorsPostCompile()
     }
 }
 
+//-----------------------------------------------------------------------------
+// Branch relaxation. Code generation must pick an encoding for every jump
+// before the distance is known, so forward jumps and calls on the bigger
+// cores always get the long LDI ZL/LDI ZH/IJMP (and EIND) sequences, and a
+// conditional branch that ends up more than 64 words away is an error. Once
+// all addresses are resolved, iterate over the PLC cycle code:
+//   1. a BRxx that is out of range becomes BR!xx over a following RJMP;
+//   2. a long jump/call sequence whose target is in RJMP range becomes a
+//      single RJMP/RCALL.
+// Step 1 only grows the code and step 2 only shrinks it, so each runs to a
+// fixed point on its own. Step 1 only changes programs that would not
+// assemble otherwise; step 2 changes the hex, so it runs only when the
+// project asks for an optimization (Prog.optimize). Every absolute code
+// address (arg1 of a jump, the Z immediates of the long sequences that stay)
+// is remapped after each pass.
+// Everything before BeginOfPLCCycle (vectors, flash tables) is left in place.
+//-----------------------------------------------------------------------------
+static bool IsSkipOperation(AvrOp op)
+{
+    switch(op) {
+        case OP_SBRC:
+        case OP_SBRS:
+        case OP_CPSE:
+#if USE_IO_REGISTERS == 1
+        case OP_SBIC:
+        case OP_SBIS:
+#endif
+            return true;
+        default:
+            return false;
+    }
+}
+
+static AvrOp InvertBranch(AvrOp op)
+{
+    switch(op) {
+        case OP_BREQ:
+            return OP_BRNE;
+        case OP_BRNE:
+            return OP_BREQ;
+        case OP_BRGE:
+            return OP_BRLT;
+        case OP_BRLT:
+            return OP_BRGE;
+        case OP_BRCC:
+            return OP_BRCS;
+        case OP_BRCS: // == OP_BRLO
+        case OP_BRLO:
+            return OP_BRCC;
+        default:
+            return OP_VACANT; // OP_BRMI has no OP_BRPL here
+    }
+}
+
+static bool IsLdi(uint32_t i, int reg, uint32_t val)
+{
+    return (AvrProg[i].opAvr == OP_LDI) && (AvrProg[i].arg1 == (uint32_t)reg) && (AvrProg[i].arg2 == val);
+}
+
+// Length in words of the long jump/call sequence ending at IJMP/ICALL/EIJMP/
+// EICALL i, as emitted by InstructionJMP() and CallSubroutine(); 0 if i does
+// not end such a sequence.
+static uint32_t LongJumpLength(uint32_t i)
+{
+    uint32_t target = AvrProg[i].arg1;
+    switch(AvrProg[i].opAvr) {
+        case OP_IJMP:
+        case OP_ICALL:
+            if((i >= 2) && IsLdi(i - 2, ZL, target & 0xff) && IsLdi(i - 1, ZH, (target >> 8) & 0xff))
+                return 3;
+            return 0;
+        case OP_EIJMP:
+        case OP_EICALL:
+            if((i >= 6) && IsLdi(i - 6, ZL, REG_EIND & 0xff) && IsLdi(i - 5, ZH, (REG_EIND >> 8) & 0xff) && IsLdi(i - 4, r25, (target >> 16) & 0xff)
+               && ((AvrProg[i - 3].opAvr == OP_ST_Z) || (AvrProg[i - 3].opAvr == OP_ST_ZP)) && (AvrProg[i - 3].arg1 == r25) && IsLdi(i - 2, ZL, target & 0xff)
+               && IsLdi(i - 1, ZH, (target >> 8) & 0xff))
+                return 7;
+            return 0;
+        default:
+            return 0;
+    }
+}
+
+typedef struct AvrRelaxEditTag {
+    uint32_t                       from; // first replaced instruction
+    uint32_t                       len;  // number of replaced instructions
+    std::vector<PicAvrInstruction> with; // jump targets in old addresses
+} AvrRelaxEdit;
+
+// Apply the edits (sorted by from, not overlapping), then remap every code
+// address and re-encode the long sequences that were kept.
+static void RelaxApply(std::vector<AvrRelaxEdit> &edits)
+{
+    std::vector<uint32_t> newAddr(AvrProg.size() + 1);
+    std::vector<PicAvrInstruction> prog;
+    prog.reserve(AvrProg.size() + edits.size());
+
+    size_t e = 0;
+    for(uint32_t i = 0; i < AvrProg.size();) {
+        if((e < edits.size()) && (edits[e].from == i)) {
+            for(uint32_t j = 0; j < edits[e].len; j++)
+                newAddr[i + j] = prog.size();
+            prog.insert(prog.end(), edits[e].with.begin(), edits[e].with.end());
+            i += edits[e].len;
+            e++;
+        } else {
+            newAddr[i] = prog.size();
+            prog.push_back(AvrProg[i]);
+            i++;
+        }
+    }
+    newAddr[AvrProg.size()] = prog.size();
+
+    std::vector<uint32_t> kept; // old addresses of the IJMP.. ending a long sequence
+    for(uint32_t i = 0; i < AvrProg.size(); i++)
+        if(LongJumpLength(i))
+            kept.push_back(i);
+
+    AvrProg.swap(prog);
+    for(auto &ins : AvrProg)
+        if((IsOperation(ins.opAvr) <= IS_PAGE) && (ins.arg1 < newAddr.size()))
+            ins.arg1 = newAddr[ins.arg1];
+
+    for(uint32_t old : kept) {
+        uint32_t i = newAddr[old];
+        if(AvrProg[i].opAvr != prog[old].opAvr)
+            continue; // replaced
+        uint32_t target = AvrProg[i].arg1;
+        AvrProg[i - 2].arg2 = target & 0xff;
+        AvrProg[i - 1].arg2 = (target >> 8) & 0xff;
+        if((AvrProg[i].opAvr == OP_EIJMP) || (AvrProg[i].opAvr == OP_EICALL))
+            AvrProg[i - 4].arg2 = (target >> 16) & 0xff;
+    }
+    BeginOfPLCCycle = newAddr[BeginOfPLCCycle];
+}
+
+static void RelaxBranches()
+{
+    for(uint32_t i = BeginOfPLCCycle; i < AvrProg.size(); i++)
+        if((AvrProg[i].opAvr == OP_DB) || (AvrProg[i].opAvr == OP_DB2) || (AvrProg[i].opAvr == OP_DW))
+            return; // data in flash must stay where it is
+
+    for(;;) {
+        std::vector<AvrRelaxEdit> edits;
+        for(uint32_t i = BeginOfPLCCycle; i < AvrProg.size(); i++) {
+            AvrOp inv = InvertBranch(AvrProg[i].opAvr);
+            if(inv == OP_VACANT)
+                continue;
+            int32_t d = (int32_t)AvrProg[i].arg1 - (int32_t)i - 1;
+            if((-64 <= d) && (d <= 63))
+                continue;
+            if((i > 0) && IsSkipOperation(AvrProg[i - 1].opAvr))
+                continue; // Assemble() will report it
+            AvrRelaxEdit edit;
+            edit.from = i;
+            edit.len = 1;
+            edit.with.push_back(AvrProg[i]);
+            edit.with.push_back(AvrProg[i]);
+            edit.with[0].opAvr = inv;
+            edit.with[0].arg1 = i + 1; // over the RJMP
+            edit.with[1].opAvr = OP_RJMP;
+            edit.with[1].commentInt[0] = '\0';
+            edits.push_back(edit);
+        }
+        if(edits.empty())
+            break;
+        RelaxApply(edits);
+    }
+
+    if(Prog.optimize == OPTIMIZE_DEFAULT)
+        return;
+
+    for(;;) {
+        std::vector<bool> isTarget(AvrProg.size() + 1, false);
+        for(const auto &ins : AvrProg)
+            if((IsOperation(ins.opAvr) <= IS_PAGE) && (ins.arg1 < isTarget.size()))
+                isTarget[ins.arg1] = true;
+
+        std::vector<AvrRelaxEdit> edits;
+        for(uint32_t i = BeginOfPLCCycle; i < AvrProg.size(); i++) {
+            uint32_t len = LongJumpLength(i);
+            if(!len)
+                continue;
+            uint32_t start = i + 1 - len;
+            if((start < BeginOfPLCCycle) || ((start > 0) && IsSkipOperation(AvrProg[start - 1].opAvr)))
+                continue;
+            bool inner = false; // a jump into the middle of the sequence
+            for(uint32_t j = start + 1; j <= i; j++)
+                inner = inner || isTarget[j];
+            int32_t d = (int32_t)AvrProg[i].arg1 - (int32_t)start - 1;
+            if(inner || (d < -2048) || (d > 2047))
+                continue;
+            AvrRelaxEdit edit;
+            edit.from = start;
+            edit.len = len;
+            edit.with.push_back(AvrProg[start]);
+            edit.with[0].opAvr = ((AvrProg[i].opAvr == OP_ICALL) || (AvrProg[i].opAvr == OP_EICALL)) ? OP_RCALL : OP_RJMP;
+            edit.with[0].arg1 = AvrProg[i].arg1;
+            edit.with[0].arg2 = 0;
+            edits.push_back(edit);
+        }
+        if(edits.empty())
+            break;
+        RelaxApply(edits);
+    }
+}
+
 //-----------------------------------------------------------------------------
 // Given an opcode and its operands, assemble the 16-bit instruction for the
 // AVR. Check that the operands do not have more bits set than is meaningful;
@@ -2831,6 +3121,7 @@ static void CopyLitToReg(int reg, int sov, int32_t literal, const char *comment)
         oops();
     if(sov > 4)
         oops();
+    RegCacheIsValid();
     if(sov >= 1)
         Instruction(OP_LDI, reg, literal & 0xff, comment);
     if(sov >= 2)
@@ -2839,6 +3130,8 @@ static void CopyLitToReg(int reg, int sov, int32_t literal, const char *comment)
         Instruction(OP_LDI, reg + 2, (literal >> 16) & 0xff);
     if(sov >= 4)
         Instruction(OP_LDI, reg + 3, (literal >> 24) & 0xff);
+    RegCacheClobber(reg, sov);
+    RegCacheRecord(nullptr, reg, sov);
 }
 
 static void CopyLitToReg(int reg, int sov, int32_t literal)
@@ -2854,6 +3147,21 @@ static void CopyVarToReg(int reg, int sovReg, const char *var)
     if(sov != sovReg)
         dbp("reg=%d sovReg=%d <- var=%s sov=%d", reg, sovReg, var, sov);
 
+    if((sov == sovReg) && !IsAddrInVar(var)) {
+        const RegCacheEntry *e = RegCacheFind(var, sov);
+        if(e && (e->reg == reg))
+            return; // still there from the previous op
+        if(e && ((e->reg + sov <= reg) || (reg + sov <= e->reg))) {
+            int src = e->reg;
+            for(int i = 0; i < sov; i++)
+                Instruction(OP_MOV, reg + i, src + i);
+            RegCacheClobber(reg, sov);
+            RegCacheRecord(var, reg, sov);
+            return;
+        }
+    }
+
+    RegCacheIsValid();
     MemForVariable(var, &addr);
     LoadXAddr(addr, var); // load direct address
 
@@ -2861,8 +3169,12 @@ static void CopyVarToReg(int reg, int sovReg, const char *var)
         int sovA = SizeOfVar(&var[1]);
         LdToReg(OP_LD_XP, sovA, r4, 2, false); // as address
         LoadXAddrFromReg(r4, 2);               // reload indirect address
+        RegCacheClobber(r4, 2);
     }
     LdToReg(OP_LD_XP, sov, reg, sovReg, true); // as data
+    RegCacheClobber(reg, sovReg);
+    RegCacheClobber(r25, 1);
+    RegCacheRecord(((sov == sovReg) && !IsAddrInVar(var)) ? var : nullptr, reg, sovReg);
 }
 
 static void CopyVarToReg(int reg, int sovReg, const NameArray &var)
@@ -2926,14 +3238,19 @@ static void _CopyRegToVar(int l, const char *f, const char *args, const char *va
         MemForVariable(var, &addr);
     }
     sov = SizeOfVar(var);
+    RegCacheIsValid();
     LoadXAddr(addr, var); // load direct address
 
     if(IsAddrInVar(var)) {
         int sovA = SizeOfVar(&var[1]);
         LdToReg(OP_LD_XP, sovA, r4, 2, false); // as address
         LoadXAddrFromReg(r4, 2);               // reload indirect address
+        RegCache.clear();                      // may alias any variable
     }
     StFromReg(OP_ST_XP, sov, reg, sovReg, true); // as data
+    RegCacheClobber(r25, 1);
+    RegCacheForget(var);
+    RegCacheRecord(((sov == sovReg) && !IsAddrInVar(var)) ? var : nullptr, reg, sovReg);
 }
 
 static void _CopyRegToVar(int l, const char *f, const char *args, const NameArray &var, int reg, int sovReg)
@@ -4263,6 +4580,23 @@ static void CompileFromIntermediate()
                 sov = std::max(SizeOfVar(a->name2), SizeOfVar(a->name3));
                 CopyArgToReg(r20, sov, a->name2);
                 CopyArgToReg(r16, sov, a->name3);
+#ifdef USE_MUL
+                // The hardware multiply routines are straight-line code, so
+                // when optimizing for speed they are inlined to save the
+                // CALL/RET pair.
+                if((Prog.optimize == OPTIMIZE_SPEED) && (sov >= 1) && (sov <= 3)) {
+                    if(sov == 1) {
+                        MultiplyBody8();
+                        sov1 = std::min(2, SizeOfVar(a->name1));
+                    } else if(sov == 2) {
+                        MultiplyBody();
+                        sov1 = std::min(4, SizeOfVar(a->name1));
+                    } else {
+                        MultiplyBody24();
+                        sov1 = std::min(6, SizeOfVar(a->name1));
+                    }
+                } else
+#endif
                 if(sov == 1) {
                     CallSubroutine(MultiplyAddress8);
                     MultiplyUsed8 = true;
@@ -4297,9 +4631,20 @@ static void CompileFromIntermediate()
                 sov = SizeOfVar(a->name1);
                 CopyArgToReg(r20, sov, a->name2);
 
+                // A shift by a literal count is unrolled when optimizing for
+                // speed, then r16 is not needed as the loop counter.
+                int steps = -1;
+                if((a->op == INT_SET_VARIABLE_SHL) || (a->op == INT_SET_VARIABLE_SHR) || (a->op == INT_SET_VARIABLE_SR0) || (a->op == INT_SET_VARIABLE_ROR) || (a->op == INT_SET_VARIABLE_ROL))
+                    if((Prog.optimize == OPTIMIZE_SPEED) && IsNumber(a->name3)) {
+                        int32_t n = hobatoi(a->name3.c_str());
+                        if((n >= 0) && (n <= 8 * sov))
+                            steps = n;
+                    }
+
                 if(a->op != INT_SET_VARIABLE_NEG)
                     if(a->op != INT_SET_VARIABLE_NOT)
-                        CopyArgToReg(r16, sov, a->name3);
+                        if(steps < 0)
+                            CopyArgToReg(r16, sov, a->name3);
 
                 if(a->op == INT_SET_VARIABLE_ADD) {
                     Instruction(OP_ADD, r20, 16);
@@ -4353,80 +4698,88 @@ static void CompileFromIntermediate()
                     if(sov >= 4)
                         Instruction(OP_COM, 23, 0);
                 } else if((a->op == INT_SET_VARIABLE_SHL) || (a->op == INT_SET_VARIABLE_SHR) || (a->op == INT_SET_VARIABLE_SR0) || (a->op == INT_SET_VARIABLE_ROR) || (a->op == INT_SET_VARIABLE_ROL)) {
-                    uint32_t Loop = AvrProg.size();
-                    Instruction(OP_DEC, r16);
-                    uint32_t Skip = AllocFwdAddr();
-                    Instruction(OP_BRMI, Skip, 0);
-
-                    if(a->op == INT_SET_VARIABLE_SHL) {
-                        ShlReg(r20, sov);
-                    } else if(a->op == INT_SET_VARIABLE_SR0) {
-                        Instruction(OP_CLC);
-                        if(sov == 1) {
-                            Instruction(OP_ROR, 20);
-                        } else if(sov == 2) {
-                            Instruction(OP_ROR, 21);
-                            Instruction(OP_ROR, 20);
-                        } else if(sov == 3) {
-                            Instruction(OP_ROR, 22);
-                            Instruction(OP_ROR, 21);
-                            Instruction(OP_ROR, 20);
-                        } else if(sov == 4) {
-                            Instruction(OP_ROR, 23);
-                            Instruction(OP_ROR, 22);
-                            Instruction(OP_ROR, 21);
-                            Instruction(OP_ROR, 20);
-                        } else
-                            THROW_COMPILER_EXCEPTION(_("Invalid variable size."));
-                    } else if(a->op == INT_SET_VARIABLE_SHR) {
-                        if(sov == 1) {
-                            Instruction(OP_ASR, 20);
-                        } else if(sov == 2) {
-                            Instruction(OP_ASR, 21);
-                            Instruction(OP_ROR, 20);
-                        } else if(sov == 3) {
-                            Instruction(OP_ASR, 22);
-                            Instruction(OP_ROR, 21);
-                            Instruction(OP_ROR, 20);
-                        } else if(sov == 4) {
-                            Instruction(OP_ASR, 23);
-                            Instruction(OP_ROR, 22);
-                            Instruction(OP_ROR, 21);
-                            Instruction(OP_ROR, 20);
-                        } else
-                            THROW_COMPILER_EXCEPTION(_("Invalid variable size."));
-                    } else if(a->op == INT_SET_VARIABLE_ROL) {
-                        RolReg(r20, sov);
-                    } else if(a->op == INT_SET_VARIABLE_ROR) {
-                        Instruction(OP_CLC);
-                        if(sov == 1) {
-                            Instruction(OP_ROR, 20);
-                            IfBitSet(REG_SREG, SREG_C);
-                            Instruction(OP_SBR, 20, 0x80);
-                        } else if(sov == 2) {
-                            Instruction(OP_ROR, 21);
-                            Instruction(OP_ROR, 20);
-                            IfBitSet(REG_SREG, SREG_C);
-                            Instruction(OP_SBR, 21, 0x80);
-                        } else if(sov == 3) {
-                            Instruction(OP_ROR, 22);
-                            Instruction(OP_ROR, 21);
-                            Instruction(OP_ROR, 20);
-                            IfBitSet(REG_SREG, SREG_C);
-                            Instruction(OP_SBR, 22, 0x80);
-                        } else if(sov == 4) {
-                            Instruction(OP_ROR, 23);
-                            Instruction(OP_ROR, 22);
-                            Instruction(OP_ROR, 21);
-                            Instruction(OP_ROR, 20);
-                            IfBitSet(REG_SREG, SREG_C);
-                            Instruction(OP_SBR, 23, 0x80);
+                    uint32_t Loop = 0;
+                    uint32_t Skip = 0;
+                    if(steps < 0) {
+                        Loop = AvrProg.size();
+                        Instruction(OP_DEC, r16);
+                        Skip = AllocFwdAddr();
+                        Instruction(OP_BRMI, Skip, 0);
+                    }
+
+                    for(int i = 0; i < ((steps < 0) ? 1 : steps); i++) {
+                        if(a->op == INT_SET_VARIABLE_SHL) {
+                            ShlReg(r20, sov);
+                        } else if(a->op == INT_SET_VARIABLE_SR0) {
+                            Instruction(OP_CLC);
+                            if(sov == 1) {
+                                Instruction(OP_ROR, 20);
+                            } else if(sov == 2) {
+                                Instruction(OP_ROR, 21);
+                                Instruction(OP_ROR, 20);
+                            } else if(sov == 3) {
+                                Instruction(OP_ROR, 22);
+                                Instruction(OP_ROR, 21);
+                                Instruction(OP_ROR, 20);
+                            } else if(sov == 4) {
+                                Instruction(OP_ROR, 23);
+                                Instruction(OP_ROR, 22);
+                                Instruction(OP_ROR, 21);
+                                Instruction(OP_ROR, 20);
+                            } else
+                                THROW_COMPILER_EXCEPTION(_("Invalid variable size."));
+                        } else if(a->op == INT_SET_VARIABLE_SHR) {
+                            if(sov == 1) {
+                                Instruction(OP_ASR, 20);
+                            } else if(sov == 2) {
+                                Instruction(OP_ASR, 21);
+                                Instruction(OP_ROR, 20);
+                            } else if(sov == 3) {
+                                Instruction(OP_ASR, 22);
+                                Instruction(OP_ROR, 21);
+                                Instruction(OP_ROR, 20);
+                            } else if(sov == 4) {
+                                Instruction(OP_ASR, 23);
+                                Instruction(OP_ROR, 22);
+                                Instruction(OP_ROR, 21);
+                                Instruction(OP_ROR, 20);
+                            } else
+                                THROW_COMPILER_EXCEPTION(_("Invalid variable size."));
+                        } else if(a->op == INT_SET_VARIABLE_ROL) {
+                            RolReg(r20, sov);
+                        } else if(a->op == INT_SET_VARIABLE_ROR) {
+                            Instruction(OP_CLC);
+                            if(sov == 1) {
+                                Instruction(OP_ROR, 20);
+                                IfBitSet(REG_SREG, SREG_C);
+                                Instruction(OP_SBR, 20, 0x80);
+                            } else if(sov == 2) {
+                                Instruction(OP_ROR, 21);
+                                Instruction(OP_ROR, 20);
+                                IfBitSet(REG_SREG, SREG_C);
+                                Instruction(OP_SBR, 21, 0x80);
+                            } else if(sov == 3) {
+                                Instruction(OP_ROR, 22);
+                                Instruction(OP_ROR, 21);
+                                Instruction(OP_ROR, 20);
+                                IfBitSet(REG_SREG, SREG_C);
+                                Instruction(OP_SBR, 22, 0x80);
+                            } else if(sov == 4) {
+                                Instruction(OP_ROR, 23);
+                                Instruction(OP_ROR, 22);
+                                Instruction(OP_ROR, 21);
+                                Instruction(OP_ROR, 20);
+                                IfBitSet(REG_SREG, SREG_C);
+                                Instruction(OP_SBR, 23, 0x80);
+                            } else
+                                THROW_COMPILER_EXCEPTION(_("Invalid variable size."));
                         } else
-                            THROW_COMPILER_EXCEPTION(_("Invalid variable size."));
-                    } else
-                        THROW_COMPILER_EXCEPTION(_("Invalid instruction."));
-                    Instruction(OP_RJMP, Loop);
-                    FwdAddrIsNow(Skip);
+                            THROW_COMPILER_EXCEPTION(_("Invalid instruction."));
+                    }
+                    if(steps < 0) {
+                        Instruction(OP_RJMP, Loop);
+                        FwdAddrIsNow(Skip);
+                    }
                 } else
                     THROW_COMPILER_EXCEPTION("Invalid instruction.");
 
@@ -5329,6 +5682,7 @@ static void CompileFromIntermediate()
             case INT_AllocKnownAddr: {
                 Comment("INT_AllocKnownAddr %s", a->name1.c_str());
                 LabelAddr *l = GetLabelAddr(a->name1.c_str());
+                RegCacheFlush(); // backward jumps land here
                 l->KnownAddr = AvrProg.size();
                 break;
             }
@@ -5577,6 +5931,9 @@ static void CompileFromIntermediate()
                         Instruction(OP_BRNE, AvrProg.size() - 1); // 1/2 clocks
                         clocksSave -= clocks * 4 + 1;
                     }
+                    if(Prog.optimize == OPTIMIZE_SIZE) // only on /Os, it changes the hex of every delay
+                        for(; clocksSave >= 2; clocksSave -= 2)
+                            Instruction(OP_RJMP, AvrProg.size() + 1); // 2 clocks in 1 word
                     for(int i = 0; i < clocksSave; i++)
                         Instruction(OP_NOP); // 1 clocks
                 } else {
@@ -5765,12 +6122,17 @@ static void MultiplyRoutine8() //5.1 Algorithm Description
 // op1 in r20,
 // op2 in r16, result word goes into r21:r20.
 //-----------------------------------------------------------------------------
+static void MultiplyBody8()
+{
+    Instruction(OP_MULS, r20, r16);
+    Instruction(OP_MOVW, r20, r0);
+}
+
 static void MultiplyRoutine8()
 {
     Comment("MultiplyRoutine8");
     FwdAddrIsNow(MultiplyAddress8);
-    Instruction(OP_MULS, r20, r16);
-    Instruction(OP_MOVW, r20, r0);
+    MultiplyBody8();
     Instruction(OP_RET);
 }
 /*
@@ -5851,10 +6213,8 @@ muls16x16_32:
 // op2 in r17:r16, result low word goes into r21:r20.
 // Signed 32bit result goes into     r23:r22:r21:r20.
 //-----------------------------------------------------------------------------
-static void MultiplyRoutine()
+static void MultiplyBody()
 {
-    Comment("MultiplyRoutine16");
-    FwdAddrIsNow(MultiplyAddress);
     Instruction(OP_MOVW, r18, r20); // save op1; r19:r18 <- r21:r20
     Instruction(OP_CLR, r2, 0);
     Instruction(OP_MULS, r19, r17); //; (signed)ah * (signed)bh
@@ -5871,6 +6231,13 @@ static void MultiplyRoutine()
     Instruction(OP_ADD, r21, r0);
     Instruction(OP_ADC, r22, r1);
     Instruction(OP_ADC, r23, r2);
+}
+
+static void MultiplyRoutine()
+{
+    Comment("MultiplyRoutine16");
+    FwdAddrIsNow(MultiplyAddress);
+    MultiplyBody();
     Instruction(OP_RET); //17
 }
 //-----------------------------------------------------------------------------
@@ -5879,10 +6246,8 @@ static void MultiplyRoutine()
 // op2 in r18:r17:r16, result 3 low bytes goes into r12:r11:r10.
 //                     result 3 low bytes goes into r22:r21:r20.
 //-----------------------------------------------------------------------------
-static void MultiplyRoutine24()
+static void MultiplyBody24()
 {
-    Comment("MultiplyRoutine24");
-    FwdAddrIsNow(MultiplyAddress24);
     Instruction(OP_MUL, r20, r16); //l * l
     Instruction(OP_MOVW, r10, r0);
     Instruction(OP_MUL, r21, r17); //m * m
@@ -5899,6 +6264,13 @@ static void MultiplyRoutine24()
     Instruction(OP_ADC, r12, r1);
     Instruction(OP_MOVW, r20, r10);
     Instruction(OP_MOV, r22, r12);
+}
+
+static void MultiplyRoutine24()
+{
+    Comment("MultiplyRoutine24");
+    FwdAddrIsNow(MultiplyAddress24);
+    MultiplyBody24();
     Instruction(OP_RET); //17
 }
 #endif
@@ -7195,12 +7567,6 @@ void CompileAvr(const char *outFile)
     CompileFromIntermediate();
     Comment("CompileFromIntermediate END");
 
-    for(int i = 0; i < MAX_RUNGS; i++)
-        Prog.HexInRung[i] = 0;
-    for(uint32_t i = 0; i < AvrProg.size(); i++)
-        if((AvrProg[i].rung >= 0) && (AvrProg[i].rung < MAX_RUNGS))
-            Prog.HexInRung[AvrProg[i].rung]++;
-
     if(Prog.cycleDuty) {
         Comment("ClearBit YPlcCycleDuty");
         ClearBit(addrDuty, bitDuty);
@@ -7242,6 +7608,14 @@ void CompileAvr(const char *outFile)
     MemCheckForErrorsPostCompile();
     AddrCheckForErrorsPostCompile();
 
+    RelaxBranches();
+
+    for(int i = 0; i < MAX_RUNGS; i++)
+        Prog.HexInRung[i] = 0;
+    for(uint32_t i = 0; i < AvrProg.size(); i++)
+        if((AvrProg[i].rung >= 0) && (AvrProg[i].rung < MAX_RUNGS))
+            Prog.HexInRung[AvrProg[i].rung]++;
+
     ProgWriteP = AvrProg.size();
 
     rungNow = -5;
@@ -45,21 +45,251 @@ void CheckFree(void *p)
     // p = nullptr;
 }
 
+//-----------------------------------------------------------------------------
+// The elements of the program come from an arena, in size classes of
+// ARENA_GRAIN bytes, not each from malloc. Blocks are carved out of big
+// chunks, and freed ones go on a free list of their class for the next
+// allocation of that size; the chunks are never given back.
+//-----------------------------------------------------------------------------
+#define ARENA_GRAIN (8)
+#define ARENA_CLASSES (512) // up to 4 KB
+#define ARENA_CHUNK (64 * 1024)
+
+static void *   ArenaFree[ARENA_CLASSES + 1];
+static uint8_t *ArenaNext; // the rest of the current chunk
+static size_t   ArenaLeft;
+
+static int ArenaClass(size_t n)
+{
+    return (int)((n + ARENA_GRAIN - 1) / ARENA_GRAIN);
+}
+
+static void *ArenaAlloc(int cls)
+{
+    if((cls < 1) || (cls > ARENA_CLASSES))
+        THROW_COMPILER_EXCEPTION_FMT("ArenaAlloc(%d)", cls);
+    size_t n = cls * ARENA_GRAIN;
+    void * p = ArenaFree[cls];
+    if(p) {
+        ArenaFree[cls] = *(void **)p;
+    } else {
+        if(ArenaLeft < n) {
+            ArenaNext = (uint8_t *)CheckMalloc(ARENA_CHUNK);
+            ArenaLeft = ARENA_CHUNK;
+        }
+        p = ArenaNext;
+        ArenaNext += n;
+        ArenaLeft -= n;
+    }
+    memset(p, 0, n);
+    return p;
+}
+
+static void ArenaRelease(void *p, int cls)
+{
+    *(void **)p = ArenaFree[cls];
+    ArenaFree[cls] = p;
+}
+
+//-----------------------------------------------------------------------------
+// Size of a leaf of the given type: the header of ElemLeaf and the biggest
+// member of its union d that the code uses for that type. A contact takes
+// some 80 bytes instead of the 500 of a comment; types not listed here
+// get the whole union.
+//-----------------------------------------------------------------------------
+size_t LeafSize(int which)
+{
+    size_t d;
+    switch(which) {
+        case ELEM_PLACEHOLDER:
+        case ELEM_CONTACTS:
+        case ELEM_COIL:
+        case ELEM_RES:
+        case ELEM_SHORT:
+        case ELEM_OPEN:
+        case ELEM_ONE_SHOT_RISING:
+        case ELEM_ONE_SHOT_FALLING:
+        case ELEM_ONE_DROP_FALLING:
+        case ELEM_ONE_DROP_RISING:
+        case ELEM_OSC:
+        case ELEM_MASTER_RELAY:
+        case ELEM_LOCK:
+        case ELEM_CLRWDT:
+        case ELEM_LABEL:
+        case ELEM_GOTO:
+        case ELEM_SUBPROG:
+        case ELEM_RETURN:
+        case ELEM_ENDSUB:
+        case ELEM_GOSUB:
+        case ELEM_READ_ADC:
+        case ELEM_UART_SEND:
+        case ELEM_UART_SEND_READY:
+        case ELEM_UART_RECV:
+        case ELEM_UART_RECV_AVAIL:
+        case ELEM_SHIFT_REGISTER:
+        case ELEM_PERSIST:
+            d = std::max({sizeof(ElemContacts), sizeof(ElemCoil), sizeof(ElemReset), sizeof(ElemGoto), sizeof(ElemReadAdc), sizeof(ElemUart),
+                          sizeof(ElemShiftRegister), sizeof(ElemPersist)});
+            break;
+        case ELEM_TON:
+        case ELEM_TOF:
+        case ELEM_RTO:
+        case ELEM_RTL:
+        case ELEM_THI:
+        case ELEM_TLO:
+        case ELEM_TCY:
+        case ELEM_TIME2COUNT:
+        case ELEM_TIME2DELAY:
+        case ELEM_DELAY:
+        case ELEM_SLEEP:
+        case ELEM_CTU:
+        case ELEM_CTD:
+        case ELEM_CTC:
+        case ELEM_CTR:
+        case ELEM_MOVE:
+        case ELEM_BIN2BCD:
+        case ELEM_BCD2BIN:
+        case ELEM_SWAP:
+        case ELEM_OPPOSITE:
+        case ELEM_ADD:
+        case ELEM_SUB:
+        case ELEM_MUL:
+        case ELEM_DIV:
+        case ELEM_MOD:
+        case ELEM_SET_BIT:
+        case ELEM_CLEAR_BIT:
+        case ELEM_COPY_BIT:
+        case ELEM_XOR_COPY_BIT:
+        case ELEM_AND:
+        case ELEM_OR:
+        case ELEM_XOR:
+        case ELEM_NOT:
+        case ELEM_NEG:
+        case ELEM_RANDOM:
+        case ELEM_SEED_RANDOM:
+        case ELEM_SHL:
+        case ELEM_SHR:
+        case ELEM_SR0:
+        case ELEM_ROL:
+        case ELEM_ROR:
+        case ELEM_EQU:
+        case ELEM_NEQ:
+        case ELEM_GRT:
+        case ELEM_GEQ:
+        case ELEM_LES:
+        case ELEM_LEQ:
+        case ELEM_IF_BIT_SET:
+        case ELEM_IF_BIT_CLEAR:
+        case ELEM_RSFR:
+        case ELEM_WSFR:
+        case ELEM_SSFR:
+        case ELEM_CSFR:
+        case ELEM_TSFR:
+        case ELEM_T_C_SFR:
+        case ELEM_BUS:
+        case ELEM_7SEG:
+        case ELEM_9SEG:
+        case ELEM_14SEG:
+        case ELEM_16SEG:
+        case ELEM_NPULSE:
+            d = std::max({sizeof(ElemTimer), sizeof(ElemCounter), sizeof(ElemMove), sizeof(ElemMath), sizeof(ElemCmp), sizeof(ElemSfr),
+                          sizeof(ElemBus), sizeof(ElemSegments), sizeof(ElemNPulse), sizeof(ElemReadAdc)});
+            break;
+        case ELEM_STEPPER:
+            d = sizeof(ElemStepper);
+            break;
+        case ELEM_PULSER:
+            d = std::max(sizeof(ElemPulser), sizeof(ElemStepper));
+            break;
+        case ELEM_QUAD_ENCOD:
+            d = sizeof(ElemQuadEncod);
+            break;
+        case ELEM_SET_PWM:
+            d = sizeof(ElemSetPwm);
+            break;
+        default:
+            d = sizeof(ElemLeaf::d);
+            break;
+    }
+    return offsetof(ElemLeaf, d) + d;
+}
+
 //-----------------------------------------------------------------------------
 // Convenience routines for allocating frequently-used data structures.
 //-----------------------------------------------------------------------------
+ElemLeaf *AllocLeaf(int which)
+{
+    int       cls = ArenaClass(LeafSize(which));
+    ElemLeaf *l = (ElemLeaf *)ArenaAlloc(cls);
+    l->sizeClass = (uint8_t)cls;
+    return l;
+}
+
+// A new leaf of the given type, with the contents of leaf.
+ElemLeaf *CopyLeaf(int which, const ElemLeaf *leaf)
+{
+    ElemLeaf *l = AllocLeaf(which);
+    uint8_t   cls = l->sizeClass;
+    memcpy(l, leaf, LeafSize(which));
+    l->sizeClass = cls;
+    return l;
+}
+
+void FreeLeaf(ElemLeaf *leaf)
+{
+    if(leaf)
+        ArenaRelease(leaf, leaf->sizeClass);
+}
+
+static SeriesNode *GrowContents(SeriesNode *contents, int *size, int count)
+{
+    if(count <= *size)
+        return contents;
+    int n = std::max(*size, 2);
+    while(n < count)
+        n *= 2;
+    SeriesNode *grown = (SeriesNode *)ArenaAlloc(ArenaClass(n * sizeof(SeriesNode)));
+    if(contents) {
+        memcpy(grown, contents, *size * sizeof(SeriesNode));
+        ArenaRelease(contents, ArenaClass(*size * sizeof(SeriesNode)));
+    }
+    *size = n;
+    return grown;
+}
 
-ElemLeaf *AllocLeaf()
+// Make room for count elements in the contents[] of the subcircuit.
+void GrowSubckt(ElemSubcktSeries *s, int count)
+{
+    s->contents = GrowContents(s->contents, &s->size, count);
+}
+void GrowSubckt(ElemSubcktParallel *p, int count)
 {
-    return (ElemLeaf *)CheckMalloc(sizeof(ElemLeaf));
+    p->contents = GrowContents(p->contents, &p->size, count);
 }
+
 ElemSubcktSeries *AllocSubcktSeries()
 {
-    return (ElemSubcktSeries *)CheckMalloc(sizeof(ElemSubcktSeries));
+    ElemSubcktSeries *s = (ElemSubcktSeries *)ArenaAlloc(ArenaClass(sizeof(ElemSubcktSeries)));
+    GrowSubckt(s, 2);
+    return s;
 }
 ElemSubcktParallel *AllocSubcktParallel()
 {
-    return (ElemSubcktParallel *)CheckMalloc(sizeof(ElemSubcktParallel));
+    ElemSubcktParallel *p = (ElemSubcktParallel *)ArenaAlloc(ArenaClass(sizeof(ElemSubcktParallel)));
+    GrowSubckt(p, 2);
+    return p;
+}
+
+// Free the subcircuit itself, not what it contains.
+void FreeSubckt(ElemSubcktSeries *s)
+{
+    ArenaRelease(s->contents, ArenaClass(s->size * sizeof(SeriesNode)));
+    ArenaRelease(s, ArenaClass(sizeof(ElemSubcktSeries)));
+}
+void FreeSubckt(ElemSubcktParallel *p)
+{
+    ArenaRelease(p->contents, ArenaClass(p->size * sizeof(SeriesNode)));
+    ArenaRelease(p, ArenaClass(sizeof(ElemSubcktParallel)));
 }
 
 //-----------------------------------------------------------------------------
@@ -95,13 +325,14 @@ static bool AddLeafWorker(int which, void *any, int newWhich, ElemLeaf *newElem)
                 // Special case--placeholders are replaced. They only appear
                 // in the empty series subcircuit that I generate for them,
                 // so there is no need to consider them anywhere but here.
-                // If we copy instead of replacing then the DisplayMatrix
-                // tables don't get all messed up.
-                memcpy(s->contents[i].leaf(), newElem, sizeof(ElemLeaf));
-                s->contents[i].leaf()->selectedState = EndOfRungElem(newWhich) ? SELECTED_LEFT : SELECTED_RIGHT;
-                CheckFree(newElem);
+                // The DisplayMatrix tables and the selection move over to
+                // the new leaf, so they don't get all messed up.
+                ElemLeaf *placeholder = s->contents[i].leaf();
+                newElem->selectedState = EndOfRungElem(newWhich) ? SELECTED_LEFT : SELECTED_RIGHT;
                 s->contents[i].which = newWhich;
-                Selected.which = newWhich;
+                s->contents[i].data.leaf = newElem;
+                ReplaceInGrid(placeholder, newWhich, newElem);
+                FreeLeaf(placeholder);
                 return true;
             }
             if(s->count >= (MAX_ELEMENTS_IN_SUBCKT - 1)) {
@@ -110,6 +341,7 @@ static bool AddLeafWorker(int which, void *any, int newWhich, ElemLeaf *newElem)
             }
             switch(Selected.leaf()->selectedState) {
                 case SELECTED_LEFT:
+                    GrowSubckt(s, s->count + 1);
                     memmove(&s->contents[i + 1], &s->contents[i], (s->count - i) * sizeof(s->contents[0]));
                     s->contents[i].data.leaf = newElem;
                     s->contents[i].which = newWhich;
@@ -117,6 +349,7 @@ static bool AddLeafWorker(int which, void *any, int newWhich, ElemLeaf *newElem)
                     break;
 
                 case SELECTED_RIGHT:
+                    GrowSubckt(s, s->count + 1);
                     memmove(&s->contents[i + 2], &s->contents[i + 1], (s->count - i - 1) * sizeof(s->contents[0]));
                     s->contents[i + 1].data.leaf = newElem;
                     s->contents[i + 1].which = newWhich;
@@ -167,6 +400,7 @@ static bool AddLeafWorker(int which, void *any, int newWhich, ElemLeaf *newElem)
             }
             switch(Selected.leaf()->selectedState) {
                 case SELECTED_ABOVE:
+                    GrowSubckt(p, p->count + 1);
                     memmove(&p->contents[i + 1], &p->contents[i], (p->count - i) * sizeof(p->contents[0]));
                     p->contents[i].data.leaf = newElem;
                     p->contents[i].which = newWhich;
@@ -174,6 +408,7 @@ static bool AddLeafWorker(int which, void *any, int newWhich, ElemLeaf *newElem)
                     break;
 
                 case SELECTED_BELOW:
+                    GrowSubckt(p, p->count + 1);
                     memmove(&p->contents[i + 2], &p->contents[i + 1], (p->count - i - 1) * sizeof(p->contents[0]));
                     p->contents[i + 1].data.leaf = newElem;
                     p->contents[i + 1].which = newWhich;
@@ -231,13 +466,16 @@ static bool AddLeafWorker(SeriesNode &any, SeriesNode &selected, SeriesNode newE
                 // Special case--placeholders are replaced. They only appear
                 // in the empty series subcircuit that I generate for them,
                 // so there is no need to consider them anywhere but here.
-                // If we copy instead of replacing then the DisplayMatrix
-                // tables don't get all messed up.
-                memcpy(series->contents[i].leaf(), newElem.leaf(), sizeof(ElemLeaf));
-                series->contents[i].leaf()->selectedState = EndOfRungElem(newElem.which) ? SELECTED_LEFT : SELECTED_RIGHT;
-                CheckFree(newElem.leaf());
+                // The DisplayMatrix tables and the selection move over to
+                // the new leaf, so they don't get all messed up.
+                ElemLeaf *placeholder = series->contents[i].leaf();
+                newElem.leaf()->selectedState = EndOfRungElem(newElem.which) ? SELECTED_LEFT : SELECTED_RIGHT;
                 series->contents[i].which = newElem.which;
+                series->contents[i].data.leaf = newElem.leaf();
+                ReplaceInGrid(placeholder, newElem.which, newElem.leaf());
                 selected.which = newElem.which;
+                selected.data.leaf = newElem.leaf();
+                FreeLeaf(placeholder);
                 return true;
             }
             if(series->count >= (MAX_ELEMENTS_IN_SUBCKT - 1)) {
@@ -246,12 +484,14 @@ static bool AddLeafWorker(SeriesNode &any, SeriesNode &selected, SeriesNode newE
             }
             switch(selected.leaf()->selectedState) {
                 case SELECTED_LEFT:
+                    GrowSubckt(series, series->count + 1);
                     memmove(&series->contents[i + 1], &series->contents[i], (series->count - i) * sizeof(series->contents[0]));
                     series->contents[i] = newElem;
                     (series->count)++;
                     break;
 
                 case SELECTED_RIGHT:
+                    GrowSubckt(series, series->count + 1);
                     memmove(&series->contents[i + 2], &series->contents[i + 1], (series->count - i - 1) * sizeof(series->contents[0]));
                     series->contents[i + 1] = newElem;
                     (series->count)++;
@@ -298,12 +538,14 @@ static bool AddLeafWorker(SeriesNode &any, SeriesNode &selected, SeriesNode newE
             }
             switch(selected.leaf()->selectedState) {
                 case SELECTED_ABOVE:
+                    GrowSubckt(parallel, parallel->count + 1);
                     memmove(&parallel->contents[i + 1], &parallel->contents[i], (parallel->count - i) * sizeof(parallel->contents[0]));
                     parallel->contents[i] = newElem;
                     (parallel->count)++;
                     break;
 
                 case SELECTED_BELOW:
+                    GrowSubckt(parallel, parallel->count + 1);
                     memmove(&parallel->contents[i + 2], &parallel->contents[i + 1], (parallel->count - i - 1) * sizeof(parallel->contents[0]));
                     parallel->contents[i + 1] = newElem;
                     (parallel->count)++;
@@ -343,6 +585,7 @@ bool AddLeafToParent(SeriesNode selected, const SeriesNode newNode)
         if(selected.leaf()->selectedState == SELECTED_LEFT) {
             ElemSubcktSeries *s = const_cast<ElemSubcktSeries *>(selected.parent()->series());
             auto              i = pos;
+            GrowSubckt(s, s->count + 1);
             memmove(&s->contents[i + 1], &s->contents[i], (s->count - i) * sizeof(s->contents[0]));
             s->contents[i] = newNode;
             s->contents[i].parent_ = const_cast<SeriesNode *>(selected.parent());
@@ -401,7 +644,7 @@ void AddComment(const char *text)
     if(!CanInsertComment)
         return;
 
-    ElemLeaf *c = AllocLeaf();
+    ElemLeaf *c = AllocLeaf(ELEM_COMMENT);
     strcpy(c->d.comment.str, text);
 
     AddLeaf(ELEM_COMMENT, c);
@@ -412,7 +655,7 @@ void AddContact(int what)
     if(!CanInsertOther)
         return;
 
-    ElemLeaf *c = AllocLeaf();
+    ElemLeaf *c = AllocLeaf(ELEM_CONTACTS);
     if(what == MNU_INSERT_CONT_RELAY) {
         strcpy(c->d.contacts.name, "Rnew");
     } else if(what == MNU_INSERT_CONT_OUTPUT) {
@@ -432,7 +675,7 @@ void AddCoil(int what)
     if(!CanInsertEnd)
         return;
 
-    ElemLeaf *c = AllocLeaf();
+    ElemLeaf *c = AllocLeaf(ELEM_COIL);
     if(what == MNU_INSERT_COIL_RELAY) {
         strcpy(c->d.coil.name, "Rnew");
     } else {
@@ -452,7 +695,7 @@ void AddDelay()
     /*
     if(!CanInsertOther)
         return;
-    ElemLeaf *t = AllocLeaf();
+    ElemLeaf *t = AllocLeaf(ELEM_DELAY);
     strcpy(t->d.timer.delay, "10"); // 10 us
     AddLeaf(ELEM_DELAY, t);
 */
@@ -463,7 +706,7 @@ void AddTimer(int which)
     if(!CanInsertOther)
         return;
 
-    ElemLeaf *t = AllocLeaf();
+    ElemLeaf *t = AllocLeaf(which);
     if((which == ELEM_DELAY) || (which == ELEM_TIME2DELAY)) {
         strcpy(t->d.timer.name, "delay");
         strcpy(t->d.timer.delay, "10"); // 10 us
@@ -483,7 +726,7 @@ void AddEmpty(int which)
     if(!CanInsertOther)
         return;
 
-    ElemLeaf *t = AllocLeaf();
+    ElemLeaf *t = AllocLeaf(which);
     AddLeaf(which, t);
 }
 
@@ -492,7 +735,7 @@ void AddReset()
     if(!CanInsertEnd)
         return;
 
-    ElemLeaf *t = AllocLeaf();
+    ElemLeaf *t = AllocLeaf(ELEM_RES);
     strcpy(t->d.reset.name, "Tnew");
     AddLeaf(ELEM_RES, t);
 }
@@ -502,7 +745,7 @@ void AddSleep()
     if(!CanInsertEnd)
         return;
 
-    ElemLeaf *t = AllocLeaf();
+    ElemLeaf *t = AllocLeaf(ELEM_SLEEP);
     strcpy(t->d.timer.name, "$Tsleep");
     strcpy(t->d.timer.delay, "1000000"); // 1 s
     AddLeaf(ELEM_SLEEP, t);
@@ -513,7 +756,7 @@ void AddLock()
     if(!CanInsertEnd)
         return;
 
-    ElemLeaf *t = AllocLeaf();
+    ElemLeaf *t = AllocLeaf(ELEM_LOCK);
     AddLeaf(ELEM_LOCK, t);
 }
 
@@ -522,7 +765,7 @@ void AddClrWdt()
     if(!CanInsertEnd)
         return;
 
-    ElemLeaf *t = AllocLeaf();
+    ElemLeaf *t = AllocLeaf(ELEM_CLRWDT);
     AddLeaf(ELEM_CLRWDT, t);
 }
 
@@ -533,7 +776,7 @@ void AddGoto(int which)
     if(!CanInsertOther && !EndOfRungElem(which))
         return;
 
-    ElemLeaf *t = AllocLeaf();
+    ElemLeaf *t = AllocLeaf(which);
     strcpy(t->d.doGoto.label, "?");
     AddLeaf(which, t);
 }
@@ -543,7 +786,7 @@ void AddMasterRelay()
     if(!CanInsertEnd)
         return;
 
-    ElemLeaf *t = AllocLeaf();
+    ElemLeaf *t = AllocLeaf(ELEM_MASTER_RELAY);
     AddLeaf(ELEM_MASTER_RELAY, t);
 }
 
@@ -552,7 +795,7 @@ void AddShiftRegister()
     if(!CanInsertEnd)
         return;
 
-    ElemLeaf *t = AllocLeaf();
+    ElemLeaf *t = AllocLeaf(ELEM_SHIFT_REGISTER);
     strcpy(t->d.shiftRegister.name, "reg");
     t->d.shiftRegister.stages = 7;
     AddLeaf(ELEM_SHIFT_REGISTER, t);
@@ -563,7 +806,7 @@ void AddFormattedString()
     if(!CanInsertOther)
         return;
 
-    ElemLeaf *t = AllocLeaf();
+    ElemLeaf *t = AllocLeaf(ELEM_FORMATTED_STRING);
     strcpy(t->d.fmtdStr.var, "var");
     strcpy(t->d.fmtdStr.string, "value: \\3\\r\\n");
     AddLeaf(ELEM_FORMATTED_STRING, t);
@@ -574,7 +817,7 @@ void AddWrite(int code)
     if(!CanInsertOther)
         return;
 
-    ElemLeaf *t = AllocLeaf();
+    ElemLeaf *t = AllocLeaf(code);
     //strcpy(t->d.fmtdStr.string, "\"String\" or var");
     strcpy(t->d.fmtdStr.string, "var");
     AddLeaf(code, t);
@@ -585,7 +828,7 @@ void AddString()
     if(!CanInsertOther)
         return;
 
-    ElemLeaf *t = AllocLeaf();
+    ElemLeaf *t = AllocLeaf(ELEM_STRING);
     strcpy(t->d.fmtdStr.dest, "dest");
     strcpy(t->d.fmtdStr.string, "frmtString");
     strcpy(t->d.fmtdStr.var, "var");
@@ -597,7 +840,7 @@ void AddPrint(int code)
     if(!CanInsertOther)
         return;
 
-    ElemLeaf *t = AllocLeaf();
+    ElemLeaf *t = AllocLeaf(code);
     strcpy(t->d.fmtdStr.dest, "dest");
     strcpy(t->d.fmtdStr.string, "fmtString");
     strcpy(t->d.fmtdStr.var, "varsList");
@@ -611,7 +854,7 @@ void AddLookUpTable()
     if(!CanInsertEnd)
         return;
 
-    ElemLeaf *t = AllocLeaf();
+    ElemLeaf *t = AllocLeaf(ELEM_LOOK_UP_TABLE);
     strcpy(t->d.lookUpTable.dest, "dest");
     strcpy(t->d.lookUpTable.name, "tabName");
     strcpy(t->d.lookUpTable.index, "index");
@@ -625,7 +868,7 @@ void AddPiecewiseLinear()
     if(!CanInsertEnd)
         return;
 
-    ElemLeaf *t = AllocLeaf();
+    ElemLeaf *t = AllocLeaf(ELEM_PIECEWISE_LINEAR);
     strcpy(t->d.piecewiseLinear.name, "name");
     strcpy(t->d.piecewiseLinear.dest, "yvar");
     strcpy(t->d.piecewiseLinear.index, "xvar");
@@ -638,7 +881,7 @@ void AddMove()
     if(!CanInsertEnd)
         return;
 
-    ElemLeaf *t = AllocLeaf();
+    ElemLeaf *t = AllocLeaf(ELEM_MOVE);
     strcpy(t->d.move.dest, "dest");
     strcpy(t->d.move.src, "src");
     AddLeaf(ELEM_MOVE, t);
@@ -649,7 +892,7 @@ void AddBcd(int which)
     if(!CanInsertOther)
         return;
 
-    ElemLeaf *t = AllocLeaf();
+    ElemLeaf *t = AllocLeaf(which);
     strcpy(t->d.move.dest, "dest");
     strcpy(t->d.move.src, "src");
     AddLeaf(which, t);
@@ -660,7 +903,7 @@ void AddSegments(int which)
     if(!CanInsertOther)
         return;
 
-    ElemLeaf *t = AllocLeaf();
+    ElemLeaf *t = AllocLeaf(which);
     strcpy(t->d.segments.dest, "dest");
     strcpy(t->d.segments.src, "src");
     t->d.segments.common = 'C';
@@ -673,7 +916,7 @@ void AddBus(int which)
     if(!CanInsertOther)
         return;
 
-    ElemLeaf *t = AllocLeaf();
+    ElemLeaf *t = AllocLeaf(which);
     strcpy(t->d.bus.dest, "dest");
     strcpy(t->d.bus.src, "src");
     for(int i = 0; i < PCBbit_LEN; i++)
@@ -686,7 +929,7 @@ void AddStepper()
     if(!CanInsertOther)
         return;
 
-    ElemLeaf *t = AllocLeaf();
+    ElemLeaf *t = AllocLeaf(ELEM_STEPPER);
     strcpy(t->d.stepper.name, "step");
     strcpy(t->d.stepper.max, "stepMax");
     strcpy(t->d.stepper.P, "P");
@@ -702,7 +945,7 @@ void AddPulser()
     if(!CanInsertOther)
         return;
 
-    ElemLeaf *t = AllocLeaf();
+    ElemLeaf *t = AllocLeaf(ELEM_PULSER);
     strcpy(t->d.pulser.P1, "D1");
     strcpy(t->d.pulser.P0, "D0");
     strcpy(t->d.pulser.accel, "accel_decel");
@@ -720,7 +963,7 @@ void AddNPulse()
         Error(_("Can use only one N PULSE element on timer0."));
         return;
     }
-    ElemLeaf *t = AllocLeaf();
+    ElemLeaf *t = AllocLeaf(ELEM_NPULSE);
     strcpy(t->d.Npulse.counter, "counter");
     strcpy(t->d.Npulse.targetFreq, "1000");
     strcpy(t->d.Npulse.coil, "YNpulse");
@@ -740,7 +983,7 @@ void AddQuadEncod()
             //return;
         }
     }
-    ElemLeaf *t = AllocLeaf();
+    ElemLeaf *t = AllocLeaf(ELEM_QUAD_ENCOD);
     t->d.QuadEncod.int01 = n;
     sprintf(t->d.QuadEncod.counter, "qCount%d", n);
     sprintf(t->d.QuadEncod.inputA, "XqA%d", n);
@@ -757,7 +1000,7 @@ void AddSfr(int which)
     if(!CanInsertEnd)
         return;
 
-    ElemLeaf *t = AllocLeaf();
+    ElemLeaf *t = AllocLeaf(which);
     strcpy(t->d.cmp.op1, "sfr");
 #ifdef USE_SFR
     if(which == ELEM_WSFR)
@@ -777,7 +1020,7 @@ void AddMath(int which)
     if(!CanInsertOther && !EndOfRungElem(which))
         return;
 
-    ElemLeaf *t = AllocLeaf();
+    ElemLeaf *t = AllocLeaf(which);
     strcpy(t->d.math.dest, "dest");
     strcpy(t->d.math.op1, "src");
     strcpy(t->d.math.op2, "1");
@@ -791,7 +1034,7 @@ void AddBitOps(int which)
     if(!CanInsertOther && !EndOfRungElem(which))
         return;
 
-    ElemLeaf *t = AllocLeaf();
+    ElemLeaf *t = AllocLeaf(which);
     strcpy(t->d.move.dest, "var");
     strcpy(t->d.move.src, "bit");
     AddLeaf(which, t);
@@ -802,7 +1045,7 @@ void AddCmp(int which)
     if(!CanInsertOther)
         return;
 
-    ElemLeaf *t = AllocLeaf();
+    ElemLeaf *t = AllocLeaf(which);
     strcpy(t->d.cmp.op1, "var");
     strcpy(t->d.cmp.op2, "1");
     AddLeaf(which, t);
@@ -817,7 +1060,7 @@ void AddCounter(int which)
         return;
     //  }
 
-    ElemLeaf *t = AllocLeaf();
+    ElemLeaf *t = AllocLeaf(which);
     strcpy(t->d.counter.name, "Cnew");
     switch(which) {
         case ELEM_CTU:
@@ -843,7 +1086,7 @@ void AddSeedRandom()
     if(!CanInsertOther)
         return;
 
-    ElemLeaf *t = AllocLeaf();
+    ElemLeaf *t = AllocLeaf(ELEM_SEED_RANDOM);
     strcpy(t->d.move.dest, "Rand");
     strcpy(t->d.move.src, "newSeed");
     AddLeaf(ELEM_SEED_RANDOM, t);
@@ -854,7 +1097,7 @@ void AddRandom()
     if(!CanInsertOther)
         return;
 
-    ElemLeaf *t = AllocLeaf();
+    ElemLeaf *t = AllocLeaf(ELEM_RANDOM);
     strcpy(t->d.readAdc.name, "Rand");
     AddLeaf(ELEM_RANDOM, t);
 }
@@ -874,7 +1117,7 @@ void AddReadAdc()
             // return;
         }
     }
-    ElemLeaf *t = AllocLeaf();
+    ElemLeaf *t = AllocLeaf(ELEM_READ_ADC);
     strcpy(t->d.readAdc.name, "ADCnew");
     AddLeaf(ELEM_READ_ADC, t);
 }
@@ -894,7 +1137,7 @@ void AddSetPwm()
             // return;
         }
     }
-    ElemLeaf *t = AllocLeaf();
+    ElemLeaf *t = AllocLeaf(ELEM_SET_PWM);
     strcpy(t->d.setPwm.name, "PWMoutpin");
     strcpy(t->d.setPwm.duty_cycle, "duty_cycle");
     strcpy(t->d.setPwm.targetFreq, "1000");
@@ -912,7 +1155,7 @@ void AddUart(int which)
             // return;
         }
     }
-    ElemLeaf *t = AllocLeaf();
+    ElemLeaf *t = AllocLeaf(which);
     if((which == ELEM_UART_SEND) || (which == ELEM_UART_RECV))
         strcpy(t->d.uart.name, "var");
     else
@@ -933,7 +1176,7 @@ void AddSpi(int which)
             // return;
         }
     }
-    ElemLeaf *t = AllocLeaf();
+    ElemLeaf *t = AllocLeaf(which);
     /////   strcpy(t->d.spi.name, "SPIn");
     strcpy(t->d.spi.name, "SPI1"); ///// Modified by JG
     /////
@@ -960,7 +1203,7 @@ void AddI2c(int which)
             // return;
         }
     }
-    ElemLeaf *t = AllocLeaf();
+    ElemLeaf *t = AllocLeaf(which);
     strcpy(t->d.i2c.name, "I2C1");
     /////
     strcpy(t->d.i2c.mode, "Master");
@@ -986,7 +1229,7 @@ void AddPersist()
             // return;
         }
     }
-    ElemLeaf *t = AllocLeaf();
+    ElemLeaf *t = AllocLeaf(ELEM_PERSIST);
     strcpy(t->d.persist.var, "saved");
     AddLeaf(ELEM_PERSIST, t);
 }
@@ -1015,20 +1258,21 @@ bool CollapseUnnecessarySubckts(int which, void *any)
                             // merge the two series subcircuits
                             ElemSubcktSeries *s2 = p->contents[0].data.series;
                             int               makeSpaces = s2->count - 1;
+                            GrowSubckt(s, s->count + makeSpaces);
                             memmove(&s->contents[i + makeSpaces + 1], &s->contents[i + 1], (s->count - i - 1) * sizeof(s->contents[0]));
                             memcpy(&s->contents[i], &s2->contents[0], (s2->count) * sizeof(s->contents[0]));
                             s->count += makeSpaces;
-                            CheckFree(s2);
+                            FreeSubckt(s2);
                         } else {
                             s->contents[i].which = p->contents[0].which;
                             s->contents[i].data.any = p->contents[0].data.any;
                         }
-                        CheckFree(p);
+                        FreeSubckt(p);
                         modified = true;
                     } else if(p->count == 0) {
                         memmove(&s->contents[i], &s->contents[i + 1], (s->count - i - 1) * sizeof(s->contents[0]));
                         s->count -= 1;
-                        CheckFree(p);
+                        FreeSubckt(p);
                         modified = true;
                     } else {
                         while(CollapseUnnecessarySubckts(ELEM_PARALLEL_SUBCKT, s->contents[i].data.parallel)) {
@@ -1039,10 +1283,11 @@ bool CollapseUnnecessarySubckts(int which, void *any)
                     // move up level
                     ElemSubcktSeries *s2 = s->contents[i].data.series;
                     if((s->count + s2->count) < MAX_ELEMENTS_IN_SUBCKT) {
+                        GrowSubckt(s, s->count + s2->count - 1);
                         memmove(&s->contents[i + s2->count], &s->contents[i + 1], (s->count - i - 1) * sizeof(s->contents[0]));
                         memcpy(&s->contents[i], &s2->contents[0], (s2->count) * sizeof(s->contents[0]));
                         s->count += s2->count - 1;
-                        CheckFree(s2);
+                        FreeSubckt(s2);
                         modified = true;
                     }
                 }
@@ -1061,20 +1306,21 @@ bool CollapseUnnecessarySubckts(int which, void *any)
                             // merge the two parallel subcircuits
                             ElemSubcktParallel *p2 = s->contents[0].data.parallel;
                             int                 makeSpaces = p2->count - 1;
+                            GrowSubckt(p, p->count + makeSpaces);
                             memmove(&p->contents[i + makeSpaces + 1], &p->contents[i + 1], (p->count - i - 1) * sizeof(p->contents[0]));
                             memcpy(&p->contents[i], &p2->contents[0], (p2->count) * sizeof(p->contents[0]));
                             p->count += makeSpaces;
-                            CheckFree(p2);
+                            FreeSubckt(p2);
                         } else {
                             p->contents[i].which = s->contents[0].which;
                             p->contents[i].data.any = s->contents[0].data.any;
                         }
-                        CheckFree(s);
+                        FreeSubckt(s);
                         modified = true;
                     } else if(s->count == 0) {
                         memmove(&p->contents[i], &p->contents[i + 1], (p->count - i - 1) * sizeof(p->contents[0]));
                         p->count -= 1;
-                        CheckFree(s);
+                        FreeSubckt(s);
                         modified = true;
                     } else {
                         while(CollapseUnnecessarySubckts(ELEM_SERIES_SUBCKT, p->contents[i].data.series)) {
@@ -1111,7 +1357,7 @@ static bool DeleteSelectedFromSubckt(int which, void *any)
             for(i = 0; i < s->count; i++) {
                 if(s->contents[i].data.any == Selected.data.any) {
                     ForgetFromGrid(s->contents[i].data.any);
-                    CheckFree(s->contents[i].data.any);
+                    FreeLeaf(s->contents[i].leaf());
                     memmove(&s->contents[i], &s->contents[i + 1], (s->count - i - 1) * sizeof(s->contents[0]));
                     (s->count)--;
                     return true;
@@ -1130,7 +1376,7 @@ static bool DeleteSelectedFromSubckt(int which, void *any)
             for(i = 0; i < p->count; i++) {
                 if(p->contents[i].data.any == Selected.data.any) {
                     ForgetFromGrid(p->contents[i].data.any);
-                    CheckFree(p->contents[i].data.any);
+                    FreeLeaf(p->contents[i].leaf());
                     memmove(&p->contents[i], &p->contents[i + 1], (p->count - i - 1) * sizeof(p->contents[0]));
                     (p->count)--;
                     return true;
@@ -1234,7 +1480,9 @@ void FreeCircuit(int which, void *any)
             for(i = 0; i < s->count; i++) {
                 FreeCircuit(s->contents[i].which, s->contents[i].data.any);
             }
-            CheckFree(s);
+            ForgetRungLayout(s);
+            UndoRungChanged(s);
+            FreeSubckt(s);
             break;
         }
         case ELEM_PARALLEL_SUBCKT: {
@@ -1243,12 +1491,12 @@ void FreeCircuit(int which, void *any)
             for(i = 0; i < p->count; i++) {
                 FreeCircuit(p->contents[i].which, p->contents[i].data.any);
             }
-            CheckFree(p);
+            FreeSubckt(p);
             break;
         }
             CASE_LEAF
             ForgetFromGrid(any);
-            CheckFree(any);
+            FreeLeaf((ElemLeaf *)any);
             break;
 
         default:
@@ -1444,9 +1692,9 @@ void PushRungDown()
     int HeightBefore = 0;
     int j;
     for(j = 0; j < i; j++)
-        HeightBefore += CountHeightOfElement(ELEM_SERIES_SUBCKT, Prog.rungs_[j]);
-    int HeightNow = CountHeightOfElement(ELEM_SERIES_SUBCKT, Prog.rungs_[i]);
-    int HeightDown = CountHeightOfElement(ELEM_SERIES_SUBCKT, Prog.rungs_[i + 1]);
+        HeightBefore += RungHeight(j);
+    int HeightNow = RungHeight(i);
+    int HeightDown = RungHeight(i + 1);
 
     ElemSubcktSeries *temp = Prog.rungs_[i];
     Prog.rungs_[i] = Prog.rungs_[i + 1];
@@ -1471,9 +1719,9 @@ void PushRungUp()
     int HeightBefore = 0;
     int j;
     for(j = 0; j < i - 1; j++)
-        HeightBefore += CountHeightOfElement(ELEM_SERIES_SUBCKT, Prog.rungs_[j]);
-    int HeightUp = CountHeightOfElement(ELEM_SERIES_SUBCKT, Prog.rungs_[i - 1]);
-    int HeightNow = CountHeightOfElement(ELEM_SERIES_SUBCKT, Prog.rungs_[i]);
+        HeightBefore += RungHeight(j);
+    int HeightUp = RungHeight(i - 1);
+    int HeightNow = RungHeight(i);
 
     ElemSubcktSeries *temp = Prog.rungs_[i];
     Prog.rungs_[i] = Prog.rungs_[i - 1];
@@ -2047,19 +2295,21 @@ void PasteRung(int PasteInTo)
 }
 
 //-----------------------------------------------------------------------------
-static void RenameSet1_(int which, void *any, int which_elem, char *name, char *new_name, bool set1)
+// Returns true if it changed something.
+static bool RenameSet1_(int which, void *any, int which_elem, char *name, char *new_name, bool set1)
 {
+    bool changed = false;
     switch(which) {
         case ELEM_PARALLEL_SUBCKT: {
             ElemSubcktParallel *p = (ElemSubcktParallel *)any;
             for(int i = 0; i < p->count; i++)
-                RenameSet1_(p->contents[i].which, p->contents[i].data.any, which_elem, name, new_name, set1);
+                changed |= RenameSet1_(p->contents[i].which, p->contents[i].data.any, which_elem, name, new_name, set1);
             break;
         }
         case ELEM_SERIES_SUBCKT: {
             ElemSubcktSeries *s = (ElemSubcktSeries *)any;
             for(int i = 0; i < s->count; i++)
-                RenameSet1_(s->contents[i].which, s->contents[i].data.any, which_elem, name, new_name, set1);
+                changed |= RenameSet1_(s->contents[i].which, s->contents[i].data.any, which_elem, name, new_name, set1);
             break;
         }
         case ELEM_COIL: {
@@ -2068,8 +2318,10 @@ static void RenameSet1_(int which, void *any, int which_elem, char *name, char *
             if(strcmp(c->name, name) == 0) {
                 if(new_name && strlen(new_name))
                     //if(which_elem == ELEM_COIL) ???
-                    if(new_name[0] == name[0])
+                    if(new_name[0] == name[0]) {
                         strcpy(c->name, new_name);
+                        changed = true;
+                    }
             }
             break;
         }
@@ -2081,19 +2333,22 @@ static void RenameSet1_(int which, void *any, int which_elem, char *name, char *
                     strcpy(c->name, new_name);
                 if(which == ELEM_CONTACTS)
                     c->set1 = set1;
+                changed = true;
             }
             break;
         }
         default:
             break;
     }
+    return changed;
 }
 
 //-----------------------------------------------------------------------------
 void RenameSet1(int which, char *name, char *new_name, bool set1)
 {
     for(int i = 0; i < Prog.numRungs; i++)
-        RenameSet1_(ELEM_SERIES_SUBCKT, Prog.rungs_[i], which, name, new_name, set1);
+        if(RenameSet1_(ELEM_SERIES_SUBCKT, Prog.rungs_[i], which, name, new_name, set1))
+            UndoRungChanged(Prog.rungs_[i]);
 }
 
 //-----------------------------------------------------------------------------
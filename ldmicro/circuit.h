@@ -544,10 +544,13 @@ typedef struct ElemPerisistTag {
 #define SELECTED_RIGHT 3
 #define SELECTED_LEFT 4
 
+// A leaf takes only the bytes of the member of d that its element uses
+// (see AllocLeaf()), never copy it with sizeof(ElemLeaf).
 struct ElemLeaf {
-    int  selectedState;
-    bool poweredAfter;
-    bool workingNow;
+    int     selectedState;
+    bool    poweredAfter;
+    bool    workingNow;
+    uint8_t sizeClass; // of the block from the arena
     union {
         ElemComment         comment;
         ElemContacts        contacts;
@@ -652,14 +655,18 @@ struct SeriesNode {
     }
 };
 
+// The contents[] of a subcircuit have room for size elements; GrowSubckt()
+// before adding one.
 struct ElemSubcktSeries {
-    SeriesNode contents[MAX_ELEMENTS_IN_SUBCKT];
-    int        count;
+    SeriesNode *contents;
+    int         count;
+    int         size;
 };
 
 struct ElemSubcktParallel {
-    SeriesNode contents[MAX_ELEMENTS_IN_SUBCKT];
-    int        count;
+    SeriesNode *contents;
+    int         count;
+    int         size;
 };
 
 void                AddTimer(int which);
@@ -731,9 +738,16 @@ void                CopyRung();
 void                CopyElem();
 void                PasteRung(int PasteInTo);
 void                NewProgram();
-ElemLeaf *          AllocLeaf();
+size_t              LeafSize(int which);
+ElemLeaf *          AllocLeaf(int which);
+ElemLeaf *          CopyLeaf(int which, const ElemLeaf *leaf);
+void                FreeLeaf(ElemLeaf *leaf);
 ElemSubcktSeries *  AllocSubcktSeries();
 ElemSubcktParallel *AllocSubcktParallel();
+void                GrowSubckt(ElemSubcktSeries *s, int count);
+void                GrowSubckt(ElemSubcktParallel *p, int count);
+void                FreeSubckt(ElemSubcktSeries *s);
+void                FreeSubckt(ElemSubcktParallel *p);
 void                FreeCircuit(int which, void *any);
 void                FreeEntireProgram();
 ElemLeaf *          ContainsWhich(int which, void *any, int seek1, int seek2, int seek3);
@@ -36,6 +36,7 @@ static HWND YPlcCycleDutyCheckbox;
 static HWND BaudTextbox;
 static HWND RateTextbox;
 static HWND SpeedTextbox;
+static HWND OptimizeCombobox;
 
 static LONG_PTR PrevCrystalProc;
 static LONG_PTR PrevConfigBitsProc;
@@ -124,6 +125,16 @@ static void MakeControls()
     ConfigBitsTextbox = CreateWindowEx(WS_EX_CLIENTEDGE, WC_EDIT, "", WS_CHILD | ES_AUTOHSCROLL | WS_TABSTOP | WS_CLIPSIBLINGS | WS_VISIBLE, 400, 72, 100, 21, ConfDialog, nullptr, Instance, nullptr);
     NiceFont(ConfigBitsTextbox);
 
+    HWND textLabel7 = CreateWindowEx(0, WC_STATIC, _("Optimize the Code for:"), WS_CHILD | WS_CLIPSIBLINGS | WS_VISIBLE | SS_RIGHT, 1, 133, 180, 21, ConfDialog, nullptr, Instance, nullptr);
+    NiceFont(textLabel7);
+
+    // in the order of OPTIMIZE_DEFAULT, OPTIMIZE_SPEED, OPTIMIZE_SIZE
+    OptimizeCombobox = CreateWindowEx(WS_EX_CLIENTEDGE, WC_COMBOBOX, "", WS_CHILD | WS_TABSTOP | WS_CLIPSIBLINGS | WS_VISIBLE | CBS_DROPDOWNLIST | CBS_HASSTRINGS, 185, 132, 180, 100, ConfDialog, nullptr, Instance, nullptr);
+    NiceFont(OptimizeCombobox);
+    SendMessage(OptimizeCombobox, CB_ADDSTRING, 0, (LPARAM)_("Default (as before)"));
+    SendMessage(OptimizeCombobox, CB_ADDSTRING, 0, (LPARAM)_("Speed (/O2)"));
+    SendMessage(OptimizeCombobox, CB_ADDSTRING, 0, (LPARAM)_("Size (/Os)"));
+
     if(Prog.mcu() && ((Prog.mcu()->whichIsa == ISA_PIC16) || (Prog.mcu()->whichIsa == ISA_PIC18))) {
         EnableWindow(ConfigBitsTextbox, true);
         EnableWindow(textLabel2_, true);
@@ -255,7 +266,7 @@ static void MakeControls()
                                      explanation,
                                      WS_CHILD | WS_CLIPSIBLINGS | WS_VISIBLE,
                                      10,
-                                     100 + 30, ///// 30 added by JG
+                                     100 + 30 + 30, ///// 30 added by JG, 30 for the optimization
                                      340 + 200,
                                      800,
                                      ConfDialog,
@@ -272,7 +283,7 @@ static void MakeControls()
     SetRect(&tr, 0, 0, w, 800);
     DrawText(hdc, explanation, -1, &tr, DT_CALCRECT | DT_LEFT | DT_TOP | DT_WORDBREAK);
     DeleteDC(hdc);
-    int h = 104 + tr.bottom + 10 + 20 + 30; ///// 30 added by JG
+    int h = 104 + tr.bottom + 10 + 20 + 30 + 30; ///// 30 added by JG, 30 for the optimization
     SetWindowPos(ConfDialog, nullptr, 0, 0, w, h, SWP_NOMOVE);
     // h is the desired client height, but SetWindowPos includes title bar;
     // so fix it up by hand
@@ -328,6 +339,8 @@ void ShowConfDialog()
     sprintf(buf, "%d", Prog.i2cRate);
     SendMessage(SpeedTextbox, WM_SETTEXT, 0, (LPARAM)buf);
 
+    SendMessage(OptimizeCombobox, CB_SETCURSEL, (WPARAM)Prog.optimize, 0);
+
     if((Prog.mcu()) && (Prog.mcu()->whichIsa == ISA_ARM)) {
         Prog.cycleTimer = 3; //  ARM uses Timer 3
         sprintf(buf, "%d", 3);
@@ -410,6 +423,10 @@ void ShowConfDialog()
         SendMessage(SpeedTextbox, WM_GETTEXT, (WPARAM)sizeof(cancel_buf), (LPARAM)(cancel_buf));
         Prog.i2cRate = atol(cancel_buf);
 
+        int optimize = (int)SendMessage(OptimizeCombobox, CB_GETCURSEL, 0, 0);
+        if((optimize == OPTIMIZE_DEFAULT) || (optimize == OPTIMIZE_SPEED) || (optimize == OPTIMIZE_SIZE))
+            Prog.optimize = optimize;
+
         if(Prog.mcuClock <= 0) {
             Error(_("Zero crystal frequency not valid; resetting to 16 MHz."));
             Prog.mcuClock = 16000000; //16 MHz
@@ -302,6 +302,50 @@ int CountHeightOfElement(int which, void *elem)
     }
 }
 
+//-----------------------------------------------------------------------------
+// The height and width of every rung, counted once so that a repaint doesn't
+// walk the circuit of every rung of the program. The entry of a rung is
+// dropped when the rung is edited or freed. The width is the one that
+// ProgCountWidestRow() counts, which for a comment also depends on the
+// width of the window.
+//-----------------------------------------------------------------------------
+struct RungLayout {
+    int height;
+    int width;
+    int widthCols; // ScreenColsAvailable() of width, INT_MIN if not counted
+};
+static std::unordered_map<const void *, RungLayout> RungLayouts;
+
+static RungLayout &LayoutOfRung(ElemSubcktSeries *rung)
+{
+    auto l = RungLayouts.find(rung);
+    if(l == RungLayouts.end())
+        l = RungLayouts.emplace(rung, RungLayout{CountHeightOfElement(ELEM_SERIES_SUBCKT, rung), 0, INT_MIN}).first;
+    return l->second;
+}
+
+int RungHeight(int i)
+{
+    return LayoutOfRung(Prog.rungs(i)).height;
+}
+
+void ForgetRungLayout(const void *rung)
+{
+    RungLayouts.erase(rung);
+}
+
+void ForgetSelectedRungLayout()
+{
+    int i = RungContainingSelected();
+    if(i >= 0)
+        ForgetRungLayout(Prog.rungs(i));
+}
+
+void ForgetRungLayouts()
+{
+    RungLayouts.clear();
+}
+
 //-----------------------------------------------------------------------------
 // Determine the width, in leaf element units, of the widest row of the PLC
 // program (i.e. loop over all the rungs and find the widest).
@@ -310,11 +354,16 @@ int ProgCountWidestRow()
 {
     int max = 0;
     int colsTemp = ColsAvailable;
+    int screenCols = ScreenColsAvailable();
     ColsAvailable = 0;
     for(int i = 0; i < Prog.numRungs; i++) {
-        int w = CountWidthOfElement(ELEM_SERIES_SUBCKT, Prog.rungs(i), 0);
-        if(w > max) {
-            max = w;
+        RungLayout &l = LayoutOfRung(Prog.rungs(i));
+        if(l.widthCols != screenCols) {
+            l.width = CountWidthOfElement(ELEM_SERIES_SUBCKT, Prog.rungs(i), 0);
+            l.widthCols = screenCols;
+        }
+        if(l.width > max) {
+            max = l.width;
         }
     }
     ColsAvailable = colsTemp;
@@ -325,7 +374,7 @@ int ProgCountRows()
 {
     int totalHeight = 0;
     for(int i = 0; i < Prog.numRungs; i++) {
-        totalHeight += CountHeightOfElement(ELEM_SERIES_SUBCKT, Prog.rungs(i));
+        totalHeight += RungHeight(i);
     }
     // // //totalHeight += 1; // without EndRung !
     return totalHeight;
@@ -613,8 +662,7 @@ static bool DrawEndOfLine(int which, ElemLeaf *leaf, int *cx, int *cy, bool powe
         if(gx >= DISPLAY_MATRIX_X_SIZE)
             oops();
         DM_BOUNDS(gx, gy);
-        DisplayMatrix[gx][gy].data.leaf = PADDING_IN_DISPLAY_MATRIX;
-        DisplayMatrix[gx][gy].which = ELEM_PADDING;
+        DisplayMatrix.set(gx, gy, ELEM_PADDING, PADDING_IN_DISPLAY_MATRIX);
 
         DrawWire(cx, cy, '-');
         cx0 += POS_WIDTH;
@@ -1732,8 +1780,7 @@ static bool DrawLeaf(int which, ElemLeaf *leaf, int *cx, int *cy, bool poweredBe
         return false;
     DM_BOUNDS(gx, gy);
 
-    DisplayMatrix[gx][gy].data.leaf = leaf;
-    DisplayMatrix[gx][gy].which = which;
+    DisplayMatrix.set(gx, gy, which, leaf);
 
     int xadj = 0;
     switch(which) {
@@ -1754,8 +1801,7 @@ static bool DrawLeaf(int which, ElemLeaf *leaf, int *cx, int *cy, bool poweredBe
             //      case ELEM_UART_WR:
         case ELEM_FORMATTED_STRING:
             DM_BOUNDS(gx - 1, gy);
-            DisplayMatrix[gx - 1][gy].data.leaf = leaf;
-            DisplayMatrix[gx - 1][gy].which = which;
+            DisplayMatrix.set(gx - 1, gy, which, leaf);
             xadj = POS_WIDTH * FONT_WIDTH;
             break;
     }
@@ -1765,8 +1811,7 @@ static bool DrawLeaf(int which, ElemLeaf *leaf, int *cx, int *cy, bool poweredBe
         for(int i = 0; i < ColsAvailable; i++) {
             if((DisplayMatrix[i][gy].which <= ELEM_PLACEHOLDER) || true // 2.3
                || (DisplayMatrix[i][gy].which == ELEM_COMMENT)) {
-                DisplayMatrix[i][gy].data.leaf = leaf;
-                DisplayMatrix[i][gy].which = ELEM_COMMENT;
+                DisplayMatrix.set(i, gy, ELEM_COMMENT, leaf);
                 len++;
             }
         }
@@ -1919,8 +1964,7 @@ bool DrawElement(int which, void *any, int *cx, int *cy, bool poweredBefore /*,
                         return false;
 
                     DM_BOUNDS(gx, gy);
-                    DisplayMatrix[gx][gy].data.leaf = PADDING_IN_DISPLAY_MATRIX;
-                    DisplayMatrix[gx][gy].which = ELEM_PADDING;
+                    DisplayMatrix.set(gx, gy, ELEM_PADDING, PADDING_IN_DISPLAY_MATRIX);
 
                     DrawWire(cx, cy, '-');
                 }
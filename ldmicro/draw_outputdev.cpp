@@ -229,6 +229,29 @@ int ScreenRowsAvailable()
     return (IoListTop - Y_PADDING - adj + FONT_HEIGHT) / (POS_HEIGHT * FONT_HEIGHT);
 }
 
+//-----------------------------------------------------------------------------
+// Invalidate the part of the window where the rungs with changed[i] are, for
+// a repaint of only those after a cycle of the simulation.
+//-----------------------------------------------------------------------------
+void InvalidateRungs(const std::vector<bool> &changed)
+{
+    RECT r;
+    GetClientRect(MainWindow, &r);
+    int cy = -ScrollYOffset * POS_HEIGHT;
+    for(int i = 0; i < Prog.numRungs; i++) {
+        int thisHeight = POS_HEIGHT * RungHeight(i);
+        int top = Y_PADDING + FONT_HEIGHT * cy;
+        if(top >= IoListTop)
+            break;
+        if(changed[i] && (top + FONT_HEIGHT * thisHeight > 0)) {
+            r.top = std::max(top, 0);
+            r.bottom = std::min(top + FONT_HEIGHT * thisHeight, IoListTop);
+            InvalidateRect(MainWindow, &r, false);
+        }
+        cy += thisHeight;
+    }
+}
+
 //-----------------------------------------------------------------------------
 // Paint the ladder logic program to the screen. Also figure out where the
 // cursor should go and fill in coordinates for BlinkCursor. Not allowed to
@@ -239,6 +262,14 @@ void PaintWindow()
     static HBITMAP BackBitmap;
     static HDC     BackDc;
     static int     BitmapWidth;
+    // What the last paint drew into BackDc. During the simulation nothing
+    // moves, so when the window didn't scroll or resize since, a paint of
+    // a part of it (see InvalidateRungs()) draws only the rungs in that part
+    // and keeps the rest of BackDc.
+    static bool    PaintedSimulation;
+    static int     PaintedScrollY = -1;
+    static int     PaintedWidth;
+    static int     PaintedHeight;
 
     KillTimer(MainWindow, TIMER_BLINK_CURSOR);
     if(CursorDrawn)
@@ -264,11 +295,19 @@ void PaintWindow()
     paintDc = Hdc;
     Hdc = BackDc;
 
+    RECT clip;
+    bool partial = InSimulationMode && PaintedSimulation && (PaintedScrollY == ScrollYOffset) && (PaintedWidth == bw) && (PaintedHeight == bh)
+                   && (GetClipBox(paintDc, &clip) != ERROR) && ((clip.top > 0) || (clip.bottom < bh));
+    PaintedSimulation = InSimulationMode;
+    PaintedScrollY = ScrollYOffset;
+    PaintedWidth = bw;
+    PaintedHeight = bh;
+
     RECT fi;
     fi.left = 0;
-    fi.top = 0;
+    fi.top = partial ? clip.top : 0;
     fi.right = BitmapWidth;
-    fi.bottom = bh;
+    fi.bottom = partial ? std::min(static_cast<int>(clip.bottom), bh) : bh;
     FillRect(Hdc, &fi, InSimulationMode ? SimBgBrush : BgBrush);
 
     // now figure out how we should draw the ladder logic
@@ -276,9 +315,11 @@ void PaintWindow()
     if(ColsAvailable < ScreenColsAvailable()) {
         ColsAvailable = ScreenColsAvailable();
     }
-    memset(DisplayMatrix, 0, sizeof(DisplayMatrix));
-    SelectionActive = false;
-    memset(&Cursor, 0, sizeof(Cursor));
+    if(!partial) {
+        DisplayMatrix.clear();
+        SelectionActive = false;
+        memset(&Cursor, 0, sizeof(Cursor));
+    }
 
     DrawChars = DrawCharsToScreen;
 
@@ -288,13 +329,18 @@ void PaintWindow()
     int  cy = 0;
     int  rowsAvailable = ScreenRowsAvailable();
     for(i = 0; i < Prog.numRungs; i++) {
-        int thisHeight = POS_HEIGHT * CountHeightOfElement(ELEM_SERIES_SUBCKT, Prog.rungs(i));
+        int thisHeight = POS_HEIGHT * RungHeight(i);
 
         // For speed, there is no need to draw everything all the time, but
         // we still must draw a bit above and below so that the DisplayMatrix
         // is filled in enough to make it possible to reselect using the
         // cursor keys.
-        if(((cy + thisHeight) >= (ScrollYOffset - 8) * POS_HEIGHT) && (cy < (ScrollYOffset + rowsAvailable + 8) * POS_HEIGHT)) {
+        bool draw = ((cy + thisHeight) >= (ScrollYOffset - 8) * POS_HEIGHT) && (cy < (ScrollYOffset + rowsAvailable + 8) * POS_HEIGHT);
+        if(draw && partial) {
+            int top = Y_PADDING + FONT_HEIGHT * (cy - ScrollYOffset * POS_HEIGHT);
+            draw = (top < clip.bottom) && (top + FONT_HEIGHT * thisHeight > clip.top);
+        }
+        if(draw) {
             SetBkColor(Hdc, InSimulationMode ? HighlightColours.simBg : HighlightColours.bg);
             SetTextColor(Hdc, InSimulationMode ? HighlightColours.simRungNum : HighlightColours.rungNum);
             SelectObject(Hdc, FixedWidthFont);
@@ -350,7 +396,9 @@ void PaintWindow()
 
     SetTextColor(Hdc, prev);
 
-    if(SelectedGxAfterNextPaint >= 0) {
+    if(partial) {
+        // the selection and the cursor are as the last paint left them
+    } else if(SelectedGxAfterNextPaint >= 0) {
         int gx = SelectedGxAfterNextPaint, gy = SelectedGyAfterNextPaint;
         MoveCursorNear(&gx, &gy);
         InvalidateRect(MainWindow, nullptr, false);
@@ -771,7 +819,7 @@ void ExportDrawingAsText(char *file)
             strncpy(ExportBuffer[cy + 3], str, 4);
         }
 
-        cy += POS_HEIGHT * CountHeightOfElement(ELEM_SERIES_SUBCKT, Prog.rungs(i));
+        cy += POS_HEIGHT * RungHeight(i);
         cy += 1; //+1 for one empty line
     }
     DrawEndRung(6, cy);
@@ -240,6 +240,16 @@
 
 // Only used for the interpretable code.
 #define INT_END_OF_PROGRAM                       255
+// Superinstructions of the interpretable code, see SuperInstruction().
+// They must fit in the one-byte opcodes of the .xint files.
+#define INT_IF_BIT_SET_THEN_SET_BIT              240 // if(bits[a]) bits[b] := 1
+#define INT_IF_BIT_SET_THEN_CLEAR_BIT            241 // if(bits[a]) bits[b] := 0
+#define INT_IF_BIT_CLEAR_THEN_SET_BIT            242 // if(!bits[a]) bits[b] := 1
+#define INT_IF_BIT_CLEAR_THEN_CLEAR_BIT          243 // if(!bits[a]) bits[b] := 0
+#define INT_COPY_INVERTED_BIT                    244 // bits[a] := !bits[b]
+#define INT_COPY_BIT_TO_TWO_BITS                 245 // bits[a] := bits[c] := bits[b]
+// Prefix of a .xint op whose literal is 32 bits instead of 16.
+#define INT_WIDE_LITERAL                         246
 
 // clang-format on
 
@@ -271,6 +281,9 @@ struct IntOp {
 #define MAX_INT_OPS (1024 * 24)
 extern std::vector<IntOp> IntCode;
 extern int                ProgWriteP;
+
+// interpreted.cpp
+int SuperInstruction(uint32_t ipc, int *op, const NameArray *names[3]);
 #endif // !defined(INTCODE_H_CONSTANTS_ONLY)
 
 #endif //__INTCODE_H
@@ -26,12 +26,20 @@
 
 #include "ldmicro.h"
 #include "intcode.h"
+#include "ldimage.h"
 
-static char Variables[MAX_IO][MAX_NAME_LEN];
-static int  VariablesCount;
+static std::vector<std::string> Variables;
+static std::vector<std::string> InternalRelays;
 
-static char InternalRelays[MAX_IO][MAX_NAME_LEN];
-static int  InternalRelaysCount;
+// The ops are built with 32-bit fields and written with 16-bit fields
+// (BinOp16) unless a field doesn't fit, see ldinterpret.cpp.
+typedef struct {
+    int32_t op;
+    int32_t name1;
+    int32_t name2;
+    int32_t name3;
+    int32_t literal1;
+} BinOp;
 
 typedef struct {
     int16_t op;
@@ -39,45 +47,146 @@ typedef struct {
     int16_t name2;
     int16_t name3;
     int16_t literal1;
-} BinOp;
+} BinOp16;
 
-static BinOp OutProg[MAX_INT_OPS];
+static std::vector<BinOp> OutProg;
 
 template <size_t N> static int32_t AddrForInternalRelay(const StringArray<N> &name)
 {
     int32_t i;
-    for(i = 0; i < InternalRelaysCount; i++) {
-        if(name == InternalRelays[i]) {
+    for(i = 0; i < (int32_t)InternalRelays.size(); i++) {
+        if(name == InternalRelays[i].c_str()) {
             return i;
         }
     }
-    strcpy(InternalRelays[i], name.c_str());
-    InternalRelaysCount++;
+    InternalRelays.push_back(name.c_str());
     return i;
 }
 
 template <size_t N> static int32_t AddrForVariable(const StringArray<N> &name)
 {
     int32_t i;
-    for(i = 0; i < VariablesCount; i++) {
-        if((name == Variables[i])) {
+    for(i = 0; i < (int32_t)Variables.size(); i++) {
+        if((name == Variables[i].c_str())) {
             return i;
         }
     }
-    strcpy(Variables[i], name.c_str());
-    VariablesCount++;
+    Variables.push_back(name.c_str());
     return i;
 }
 
-static void Write(FileTracker &f, BinOp *op)
+static void Write(FileTracker &f, const void *op, size_t size)
 {
-    uint8_t *b = (uint8_t *)op;
-    for(uint32_t i = 0; i < sizeof(BinOp); i++) {
+    const uint8_t *b = (const uint8_t *)op;
+    for(uint32_t i = 0; i < size; i++) {
         fprintf(f, "%02x", b[i]);
     }
     fprintf(f, "\n");
 }
 
+//-----------------------------------------------------------------------------
+// Write the binary image of the interpretable code (see ldimage.h). The
+// .int and .xint generators share it; kind tells which the ops are. They
+// write it only if WriteBinaryImage, set by Settings > Write Binary Image or
+// /i on the command line.
+//-----------------------------------------------------------------------------
+int WriteBinaryImage = 0;
+
+bool WriteLdImage(const char *fileName, uint16_t kind, uint32_t operandSize, const void *ops, uint32_t opsLength, const LdImageSymbol *symbols, uint32_t symbolsCount,
+                  const LdImageIo *io, uint32_t ioCount)
+{
+    auto align = [](uint32_t n) { return (n + LDIMAGE_ALIGN - 1) & ~(LDIMAGE_ALIGN - 1); };
+
+    LdImageHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.Magic, LDIMAGE_MAGIC, sizeof(h.Magic));
+    h.Version = LDIMAGE_VERSION;
+    h.Kind = kind;
+    h.CycleTime = static_cast<uint32_t>(Prog.cycleTime);
+    h.OperandSize = operandSize;
+    h.OpsOffset = align(sizeof(h));
+    h.OpsLength = opsLength;
+    h.SymbolsOffset = align(h.OpsOffset + opsLength);
+    h.SymbolsCount = symbolsCount;
+    h.IoOffset = align(h.SymbolsOffset + symbolsCount * sizeof(LdImageSymbol));
+    h.IoCount = ioCount;
+    h.Length = h.IoOffset + ioCount * sizeof(LdImageIo);
+
+    std::vector<uint8_t> image(h.Length, 0);
+    memcpy(&image[h.OpsOffset], ops, opsLength);
+    if(symbolsCount)
+        memcpy(&image[h.SymbolsOffset], symbols, symbolsCount * sizeof(LdImageSymbol));
+    if(ioCount)
+        memcpy(&image[h.IoOffset], io, ioCount * sizeof(LdImageIo));
+    memcpy(&image[0], &h, sizeof(h));
+    h.Crc = LdImageCrcOf(image.data(), h.Length);
+    memcpy(&image[offsetof(LdImageHeader, Crc)], &h.Crc, sizeof(h.Crc));
+
+    FileTracker f(fileName, "wb");
+    if(!f)
+        return false;
+    return fwrite(image.data(), 1, image.size(), f) == image.size();
+}
+
+//-----------------------------------------------------------------------------
+// The ladder elements compile to a few short op sequences over and over:
+// every contact is an if/clear/endif, every set or reset coil an
+// if/set-or-clear/endif, a negated coil an if/clear/else/set/endif and
+// parallel coils are copies of the same bit. If the op at ipc starts one of
+// those, return how many ops of IntCode it replaces, with the opcode of the
+// superinstruction that does the same thing in one dispatch of the
+// interpreter and its bit operands (which point into IntCode); otherwise
+// return 0.
+//-----------------------------------------------------------------------------
+int SuperInstruction(uint32_t ipc, int *op, const NameArray *names[3])
+{
+    auto is = [ipc](uint32_t i, int op) { return (ipc + i < IntCode.size()) && (IntCode[ipc + i].op == op); };
+    auto isBitWrite = [&is](uint32_t i) { return is(i, INT_SET_BIT) || is(i, INT_CLEAR_BIT); };
+    const IntOp &a = IntCode[ipc];
+
+    switch(a.op) {
+        case INT_IF_BIT_SET:
+        case INT_IF_BIT_CLEAR: {
+            if(!isBitWrite(1))
+                return 0;
+            const IntOp &b = IntCode[ipc + 1];
+            names[0] = &a.name1;
+            names[1] = &b.name1;
+            if(is(2, INT_END_IF)) {
+                if(a.op == INT_IF_BIT_SET)
+                    *op = (b.op == INT_SET_BIT) ? INT_IF_BIT_SET_THEN_SET_BIT : INT_IF_BIT_SET_THEN_CLEAR_BIT;
+                else
+                    *op = (b.op == INT_SET_BIT) ? INT_IF_BIT_CLEAR_THEN_SET_BIT : INT_IF_BIT_CLEAR_THEN_CLEAR_BIT;
+                return 3;
+            }
+            // if(a) b := x else b := !x endif
+            if(is(2, INT_ELSE) && isBitWrite(3) && is(4, INT_END_IF) && (IntCode[ipc + 3].op != b.op) && (IntCode[ipc + 3].name1 == b.name1)) {
+                *op = ((a.op == INT_IF_BIT_SET) == (b.op == INT_SET_BIT)) ? INT_COPY_BIT_TO_BIT : INT_COPY_INVERTED_BIT;
+                names[0] = &b.name1;
+                names[1] = &a.name1;
+                return 5;
+            }
+            return 0;
+        }
+        case INT_COPY_NOT_BIT_TO_BIT:
+            *op = INT_COPY_INVERTED_BIT;
+            names[0] = &a.name1;
+            names[1] = &a.name2;
+            return 1;
+
+        case INT_COPY_BIT_TO_BIT:
+            if(is(1, INT_COPY_BIT_TO_BIT) && (IntCode[ipc + 1].name2 == a.name2) && (a.name1 != a.name2)) {
+                *op = INT_COPY_BIT_TO_TWO_BITS;
+                names[0] = &a.name1;
+                names[1] = &a.name2;
+                names[2] = &IntCode[ipc + 1].name1;
+                return 2;
+            }
+            return 0;
+    }
+    return 0;
+}
+
 void CompileInterpreted(const char *outFile)
 {
     FileTracker f(outFile, "w");
@@ -86,13 +195,13 @@ void CompileInterpreted(const char *outFile)
         return;
     }
 
-    InternalRelaysCount = 0;
-    VariablesCount = 0;
+    InternalRelays.clear();
+    Variables.clear();
+    OutProg.clear();
 
     fprintf(f, "$$LDcode\n");
 
     int   ignore_op;
-    int   outPc;
     BinOp op;
 
     // Convert the if/else structures in the intermediate code to absolute
@@ -106,10 +215,23 @@ void CompileInterpreted(const char *outFile)
     // 'jump to if reached' address (which is the ENDIF+1)
     int ifOpElse[MAX_IF_NESTING];
 
-    outPc = 0;
     for(uint32_t ipc = 0; ipc < IntCode.size(); ipc++) {
         ignore_op = 0;
         memset(&op, 0, sizeof(op));
+
+        int              fusedOp;
+        const NameArray *fused[3];
+        if(int n = SuperInstruction(ipc, &fusedOp, fused)) {
+            op.op = fusedOp;
+            op.name1 = AddrForInternalRelay(*fused[0]);
+            op.name2 = AddrForInternalRelay(*fused[1]);
+            if(fusedOp == INT_COPY_BIT_TO_TWO_BITS)
+                op.name3 = AddrForInternalRelay(*fused[2]);
+            OutProg.push_back(op);
+            ipc += n - 1;
+            continue;
+        }
+
         op.op = IntCode[ipc].op;
 
         switch(IntCode[ipc].op) {
@@ -185,14 +307,14 @@ void CompileInterpreted(const char *outFile)
                 op.name2 = AddrForVariable(IntCode[ipc].name2);
                 goto finishIf;
             finishIf:
-                ifOpIf[ifDepth] = outPc;
+                ifOpIf[ifDepth] = OutProg.size();
                 ifOpElse[ifDepth] = 0;
                 ifDepth++;
                 // jump target will be filled in later
                 break;
 
             case INT_ELSE:
-                ifOpElse[ifDepth - 1] = outPc;
+                ifOpElse[ifDepth - 1] = OutProg.size();
                 // jump target will be filled in later
                 break;
 
@@ -201,13 +323,13 @@ void CompileInterpreted(const char *outFile)
                 if(ifOpElse[ifDepth] == 0) {
                     // There is no else; if should jump straight to the
                     // instruction after this one if the condition is false.
-                    OutProg[ifOpIf[ifDepth]].name3 = outPc - 1;
+                    OutProg[ifOpIf[ifDepth]].name3 = OutProg.size() - 1;
                 } else {
                     // There is an else clause; if the if is false then jump
                     // just past the else, and if the else is reached then
                     // jump to the endif.
                     OutProg[ifOpIf[ifDepth]].name3 = ifOpElse[ifDepth];
-                    OutProg[ifOpElse[ifDepth]].name3 = outPc - 1;
+                    OutProg[ifOpElse[ifDepth]].name3 = OutProg.size() - 1;
                 }
                 // But don't generate an instruction for this.
                 continue;
@@ -256,32 +378,79 @@ void CompileInterpreted(const char *outFile)
                 return;
         }
 
-        memcpy(&OutProg[outPc], &op, sizeof(op));
-        outPc++;
-    }
-
-    for(int i = 0; i < outPc; i++) {
-        Write(f, &OutProg[i]);
+        OutProg.push_back(op);
     }
     memset(&op, 0, sizeof(op));
     op.op = INT_END_OF_PROGRAM;
-    Write(f, &op);
+    OutProg.push_back(op);
+
+    // Small programs keep the 16-bit records that existing interpreters
+    // read; any address, jump or literal out of range makes all of them wide.
+    auto fits16 = [](int32_t v) { return (v >= INT16_MIN) && (v <= INT16_MAX); };
+    bool wide = false;
+    for(const BinOp &o : OutProg)
+        wide = wide || !fits16(o.op) || !fits16(o.name1) || !fits16(o.name2) || !fits16(o.name3) || !fits16(o.literal1);
+    std::vector<BinOp16> outProg16;
+    if(!wide) {
+        for(const BinOp &o : OutProg)
+            outProg16.push_back({(int16_t)o.op, (int16_t)o.name1, (int16_t)o.name2, (int16_t)o.name3, (int16_t)o.literal1});
+    }
+    const void *ops = wide ? (const void *)OutProg.data() : (const void *)outProg16.data();
+    size_t      opSize = wide ? sizeof(BinOp) : sizeof(BinOp16);
+
+    for(size_t i = 0; i < OutProg.size(); i++) {
+        Write(f, (const uint8_t *)ops + i * opSize, opSize);
+    }
 
     fprintf(f, "$$bits\n");
-    for(int i = 0; i < InternalRelaysCount; i++) {
+    for(size_t i = 0; i < InternalRelays.size(); i++) {
         //if(InternalRelays[i][0] != '$') {
-            fprintf(f, "%s,%d\n", InternalRelays[i], i);
+            fprintf(f, "%s,%d\n", InternalRelays[i].c_str(), (int)i);
         //}
     }
     fprintf(f, "$$int16s\n");
-    for(int i = 0; i < VariablesCount; i++) {
+    for(size_t i = 0; i < Variables.size(); i++) {
         //if(Variables[i][0] != '$') {
-            fprintf(f, "%s,%d\n", Variables[i], i);
+            fprintf(f, "%s,%d\n", Variables[i].c_str(), (int)i);
         //}
     }
 
     fprintf(f, "$$cycle %lld us\n", Prog.cycleTime);
 
+    // The same program as a binary image, that ldinterpret maps and runs in
+    // place, if asked for.
+    if(WriteBinaryImage) {
+        std::vector<LdImageSymbol> symbols(InternalRelays.size() + Variables.size());
+        for(size_t i = 0; i < InternalRelays.size(); i++) {
+            symbols[i].Addr = i;
+            symbols[i].Type = LDIMAGE_SYMBOL_BIT;
+            strncpy(symbols[i].Name, InternalRelays[i].c_str(), LDIMAGE_NAME_LEN - 1);
+        }
+        for(size_t i = 0; i < Variables.size(); i++) {
+            LdImageSymbol &s = symbols[InternalRelays.size() + i];
+            s.Addr = i;
+            s.Type = LDIMAGE_SYMBOL_INT;
+            strncpy(s.Name, Variables[i].c_str(), LDIMAGE_NAME_LEN - 1);
+        }
+        std::vector<LdImageIo> io(Prog.io.count);
+        for(int i = 0; i < Prog.io.count; i++) {
+            io[i].Addr = static_cast<uint32_t>(-1);
+            for(const LdImageSymbol &s : symbols)
+                if(strcmp(s.Name, Prog.io.assignment[i].name) == 0)
+                    io[i].Addr = s.Addr;
+            io[i].Type = Prog.io.assignment[i].type;
+            io[i].ModbusSlave = Prog.io.assignment[i].modbus.Slave;
+            io[i].ModbusAddress = Prog.io.assignment[i].modbus.Address;
+            strncpy(io[i].Name, Prog.io.assignment[i].name, LDIMAGE_NAME_LEN - 1);
+        }
+        char imageFile[MAX_PATH];
+        SetExt(imageFile, outFile, ".intb");
+        if(!WriteLdImage(imageFile, LDIMAGE_INT, opSize / 5, ops, OutProg.size() * opSize, symbols.data(), symbols.size(), io.data(), io.size())) {
+            THROW_COMPILER_EXCEPTION_FMT(_("Couldn't write to '%s'"), imageFile);
+            return;
+        }
+    }
+
     char str[MAX_PATH + 500];
     sprintf(str, _("Compile successful; wrote interpretable code to '%s'.\r\n\r\nYou probably have to adapt the interpreter to your application. See the documentation."), outFile);
     CompileSuccessfulMessage(str);
@@ -41,6 +41,34 @@ static struct {
     ModbusAddr_t modbus;
 } IoSeenPreviously[MAX_IO_SEEN_PREVIOUSLY];
 static int IoSeenPreviouslyCount;
+// IoSeenPreviously[] by name, the indices in the order they were added
+static std::unordered_map<std::string, std::vector<int>> IoSeenIndex;
+
+// The I/O that each rung of the program uses, as ExtractNamesFromCircuit()
+// found it, so that GenerateIoList() only walks the rungs that changed since
+// the last time. hash is of the whole rung; a rung is changed in place by
+// many edits, not only through the selection, so this is what tells. The
+// errors of the walk are kept too, and raised again for a rung not walked.
+struct IoName {
+    std::string name;
+    int         type;
+};
+struct RungIo {
+    uint64_t                 hash;
+    bool                     extracted;
+    uint32_t                 generation; // of the last GenerateIoList() that saw the rung
+    std::vector<IoName>      names;
+    std::vector<std::string> errors;
+    int                      spiErrors; // invalid SPI and I2C names, reported once per list
+    int                      i2cErrors;
+};
+static std::unordered_map<const void *, RungIo> RungIos;
+static RungIo *                                 Extracted; // the rung walked now
+
+// Prog.io.assignment[] by name: the first one with the name, and from each
+// the next one with the same name (and another type), or -1
+static std::unordered_map<std::string, int> IoByName;
+static int                                  IoNextSameName[MAX_IO];
 
 static int SpiErrors = 0; ///// Added by JG
 static int I2cErrors = 0; ///// Added by JG
@@ -87,6 +115,53 @@ int IsIoType(int type)
 //-----------------------------------------------------------------------------
 // Append an I/O to the I/O list if it is not in there already.
 //-----------------------------------------------------------------------------
+static void MergeIo(const IoName &io)
+{
+    int  type = io.type;
+    int  last = -1;
+    auto first = IoByName.find(io.name);
+    if(first != IoByName.end()) {
+        for(int i = first->second; i >= 0; i = IoNextSameName[i]) {
+            if((Prog.io.assignment[i].type == IO_TYPE_COUNTER) && (type == IO_TYPE_GENERAL)) {
+                return;
+            } else if((Prog.io.assignment[i].type == IO_TYPE_GENERAL) && (type == IO_TYPE_COUNTER)) {
+                Prog.io.assignment[i].type = type; // replace // see compilercommon.cpp
+            }
+            if(Prog.io.assignment[i].type == type)
+                return;
+            last = i;
+        }
+    }
+    int i = Prog.io.count;
+    if(i < MAX_IO) {
+        Prog.io.assignment[i].type = type;
+        Prog.io.assignment[i].pin = NO_PIN_ASSIGNED;
+        Prog.io.assignment[i].modbus.Slave = 0;
+        Prog.io.assignment[i].modbus.Address = 0;
+        strcpy(Prog.io.assignment[i].name, io.name.c_str());
+        IoNextSameName[i] = -1;
+        if(last >= 0)
+            IoNextSameName[last] = i;
+        else
+            IoByName.emplace(io.name, i);
+        (Prog.io.count)++;
+    }
+}
+
+// Error() in the rung walked now
+static void IoError(const char *str, ...)
+{
+    char    buf[1024];
+    va_list f;
+    va_start(f, str);
+    vsnprintf(buf, sizeof(buf), str, f);
+    va_end(f);
+    if(Extracted)
+        Extracted->errors.push_back(buf);
+    Error("%s", buf);
+}
+
+// Note an I/O of the rung walked now, for MergeIo().
 static void AppendIo(const char *name, int type)
 {
     if(!name || !strlen(name))
@@ -97,7 +172,7 @@ static void AppendIo(const char *name, int type)
 
     if(!IsNumber(name)) {
         if(strchr(name, '-')) {
-            Error(_("Rename '%s': Replace the character '-' by the '_'."), name);
+            IoError(_("Rename '%s': Replace the character '-' by the '_'."), name);
             return;
         }
     }
@@ -113,37 +188,13 @@ static void AppendIo(const char *name, int type)
 
     SetVariableType(name, type);
 
-    int i;
-    for(i = 0; i < Prog.io.count; i++) {
-        if(strcmp(Prog.io.assignment[i].name, name) == 0) {
-            if((Prog.io.assignment[i].type == IO_TYPE_COUNTER) && (type == IO_TYPE_GENERAL)) {
-                return;
-            } else if((Prog.io.assignment[i].type == IO_TYPE_GENERAL) && (type == IO_TYPE_COUNTER)) {
-                Prog.io.assignment[i].type = type; // replace // see compilercommon.cpp
-            }
-        }
-        if((strcmp(Prog.io.assignment[i].name, name) == 0) && (Prog.io.assignment[i].type == type))
-            return;
-        /*
-        if(strcmp(Prog.io.assignment[i].name, name)==0) {
-            if(type != IO_TYPE_GENERAL && Prog.io.assignment[i].type ==
-                IO_TYPE_GENERAL)
-            {
-                Prog.io.assignment[i].type = type;
-            }
-            // already in there
-            return;
-        }
-        */
-    }
-    if(i < MAX_IO) {
-        Prog.io.assignment[i].type = type;
-        Prog.io.assignment[i].pin = NO_PIN_ASSIGNED;
-        Prog.io.assignment[i].modbus.Slave = 0;
-        Prog.io.assignment[i].modbus.Address = 0;
-        strcpy(Prog.io.assignment[i].name, name);
-        (Prog.io.count)++;
-    }
+    Extracted->names.push_back(IoName{name, type});
+}
+
+static void ForgetIoSeenPreviously()
+{
+    IoSeenPreviouslyCount = 0;
+    IoSeenIndex.clear();
 }
 
 //-----------------------------------------------------------------------------
@@ -156,25 +207,29 @@ static void AppendIoSeenPreviously(char *name, int type, int pin, ModbusAddr_t m
     if(strcmp(name + 1, "new") == 0)
         return;
 
-    for(int i = 0; i < IoSeenPreviouslyCount; i++) {
-        if(strcmp(name, IoSeenPreviously[i].name) == 0 && type == IoSeenPreviously[i].type) {
-            if(pin != NO_PIN_ASSIGNED) {
-                IoSeenPreviously[i].pin = pin;
+    auto seen = IoSeenIndex.find(name);
+    if(seen != IoSeenIndex.end()) {
+        for(int i : seen->second) {
+            if(type == IoSeenPreviously[i].type) {
+                if(pin != NO_PIN_ASSIGNED) {
+                    IoSeenPreviously[i].pin = pin;
+                }
+                IoSeenPreviously[i].modbus = modbus;
+                return;
             }
-            IoSeenPreviously[i].modbus = modbus;
-            return;
         }
     }
     if(IoSeenPreviouslyCount >= MAX_IO_SEEN_PREVIOUSLY) {
         // maybe improve later; just throw away all our old information, and
         // the user might have to reenter the pin if they delete and recreate
         // things
-        IoSeenPreviouslyCount = 0;
+        ForgetIoSeenPreviously();
     }
     IoSeenPreviously[IoSeenPreviouslyCount].type = type;
     IoSeenPreviously[IoSeenPreviouslyCount].pin = pin;
     IoSeenPreviously[IoSeenPreviouslyCount].modbus = modbus;
     strcpy(IoSeenPreviously[IoSeenPreviouslyCount].name, name);
+    IoSeenIndex[name].push_back(IoSeenPreviouslyCount);
     IoSeenPreviouslyCount++;
 }
 
@@ -280,7 +335,7 @@ static void ExtractNamesFromCircuit(int which, void *any)
                     AppendIo(l->d.QuadEncod.inputA, IO_TYPE_INT_INPUT);
                     break;
                 default:
-                    Error(_("Connect QUAD ENCOD input A to INTs input pin IqAn."));
+                    IoError(_("Connect QUAD ENCOD input A to INTs input pin IqAn."));
                     break;
             }
             */
@@ -289,7 +344,7 @@ static void ExtractNamesFromCircuit(int which, void *any)
                     AppendIo(l->d.QuadEncod.inputA, IO_TYPE_DIG_INPUT);
                     break;
                 default:
-                    Error(_("Connect QUAD ENCOD input A to input pin XqAn."));
+                    IoError(_("Connect QUAD ENCOD input A to input pin XqAn."));
                     break;
             }
             switch(l->d.QuadEncod.inputB[0]) {
@@ -297,7 +352,7 @@ static void ExtractNamesFromCircuit(int which, void *any)
                     AppendIo(l->d.QuadEncod.inputB, IO_TYPE_DIG_INPUT);
                     break;
                 default:
-                    Error(_("Connect QUAD ENCOD input B to input pin XqBn."));
+                    IoError(_("Connect QUAD ENCOD input B to input pin XqBn."));
                     break;
             }
             if(strlen(l->d.QuadEncod.inputZ) > 0)
@@ -306,7 +361,7 @@ static void ExtractNamesFromCircuit(int which, void *any)
                         AppendIo(l->d.QuadEncod.inputZ, IO_TYPE_DIG_INPUT);
                         break;
                     default:
-                        Error(_("Connect QUAD ENCOD input Z to input pin XqZn."));
+                        IoError(_("Connect QUAD ENCOD input Z to input pin XqZn."));
                         break;
                 }
             if(strlen(l->d.QuadEncod.dir) > 0)
@@ -318,7 +373,7 @@ static void ExtractNamesFromCircuit(int which, void *any)
                         AppendIo(l->d.QuadEncod.dir, IO_TYPE_DIG_OUTPUT);
                         break;
                     default:
-                        Error(_("Connect QUAD ENCOD dir flag to output pin YsomeName or internal relay RsomeName."));
+                        IoError(_("Connect QUAD ENCOD dir flag to output pin YsomeName or internal relay RsomeName."));
                         break;
                 }
             /*
@@ -334,7 +389,7 @@ static void ExtractNamesFromCircuit(int which, void *any)
                     AppendIo(l->d.Npulse.coil, IO_TYPE_DIG_OUTPUT);
                     break;
                 default:
-                    Error(_("Connect NPULSE to output pin YsomeName."));
+                    IoError(_("Connect NPULSE to output pin YsomeName."));
                     break;
             }
             break;
@@ -357,7 +412,7 @@ static void ExtractNamesFromCircuit(int which, void *any)
                     AppendIo(l->d.stepper.coil, IO_TYPE_DIG_OUTPUT);
                     break;
                 default:
-                    Error(_("Connect STEPPER coil to output pin YsomeName."));
+                    IoError(_("Connect STEPPER coil to output pin YsomeName."));
                     break;
             }
             break;
@@ -371,7 +426,7 @@ static void ExtractNamesFromCircuit(int which, void *any)
                     AppendIo(l->d.pulser.coil, IO_TYPE_DIG_OUTPUT);
                     break;
                 default:
-                    Error(_("Connect PULSER coil to output pin YsomeName or internal relay RsomeName."));
+                    IoError(_("Connect PULSER coil to output pin YsomeName or internal relay RsomeName."));
                     break;
             }
             break;
@@ -747,6 +802,42 @@ static void ExtractNamesFromCircuit(int which, void *any)
     }
 }
 
+//-----------------------------------------------------------------------------
+// Hash of a circuit, of its structure and the parameters of its leaves, to
+// tell the rungs whose I/O could have changed.
+//-----------------------------------------------------------------------------
+static uint64_t HashCircuit(int which, const void *any, uint64_t h)
+{
+    const uint64_t prime = 0x100000001b3ULL;
+    h = (h ^ (uint32_t)which) * prime;
+    switch(which) {
+        case ELEM_SERIES_SUBCKT:
+        case ELEM_PARALLEL_SUBCKT: {
+            // the same layout for both
+            const ElemSubcktSeries *s = (const ElemSubcktSeries *)any;
+            h = (h ^ (uint32_t)s->count) * prime;
+            for(int i = 0; i < s->count; i++)
+                h = HashCircuit(s->contents[i].which, s->contents[i].data.any, h);
+            return h;
+        }
+        case ELEM_COMMENT:
+            return h; // no I/O in it
+        default: {
+            const uint8_t *p = (const uint8_t *)&((const ElemLeaf *)any)->d;
+            size_t         n = LeafSize(which) - offsetof(ElemLeaf, d);
+            for(; n >= sizeof(uint64_t); n -= sizeof(uint64_t), p += sizeof(uint64_t)) {
+                uint64_t w;
+                memcpy(&w, p, sizeof(w));
+                h = (h ^ w) * prime;
+                h ^= h >> 29;
+            }
+            for(; n > 0; n--, p++)
+                h = (h ^ *p) * prime;
+            return h;
+        }
+    }
+}
+
 //-----------------------------------------------------------------------------
 // Compare function to qsort() the I/O list. Group by type, then
 // alphabetically within each section.
@@ -786,7 +877,7 @@ int GenerateIoList(int prevSel)
     if(IoSeenPreviouslyCount > MAX_IO_SEEN_PREVIOUSLY / 2) {
         // flush it so there's lots of room, and we don't run out and
         // forget important things
-        IoSeenPreviouslyCount = 0;
+        ForgetIoSeenPreviously();
     }
 
     // remember the pin assignments
@@ -795,15 +886,68 @@ int GenerateIoList(int prevSel)
     }
     // wipe the list
     Prog.io.count = 0;
-    // extract the new list so that it must be up to date
+    IoByName.clear();
+
+    // extract the new list so that it must be up to date; only the rungs
+    // that changed are walked, the others give the I/O they gave last time.
+    // The walk also depends on the MCU and the SPI and I2C rates.
+    static uint32_t         generation;
+    static const McuIoInfo *mcu;
+    static int32_t          spiRate, i2cRate;
+    if((mcu != Prog.mcu()) || (spiRate != Prog.spiRate) || (i2cRate != Prog.i2cRate)) {
+        RungIos.clear();
+        mcu = Prog.mcu();
+        spiRate = Prog.spiRate;
+        i2cRate = Prog.i2cRate;
+    }
+    generation++;
     for(i = 0; i < Prog.numRungs; i++) {
-        ExtractNamesFromCircuit(ELEM_SERIES_SUBCKT, Prog.rungs(i));
+        ElemSubcktSeries *rung = Prog.rungs(i);
+        uint64_t          hash = HashCircuit(ELEM_SERIES_SUBCKT, rung, 0xcbf29ce484222325ULL);
+        RungIo &          r = RungIos[rung];
+        if(!r.extracted || (r.hash != hash)) {
+            r.extracted = false;
+            r.names.clear();
+            r.errors.clear();
+            r.spiErrors = SpiErrors;
+            r.i2cErrors = I2cErrors;
+            Extracted = &r;
+            ExtractNamesFromCircuit(ELEM_SERIES_SUBCKT, rung);
+            r.spiErrors = SpiErrors - r.spiErrors;
+            r.i2cErrors = I2cErrors - r.i2cErrors;
+            // after the walk, which sets the bit rate of SPI and I2C in the rung
+            r.hash = HashCircuit(ELEM_SERIES_SUBCKT, rung, 0xcbf29ce484222325ULL);
+            r.extracted = true;
+        } else {
+            for(const std::string &e : r.errors)
+                Error("%s", e.c_str());
+            if((SpiErrors == 0) && (r.spiErrors > 0))
+                Error(_("Invalid SPI name in ladder."));
+            if((I2cErrors == 0) && (r.i2cErrors > 0))
+                Error(_("Invalid I2C name in ladder."));
+            SpiErrors += r.spiErrors;
+            I2cErrors += r.i2cErrors;
+        }
+        r.generation = generation;
+        for(const IoName &io : r.names)
+            MergeIo(io);
+    }
+    for(auto r = RungIos.begin(); r != RungIos.end();) {
+        if(r->second.generation != generation)
+            r = RungIos.erase(r);
+        else
+            ++r;
     }
     // AppendIo("ROverflowFlagV", IO_TYPE_INTERNAL_RELAY);
 
     if(Prog.cycleDuty) {
+        RungIo duty;
+        Extracted = &duty;
         AppendIo(YPlcCycleDuty, IO_TYPE_DIG_OUTPUT);
+        for(const IoName &io : duty.names)
+            MergeIo(io);
     }
+    Extracted = nullptr;
     for(i = 0; i < Prog.io.count; i++) {
         // clang-format off
         if(Prog.io.assignment[i].type == IO_TYPE_DIG_INPUT ||
@@ -822,12 +966,11 @@ int GenerateIoList(int prevSel)
            Prog.io.assignment[i].type == IO_TYPE_READ_ADC)
         {
             // clang-format on
-            for(j = 0; j < IoSeenPreviouslyCount; j++) {
-                if(strcmp(Prog.io.assignment[i].name, IoSeenPreviously[j].name) == 0) {
-                    Prog.io.assignment[i].pin = IoSeenPreviously[j].pin;
-                    Prog.io.assignment[i].modbus = IoSeenPreviously[j].modbus;
-                    break;
-                }
+            auto seen = IoSeenIndex.find(Prog.io.assignment[i].name);
+            if(seen != IoSeenIndex.end()) {
+                j = seen->second.front();
+                Prog.io.assignment[i].pin = IoSeenPreviously[j].pin;
+                Prog.io.assignment[i].modbus = IoSeenPreviously[j].modbus;
             }
         }
     }
@@ -1094,7 +1237,7 @@ void ShowAnalogSliderPopup(char *name)
     EnableWindow(MainWindow, true);
     SetFocus(MainWindow);
     DestroyWindow(AnalogSliderMain);
-    ListView_RedrawItems(IoList, 0, Prog.io.count - 1);
+    RedrawIoListRows(0, Prog.io.count - 1);
 }
 
 //-----------------------------------------------------------------------------
@@ -1603,13 +1746,67 @@ void ShowModbusDialog(int item)
     DestroyWindow(IoDialog);
     return;
 }
+//-----------------------------------------------------------------------------
+// The text of the State column of every row, formatted when the list first
+// shows the row and kept until the row is redrawn for a new value. The text
+// of a row is good while its stamp is IoStateGeneration; redrawing some rows
+// clears their stamps, redrawing all of them starts a new generation.
+//-----------------------------------------------------------------------------
+struct IoStateText {
+    uint32_t    stamp;
+    std::string text;
+};
+static std::vector<IoStateText> IoStateTexts;
+static uint32_t                 IoStateGeneration = 1;
+
+static void DescribeRowForIoList(int item, char *out)
+{
+    if((size_t)item >= IoStateTexts.size())
+        IoStateTexts.resize(Prog.io.count, IoStateText{0, ""});
+    if((size_t)item >= IoStateTexts.size()) {
+        // a row of the old list while it's regenerated
+        DescribeForIoList(Prog.io.assignment[item].name, Prog.io.assignment[item].type, out);
+        return;
+    }
+    IoStateText &s = IoStateTexts[item];
+    if(s.stamp != IoStateGeneration) {
+        DescribeForIoList(Prog.io.assignment[item].name, Prog.io.assignment[item].type, out);
+        s.text = out;
+        s.stamp = IoStateGeneration;
+    } else {
+        strcpy(out, s.text.c_str());
+    }
+}
+
+//-----------------------------------------------------------------------------
+// Redraw the rows first..last of the I/O list, for a change of their values.
+// Only the rows on the screen are painted; the list is virtual, and asks for
+// the text of the others when it's scrolled to them.
+//-----------------------------------------------------------------------------
+void RedrawIoListRows(int first, int last)
+{
+    if((first <= 0) && (last >= Prog.io.count - 1)) {
+        if(++IoStateGeneration == 0)
+            IoStateGeneration = 1;
+    } else {
+        for(int i = std::max(first, 0); (i <= last) && (i < (int)IoStateTexts.size()); i++)
+            IoStateTexts[i].stamp = 0;
+    }
+
+    int top = ListView_GetTopIndex(IoList);
+    first = std::max(first, top);
+    last = std::min(last, top + ListView_GetCountPerPage(IoList)); // with the one partly shown
+    if(first <= last)
+        ListView_RedrawItems(IoList, first, last);
+}
+
 //-----------------------------------------------------------------------------
 // Called in response to a notify for the listview. Handles click, text-edit
 // operations etc., but also gets called to find out what text to display
-// where (LPSTR_TEXTCALLBACK); that way we don't have two parallel copies of
-// the I/O list to keep in sync.
+// where; the list is virtual (LVS_OWNERDATA), so that we don't have two
+// parallel copies of the I/O list to keep in sync.
 //-----------------------------------------------------------------------------
-void IoListProc(NMHDR *h)
+LRESULT IoListProc(NMHDR *h)
 {
     switch(h->code) {
         case LVN_GETDISPINFO: {
@@ -1637,7 +1834,7 @@ void IoListProc(NMHDR *h)
 
                 case LV_IO_STATE: {
                     if(true || InSimulationMode) {
-                        DescribeForIoList(name, type, i->item.pszText);
+                        DescribeRowForIoList(item, i->item.pszText);
                     } else {
                         strcpy(i->item.pszText, "");
                     }
@@ -1839,7 +2036,7 @@ void IoListProc(NMHDR *h)
                     case IO_TYPE_TOF: {
                         ShowIoDialog(i->iItem);
                         InvalidateRect(MainWindow, nullptr, false);
-                        ListView_RedrawItems(IoList, 0, Prog.io.count - 1);
+                        RedrawIoListRows(0, Prog.io.count - 1);
                         break;
                     }
                     case IO_TYPE_READ_ADC: {
@@ -1872,5 +2069,21 @@ void IoListProc(NMHDR *h)
             }
             break;
         }
+        case LVN_ODFINDITEM: {
+            // Typing in the list: the row from iStart on whose name starts
+            // with what was typed, as a list with its own items would find.
+            NMLVFINDITEM *f = (NMLVFINDITEM *)h;
+            if(!(f->lvfi.flags & LVFI_STRING) || !f->lvfi.psz || (Prog.io.count == 0))
+                return -1;
+            size_t len = strlen(f->lvfi.psz) + ((f->lvfi.flags & LVFI_PARTIAL) ? 0 : 1);
+            int    rows = (f->lvfi.flags & LVFI_WRAP) ? Prog.io.count : (Prog.io.count - f->iStart);
+            for(int k = 0; k < rows; k++) {
+                int row = (f->iStart + k) % Prog.io.count;
+                if(_strnicmp(Prog.io.assignment[row].name, f->lvfi.psz, len) == 0)
+                    return row;
+            }
+            return -1;
+        }
     }
+    return 0;
 }
@@ -0,0 +1,151 @@
+//-----------------------------------------------------------------------------
+// This file is part of LDmicro.
+//
+// LDmicro is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// LDmicro is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with LDmicro.  If not, see <http://www.gnu.org/licenses/>.
+//------
+//
+// Cycle scheduler of the sample interpreters. The PLC cycles start on
+// absolute deadlines, start + n * period, of a monotonic clock, so the
+// execution time of a cycle doesn't add to the period and the timing doesn't
+// drift:
+//
+//     LdCycle c;
+//     LdCycleInit(&c, periodUs);
+//     while(...) {
+//         LdCycleWait(&c);   // sleep until the deadline
+//         InterpretOneCycle();
+//         LdCycleDone(&c);   // account the cycle, next deadline
+//     }
+//     LdCyclePrint(&c, stderr);
+//
+// A cycle that ends after the next deadline is an overrun; the deadlines
+// that it missed are skipped, not caught up with a burst of cycles. On
+// Linux the sleep is a clock_nanosleep(TIMER_ABSTIME) on CLOCK_MONOTONIC,
+// elsewhere a sleep_until() on the steady clock.
+//-----------------------------------------------------------------------------
+#ifndef __LDCYCLE_H
+#define __LDCYCLE_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <signal.h>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#ifdef __linux__
+#include <errno.h>
+#include <time.h>
+#endif
+
+typedef struct LdCycleTag {
+    int64_t period;   // ns
+    int64_t deadline; // ns, of the cycle running or waited for
+    int64_t started;  // ns, when the cycle running started
+
+    uint64_t cycles;
+    uint64_t overruns;
+    uint64_t skipped; // deadlines missed by the overruns
+    int64_t  minLatency, maxLatency, sumLatency; // ns from the deadline to the start
+    int64_t  minExec, maxExec, sumExec;          // ns from the start to the end
+} LdCycle;
+
+inline int64_t LdCycleNow()
+{
+#ifdef __linux__
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#else
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+inline void LdCycleInit(LdCycle *c, int64_t periodUs)
+{
+    memset(c, 0, sizeof(*c));
+    c->period = (periodUs > 0 ? periodUs : 1) * 1000;
+    c->deadline = LdCycleNow();
+    c->minLatency = INT64_MAX;
+    c->minExec = INT64_MAX;
+}
+
+// Sleep until the deadline of the next cycle.
+inline void LdCycleWait(LdCycle *c)
+{
+#ifdef __linux__
+    struct timespec ts;
+    ts.tv_sec = c->deadline / 1000000000;
+    ts.tv_nsec = c->deadline % 1000000000;
+    while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr) == EINTR)
+        ;
+#else
+    std::this_thread::sleep_until(std::chrono::steady_clock::time_point(std::chrono::nanoseconds(c->deadline)));
+#endif
+    c->started = LdCycleNow();
+    int64_t latency = c->started - c->deadline;
+    c->minLatency = std::min(c->minLatency, latency);
+    c->maxLatency = std::max(c->maxLatency, latency);
+    c->sumLatency += latency;
+}
+
+// The cycle is done: account it and move to the next deadline.
+inline void LdCycleDone(LdCycle *c)
+{
+    int64_t now = LdCycleNow();
+    int64_t exec = now - c->started;
+    c->minExec = std::min(c->minExec, exec);
+    c->maxExec = std::max(c->maxExec, exec);
+    c->sumExec += exec;
+    c->cycles++;
+
+    c->deadline += c->period;
+    if(now > c->deadline) {
+        int64_t missed = (now - c->deadline) / c->period + 1;
+        c->overruns++;
+        c->skipped += missed;
+        c->deadline += missed * c->period;
+    }
+}
+
+inline void LdCyclePrint(const LdCycle *c, FILE *f)
+{
+    if(c->cycles == 0) {
+        fprintf(f, "no cycle run\n");
+        return;
+    }
+    fprintf(f, "%llu cycles of %.3f ms, %llu overrun(s), %llu deadline(s) skipped\n", (unsigned long long)c->cycles, c->period / 1e6,
+            (unsigned long long)c->overruns, (unsigned long long)c->skipped);
+    fprintf(f, "latency   min %.1f us, avg %.1f us, max %.1f us\n", c->minLatency / 1e3, c->sumLatency / 1e3 / c->cycles, c->maxLatency / 1e3);
+    fprintf(f, "execution min %.1f us, avg %.1f us, max %.1f us\n", c->minExec / 1e3, c->sumExec / 1e3 / c->cycles, c->maxExec / 1e3);
+}
+
+//-----------------------------------------------------------------------------
+// SIGINT and SIGTERM ask the interpreter to stop after the cycle running and
+// print the statistics, SIGUSR1 (where there is one) to print them and go on.
+//-----------------------------------------------------------------------------
+static volatile sig_atomic_t LdCycleStop;
+static volatile sig_atomic_t LdCycleReport;
+
+inline void LdCycleSignals()
+{
+    auto stop = [](int) { LdCycleStop = 1; };
+    signal(SIGINT, stop);
+    signal(SIGTERM, stop);
+#ifdef SIGUSR1
+    signal(SIGUSR1, [](int) { LdCycleReport = 1; });
+#endif
+}
+
+#endif
@@ -0,0 +1,181 @@
+//-----------------------------------------------------------------------------
+// This file is part of LDmicro.
+//
+// LDmicro is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// LDmicro is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with LDmicro.  If not, see <http://www.gnu.org/licenses/>.
+//------
+//
+// Binary image of the interpretable code, written next to the .int and
+// .xint hex files as .intb and .xintb. An interpreter maps the file and
+// runs the ops where they are, without parsing anything:
+//
+//     LdImageHeader     at offset 0
+//     ops               at OpsOffset, OpsLength bytes: the BinOp records of
+//                       ldinterpret (LDIMAGE_INT) or the byte code of
+//                       ldxinterpret (LDIMAGE_XINT), INT_END_OF_PROGRAM last,
+//                       with OperandSize bytes per address and jump
+//     LdImageSymbol[]   at SymbolsOffset, name <-> address of every variable
+//     LdImageIo[]       at IoOffset, the I/O list of the program
+//
+// All sections start on an 8 byte boundary and all fields are little-endian.
+// Crc is the CRC-32 (IEEE 802.3) of the whole image but the Crc field itself.
+//-----------------------------------------------------------------------------
+#ifndef __LDIMAGE_H
+#define __LDIMAGE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#define LDIMAGE_MAGIC "LDIM"
+#define LDIMAGE_VERSION (2u)
+#define LDIMAGE_ALIGN (8u)
+#define LDIMAGE_NAME_LEN (64u)
+
+#define LDIMAGE_INT (1u)  // ops are BinOp records
+#define LDIMAGE_XINT (2u) // ops are byte code
+
+#define LDIMAGE_SYMBOL_BIT (1u)
+#define LDIMAGE_SYMBOL_INT (2u)
+#define LDIMAGE_SYMBOL_ANY (3u) // .xint has one address space for both
+
+#pragma pack(1)
+
+typedef struct LdImageHeaderTag {
+    uint8_t  Magic[4];
+    uint16_t Version;
+    uint16_t Kind;
+    uint32_t Crc;
+    uint32_t Length; // of the whole image
+    uint32_t CycleTime; // us
+    uint32_t OpsOffset;
+    uint32_t OpsLength;
+    uint32_t SymbolsOffset;
+    uint32_t SymbolsCount;
+    uint32_t IoOffset;
+    uint32_t IoCount;
+    uint32_t OperandSize; // bytes per BinOp field (2, 4) or per .xint operand (1, 2, 4)
+} LdImageHeader;
+
+typedef struct LdImageSymbolTag {
+    uint32_t Addr;
+    uint8_t  Type; // LDIMAGE_SYMBOL_xxx
+    uint8_t  Reserved[3];
+    char     Name[LDIMAGE_NAME_LEN];
+} LdImageSymbol;
+
+typedef struct LdImageIoTag {
+    uint32_t Addr; // in the Bits[]/Integers[] of the interpreter, or -1
+    uint8_t  Type; // IO_TYPE_xxx
+    uint8_t  Pin;  // Arduino pin number
+    uint8_t  ModbusSlave;
+    uint8_t  Reserved;
+    uint16_t ModbusAddress;
+    uint16_t Reserved2;
+    char     Name[LDIMAGE_NAME_LEN];
+} LdImageIo;
+
+#pragma pack()
+
+// The CRC of length bytes at data, going on from crc, that of the bytes before.
+inline uint32_t LdImageCrc(const uint8_t *data, size_t length, uint32_t crc = 0)
+{
+    crc = ~crc;
+    while(length--) {
+        crc ^= *data++;
+        for(int i = 0; i < 8; i++)
+            crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+    }
+    return ~crc;
+}
+
+// The Crc of an image of length bytes: the header before and after Crc, and
+// the rest.
+inline uint32_t LdImageCrcOf(const uint8_t *image, uint32_t length)
+{
+    const size_t after = offsetof(LdImageHeader, Crc) + sizeof(uint32_t);
+    return LdImageCrc(image + after, length - after, LdImageCrc(image, offsetof(LdImageHeader, Crc)));
+}
+
+// Check the header and the section bounds of an image of size bytes.
+// Returns nullptr if it's fine, the reason otherwise.
+inline const char *LdImageCheck(const uint8_t *image, size_t size, uint16_t kind)
+{
+    const LdImageHeader *h = (const LdImageHeader *)image;
+    if((size < sizeof(LdImageHeader)) || (memcmp(h->Magic, LDIMAGE_MAGIC, 4) != 0))
+        return "not an LDmicro image";
+    if(h->Version != LDIMAGE_VERSION)
+        return "unsupported image version";
+    if(h->Kind != kind)
+        return "image is for the other interpreter";
+    if((h->OperandSize != 1) && (h->OperandSize != 2) && (h->OperandSize != 4))
+        return "unsupported operand size";
+    if((h->Length > size) || (h->Length < sizeof(LdImageHeader)))
+        return "truncated image";
+    if((h->OpsOffset % LDIMAGE_ALIGN) || (h->SymbolsOffset % LDIMAGE_ALIGN) || (h->IoOffset % LDIMAGE_ALIGN))
+        return "misaligned section";
+    if((h->OpsOffset > h->Length) || (h->OpsLength > h->Length - h->OpsOffset) || (h->OpsLength == 0)
+       || (h->SymbolsOffset > h->Length) || (h->SymbolsCount > (h->Length - h->SymbolsOffset) / sizeof(LdImageSymbol))
+       || (h->IoOffset > h->Length) || (h->IoCount > (h->Length - h->IoOffset) / sizeof(LdImageIo)))
+        return "bad section bounds";
+    if(h->Crc != LdImageCrcOf(image, h->Length))
+        return "CRC mismatch";
+    return nullptr;
+}
+
+#if defined(LDIMAGE_H_MAP)
+// Map fileName read-only into memory; the interpreters run the ops in
+// place. Returns nullptr if the file can't be opened or mapped.
+#ifdef _WIN32
+inline const uint8_t *LdImageMap(const char *fileName, size_t *size)
+{
+    HANDLE file = CreateFileA(fileName, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if(file == INVALID_HANDLE_VALUE)
+        return nullptr;
+    *size = GetFileSize(file, nullptr);
+    HANDLE mapping = (*size > 0) ? CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr) : nullptr;
+    CloseHandle(file);
+    if(!mapping)
+        return nullptr;
+    const void *view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(mapping); // the view keeps the mapping alive
+    return (const uint8_t *)view;
+}
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+inline const uint8_t *LdImageMap(const char *fileName, size_t *size)
+{
+    int fd = open(fileName, O_RDONLY);
+    if(fd < 0)
+        return nullptr;
+    struct stat st;
+    void *      view = MAP_FAILED;
+    if((fstat(fd, &st) == 0) && (st.st_size > 0)) {
+        *size = (size_t)st.st_size;
+        view = mmap(nullptr, *size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+    return (view == MAP_FAILED) ? nullptr : (const uint8_t *)view;
+}
+#endif
+#endif
+
+// interpreted.cpp
+bool WriteLdImage(const char *fileName, uint16_t kind, uint32_t operandSize, const void *ops, uint32_t opsLength, const LdImageSymbol *symbols, uint32_t symbolsCount,
+                  const LdImageIo *io, uint32_t ioCount);
+
+#endif
@@ -35,18 +35,23 @@
 // Jonathan Westhues, Aug 2005
 //-----------------------------------------------------------------------------
 #include "stdafx.h"
+#include <chrono>
 
 #define INTCODE_H_CONSTANTS_ONLY
 #include "intcode.h"
+#define LDIMAGE_H_MAP
+#include "ldimage.h"
+#include "ldcycle.h"
+
+// The direct-threaded core needs the labels-as-values extension of GCC and
+// Clang. Build with -DSWITCH_DISPATCH to run the switch() reference core.
+#if defined(__GNUC__) && !defined(SWITCH_DISPATCH)
+#define THREADED_DISPATCH
+#endif
 
 typedef unsigned char  BYTE; // 8-bit unsigned
 typedef unsigned short WORD; // 16-bit unsigned
 
-// Some arbitrary limits on the program and data size
-#define MAX_OPS 256
-#define MAX_VARIABLES 128
-#define MAX_INTERNAL_RELAYS 128
-
 // This data structure represents a single instruction for the 'virtual
 // machine.' The .op field gives the opcode, and the other fields give
 // arguments. I have defined all of these as 16-bit fields for generality,
@@ -63,6 +68,12 @@ typedef unsigned short WORD; // 16-bit unsigned
 // and also to pick out the name <-> address mappings for those variables
 // that you're going to use for your interface out. I will therefore leave
 // that up to you.
+//
+// Programs with more than 32767 ops, variables or relays, or with literals
+// that don't fit 16 bits, come with 32-bit fields instead (BinOpWide); the
+// line length of the .int file, or OperandSize of a .intb image, tells.
+// The program and the data are sized when the program is loaded, there are
+// no fixed limits.
 typedef struct {
     int16_t op;
     int16_t name1;
@@ -71,13 +82,23 @@ typedef struct {
     int16_t literal1;
 } BinOp;
 
-
-BinOp   Program[MAX_OPS];
-int32_t Integers[MAX_VARIABLES];
-BYTE    Bits[MAX_INTERNAL_RELAYS];
-
-// This is the requested cycle time, the hardware will do it's best to run with this timing but NO guarantee is given.
-int CycleTime = 10;
+typedef struct {
+    int32_t op;
+    int32_t name1;
+    int32_t name2;
+    int32_t name3;
+    int32_t literal1;
+} BinOpWide;
+
+std::vector<BYTE>    ProgramBuffer;  // the ops read from a .int file
+const void *         Program;        // BinOp or BinOpWide records, in ProgramBuffer or a mapped .intb image
+bool                 WideOps;        // Program holds BinOpWide records
+int                  ProgramLength;  // ops, up to and including INT_END_OF_PROGRAM
+std::vector<int32_t> Integers;
+std::vector<BYTE>    Bits;
+
+// This is the requested cycle time (us), the hardware will do it's best to run with this timing but NO guarantee is given.
+int CycleTime = 10000;
 
 // this is implementation specific. Every target will use a custom association of IO register to real register
 // in this example:
@@ -126,12 +147,176 @@ int HexDigit(int c)
     }
     return 0;
 }
+//-----------------------------------------------------------------------------
+// The operands of an op that the cores run: how many of name1, name2 and
+// name3 are addresses and if name3 is a jump instead. Returns false for an
+// op that they don't run.
+//-----------------------------------------------------------------------------
+static bool OpNames(int32_t op, int *names, bool *jump)
+{
+    *jump = false;
+    switch(op) {
+        case INT_END_OF_PROGRAM:
+        case INT_AllocFwdAddr:
+        case INT_AllocKnownAddr:
+        case INT_FwdAddrIsNow:
+            *names = 0;
+            return true;
+        case INT_SET_BIT:
+        case INT_CLEAR_BIT:
+        case INT_SET_VARIABLE_TO_LITERAL:
+        case INT_DECREMENT_VARIABLE:
+        case INT_INCREMENT_VARIABLE:
+            *names = 1;
+            return true;
+        case INT_COPY_BIT_TO_BIT:
+        case INT_COPY_INVERTED_BIT:
+        case INT_IF_BIT_SET_THEN_SET_BIT:
+        case INT_IF_BIT_SET_THEN_CLEAR_BIT:
+        case INT_IF_BIT_CLEAR_THEN_SET_BIT:
+        case INT_IF_BIT_CLEAR_THEN_CLEAR_BIT:
+        case INT_SET_VARIABLE_TO_VARIABLE:
+        case INT_SET_VARIABLE_NEG:
+            *names = 2;
+            return true;
+        case INT_COPY_BIT_TO_TWO_BITS:
+        case INT_SET_VARIABLE_ADD:
+        case INT_SET_VARIABLE_SUBTRACT:
+        case INT_SET_VARIABLE_MULTIPLY:
+        case INT_SET_VARIABLE_DIVIDE:
+        case INT_SET_VARIABLE_MOD:
+            *names = 3;
+            return true;
+        case INT_IF_BIT_SET:
+        case INT_IF_BIT_CLEAR:
+        case INT_IF_VARIABLE_LES_LITERAL:
+            *names = 1;
+            *jump = true;
+            return true;
+        case INT_IF_VARIABLE_GEQ_VARIABLE:
+        case INT_IF_VARIABLE_LEQ_VARIABLE:
+        case INT_IF_VARIABLE_NEQ_VARIABLE:
+        case INT_IF_VARIABLE_EQU_VARIABLE:
+        case INT_IF_VARIABLE_GRT_VARIABLE:
+            *names = 2;
+            *jump = true;
+            return true;
+        case INT_ELSE:
+            *names = 0;
+            *jump = true;
+            return true;
+        default:
+            return false;
+    }
+}
+
+//-----------------------------------------------------------------------------
+// Verify the n ops loaded, once, so that the cores can run them without a
+// single check of their own: every op must be one that they run and the
+// program must end in INT_END_OF_PROGRAM; no address may be negative, nor
+// more than the three per op that a program can use at most; every jump must
+// go forward, to the end at the farthest, so that a cycle neither loops nor
+// leaves the program. Sizes Integers[] and Bits[] for the highest address
+// used. Returns nullptr if the program is fine, the reason otherwise.
+//-----------------------------------------------------------------------------
+template <typename Op> static const char *VerifyProgram(const Op *Program, int n)
+{
+    for(ProgramLength = 0; ProgramLength < n; ProgramLength++) {
+        if(Program[ProgramLength].op == INT_END_OF_PROGRAM)
+            break;
+    }
+    if(ProgramLength == n)
+        return "no end of program";
+    int end = ProgramLength++;
+
+    int64_t top = 0;
+    for(int pc = 0; pc < end; pc++) {
+        const Op *p = &Program[pc];
+        int       names;
+        bool      jump;
+        if(!OpNames(p->op, &names, &jump))
+            return "unsupported op";
+        int32_t name[3] = {p->name1, p->name2, p->name3};
+        for(int k = 0; k < names; k++) {
+            if((name[k] < 0) || (name[k] >= 3 * (int64_t)ProgramLength))
+                return "address out of range";
+            top = std::max(top, (int64_t)name[k]);
+        }
+        // the cores go on at name3 + 1
+        if(jump && ((p->name3 < pc) || (p->name3 >= end)))
+            return "bad jump target";
+    }
+    Integers.assign(top + 1, 0);
+    Bits.assign(top + 1, 0);
+    return nullptr;
+}
+
+static void VerifyProgram(const char *fileName, int n)
+{
+    const char *err = WideOps ? VerifyProgram((const BinOpWide *)Program, n) : VerifyProgram((const BinOp *)Program, n);
+    if(err) {
+        fprintf(stderr, "'%s': %s\n", fileName, err);
+        exit(-1);
+    }
+}
+
+//-----------------------------------------------------------------------------
+// A binary .intb image (see ldimage.h) needs no parsing: map it and run the
+// ops where they are. Returns false if fileName is not an image, so that it
+// can be loaded as hex.
+//-----------------------------------------------------------------------------
+bool LoadImage(char *fileName)
+{
+    char  magic[4] = {0};
+    FILE *f = fopen(fileName, "rb");
+    if(!f)
+        return false;
+    size_t n = fread(magic, 1, sizeof(magic), f);
+    fclose(f);
+    if((n != sizeof(magic)) || (memcmp(magic, LDIMAGE_MAGIC, sizeof(magic)) != 0))
+        return false;
+
+    size_t         size = 0;
+    const uint8_t *image = LdImageMap(fileName, &size);
+    if(!image) {
+        fprintf(stderr, "couldn't map '%s'\n", fileName);
+        exit(-1);
+    }
+    if(const char *err = LdImageCheck(image, size, LDIMAGE_INT)) {
+        fprintf(stderr, "'%s': %s\n", fileName, err);
+        exit(-1);
+    }
+    const LdImageHeader *h = (const LdImageHeader *)image;
+    size_t               opSize = (h->OperandSize == 4) ? sizeof(BinOpWide) : sizeof(BinOp);
+    if((h->OperandSize == 1) || (h->OpsLength % opSize))
+        BadFormat();
+    Program = image + h->OpsOffset;
+    WideOps = (h->OperandSize == 4);
+    VerifyProgram(fileName, h->OpsLength / opSize);
+
+    const LdImageSymbol *symbols = (const LdImageSymbol *)(image + h->SymbolsOffset);
+    for(uint32_t i = 0; i < h->SymbolsCount; i++) {
+        int reg = atoi(symbols[i].Name + 1);
+        if((symbols[i].Type == LDIMAGE_SYMBOL_BIT) && (symbols[i].Name[0] == 'X') && (reg >= 0) && (reg < MAX_INPUT) && (symbols[i].Addr < Bits.size())) {
+            InputMap[reg].addr = symbols[i].Addr;
+        }
+    }
+    CycleTime = h->CycleTime;
+    return true;
+}
+
 void LoadProgram(char *fileName)
 {
+    if(LoadImage(fileName))
+        return;
+    ProgramBuffer.clear();
+    WideOps = false;
+
     FILE *f = fopen(fileName, "r");
     char  line[80];
 
-    // This is not suitable for untrusted input.
+    // Nothing is trusted: VerifyProgram() checks the whole program before
+    // it runs.
 
     if(!f) {
         fprintf(stderr, "couldn't open '%s'\n", fileName);
@@ -143,8 +328,10 @@ void LoadProgram(char *fileName)
     if(strcmp(line, "$$LDcode\n") != 0)
         BadFormat();
 
+    int n = 0;
     for(int pc = 0;; pc++) {
-        char *t, i;
+        char *t;
+        int   i;
         BYTE *b;
 
         if(!fgets(line, sizeof(line), f))
@@ -156,17 +343,25 @@ void LoadProgram(char *fileName)
         if(strcmp(line, "$$cycle\n") == 0)
             break;
 
-        if(strlen(line) != sizeof(BinOp) * 2 + 1)
+        // the first op tells the width of all of them
+        if(pc == 0)
+            WideOps = (strlen(line) == sizeof(BinOpWide) * 2 + 1);
+        size_t opSize = WideOps ? sizeof(BinOpWide) : sizeof(BinOp);
+        if(strlen(line) != opSize * 2 + 1)
             BadFormat();
 
         t = line;
-        b = (BYTE *)&Program[pc];
+        ProgramBuffer.resize((pc + 1) * opSize);
+        b = &ProgramBuffer[pc * opSize];
 
-        for(i = 0; i < sizeof(BinOp); i++) {
+        for(i = 0; i < (int)opSize; i++) {
             b[i] = HexDigit(t[1]) | (HexDigit(t[0]) << 4);
             t += 2;
         }
+        n = pc + 1;
     }
+    Program = ProgramBuffer.data();
+    VerifyProgram(fileName, n);
 
     // end of LDcode, now parse variables and find X, Y, A
     char *p;
@@ -180,7 +375,7 @@ void LoadProgram(char *fileName)
             *p = 0;
             reg = atoi(line + 1);
             addr = atoi(p + 1);
-            if(reg < MAX_INPUT) {
+            if((reg >= 0) && (reg < MAX_INPUT) && (addr >= 0) && (addr < (int)Bits.size())) {
                 InputMap[reg].addr = addr;
             }
         }
@@ -206,12 +401,12 @@ void LoadProgram(char *fileName)
 // integer variables; I refer to those as bits[addr] and int16s[addr]
 // respectively.
 //-----------------------------------------------------------------------------
-void Disassemble()
+template <typename Op> static void Disassemble(const Op *Program)
 {
     char bad_codes = 0;
     char c;
     for(int pc = 0;; pc++) {
-        BinOp *p = &Program[pc];
+        const Op *p = &Program[pc];
         printf("%03d: ", pc);
 
         switch(Program[pc].op) {
@@ -227,6 +422,30 @@ void Disassemble()
                 printf("bits[%03d] := bits[%03d]", p->name1, p->name2);
                 break;
 
+            case INT_COPY_INVERTED_BIT:
+                printf("bits[%03d] := !bits[%03d]", p->name1, p->name2);
+                break;
+
+            case INT_COPY_BIT_TO_TWO_BITS:
+                printf("bits[%03d] := bits[%03d] := bits[%03d]", p->name1, p->name3, p->name2);
+                break;
+
+            case INT_IF_BIT_SET_THEN_SET_BIT:
+                printf("if (bits[%03d] set) bits[%03d] := 1", p->name1, p->name2);
+                break;
+
+            case INT_IF_BIT_SET_THEN_CLEAR_BIT:
+                printf("if (bits[%03d] set) bits[%03d] := 0", p->name1, p->name2);
+                break;
+
+            case INT_IF_BIT_CLEAR_THEN_SET_BIT:
+                printf("if (bits[%03d] clear) bits[%03d] := 1", p->name1, p->name2);
+                break;
+
+            case INT_IF_BIT_CLEAR_THEN_CLEAR_BIT:
+                printf("if (bits[%03d] clear) bits[%03d] := 0", p->name1, p->name2);
+                break;
+
             case INT_SET_VARIABLE_TO_LITERAL:
                 printf("int16s[%03d] := %d (0x%04x)", p->name1, p->literal1, p->literal1);
                 break;
@@ -352,10 +571,10 @@ void Disassemble()
 // The execution time of this function depends mostly on the length of the
 // program. It will be a little bit data-dependent but not very.
 //-----------------------------------------------------------------------------
-void InterpretOneCycle()
+template <typename Op> static void InterpretOneCycle(const Op *Program)
 {
     for(int pc = 0;; pc++) {
-        BinOp *p = &Program[pc];
+        const Op *p = &Program[pc];
 
         switch(Program[pc].op) {
             case INT_SET_BIT:
@@ -370,6 +589,35 @@ void InterpretOneCycle()
                 Bits[p->name1] = Bits[p->name2];
                 break;
 
+            case INT_COPY_INVERTED_BIT:
+                Bits[p->name1] = !Bits[p->name2];
+                break;
+
+            case INT_COPY_BIT_TO_TWO_BITS:
+                Bits[p->name1] = Bits[p->name2];
+                Bits[p->name3] = Bits[p->name2];
+                break;
+
+            case INT_IF_BIT_SET_THEN_SET_BIT:
+                if(Bits[p->name1])
+                    Bits[p->name2] = 1;
+                break;
+
+            case INT_IF_BIT_SET_THEN_CLEAR_BIT:
+                if(Bits[p->name1])
+                    Bits[p->name2] = 0;
+                break;
+
+            case INT_IF_BIT_CLEAR_THEN_SET_BIT:
+                if(!Bits[p->name1])
+                    Bits[p->name2] = 1;
+                break;
+
+            case INT_IF_BIT_CLEAR_THEN_CLEAR_BIT:
+                if(!Bits[p->name1])
+                    Bits[p->name2] = 0;
+                break;
+
             case INT_SET_VARIABLE_TO_LITERAL:
                 Integers[p->name1] = p->literal1;
                 break;
@@ -440,6 +688,7 @@ void InterpretOneCycle()
             case INT_IF_VARIABLE_NEQ_VARIABLE:
                 if(!(Integers[p->name1] != Integers[p->name2]))
                     pc = p->name3;
+                break;
 
             case INT_IF_VARIABLE_EQU_VARIABLE:
                 if(!(Integers[p->name1] == Integers[p->name2]))
@@ -471,6 +720,248 @@ void InterpretOneCycle()
     }
 }
 
+void Disassemble()
+{
+    WideOps ? Disassemble((const BinOpWide *)Program) : Disassemble((const BinOp *)Program);
+}
+
+void InterpretOneCycle()
+{
+    WideOps ? InterpretOneCycle((const BinOpWide *)Program) : InterpretOneCycle((const BinOp *)Program);
+}
+
+#ifdef THREADED_DISPATCH
+//-----------------------------------------------------------------------------
+// The same virtual machine with direct-threaded dispatch. Predecode() turns
+// Program[] into ThreadedProgram[] once after loading: every op holds the
+// address of its handler and every jump a pointer to its target op, so each
+// handler ends in its own indirect jump instead of all ops sharing the one
+// indirect branch of the switch.
+//-----------------------------------------------------------------------------
+typedef struct ThreadedOpTag {
+    const void *          handler;
+    struct ThreadedOpTag *target;
+    int32_t               op;
+    int32_t               name1;
+    int32_t               name2;
+    int32_t               name3;
+    int32_t               literal1;
+} ThreadedOp;
+
+std::vector<ThreadedOp> ThreadedProgram;
+
+// The handler addresses are those of one instantiation, so the program must
+// be predecoded and run by the same one.
+template <typename Op> static void RunThreaded(const Op *Program, bool predecode)
+{
+    if(predecode) {
+        ThreadedProgram.resize(ProgramLength);
+        for(int pc = 0; pc < ProgramLength; pc++) {
+            const Op *  p = &Program[pc];
+            ThreadedOp *t = &ThreadedProgram[pc];
+            t->op = p->op;
+            t->name1 = p->name1;
+            t->name2 = p->name2;
+            t->name3 = p->name3;
+            t->literal1 = p->literal1;
+            // VerifyProgram() checked that every jump lands in the program
+            int  names;
+            bool jump;
+            OpNames(p->op, &names, &jump);
+            t->target = jump ? &ThreadedProgram[p->name3 + 1] : nullptr;
+            switch(p->op) {
+                // clang-format off
+                case INT_SET_BIT:                     t->handler = &&set_bit; break;
+                case INT_CLEAR_BIT:                   t->handler = &&clear_bit; break;
+                case INT_COPY_BIT_TO_BIT:             t->handler = &&copy_bit; break;
+                case INT_COPY_INVERTED_BIT:           t->handler = &&copy_inverted_bit; break;
+                case INT_COPY_BIT_TO_TWO_BITS:        t->handler = &&copy_bit_to_two; break;
+                case INT_IF_BIT_SET_THEN_SET_BIT:     t->handler = &&if_set_then_set; break;
+                case INT_IF_BIT_SET_THEN_CLEAR_BIT:   t->handler = &&if_set_then_clear; break;
+                case INT_IF_BIT_CLEAR_THEN_SET_BIT:   t->handler = &&if_clear_then_set; break;
+                case INT_IF_BIT_CLEAR_THEN_CLEAR_BIT: t->handler = &&if_clear_then_clear; break;
+                case INT_SET_VARIABLE_TO_LITERAL:     t->handler = &&set_literal; break;
+                case INT_SET_VARIABLE_TO_VARIABLE:    t->handler = &&set_variable; break;
+                case INT_DECREMENT_VARIABLE:          t->handler = &&decrement; break;
+                case INT_INCREMENT_VARIABLE:          t->handler = &&increment; break;
+                case INT_SET_VARIABLE_ADD:            t->handler = &&add; break;
+                case INT_SET_VARIABLE_SUBTRACT:       t->handler = &&subtract; break;
+                case INT_SET_VARIABLE_MULTIPLY:       t->handler = &&multiply; break;
+                case INT_SET_VARIABLE_DIVIDE:         t->handler = &&divide; break;
+                case INT_SET_VARIABLE_MOD:            t->handler = &&mod; break;
+                case INT_SET_VARIABLE_NEG:            t->handler = &&neg; break;
+                case INT_IF_BIT_SET:                  t->handler = &&if_bit_set; break;
+                case INT_IF_BIT_CLEAR:                t->handler = &&if_bit_clear; break;
+                case INT_IF_VARIABLE_LES_LITERAL:     t->handler = &&if_les_literal; break;
+                case INT_IF_VARIABLE_GEQ_VARIABLE:    t->handler = &&if_geq; break;
+                case INT_IF_VARIABLE_LEQ_VARIABLE:    t->handler = &&if_leq; break;
+                case INT_IF_VARIABLE_NEQ_VARIABLE:    t->handler = &&if_neq; break;
+                case INT_IF_VARIABLE_EQU_VARIABLE:    t->handler = &&if_equ; break;
+                case INT_IF_VARIABLE_GRT_VARIABLE:    t->handler = &&if_grt; break;
+                case INT_ELSE:                        t->handler = &&jump; break;
+                case INT_AllocFwdAddr:
+                case INT_AllocKnownAddr:
+                case INT_FwdAddrIsNow:                t->handler = &&nop; break;
+                case INT_END_OF_PROGRAM:              t->handler = &&end; return;
+                default:                              t->handler = &&unsupported; break;
+                // clang-format on
+            }
+        }
+        return;
+    }
+
+#define DISPATCH() goto *t->handler
+#define NEXT() \
+    do {       \
+        t++;   \
+        DISPATCH(); \
+    } while(0)
+#define JUMP_UNLESS(cond) \
+    do {                  \
+        if(!(cond)) {     \
+            t = t->target; \
+            DISPATCH();   \
+        }                 \
+        NEXT();           \
+    } while(0)
+
+    ThreadedOp *t = ThreadedProgram.data();
+    DISPATCH();
+
+set_bit:
+    Bits[t->name1] = 1;
+    NEXT();
+clear_bit:
+    Bits[t->name1] = 0;
+    NEXT();
+copy_bit:
+    Bits[t->name1] = Bits[t->name2];
+    NEXT();
+copy_inverted_bit:
+    Bits[t->name1] = !Bits[t->name2];
+    NEXT();
+copy_bit_to_two:
+    Bits[t->name1] = Bits[t->name2];
+    Bits[t->name3] = Bits[t->name2];
+    NEXT();
+if_set_then_set:
+    if(Bits[t->name1])
+        Bits[t->name2] = 1;
+    NEXT();
+if_set_then_clear:
+    if(Bits[t->name1])
+        Bits[t->name2] = 0;
+    NEXT();
+if_clear_then_set:
+    if(!Bits[t->name1])
+        Bits[t->name2] = 1;
+    NEXT();
+if_clear_then_clear:
+    if(!Bits[t->name1])
+        Bits[t->name2] = 0;
+    NEXT();
+set_literal:
+    Integers[t->name1] = t->literal1;
+    NEXT();
+set_variable:
+    Integers[t->name1] = Integers[t->name2];
+    NEXT();
+decrement:
+    (Integers[t->name1])--;
+    NEXT();
+increment:
+    (Integers[t->name1])++;
+    NEXT();
+add:
+    Integers[t->name1] = Integers[t->name2] + Integers[t->name3];
+    NEXT();
+subtract:
+    Integers[t->name1] = Integers[t->name2] - Integers[t->name3];
+    NEXT();
+multiply:
+    Integers[t->name1] = Integers[t->name2] * Integers[t->name3];
+    NEXT();
+divide:
+    if(Integers[t->name3] != 0)
+        Integers[t->name1] = Integers[t->name2] / Integers[t->name3];
+    NEXT();
+mod:
+    if(Integers[t->name3] != 0)
+        Integers[t->name1] = Integers[t->name2] % Integers[t->name3];
+    NEXT();
+neg:
+    Integers[t->name1] = -Integers[t->name2];
+    NEXT();
+if_bit_set:
+    JUMP_UNLESS(Bits[t->name1]);
+if_bit_clear:
+    JUMP_UNLESS(!Bits[t->name1]);
+if_les_literal:
+    JUMP_UNLESS(Integers[t->name1] < t->literal1);
+if_geq:
+    JUMP_UNLESS(Integers[t->name1] >= Integers[t->name2]);
+if_leq:
+    JUMP_UNLESS(Integers[t->name1] <= Integers[t->name2]);
+if_neq:
+    JUMP_UNLESS(Integers[t->name1] != Integers[t->name2]);
+if_equ:
+    JUMP_UNLESS(Integers[t->name1] == Integers[t->name2]);
+if_grt:
+    JUMP_UNLESS(Integers[t->name1] > Integers[t->name2]);
+jump:
+    t = t->target;
+    DISPATCH();
+nop:
+    NEXT();
+unsupported:
+    printf("Unsupported op (Peripheral) for interpretable target. INT_%d", t->op);
+    NEXT();
+end:
+    return;
+
+#undef DISPATCH
+#undef NEXT
+#undef JUMP_UNLESS
+}
+
+void Predecode()
+{
+    WideOps ? RunThreaded((const BinOpWide *)Program, true) : RunThreaded((const BinOp *)Program, true);
+}
+
+void InterpretOneCycleThreaded()
+{
+    WideOps ? RunThreaded((const BinOpWide *)Program, false) : RunThreaded((const BinOp *)Program, false);
+}
+#endif
+
+//-----------------------------------------------------------------------------
+// Run one core for the given number of cycles from a cleared state and print
+// the time per cycle and per op of the program.
+//-----------------------------------------------------------------------------
+static void BenchmarkCore(const char *name, void (*cycle)(), long cycles)
+{
+    int ops = ProgramLength - 1;
+
+    std::fill(Integers.begin(), Integers.end(), 0);
+    std::fill(Bits.begin(), Bits.end(), 0);
+
+    auto start = std::chrono::steady_clock::now();
+    for(long i = 0; i < cycles; i++)
+        cycle();
+    double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+
+    printf("%-8s %ld cycles, %.1f ns/cycle, %.2f ns/op (%d ops)\n", name, cycles, ns / cycles, ns / cycles / (ops ? ops : 1), ops);
+}
+
+void Benchmark(long cycles)
+{
+    BenchmarkCore("switch", InterpretOneCycle, cycles);
+#ifdef THREADED_DISPATCH
+    BenchmarkCore("threaded", InterpretOneCycleThreaded, cycles);
+#endif
+}
+
 void ReadInputs(void)
 {
 
@@ -483,24 +974,55 @@ void WriteOutputs(void)
 
 int main(int argc, char **argv)
 {
+    if((argc == 4) && (strcmp(argv[1], "-b") == 0)) {
+        // ldinterpret -b cycles xxx.int: compare the interpreter cores
+        LoadProgram(argv[3]);
+#ifdef THREADED_DISPATCH
+        Predecode();
+#endif
+        Benchmark(atol(argv[2]));
+        return 0;
+    }
+
+    // ldinterpret [-n cycles] xxx.int: run the program the given number of
+    // cycles, by default until SIGINT or SIGTERM
+    long cycles = 0;
+    if((argc == 4) && (strcmp(argv[1], "-n") == 0)) {
+        cycles = atol(argv[2]);
+        argv += 2;
+        argc -= 2;
+    }
     if(argc != 2) {
-//        fprintf(stderr, "usage: %s xxx.int\n", argv[0]);
+//        fprintf(stderr, "usage: %s [-n cycles] xxx.int\n", argv[0]);
 //        return -1;
         LoadProgram("coil_s_r_n.int");
     } else {
         LoadProgram(argv[1]);
     }
 
-    memset(Integers, 0, sizeof(Integers));
-    memset(Bits, 0, sizeof(Bits));
+    std::fill(Integers.begin(), Integers.end(), 0);
+    std::fill(Bits.begin(), Bits.end(), 0);
 
     Disassemble();
-    // 1000 cycles times 10 ms gives 10 seconds execution
-    for(int i = 0; i < 10; i++) {
+#ifdef THREADED_DISPATCH
+    Predecode();
+#endif
+    // The cycles start every CycleTime us, however long they take; the
+    // statistics of the timing go to stderr at the end and on SIGUSR1.
+    LdCycle c;
+    LdCycleSignals();
+    LdCycleInit(&c, CycleTime);
+    for(long i = 0; ((cycles == 0) || (i < cycles)) && !LdCycleStop; i++) {
+        LdCycleWait(&c);
+
         // function to read the phisical inputs and update the variables
         ReadInputs();
 
+#ifdef THREADED_DISPATCH
+        InterpretOneCycleThreaded();
+#else
         InterpretOneCycle();
+#endif
 
         // function to write the outputs with values from the variables
         WriteOutputs();
@@ -508,10 +1030,13 @@ int main(int argc, char **argv)
         // Example for reaching in and reading a variable: just print it.
         //printf("a = %d              \r", Integers[SpecialAddrForA]);
 
-        // XXX, nonportable; replace with whatever timing functions are
-        // available on your target.
-        Sleep(CycleTime/1000);
+        LdCycleDone(&c);
+        if(LdCycleReport) {
+            LdCycleReport = 0;
+            LdCyclePrint(&c, stderr);
+        }
     }
+    LdCyclePrint(&c, stderr);
 
     return 0;
 }
@@ -0,0 +1,59 @@
+#!/usr/bin/perl
+#
+# Micro-benchmark of the interpreter cores: compiles every sample program
+# (or the .ld files given on the command line) to .int and .xint and runs
+# 'ldinterpret -b' and 'ldxinterpret -b', which print ns/op for the switch()
+# and the direct-threaded core.
+#
+# usage: perl bench.pl [-n cycles] [file.ld ...]
+# Run it from the build directory of ldinterpret/CMakeLists.txt; LDMICRO
+# and the path to the sample directory can be overridden from the environment.
+
+$cycles = 100000;
+if ($ARGV[0] eq '-n') {
+    shift @ARGV;
+    $cycles = shift @ARGV;
+}
+
+$ldmicro = $ENV{'LDMICRO'} || '../../ldmicro.exe';
+$samples = $ENV{'SAMPLES'} || '../../sample';
+@tests = @ARGV ? @ARGV : <$samples/*.ld>;
+
+if (not -d 'bench/') {
+    mkdir 'bench';
+}
+
+$c = 0;
+for $test (@tests) {
+    ($name = $test) =~ s/^.*[\/\\]//;
+    $name =~ s/\.ld$//;
+
+    for $target (['MNU_COMPILE_INT', 'int', './ldinterpret'], ['MNU_COMPILE_XINT', 'xint', './ldxinterpret']) {
+        ($mnu, $ext, $interp) = @$target;
+
+        # Drop the MCU and select the interpretable target, so that every
+        # sample compiles whatever it was written for.
+        open(IN, "<$test") or next;
+        open(OUT, ">bench/$name.ld") or die "couldn't write bench/$name.ld";
+        while (<IN>) {
+            next if /^MICRO=/ or /^COMPILER=/;
+            print OUT "COMPILER=$mnu\n" if /^PROGRAM/;
+            print OUT;
+        }
+        close(IN);
+        close(OUT);
+
+        $output = "bench/$name.$ext";
+        unlink $output;
+        system "$ldmicro /c bench/$name.ld $output";
+        if (not -s $output) {
+            print "$name.$ext: skipped, not interpretable\n";
+            next;
+        }
+
+        print "$name.$ext:\n";
+        print `$interp -b $cycles $output`;
+        $c++;
+    }
+}
+print "($c program(s), $cycles cycles each)\n";
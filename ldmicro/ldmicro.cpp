@@ -1061,6 +1061,8 @@ static void OpenDialog()
 void ProgramChanged()
 {
     ProgramChangedNotSaved = true;
+    ForgetSelectedRungLayout();
+    UndoSelectedRungChanged();
     GenerateIoListDontLoseSelection();
     RefreshScrollbars();
 }
@@ -1794,6 +1796,20 @@ static void ProcessMenu(int code)
             CHANGING_PROGRAM(ShowPullUpDialog());
             break;
 
+        case MNU_OPTIMIZE_SPEED:
+            CHANGING_PROGRAM(Prog.optimize = (Prog.optimize == OPTIMIZE_SPEED) ? OPTIMIZE_DEFAULT : OPTIMIZE_SPEED);
+            break;
+
+        case MNU_BINARY_IMAGE:
+            WriteBinaryImage = !WriteBinaryImage;
+            RefreshControlsToSettings();
+            break;
+
+        case MNU_CACHE_PROJECTS:
+            CacheBigProjects = !CacheBigProjects;
+            RefreshControlsToSettings();
+            break;
+
         case MNU_SIMULATION_MODE:
             ToggleSimulationMode();
             break;
@@ -2743,7 +2759,7 @@ LRESULT CALLBACK MainWndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam)
         case WM_NOTIFY: {
             NMHDR *h = (NMHDR *)lParam;
             if(h->hwndFrom == IoList) {
-                IoListProc(h);
+                return IoListProc(h);
             }
             return 0;
         }
@@ -3049,6 +3065,8 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine
         ThawWindowPos(MainWindow);
         IoListHeight = 100;
         ThawDWORD(IoListHeight);
+        ThawDWORD(WriteBinaryImage);
+        ThawDWORD(CacheBigProjects);
 
         InitCommonControls();
         InitForDrawing();
@@ -3064,10 +3082,44 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine
         while(isspace(*lpCmdLine)) {
             lpCmdLine++;
         }
+        // /Os or /O2 before /c overrides the optimization saved in the .ld file.
+        int optimize = -1;
+        if((memcmp(lpCmdLine, "/Os", 3) == 0) || (memcmp(lpCmdLine, "/O2", 3) == 0)) {
+            optimize = (lpCmdLine[2] == 's') ? OPTIMIZE_SIZE : OPTIMIZE_SPEED;
+            lpCmdLine += 3;
+            while(isspace(*lpCmdLine)) {
+                lpCmdLine++;
+            }
+        }
+        // /b before /c also writes the PlcCycle() benchmark of the ANSI C target.
+        if((memcmp(lpCmdLine, "/b", 2) == 0) && isspace(lpCmdLine[2])) {
+            AnsiCBenchmark = true;
+            lpCmdLine += 2;
+            while(isspace(*lpCmdLine)) {
+                lpCmdLine++;
+            }
+        }
+        // /i before /c also writes the binary image of the .int or .xint code.
+        if((memcmp(lpCmdLine, "/i", 2) == 0) && isspace(lpCmdLine[2])) {
+            WriteBinaryImage = 1;
+            lpCmdLine += 2;
+            while(isspace(*lpCmdLine)) {
+                lpCmdLine++;
+            }
+        }
+        // /ldc before /c or /t also caches the rungs of a big project, as
+        // Settings > Cache Big Projects.
+        if((memcmp(lpCmdLine, "/ldc", 4) == 0) && isspace(lpCmdLine[4])) {
+            CacheBigProjects = 1;
+            lpCmdLine += 4;
+            while(isspace(*lpCmdLine)) {
+                lpCmdLine++;
+            }
+        }
         if(memcmp(lpCmdLine, "/c", 2) == 0) {
             RunningInBatchMode = true;
 
-            const char *err = "Bad command line arguments: run 'ldmicro /c src.ld dest.ext'";
+            const char *err = "Bad command line arguments: run 'ldmicro [/Os|/O2] [/b] [/i] [/ldc] /c src.ld dest.ext'";
 
             char *source = lpCmdLine + 2;
             while(isspace(*source)) {
@@ -3107,6 +3159,8 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine
                 Error(_("Couldn't open '%s', running non-interactively."), source);
                 doexit(EXIT_FAILURE);
             }
+            if(optimize >= 0)
+                Prog.optimize = optimize;
             strcpy(CurrentCompileFile, dest);
             GenerateIoList(-1);
             CompileProgram(false, compile_MNU);
@@ -3122,7 +3176,7 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine
                 source++;
             }
             if(*source == '\0') {
-                const char *err = "Bad command line arguments: run 'ldmicro /t src.ld [dest.txt]'";
+                const char *err = "Bad command line arguments: run 'ldmicro [/ldc] /t src.ld [dest.txt]'";
                 Error(err);
                 doexit(EXIT_FAILURE);
             }
@@ -3213,6 +3267,8 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine
         }
         FreezeWindowPos(MainWindow);
         FreezeDWORD(IoListHeight);
+        FreezeDWORD(WriteBinaryImage);
+        FreezeDWORD(CacheBigProjects);
 
         UndoEmpty();
         Prog.reset();
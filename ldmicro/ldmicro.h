@@ -238,6 +238,9 @@ typedef uint32_t ADDR_T;
 #define MNU_MCU_SETTINGS        0x50
 #define MNU_PULL_UP_RESISTORS   0x51
 #define MNU_SPEC_FUNCTION       0x52
+#define MNU_OPTIMIZE_SPEED      0x53
+#define MNU_BINARY_IMAGE        0x54
+#define MNU_CACHE_PROJECTS      0x55
 #define MNU_PROCESSOR_0         0xa0
 #define MNU_PROCESSOR_NEW       0xa001
 #define MNU_PROCESSOR_NEW_PIC12 0xa002
@@ -455,6 +458,10 @@ int ProgCountWidestRow();
 int ProgCountRows();
 extern int totalHeightScrollbars;
 int CountHeightOfElement(int which, void *elem);
+int RungHeight(int i);
+void ForgetRungLayout(const void *rung);
+void ForgetSelectedRungLayout();
+void ForgetRungLayouts();
 bool DrawElement(int which, void *any, int *cx, int *cy, bool poweredBefore/*, int cols*/);
 void DrawEndRung(int cx, int cy);
 extern int ColsAvailable;
@@ -465,6 +472,7 @@ extern bool ThisHighlighted;
 void SetSyntaxHighlightingColours();                            ///// Prototype added by JG
 extern void (*DrawChars)(int, int, const char *);
 void CALLBACK BlinkCursor(HWND hwnd, UINT msg, UINT_PTR id, DWORD time);
+void InvalidateRungs(const std::vector<bool> &changed);
 void PaintWindow();
 BOOL tGetLastWriteTime(const char *FileName, FILETIME *ftWrite, int mode);
 void ExportDrawingAsText(char *file);
@@ -497,6 +505,7 @@ void MakeNormalSelected();
 void NegateSelected();
 void MakeTtriggerSelected();
 void ForgetFromGrid(void *p);
+void ReplaceInGrid(void *p, int which, void *q);
 void ForgetEverything();
 bool EndOfRungElem(int Which);
 bool CanChangeOutputElem(int Which);
@@ -507,7 +516,52 @@ bool MoveCursorNear(int *gx, int *gy);
 
 #define DISPLAY_MATRIX_X_SIZE 256
 #define DISPLAY_MATRIX_Y_SIZE ((MAX_RUNGS + 1) * 2)
-extern SeriesNode DisplayMatrix[DISPLAY_MATRIX_X_SIZE][DISPLAY_MATRIX_Y_SIZE];
+
+// The grid of DISPLAY_MATRIX_X_SIZE x DISPLAY_MATRIX_Y_SIZE boxes on which
+// PaintWindow() lays the program out. Only the rows that it drew (the rungs
+// on screen and a few around them) are stored, one row of boxes each; every
+// other box reads as empty. DisplayMatrix[gx][gy] reads a box, set() writes
+// one and clear() forgets the rows, in time proportional to their number.
+class DisplayGrid {
+public:
+    class Column {
+    public:
+        Column(const DisplayGrid *grid, int gx) : grid_(grid), gx_(gx)
+        {
+        }
+        SeriesNode operator[](int gy) const
+        {
+            return grid_->at(gx_, gy);
+        }
+
+    private:
+        const DisplayGrid *grid_;
+        int                gx_;
+    };
+
+    Column operator[](int gx) const
+    {
+        return Column(this, gx);
+    }
+    SeriesNode at(int gx, int gy) const;
+    void       set(int gx, int gy, int which, ElemLeaf *leaf);
+    void       clear();
+    // The leftmost box of p in the rows stored.
+    bool find(const void *p, int *gx, int *gy) const;
+    // f(node) for every box of the rows stored.
+    template <typename F> void forEach(F f)
+    {
+        for(SeriesNode &node : boxes_)
+            f(node);
+    }
+
+private:
+    std::unordered_map<int, size_t> rows_;  // gy -> index of its first box
+    std::vector<int>                rowGy_; // in the order they were stored
+    std::vector<SeriesNode>         boxes_; // DISPLAY_MATRIX_X_SIZE per row
+};
+
+extern DisplayGrid DisplayMatrix;
 extern ElemLeaf DisplayMatrixFiller;
 #define PADDING_IN_DISPLAY_MATRIX (&DisplayMatrixFiller)
 #define VALID_LEAF(x) (((x).any() != nullptr) && ((x).leaf() != PADDING_IN_DISPLAY_MATRIX))
@@ -525,6 +579,8 @@ void UndoRemember();
 void UndoFlush();
 void UndoEmpty();
 bool CanUndo();
+void UndoRungChanged(const void *rung);
+void UndoSelectedRungChanged();
 
 // loadsave.cpp
 bool LoadProjectFromFile(const char *filename);
@@ -540,6 +596,7 @@ const char *ChrToFrmtStr(const char src);
 char *StrToFrmStr(char *dest, const char *src, FRMT frmt);
 char *StrToFrmStr(char *dest, const char *src);
 void LoadWritePcPorts();
+extern int CacheBigProjects;
 
 // iolist.cpp
 int IsIoType(int type);
@@ -547,7 +604,8 @@ int GenerateIoList(int prevSel);
 void SaveIoListToFile(FileTracker& f);
 bool LoadIoListFromFile(FileTracker& f);
 void ShowIoDialog(int item);
-void IoListProc(NMHDR *h);
+LRESULT IoListProc(NMHDR *h);
+void RedrawIoListRows(int first, int last);
 void ShowAnalogSliderPopup(char *name);
 
 // commentdialog.cpp
@@ -1072,9 +1130,11 @@ bool CalcAvrPlcCycle(long long int cycleTimeMicroseconds, uint32_t AvrProgLdLen)
 void CompileAvr(const char* outFile);
 // ansic.cpp
 extern int compile_MNU;
+extern bool AnsiCBenchmark;
 bool CompileAnsiC(const char *outFile, int MNU);
 int AVR_Prediv(const char * name2, const char * name3, const char * name4);     ///// Added by JG
 // interpreted.cpp
+extern int WriteBinaryImage;
 void CompileInterpreted(const char* outFile);
 // xinterpreted.cpp
 void CompileXInterpreted(const char* outFile);
@@ -0,0 +1,297 @@
+//-----------------------------------------------------------------------------
+// This file is part of LDmicro.
+//
+// LDmicro is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// LDmicro is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with LDmicro.  If not, see <http://www.gnu.org/licenses/>.
+//------
+//
+// Process image of a sample interpreter in shared memory, for the HMI,
+// logging and test programs running on the same machine. The interpreter
+// creates the segment (a POSIX shm_open() name like "/plc", a named file
+// mapping on Windows) and at the end of every cycle copies its variables in:
+//
+//     LdShmHeader       at offset 0
+//     int32_t[]         at IntegersOffset, IntegersCount variables
+//     uint8_t[]         at BitsOffset, BitsCount variables
+//     LdImageSymbol[]   at SymbolsOffset, name <-> address, from $$IO
+//
+// The variables are guarded by a seqlock: Sequence is odd while the
+// interpreter copies them, so a reader takes a consistent snapshot without
+// ever blocking the interpreter:
+//
+//     LdShmHeader *h = LdShmOpen("/plc");
+//     int32_t      x = LdShmFind(h, "Xstart");
+//     LdShmSnapshot(h, integers, bits);         // retries while it changes
+//     LdShmPost(h, x, LDIMAGE_SYMBOL_BIT, 1);   // written before next cycle
+//
+// Writes go the other way through a short queue under a spin lock, which the
+// interpreter empties at the start of every cycle, before the program runs.
+// The interpreter never waits for that lock: if a writer holds it, the queue
+// is left for the next cycle.
+//-----------------------------------------------------------------------------
+#ifndef __LDSHM_H
+#define __LDSHM_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <atomic>
+#include <new>
+#include "ldimage.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#define LDSHM_MAGIC "LDSH"
+#define LDSHM_VERSION (1u)
+#define LDSHM_WRITES (256u) // queued writes, per cycle
+
+static_assert(ATOMIC_INT_LOCK_FREE == 2, "the seqlock needs lock-free atomics across processes");
+
+typedef struct LdShmWriteTag {
+    uint32_t Addr;
+    uint32_t Type; // LDIMAGE_SYMBOL_BIT or LDIMAGE_SYMBOL_INT
+    int32_t  Value;
+} LdShmWrite;
+
+typedef struct LdShmHeaderTag {
+    uint8_t  Magic[4];
+    uint16_t Version;
+    uint16_t Reserved;
+    uint32_t Length; // of the whole segment
+    uint32_t CycleTime; // us
+    uint32_t IntegersOffset;
+    uint32_t IntegersCount;
+    uint32_t BitsOffset;
+    uint32_t BitsCount;
+    uint32_t SymbolsOffset;
+    uint32_t SymbolsCount;
+
+    std::atomic<uint32_t> Sequence;  // seqlock of the variables, odd while they change
+    std::atomic<uint32_t> Cycles;    // run, with the variables published
+    std::atomic<uint32_t> WriteLock; // of WriteCount and Writes[]
+    std::atomic<uint32_t> WriteCount;
+    LdShmWrite            Writes[LDSHM_WRITES];
+} LdShmHeader;
+
+inline uint32_t LdShmAlign(uint32_t offset)
+{
+    return (offset + LDIMAGE_ALIGN - 1) & ~(LDIMAGE_ALIGN - 1);
+}
+
+// Map the segment name of size bytes, creating it if create (and size is
+// its length then). Returns nullptr on failure.
+inline void *LdShmMap(const char *name, size_t *size, bool create)
+{
+#ifdef _WIN32
+    HANDLE mapping;
+    if(create)
+        mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, 0, (DWORD)*size, name);
+    else
+        mapping = OpenFileMappingA(FILE_MAP_ALL_ACCESS, FALSE, name);
+    if(!mapping)
+        return nullptr;
+    void *view = MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, 0);
+    // the mapping object and its name live as long as a view of it
+    CloseHandle(mapping);
+    if(view && !create) {
+        MEMORY_BASIC_INFORMATION info;
+        VirtualQuery(view, &info, sizeof(info));
+        *size = info.RegionSize;
+    }
+    return view;
+#else
+    int fd = create ? shm_open(name, O_RDWR | O_CREAT | O_TRUNC, 0666) : shm_open(name, O_RDWR, 0);
+    if(fd < 0)
+        return nullptr;
+    struct stat st;
+    void *      view = MAP_FAILED;
+    if(create ? (ftruncate(fd, (off_t)*size) == 0) : ((fstat(fd, &st) == 0) && (st.st_size > 0))) {
+        if(!create)
+            *size = (size_t)st.st_size;
+        view = mmap(nullptr, *size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    return (view == MAP_FAILED) ? nullptr : view;
+#endif
+}
+
+//-----------------------------------------------------------------------------
+// The side of the interpreter.
+//-----------------------------------------------------------------------------
+inline LdShmHeader *LdShmCreate(const char *name, uint32_t cycleTime, uint32_t integers, uint32_t bits, const LdImageSymbol *symbols,
+                                uint32_t symbolsCount)
+{
+    uint32_t intOffset = LdShmAlign(sizeof(LdShmHeader));
+    uint32_t bitOffset = LdShmAlign(intOffset + integers * sizeof(int32_t));
+    uint32_t symOffset = LdShmAlign(bitOffset + bits);
+    size_t   size = symOffset + symbolsCount * sizeof(LdImageSymbol);
+
+    uint8_t *shm = (uint8_t *)LdShmMap(name, &size, true);
+    if(!shm)
+        return nullptr;
+    memset(shm, 0, size);
+    LdShmHeader *h = new(shm) LdShmHeader;
+    h->Version = LDSHM_VERSION;
+    h->Length = (uint32_t)size;
+    h->CycleTime = cycleTime;
+    h->IntegersOffset = intOffset;
+    h->IntegersCount = integers;
+    h->BitsOffset = bitOffset;
+    h->BitsCount = bits;
+    h->SymbolsOffset = symOffset;
+    h->SymbolsCount = symbolsCount;
+    h->Sequence = 0;
+    h->Cycles = 0;
+    h->WriteLock = 0;
+    h->WriteCount = 0;
+    memcpy(shm + symOffset, symbols, symbolsCount * sizeof(LdImageSymbol));
+    // the magic last, a reader that sees it sees the rest
+    std::atomic_thread_fence(std::memory_order_release);
+    memcpy(h->Magic, LDSHM_MAGIC, 4);
+    return h;
+}
+
+inline bool LdShmTryLock(LdShmHeader *h)
+{
+    return h->WriteLock.exchange(1, std::memory_order_acquire) == 0;
+}
+
+inline void LdShmLock(LdShmHeader *h)
+{
+    while(!LdShmTryLock(h))
+        ;
+}
+
+inline void LdShmUnlock(LdShmHeader *h)
+{
+    h->WriteLock.store(0, std::memory_order_release);
+}
+
+// Take the writes queued since the last cycle into writes[LDSHM_WRITES].
+// Returns how many there are; 0 also if a writer holds the lock, the cycle
+// doesn't wait for it.
+inline uint32_t LdShmTake(LdShmHeader *h, LdShmWrite *writes)
+{
+    if(h->WriteCount.load(std::memory_order_relaxed) == 0) // a write that misses it waits for the next cycle
+        return 0;
+    if(!LdShmTryLock(h))
+        return 0;
+    uint32_t n = h->WriteCount.load(std::memory_order_relaxed);
+    memcpy(writes, h->Writes, n * sizeof(LdShmWrite));
+    h->WriteCount = 0;
+    LdShmUnlock(h);
+    return n;
+}
+
+// Copy the variables in, at the end of a cycle.
+inline void LdShmPublish(LdShmHeader *h, const int32_t *integers, const uint8_t *bits)
+{
+    uint8_t *shm = (uint8_t *)h;
+    uint32_t seq = h->Sequence.load(std::memory_order_relaxed);
+    h->Sequence.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    memcpy(shm + h->IntegersOffset, integers, h->IntegersCount * sizeof(int32_t));
+    memcpy(shm + h->BitsOffset, bits, h->BitsCount);
+    h->Cycles.store(h->Cycles.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    h->Sequence.store(seq + 2, std::memory_order_release);
+}
+
+inline void LdShmDestroy(LdShmHeader *h, const char *name)
+{
+#ifdef _WIN32
+    (void)name;
+    UnmapViewOfFile(h);
+#else
+    munmap(h, h->Length);
+    shm_unlink(name);
+#endif
+}
+
+//-----------------------------------------------------------------------------
+// The side of the other programs.
+//-----------------------------------------------------------------------------
+inline LdShmHeader *LdShmOpen(const char *name)
+{
+    size_t   size = 0;
+    uint8_t *shm = (uint8_t *)LdShmMap(name, &size, false);
+    if(!shm)
+        return nullptr;
+    LdShmHeader *h = (LdShmHeader *)shm;
+    if((size < sizeof(LdShmHeader)) || (memcmp(h->Magic, LDSHM_MAGIC, 4) != 0) || (h->Version != LDSHM_VERSION) || (h->Length > size)) {
+#ifdef _WIN32
+        UnmapViewOfFile(shm);
+#else
+        munmap(shm, size);
+#endif
+        return nullptr;
+    }
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return h;
+}
+
+// The address of the variable name, or -1.
+inline int32_t LdShmFind(const LdShmHeader *h, const char *name)
+{
+    const LdImageSymbol *symbols = (const LdImageSymbol *)((const uint8_t *)h + h->SymbolsOffset);
+    for(uint32_t i = 0; i < h->SymbolsCount; i++) {
+        if(strncmp(symbols[i].Name, name, LDIMAGE_NAME_LEN) == 0)
+            return (int32_t)symbols[i].Addr;
+    }
+    return -1;
+}
+
+// Copy all the variables of one cycle out, into integers[IntegersCount] and
+// bits[BitsCount] (either may be nullptr). Returns the cycle they are from.
+inline uint32_t LdShmSnapshot(const LdShmHeader *h, int32_t *integers, uint8_t *bits)
+{
+    const uint8_t *shm = (const uint8_t *)h;
+    for(;;) {
+        uint32_t seq = h->Sequence.load(std::memory_order_acquire);
+        if(seq & 1)
+            continue;
+        uint32_t cycles = h->Cycles.load(std::memory_order_relaxed);
+        if(integers)
+            memcpy(integers, shm + h->IntegersOffset, h->IntegersCount * sizeof(int32_t));
+        if(bits)
+            memcpy(bits, shm + h->BitsOffset, h->BitsCount);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if(h->Sequence.load(std::memory_order_relaxed) == seq)
+            return cycles;
+    }
+}
+
+// Queue a write of value to the bit or integer variable at addr, for the
+// start of the next cycle. Returns false if the queue is full.
+inline bool LdShmPost(LdShmHeader *h, uint32_t addr, uint32_t type, int32_t value)
+{
+    bool queued = false;
+    LdShmLock(h);
+    if(h->WriteCount < LDSHM_WRITES) {
+        h->Writes[h->WriteCount].Addr = addr;
+        h->Writes[h->WriteCount].Type = type;
+        h->Writes[h->WriteCount].Value = value;
+        h->WriteCount.store(h->WriteCount + 1, std::memory_order_relaxed);
+        queued = true;
+    }
+    LdShmUnlock(h);
+    return queued;
+}
+
+#endif
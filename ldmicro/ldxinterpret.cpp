@@ -11,6 +11,14 @@
 //
 //-----------------------------------------------------------------------------
 #include "stdafx.h"
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
 
 typedef unsigned char  BYTE; // 8-bit unsigned
 typedef unsigned short WORD; // 16-bit unsigned
@@ -18,11 +26,16 @@ typedef unsigned short WORD; // 16-bit unsigned
 #define INTCODE_H_CONSTANTS_ONLY
 
 #include "intcode.h"
+#define LDIMAGE_H_MAP
+#include "ldimage.h"
+#include "ldcycle.h"
+#include "ldshm.h"
 
-// Some arbitrary limits on the program and data size
-#define MAX_OPS 1024
-#define MAX_VARIABLES 256
-#define MAX_INTERNAL_RELAYS 256
+// The direct-threaded core needs the labels-as-values extension of GCC and
+// Clang. Build with -DSWITCH_DISPATCH to run the switch() reference core.
+#if defined(__GNUC__) && !defined(SWITCH_DISPATCH)
+#define THREADED_DISPATCH
+#endif
 
 // This data structure represents a single instruction for the 'virtual
 // machine.' The .op field gives the opcode, and the other fields give
@@ -40,19 +53,53 @@ typedef unsigned short WORD; // 16-bit unsigned
 // and also to pick out the name <-> address mappings for those variables
 // that you're going to use for your interface out. I will therefore leave
 // that up to you.
-
-uint32_t Program[MAX_OPS];
-
-int32_t Integers[MAX_VARIABLES];
-BYTE    Bits[MAX_VARIABLES];
+//
+// Here every op is one opcode byte followed by its operands: the addresses,
+// a 16-bit literal right after the first address and the forward jump
+// offset last, relative to the next op; the shifts and rotations end in a
+// byte with the width of their variable instead. Addresses and jump offsets take
+// OperandSize bytes (1, 2 or 4, little-endian), as few as the program
+// allows; LDmicro picks it per program and writes it on the $$LDcode line
+// (if it is not 1) and in the header of a .xintb image.
+
+// An op of the direct-threaded core, see RunThreaded()
+typedef struct ThreadedOpTag {
+    const void *          handler;
+    struct ThreadedOpTag *target;
+    int32_t               literal;
+    uint32_t              a;
+    uint32_t              b;
+    uint32_t              c;
+    uint32_t              d;
+} ThreadedOp;
+
+// Everything about one loaded program. There are no globals, so that the
+// host (see Host()) can run many programs side by side; the functions that
+// run one take it as plc and keep what they need in locals of the names
+// below (Program, Bits, ...).
+typedef struct PlcTag {
+    std::string              Name;              // of the file
+    std::vector<uint8_t>     ProgramBuffer;     // the byte code read from a .xint file
+    const uint8_t *          Program = nullptr; // in ProgramBuffer or a mapped .xintb image
+    int                      ProgramLength = 0; // bytes, up to and including INT_END_OF_PROGRAM
+    int                      OperandSize = 1;
+    int                      CycleTime = 10000; // us, from $$cycle
+    std::vector<int32_t>     Integers;
+    std::vector<BYTE>        Bits;
+    std::vector<std::string> Symbols;
+    std::vector<ThreadedOp>  ThreadedProgram;
+    int                      Cpu = -1;          // the host runs it on a thread of its own, pinned to this CPU
+    LdCycle                  Cycle;
+    std::string              ShmName;           // of the process image in shared memory, see Share()
+    LdShmHeader *            Shm = nullptr;
+} Plc;
 
 #define READ_BIT(addr) Bits[addr]
 #define WRITE_BIT(addr, value) Bits[addr] = (value)
 #define READ_INT(addr) Integers[addr]
 #define WRITE_INT(addr, value) Integers[addr] = (value)
 
-char Symbols[MAX_VARIABLES][40];
-int  line_number = 0;
+int line_number = 0;
 
 //-----------------------------------------------------------------------------
 // What follows are just routines to load the program, which I represent as
@@ -79,19 +126,265 @@ int HexDigit(int c)
     return 0;
 }
 
-int LoadProgram(char *fileName)
+const char *Symbol(const Plc *plc, uint32_t addr)
 {
-    int pc;
+    return (addr < plc->Symbols.size()) ? plc->Symbols[addr].c_str() : "?";
+}
+
+//-----------------------------------------------------------------------------
+// The operands of an op: how many addresses it has, if a literal follows the
+// first one, if it ends in a jump offset and if it ends in a width byte.
+// Returns false for an unknown opcode or INT_END_OF_PROGRAM.
+//-----------------------------------------------------------------------------
+static bool OpOperands(uint8_t op, int *addrs, bool *literal, bool *jump, bool *width)
+{
+    *literal = false;
+    *jump = false;
+    *width = false;
+    switch(op) {
+        case INT_SET_BIT:
+        case INT_CLEAR_BIT:
+        case INT_DECREMENT_VARIABLE & 0xFF:
+        case INT_INCREMENT_VARIABLE:
+        case INT_READ_ADC:
+            *addrs = 1;
+            return true;
+        case INT_COPY_BIT_TO_BIT:
+        case INT_COPY_INVERTED_BIT:
+        case INT_IF_BIT_SET_THEN_SET_BIT:
+        case INT_IF_BIT_SET_THEN_CLEAR_BIT:
+        case INT_IF_BIT_CLEAR_THEN_SET_BIT:
+        case INT_IF_BIT_CLEAR_THEN_CLEAR_BIT:
+        case INT_SET_VARIABLE_TO_VARIABLE:
+        case INT_SET_VARIABLE_NEG:
+        case INT_SET_VARIABLE_NOT:
+            *addrs = 2;
+            return true;
+        case INT_COPY_BIT_TO_TWO_BITS:
+        case INT_SET_VARIABLE_ADD:
+        case INT_SET_VARIABLE_SUBTRACT:
+        case INT_SET_VARIABLE_MULTIPLY:
+        case INT_SET_VARIABLE_DIVIDE:
+        case INT_SET_VARIABLE_MOD & 0xFF:
+        case INT_SET_VARIABLE_AND:
+        case INT_SET_VARIABLE_OR:
+        case INT_SET_VARIABLE_XOR:
+            *addrs = 3;
+            return true;
+        // dest, source, count and carry bit, then the width of the source in
+        // bytes (1 to 4)
+        case INT_SET_VARIABLE_SHL:
+        case INT_SET_VARIABLE_SHR:
+        case INT_SET_VARIABLE_SR0 & 0xFF:
+        case INT_SET_VARIABLE_ROL:
+        case INT_SET_VARIABLE_ROR:
+            *addrs = 4;
+            *width = true;
+            return true;
+        case INT_SET_VARIABLE_TO_LITERAL:
+        case INT_SET_PWM:
+            *addrs = 1;
+            *literal = true;
+            return true;
+        case INT_IF_BIT_SET:
+        case INT_IF_BIT_CLEAR:
+            *addrs = 1;
+            *jump = true;
+            return true;
+        case INT_IF_VARIABLE_EQU_LITERAL:
+        case INT_IF_VARIABLE_NEQ_LITERAL:
+        case INT_IF_VARIABLE_LES_LITERAL:
+        case INT_IF_VARIABLE_LEQ_LITERAL:
+        case INT_IF_VARIABLE_GRT_LITERAL:
+        case INT_IF_VARIABLE_GEQ_LITERAL:
+            *addrs = 1;
+            *literal = true;
+            *jump = true;
+            return true;
+        case INT_IF_VARIABLE_EQU_VARIABLE:
+        case INT_IF_VARIABLE_NEQ_VARIABLE:
+        case INT_IF_VARIABLE_LES_VARIABLE:
+        case INT_IF_VARIABLE_LEQ_VARIABLE:
+        case INT_IF_VARIABLE_GRT_VARIABLE:
+        case INT_IF_VARIABLE_GEQ_VARIABLE:
+            *addrs = 2;
+            *jump = true;
+            return true;
+        case INT_ELSE:
+            *addrs = 0;
+            *jump = true;
+            return true;
+        default:
+            return false;
+    }
+}
+
+// Length in bytes of the op at pc, with its INT_WIDE_LITERAL prefix if it
+// has one; 0 if there is no op, -1 if it runs past ProgramLength
+static int OpLength(const Plc *plc, int pc)
+{
+    int  addrs;
+    bool literal, jump, width;
+    if((pc < 0) || (pc >= plc->ProgramLength))
+        return -1;
+    bool wide = (plc->Program[pc] == INT_WIDE_LITERAL);
+    if(pc + wide >= plc->ProgramLength)
+        return -1;
+    if(!OpOperands(plc->Program[pc + wide], &addrs, &literal, &jump, &width) || (wide && !literal))
+        return 0;
+    int len = wide + 1 + (addrs + jump) * plc->OperandSize + (literal ? (wide ? 4 : 2) : 0) + width;
+    return (len > plc->ProgramLength - pc) ? -1 : len;
+}
+
+template <int N> static inline uint32_t Operand(const uint8_t *p)
+{
+    uint32_t v = p[0];
+    if(N > 1)
+        v |= p[1] << 8;
+    if(N > 2)
+        v |= (p[2] << 16) | ((uint32_t)p[3] << 24);
+    return v;
+}
+
+static uint32_t Operand(const uint8_t *p, int size)
+{
+    return (size == 1) ? Operand<1>(p) : (size == 2) ? Operand<2>(p) : Operand<4>(p);
+}
+
+// A literal is signed, 16 bits or 32 bits after INT_WIDE_LITERAL
+static int32_t Literal(const uint8_t *p, bool wide)
+{
+    return wide ? (int32_t)Operand<4>(p) : (int16_t)Operand<2>(p);
+}
+
+// Address k of the op at pc (past the prefix), its literal and the jump
+// offset or the width that ends it at next
+#define ADDR(k) Operand(&Program[pc + 1 + (k)*OperandSize], OperandSize)
+#define LITERAL() Literal(&Program[pc + 1 + OperandSize], wide)
+#define JUMP(next) Operand(&Program[(next)-OperandSize], OperandSize)
+#define WIDTH(next) Program[(next)-1]
+
+//-----------------------------------------------------------------------------
+// Verify the ProgramLength bytes loaded, once, so that the cores can run them
+// without a single check of their own. Every op must be one that they run,
+// complete with its operands within ProgramLength (a truncated file or image
+// ends in the middle of one), and the program must end in
+// INT_END_OF_PROGRAM; every address must be below the number of variables
+// (from $$IO or the image); every width must be 1 to 4 bytes; every jump must
+// go forward to the start of an op, so that a cycle neither loops nor leaves
+// the program. Trims ProgramLength to the end and sizes Integers[], Bits[]
+// and Symbols[] for the variables. Returns nullptr if the program is fine,
+// the reason otherwise.
+//-----------------------------------------------------------------------------
+const char *VerifyProgram(Plc *plc, uint32_t variables)
+{
+    const uint8_t *      Program = plc->Program;
+    int                  OperandSize = plc->OperandSize;
+    std::vector<bool>    start(plc->ProgramLength, false);
+    std::vector<int64_t> jumps;
+    int                  at, next;
+    for(at = 0; (at < plc->ProgramLength) && (Program[at] != INT_END_OF_PROGRAM); at = next) {
+        int len = OpLength(plc, at);
+        if(len == 0)
+            return "unknown op";
+        if(len < 0)
+            return "truncated op";
+        start[at] = true;
+        next = at + len;
+
+        int  pc = at + (Program[at] == INT_WIDE_LITERAL);
+        int  addrs;
+        bool literal, jump, width;
+        OpOperands(Program[pc], &addrs, &literal, &jump, &width);
+        for(int k = 0; k < addrs; k++) {
+            if(ADDR(k) >= variables)
+                return "address out of range";
+        }
+        if(width && ((WIDTH(next) < 1) || (WIDTH(next) > 4)))
+            return "bad width";
+        if(jump)
+            jumps.push_back((int64_t)next + JUMP(next));
+    }
+    if(at >= plc->ProgramLength)
+        return "no end of program";
+    start[at] = true;
+    for(int64_t target : jumps) {
+        if((target > at) || !start[target])
+            return "bad jump target";
+    }
+
+    plc->ProgramLength = at + 1;
+    plc->Integers.assign(variables, 0);
+    plc->Bits.assign(variables, 0);
+    for(uint32_t i = plc->Symbols.size(); i < variables; i++)
+        plc->Symbols.push_back(std::to_string(i));
+    return nullptr;
+}
+
+static void Verify(Plc *plc, uint32_t variables)
+{
+    if(const char *err = VerifyProgram(plc, variables)) {
+        fprintf(stderr, "'%s': %s\n", plc->Name.c_str(), err);
+        exit(-1);
+    }
+}
+
+//-----------------------------------------------------------------------------
+// A binary .xintb image (see ldimage.h) needs no parsing: map it and run the
+// byte code where it is. Returns false if fileName is not an image, so that
+// it can be loaded as hex.
+//-----------------------------------------------------------------------------
+bool LoadImage(Plc *plc, const char *fileName)
+{
+    char  magic[4] = {0};
+    FILE *f = fopen(fileName, "rb");
+    if(!f)
+        return false;
+    size_t n = fread(magic, 1, sizeof(magic), f);
+    fclose(f);
+    if((n != sizeof(magic)) || (memcmp(magic, LDIMAGE_MAGIC, sizeof(magic)) != 0))
+        return false;
+
+    size_t         size = 0;
+    const uint8_t *image = LdImageMap(fileName, &size);
+    if(!image) {
+        fprintf(stderr, "couldn't map '%s'\n", fileName);
+        exit(-1);
+    }
+    if(const char *err = LdImageCheck(image, size, LDIMAGE_XINT)) {
+        fprintf(stderr, "'%s': %s\n", fileName, err);
+        exit(-1);
+    }
+    const LdImageHeader *h = (const LdImageHeader *)image;
+    plc->Program = image + h->OpsOffset;
+    plc->ProgramLength = h->OpsLength;
+    plc->OperandSize = h->OperandSize;
+    plc->CycleTime = h->CycleTime;
+
+    // every variable of the program has a symbol
+    Verify(plc, h->SymbolsCount);
+    const LdImageSymbol *symbols = (const LdImageSymbol *)(image + h->SymbolsOffset);
+    for(uint32_t i = 0; i < h->SymbolsCount; i++) {
+        if(symbols[i].Addr < h->SymbolsCount)
+            plc->Symbols[symbols[i].Addr] = std::string(symbols[i].Name, strnlen(symbols[i].Name, LDIMAGE_NAME_LEN));
+    }
+    return true;
+}
+
+int LoadProgram(Plc *plc, const char *fileName)
+{
+    plc->Name = fileName;
+    plc->Symbols.clear();
+    if(LoadImage(plc, fileName))
+        return 0;
 
     FILE *f = fopen(fileName, "r");
     char  line[80];
 
     line_number = 0;
-    for(int i = 0; i < MAX_VARIABLES; i++) {
-        sprintf(Symbols[i], "%d", i);
-    }
 
-    // This is not suitable for untrusted input.
+    // Nothing is trusted: VerifyProgram() checks the whole program before
+    // it runs.
 
     if(!f) {
         fprintf(stderr, "couldn't open '%s'\n", fileName);
@@ -101,7 +394,9 @@ int LoadProgram(char *fileName)
     if(!fgets(line, sizeof(line), f))
         BadFormat();
     line_number++;
-    if(strncmp(line, "$$IO", 4) != 0)
+    // $$IO named_variables variables
+    int named, variables;
+    if((sscanf(line, "$$IO %d %d", &named, &variables) != 2) || (variables < 0))
         BadFormat();
 
     while(fgets(line, sizeof(line), f)) {
@@ -118,27 +413,40 @@ int LoadProgram(char *fileName)
 
         if(sscanf(line, "%d %40s %d %d %d %d", &addr, name, &type, &pin, &modbus_slave, &modbus_offset) != 6)
             BadFormat();
-        if(addr < 0 || addr >= MAX_VARIABLES)
+        if((addr < 0) || (addr >= variables))
             BadFormat();
-        strcpy(Symbols[addr], name);
+        for(int i = plc->Symbols.size(); i <= addr; i++)
+            plc->Symbols.push_back(std::to_string(i));
+        plc->Symbols[addr] = name;
     }
 
-    if(strncmp(line, "$$LDcode", 8) != 0)
+    // $$LDcode program_size [operand_size]
+    int size;
+    plc->OperandSize = 1;
+    if((sscanf(line, "$$LDcode %d %d", &size, &plc->OperandSize) < 1) || (size < 0))
+        BadFormat();
+    if((plc->OperandSize != 1) && (plc->OperandSize != 2) && (plc->OperandSize != 4))
         BadFormat();
 
-    pc = 0;
+    plc->ProgramBuffer.clear();
+    plc->ProgramBuffer.reserve(std::min(size, 1 << 20));
     while(fgets(line, sizeof(line), f)) {
         char *t;
 
         line_number++;
-        if(line[0] == '$')
+        if(line[0] == '$') {
+            sscanf(line, "$$cycle %d", &plc->CycleTime);
             break;
+        }
         for(t = line; t[0] >= 32 && t[1] >= 32; t += 2) {
-            Program[pc++] = HexDigit(t[1]) | (HexDigit(t[0]) << 4);
+            plc->ProgramBuffer.push_back(HexDigit(t[1]) | (HexDigit(t[0]) << 4));
         }
     }
 
     fclose(f);
+    plc->Program = plc->ProgramBuffer.data();
+    plc->ProgramLength = plc->ProgramBuffer.size();
+    Verify(plc, variables);
     return 0;
 }
 //-----------------------------------------------------------------------------
@@ -150,101 +458,193 @@ int LoadProgram(char *fileName)
 // integer variables; I refer to those as bits[addr] and int16s[addr]
 // respectively.
 //-----------------------------------------------------------------------------
-void Disassemble()
+void Disassemble(const Plc *plc)
 {
-    char c;
+    const uint8_t *Program = plc->Program;
+    int            OperandSize = plc->OperandSize;
+    const char *   c;
     for(int pc = 0;;) {
+        int  next = pc + OpLength(plc, pc);
+        bool wide = (Program[pc] == INT_WIDE_LITERAL);
         printf("%03x: ", pc);
+        pc += wide;
 
         switch(Program[pc]) {
             case INT_SET_BIT:
-                printf("bits[%s] := 1", Symbols[Program[pc + 1]]);
-                pc += 2;
+                printf("bits[%s] := 1", Symbol(plc, ADDR(0)));
                 break;
 
             case INT_CLEAR_BIT:
-                printf("bits[%s] := 0", Symbols[Program[pc + 1]]);
-                pc += 2;
+                printf("bits[%s] := 0", Symbol(plc, ADDR(0)));
                 break;
 
             case INT_COPY_BIT_TO_BIT:
-                printf("bits[%s] := bits[%s]", Symbols[Program[pc + 1]], Symbols[Program[pc + 2]]);
-                pc += 3;
+                printf("bits[%s] := bits[%s]", Symbol(plc, ADDR(0)), Symbol(plc, ADDR(1)));
+                break;
+
+            case INT_COPY_INVERTED_BIT:
+                printf("bits[%s] := !bits[%s]", Symbol(plc, ADDR(0)), Symbol(plc, ADDR(1)));
+                break;
+
+            case INT_COPY_BIT_TO_TWO_BITS:
+                printf("bits[%s] := bits[%s] := bits[%s]", Symbol(plc, ADDR(0)), Symbol(plc, ADDR(2)), Symbol(plc, ADDR(1)));
+                break;
+
+            case INT_IF_BIT_SET_THEN_SET_BIT:
+                printf("if (bits[%s] set) bits[%s] := 1", Symbol(plc, ADDR(0)), Symbol(plc, ADDR(1)));
+                break;
+
+            case INT_IF_BIT_SET_THEN_CLEAR_BIT:
+                printf("if (bits[%s] set) bits[%s] := 0", Symbol(plc, ADDR(0)), Symbol(plc, ADDR(1)));
+                break;
+
+            case INT_IF_BIT_CLEAR_THEN_SET_BIT:
+                printf("if (bits[%s] clear) bits[%s] := 1", Symbol(plc, ADDR(0)), Symbol(plc, ADDR(1)));
+                break;
+
+            case INT_IF_BIT_CLEAR_THEN_CLEAR_BIT:
+                printf("if (bits[%s] clear) bits[%s] := 0", Symbol(plc, ADDR(0)), Symbol(plc, ADDR(1)));
                 break;
 
             case INT_SET_VARIABLE_TO_LITERAL:
-                printf("int16s[%s] := %d", Symbols[Program[pc + 1]], Program[pc + 2] + (Program[pc + 3] << 8));
-                pc += 4;
+                printf("int16s[%s] := %d", Symbol(plc, ADDR(0)), LITERAL());
                 break;
 
             case INT_SET_VARIABLE_TO_VARIABLE:
-                printf("int16s[%s] := int16s[%s]", Symbols[Program[pc + 1]], Symbols[Program[pc + 2]]);
-                pc += 3;
+                printf("int16s[%s] := int16s[%s]", Symbol(plc, ADDR(0)), Symbol(plc, ADDR(1)));
+                break;
+
+            case INT_SET_VARIABLE_NEG:
+                printf("int16s[%s] := -int16s[%s]", Symbol(plc, ADDR(0)), Symbol(plc, ADDR(1)));
+                break;
+
+            case INT_SET_VARIABLE_NOT:
+                printf("int16s[%s] := ~int16s[%s]", Symbol(plc, ADDR(0)), Symbol(plc, ADDR(1)));
+                break;
+
+            // the .xint opcodes are one byte: INT_DECREMENT_VARIABLE (6001) is
+            // written as 0x71, INT_SET_VARIABLE_MOD (1001) as 0xE9 and
+            // INT_SET_VARIABLE_SR0 (361) as 0x69
+            case INT_DECREMENT_VARIABLE & 0xFF:
+                printf("(int16s[%s])--", Symbol(plc, ADDR(0)));
                 break;
 
             case INT_INCREMENT_VARIABLE:
-                printf("(int16s[%s])++", Symbols[Program[pc + 1]]);
-                pc += 2;
+                printf("(int16s[%s])++", Symbol(plc, ADDR(0)));
                 break;
 
             case INT_SET_PWM:
-                printf("setpwm(%s, %d Hz)", Symbols[Program[pc + 1]], Program[pc + 2] + (Program[pc + 3] << 8));
-                pc += 4;
+                printf("setpwm(%s, %d Hz)", Symbol(plc, ADDR(0)), LITERAL());
                 break;
 
             case INT_READ_ADC:
-                printf("readadc(%s)", Symbols[Program[pc + 1]]);
-                pc += 2;
+                printf("readadc(%s)", Symbol(plc, ADDR(0)));
                 break;
 
             case INT_SET_VARIABLE_ADD:
-                c = '+';
+                c = "+";
                 goto arith;
             case INT_SET_VARIABLE_SUBTRACT:
-                c = '-';
+                c = "-";
                 goto arith;
             case INT_SET_VARIABLE_MULTIPLY:
-                c = '*';
+                c = "*";
                 goto arith;
             case INT_SET_VARIABLE_DIVIDE:
-                c = '/';
+                c = "/";
+                goto arith;
+            case INT_SET_VARIABLE_MOD & 0xFF:
+                c = "%";
                 goto arith;
-            case INT_SET_VARIABLE_MOD:
-                c = '%';
+            case INT_SET_VARIABLE_AND:
+                c = "&";
+                goto arith;
+            case INT_SET_VARIABLE_OR:
+                c = "|";
+                goto arith;
+            case INT_SET_VARIABLE_XOR:
+                c = "^";
                 goto arith;
             arith:
-                printf("int16s[%s] := int16s[%s] %c int16s[%s]", Symbols[Program[pc]], Symbols[Program[pc + 2]], c, Symbols[Program[pc + 3]]);
-                pc += 4;
+                printf("int16s[%s] := int16s[%s] %s int16s[%s]", Symbol(plc, ADDR(0)), Symbol(plc, ADDR(1)), c, Symbol(plc, ADDR(2)));
+                break;
+
+            case INT_SET_VARIABLE_SHL:
+                c = "<<";
+                goto shift;
+            case INT_SET_VARIABLE_SHR:
+                c = ">>";
+                goto shift;
+            case INT_SET_VARIABLE_SR0 & 0xFF:
+                c = ">>>";
+                goto shift;
+            case INT_SET_VARIABLE_ROL:
+                c = "rol";
+                goto shift;
+            case INT_SET_VARIABLE_ROR:
+                c = "ror";
+                goto shift;
+            shift:
+                printf("int%ds[%s] := int%ds[%s] %s int16s[%s], carry bits[%s]", 8 * WIDTH(next), Symbol(plc, ADDR(0)), 8 * WIDTH(next),
+                       Symbol(plc, ADDR(1)), c, Symbol(plc, ADDR(2)), Symbol(plc, ADDR(3)));
                 break;
 
             case INT_IF_BIT_SET:
-                printf("ifnot (bits[%s] set)", Symbols[Program[pc + 1]]);
-                pc += 2;
+                printf("ifnot (bits[%s] set)", Symbol(plc, ADDR(0)));
                 goto cond;
             case INT_IF_BIT_CLEAR:
-                printf("ifnot (bits[%s] clear)", Symbols[Program[pc + 1]]);
-                pc += 2;
+                printf("ifnot (bits[%s] clear)", Symbol(plc, ADDR(0)));
                 goto cond;
+
+            case INT_IF_VARIABLE_EQU_LITERAL:
+                c = "==";
+                goto condLiteral;
+            case INT_IF_VARIABLE_NEQ_LITERAL:
+                c = "!=";
+                goto condLiteral;
             case INT_IF_VARIABLE_LES_LITERAL:
-                printf("ifnot (int16s[%s] < %d)", Symbols[Program[pc + 1]], Program[pc + 2] + (Program[pc + 3] << 8));
-                pc += 4;
+                c = "<";
+                goto condLiteral;
+            case INT_IF_VARIABLE_LEQ_LITERAL:
+                c = "<=";
+                goto condLiteral;
+            case INT_IF_VARIABLE_GRT_LITERAL:
+                c = ">";
+                goto condLiteral;
+            case INT_IF_VARIABLE_GEQ_LITERAL:
+                c = ">=";
+                goto condLiteral;
+            condLiteral:
+                printf("ifnot (int16s[%s] %s %d)", Symbol(plc, ADDR(0)), c, LITERAL());
                 goto cond;
+
             case INT_IF_VARIABLE_EQU_VARIABLE:
-                printf("ifnot (int16s[%s] == int16s[%s])", Symbols[Program[pc + 1]], Symbols[Program[pc + 2]]);
-                pc += 3;
-                goto cond;
+                c = "==";
+                goto condVariable;
+            case INT_IF_VARIABLE_NEQ_VARIABLE:
+                c = "!=";
+                goto condVariable;
+            case INT_IF_VARIABLE_LES_VARIABLE:
+                c = "<";
+                goto condVariable;
+            case INT_IF_VARIABLE_LEQ_VARIABLE:
+                c = "<=";
+                goto condVariable;
             case INT_IF_VARIABLE_GRT_VARIABLE:
-                printf("ifnot (int16s[%s] > int16s[%s])", Symbols[Program[pc + 1]], Symbols[Program[pc + 2]]);
-                pc += 3;
+                c = ">";
+                goto condVariable;
+            case INT_IF_VARIABLE_GEQ_VARIABLE:
+                c = ">=";
+                goto condVariable;
+            condVariable:
+                printf("ifnot (int16s[%s] %s int16s[%s])", Symbol(plc, ADDR(0)), c, Symbol(plc, ADDR(1)));
                 goto cond;
             cond:
-                printf(" jump %03x", pc + Program[pc] + 1);
-                pc += 1;
+                printf(" jump %03x", next + JUMP(next));
                 break;
 
             case INT_ELSE:
-                printf("jump %03x", pc + Program[pc + 1] + 2);
-                pc += 2;
+                printf("jump %03x", next + JUMP(next));
                 break;
 
             case INT_END_OF_PROGRAM:
@@ -255,10 +655,78 @@ void Disassemble()
                 BadFormat();
                 break;
         }
+        pc = next;
         printf("\n");
     }
 }
 
+//-----------------------------------------------------------------------------
+// The shifts and rotations of a variable of bits (8 to 32) bits, by n bits:
+// the result is sign-extended from bits, like the variable itself, and the
+// last bit shifted or rotated out goes to *carry. A count of 0 or less
+// leaves the value and the carry as they are.
+//-----------------------------------------------------------------------------
+static inline int32_t SignExtend(uint64_t v, int bits)
+{
+    return (int32_t)((uint32_t)v << (32 - bits)) >> (32 - bits);
+}
+
+static inline uint64_t Unsigned(int32_t a, int bits)
+{
+    return (uint32_t)a & (0xFFFFFFFFu >> (32 - bits));
+}
+
+static inline int32_t Shl(int32_t a, int32_t n, int bits, BYTE *carry)
+{
+    if(n <= 0)
+        return SignExtend(Unsigned(a, bits), bits);
+    uint64_t v = Unsigned(a, bits) << std::min(n, bits + 1);
+    *carry = (v >> bits) & 1;
+    return SignExtend(v, bits);
+}
+
+static inline int32_t Shr(int32_t a, int32_t n, int bits, BYTE *carry)
+{
+    int64_t v = SignExtend(Unsigned(a, bits), bits);
+    if(n <= 0)
+        return (int32_t)v;
+    n = std::min(n, bits);
+    *carry = (v >> (n - 1)) & 1;
+    return (int32_t)(v >> n);
+}
+
+static inline int32_t Sr0(int32_t a, int32_t n, int bits, BYTE *carry)
+{
+    uint64_t v = Unsigned(a, bits);
+    if(n <= 0)
+        return SignExtend(v, bits);
+    n = std::min(n, bits + 1);
+    *carry = (v >> (n - 1)) & 1;
+    return SignExtend(v >> n, bits);
+}
+
+static inline int32_t Rol(int32_t a, int32_t n, int bits, BYTE *carry)
+{
+    uint64_t v = Unsigned(a, bits);
+    if(n <= 0)
+        return SignExtend(v, bits);
+    n %= bits;
+    v = (v << n) | (v >> (bits - n));
+    *carry = v & 1;
+    return SignExtend(v, bits);
+}
+
+static inline int32_t Ror(int32_t a, int32_t n, int bits, BYTE *carry)
+{
+    uint64_t v = Unsigned(a, bits);
+    if(n <= 0)
+        return SignExtend(v, bits);
+    n %= bits;
+    v = (v >> n) | (v << (bits - n));
+    *carry = (v >> (bits - 1)) & 1;
+    return SignExtend(v, bits);
+}
+
 //-----------------------------------------------------------------------------
 // This is the actual interpreter. It runs the program, and needs no state
 // other than that kept in Bits[] and Integers[]. If you specified a cycle
@@ -267,115 +735,304 @@ void Disassemble()
 //
 // The execution time of this function depends mostly on the length of the
 // program. It will be a little bit data-dependent but not very.
+//
+// It is instantiated for each OperandSize N, so that the operands are read
+// with the width known at compile time.
 //-----------------------------------------------------------------------------
+#define A(k) Operand<N>(&Program[pc + 1 + (k)*N])
+#define L() static_cast<int16_t>(Operand<2>(&Program[pc + 1 + N]))
+#define J(len) Operand<N>(&Program[pc + (len)-N])
+#define W() (8 * Program[pc + 1 + 4 * N])
+
+// An op with a 32-bit literal, at pc past its INT_WIDE_LITERAL prefix.
+// Those are rare, so they don't get cases of their own in the switch.
+// Returns the pc of the op to run next.
+template <int N> static int InterpretWideLiteral(Plc *plc, int pc)
+{
+    const uint8_t *Program = plc->Program;
+    int32_t *      Integers = plc->Integers.data();
+    int            next = pc - 1 + OpLength(plc, pc - 1);
+    int32_t        literal = Literal(&Program[pc + 1 + N], true);
+    bool           cond;
+    switch(Program[pc]) {
+        case INT_SET_VARIABLE_TO_LITERAL:
+            WRITE_INT(A(0), literal);
+            return next;
+        case INT_SET_PWM:
+            return next;
+        // clang-format off
+        case INT_IF_VARIABLE_EQU_LITERAL: cond = READ_INT(A(0)) == literal; break;
+        case INT_IF_VARIABLE_NEQ_LITERAL: cond = READ_INT(A(0)) != literal; break;
+        case INT_IF_VARIABLE_LES_LITERAL: cond = READ_INT(A(0)) < literal; break;
+        case INT_IF_VARIABLE_LEQ_LITERAL: cond = READ_INT(A(0)) <= literal; break;
+        case INT_IF_VARIABLE_GRT_LITERAL: cond = READ_INT(A(0)) > literal; break;
+        case INT_IF_VARIABLE_GEQ_LITERAL: cond = READ_INT(A(0)) >= literal; break;
+        // clang-format on
+        default:
+            return plc->ProgramLength - 1;
+    }
+    return cond ? next : next + Operand<N>(&Program[next - N]);
+}
 
-void InterpretOneCycle()
+template <int N> static void InterpretOneCycle(Plc *plc)
 {
+    const uint8_t *Program = plc->Program;
+    BYTE *         Bits = plc->Bits.data();
+    int32_t *      Integers = plc->Integers.data();
+
     int pc;
     for(pc = 0;;) {
         switch(Program[pc]) {
             case INT_SET_BIT:
-                WRITE_BIT(Program[pc + 1], 1);
-                pc += 2;
+                WRITE_BIT(A(0), 1);
+                pc += 1 + N;
                 break;
 
             case INT_CLEAR_BIT:
-                WRITE_BIT(Program[pc + 1], 0);
-                pc += 2;
+                WRITE_BIT(A(0), 0);
+                pc += 1 + N;
                 break;
 
             case INT_COPY_BIT_TO_BIT:
-                WRITE_BIT(Program[pc + 1], READ_BIT(Program[pc + 2]));
-                pc += 3;
+                WRITE_BIT(A(0), READ_BIT(A(1)));
+                pc += 1 + 2 * N;
+                break;
+
+            case INT_COPY_INVERTED_BIT:
+                WRITE_BIT(A(0), !READ_BIT(A(1)));
+                pc += 1 + 2 * N;
+                break;
+
+            case INT_COPY_BIT_TO_TWO_BITS:
+                WRITE_BIT(A(0), READ_BIT(A(1)));
+                WRITE_BIT(A(2), READ_BIT(A(1)));
+                pc += 1 + 3 * N;
+                break;
+
+            case INT_IF_BIT_SET_THEN_SET_BIT:
+                if(READ_BIT(A(0)))
+                    WRITE_BIT(A(1), 1);
+                pc += 1 + 2 * N;
+                break;
+
+            case INT_IF_BIT_SET_THEN_CLEAR_BIT:
+                if(READ_BIT(A(0)))
+                    WRITE_BIT(A(1), 0);
+                pc += 1 + 2 * N;
+                break;
+
+            case INT_IF_BIT_CLEAR_THEN_SET_BIT:
+                if(!READ_BIT(A(0)))
+                    WRITE_BIT(A(1), 1);
+                pc += 1 + 2 * N;
+                break;
+
+            case INT_IF_BIT_CLEAR_THEN_CLEAR_BIT:
+                if(!READ_BIT(A(0)))
+                    WRITE_BIT(A(1), 0);
+                pc += 1 + 2 * N;
                 break;
 
             case INT_SET_VARIABLE_TO_LITERAL:
-                WRITE_INT(Program[pc + 1], Program[pc + 2] + (Program[pc + 3] << 8));
-                pc += 4;
+                WRITE_INT(A(0), L());
+                pc += 3 + N;
                 break;
 
             case INT_SET_VARIABLE_TO_VARIABLE:
-                WRITE_INT(Program[pc + 1], READ_INT(Program[pc + 2]));
-                pc += 3;
+                WRITE_INT(A(0), READ_INT(A(1)));
+                pc += 1 + 2 * N;
+                break;
+
+            case INT_SET_VARIABLE_NEG:
+                WRITE_INT(A(0), -READ_INT(A(1)));
+                pc += 1 + 2 * N;
+                break;
+
+            case INT_SET_VARIABLE_NOT:
+                WRITE_INT(A(0), ~READ_INT(A(1)));
+                pc += 1 + 2 * N;
+                break;
+
+            case INT_DECREMENT_VARIABLE & 0xFF:
+                WRITE_INT(A(0), READ_INT(A(0)) - 1);
+                pc += 1 + N;
                 break;
 
             case INT_INCREMENT_VARIABLE:
-                WRITE_INT(Program[pc + 1], READ_INT(Program[pc + 1]) + 1);
-                pc += 2;
+                WRITE_INT(A(0), READ_INT(A(0)) + 1);
+                pc += 1 + N;
                 break;
 
             case INT_SET_VARIABLE_ADD:
-                WRITE_INT(Program[pc + 1], READ_INT(Program[pc + 2]) + READ_INT(Program[pc + 3]));
-                pc += 4;
+                WRITE_INT(A(0), READ_INT(A(1)) + READ_INT(A(2)));
+                pc += 1 + 3 * N;
                 break;
 
             case INT_SET_VARIABLE_SUBTRACT:
-                WRITE_INT(Program[pc + 1], READ_INT(Program[pc + 2]) - READ_INT(Program[pc + 3]));
-                pc += 4;
+                WRITE_INT(A(0), READ_INT(A(1)) - READ_INT(A(2)));
+                pc += 1 + 3 * N;
                 break;
 
             case INT_SET_VARIABLE_MULTIPLY:
-                WRITE_INT(Program[pc + 1], READ_INT(Program[pc + 2]) * READ_INT(Program[pc + 3]));
-                pc += 4;
+                WRITE_INT(A(0), READ_INT(A(1)) * READ_INT(A(2)));
+                pc += 1 + 3 * N;
                 break;
 
             case INT_SET_VARIABLE_DIVIDE:
-                if(READ_INT(Program[pc + 3]) != 0) {
-                    WRITE_INT(Program[pc + 1], READ_INT(Program[pc + 2]) / READ_INT(Program[pc + 3]));
+                if(READ_INT(A(2)) != 0) {
+                    WRITE_INT(A(0), READ_INT(A(1)) / READ_INT(A(2)));
                 }
-                pc += 4;
+                pc += 1 + 3 * N;
                 break;
 
-            case INT_SET_VARIABLE_MOD:
-                if(READ_INT(Program[pc + 3]) != 0) {
-                    WRITE_INT(Program[pc + 1], READ_INT(Program[pc + 2]) % READ_INT(Program[pc + 3]));
+            case INT_SET_VARIABLE_MOD & 0xFF:
+                if(READ_INT(A(2)) != 0) {
+                    WRITE_INT(A(0), READ_INT(A(1)) % READ_INT(A(2)));
                 }
-                pc += 4;
+                pc += 1 + 3 * N;
+                break;
+
+            case INT_SET_VARIABLE_AND:
+                WRITE_INT(A(0), READ_INT(A(1)) & READ_INT(A(2)));
+                pc += 1 + 3 * N;
+                break;
+
+            case INT_SET_VARIABLE_OR:
+                WRITE_INT(A(0), READ_INT(A(1)) | READ_INT(A(2)));
+                pc += 1 + 3 * N;
+                break;
+
+            case INT_SET_VARIABLE_XOR:
+                WRITE_INT(A(0), READ_INT(A(1)) ^ READ_INT(A(2)));
+                pc += 1 + 3 * N;
+                break;
+
+            case INT_SET_VARIABLE_SHL:
+                WRITE_INT(A(0), Shl(READ_INT(A(1)), READ_INT(A(2)), W(), &Bits[A(3)]));
+                pc += 2 + 4 * N;
+                break;
+
+            case INT_SET_VARIABLE_SHR:
+                WRITE_INT(A(0), Shr(READ_INT(A(1)), READ_INT(A(2)), W(), &Bits[A(3)]));
+                pc += 2 + 4 * N;
+                break;
+
+            case INT_SET_VARIABLE_SR0 & 0xFF:
+                WRITE_INT(A(0), Sr0(READ_INT(A(1)), READ_INT(A(2)), W(), &Bits[A(3)]));
+                pc += 2 + 4 * N;
+                break;
+
+            case INT_SET_VARIABLE_ROL:
+                WRITE_INT(A(0), Rol(READ_INT(A(1)), READ_INT(A(2)), W(), &Bits[A(3)]));
+                pc += 2 + 4 * N;
+                break;
+
+            case INT_SET_VARIABLE_ROR:
+                WRITE_INT(A(0), Ror(READ_INT(A(1)), READ_INT(A(2)), W(), &Bits[A(3)]));
+                pc += 2 + 4 * N;
                 break;
 
             case INT_SET_PWM:
-                //WRITE_PWM(Program[pc + 1]);    // PWM frequency is ignored
-                pc += 4;
+                //WRITE_PWM(A(0));    // PWM frequency is ignored
+                pc += 3 + N;
                 break;
 
             case INT_READ_ADC:
-                //READ_ADC(Program[pc + 1]);
-                pc += 2;
+                //READ_ADC(A(0));
+                pc += 1 + N;
                 break;
 
             case INT_IF_BIT_SET:
-                if(!READ_BIT(Program[pc + 1]))
-                    pc += Program[pc + 2];
-                pc += 3;
+                if(!READ_BIT(A(0)))
+                    pc += J(1 + 2 * N);
+                pc += 1 + 2 * N;
                 break;
 
             case INT_IF_BIT_CLEAR:
-                if(READ_BIT(Program[pc + 1]))
-                    pc += Program[pc + 2];
-                pc += 3;
+                if(READ_BIT(A(0)))
+                    pc += J(1 + 2 * N);
+                pc += 1 + 2 * N;
+                break;
+
+            case INT_IF_VARIABLE_EQU_LITERAL:
+                if(!(READ_INT(A(0)) == L()))
+                    pc += J(3 + 2 * N);
+                pc += 3 + 2 * N;
+                break;
+
+            case INT_IF_VARIABLE_NEQ_LITERAL:
+                if(!(READ_INT(A(0)) != L()))
+                    pc += J(3 + 2 * N);
+                pc += 3 + 2 * N;
                 break;
 
             case INT_IF_VARIABLE_LES_LITERAL:
-                if(!(READ_INT(Program[pc + 1]) < static_cast<int>(Program[pc + 2] + (Program[pc + 3] << 8))))
-                    pc += Program[pc + 4];
-                pc += 5;
+                if(!(READ_INT(A(0)) < L()))
+                    pc += J(3 + 2 * N);
+                pc += 3 + 2 * N;
+                break;
+
+            case INT_IF_VARIABLE_LEQ_LITERAL:
+                if(!(READ_INT(A(0)) <= L()))
+                    pc += J(3 + 2 * N);
+                pc += 3 + 2 * N;
+                break;
+
+            case INT_IF_VARIABLE_GRT_LITERAL:
+                if(!(READ_INT(A(0)) > L()))
+                    pc += J(3 + 2 * N);
+                pc += 3 + 2 * N;
+                break;
+
+            case INT_IF_VARIABLE_GEQ_LITERAL:
+                if(!(READ_INT(A(0)) >= L()))
+                    pc += J(3 + 2 * N);
+                pc += 3 + 2 * N;
                 break;
 
             case INT_IF_VARIABLE_EQU_VARIABLE:
-                if(!(READ_INT(Program[pc + 1]) == READ_INT(Program[pc + 2])))
-                    pc += Program[pc + 3];
-                pc += 4;
+                if(!(READ_INT(A(0)) == READ_INT(A(1))))
+                    pc += J(1 + 3 * N);
+                pc += 1 + 3 * N;
+                break;
+
+            case INT_IF_VARIABLE_NEQ_VARIABLE:
+                if(!(READ_INT(A(0)) != READ_INT(A(1))))
+                    pc += J(1 + 3 * N);
+                pc += 1 + 3 * N;
+                break;
+
+            case INT_IF_VARIABLE_LES_VARIABLE:
+                if(!(READ_INT(A(0)) < READ_INT(A(1))))
+                    pc += J(1 + 3 * N);
+                pc += 1 + 3 * N;
+                break;
+
+            case INT_IF_VARIABLE_LEQ_VARIABLE:
+                if(!(READ_INT(A(0)) <= READ_INT(A(1))))
+                    pc += J(1 + 3 * N);
+                pc += 1 + 3 * N;
                 break;
 
             case INT_IF_VARIABLE_GRT_VARIABLE:
-                if(!(READ_INT(Program[pc + 1]) > READ_INT(Program[pc + 2])))
-                    pc += Program[pc + 3];
-                pc += 4;
+                if(!(READ_INT(A(0)) > READ_INT(A(1))))
+                    pc += J(1 + 3 * N);
+                pc += 1 + 3 * N;
+                break;
+
+            case INT_IF_VARIABLE_GEQ_VARIABLE:
+                if(!(READ_INT(A(0)) >= READ_INT(A(1))))
+                    pc += J(1 + 3 * N);
+                pc += 1 + 3 * N;
                 break;
 
             case INT_ELSE:
-                pc += Program[pc + 1];
-                pc += 2;
+                pc += J(1 + N);
+                pc += 1 + N;
+                break;
+
+            case INT_WIDE_LITERAL:
+                pc = InterpretWideLiteral<N>(plc, pc + 1);
                 break;
 
             case INT_END_OF_PROGRAM:
@@ -386,29 +1043,538 @@ void InterpretOneCycle()
         }
     }
 }
+#undef A
+#undef L
+#undef J
+#undef W
 
-int main(int argc, char **argv)
+void InterpretOneCycle(Plc *plc)
+{
+    switch(plc->OperandSize) {
+        case 1:
+            InterpretOneCycle<1>(plc);
+            break;
+        case 2:
+            InterpretOneCycle<2>(plc);
+            break;
+        default:
+            InterpretOneCycle<4>(plc);
+            break;
+    }
+}
+
+#ifdef THREADED_DISPATCH
+//-----------------------------------------------------------------------------
+// The same virtual machine with direct-threaded dispatch. Predecode() walks
+// the variable-length byte program once after loading and turns it into
+// fixed-size ThreadedProgram[] entries: the address of the handler, the
+// addresses, the literal already assembled (16 or 32 bits, it makes no
+// difference here) or the width in bits of a shift, and the relative jump
+// offsets resolved to a pointer to the target op. Every handler then ends in its own indirect jump instead of
+// all ops sharing the one of the switch.
+//-----------------------------------------------------------------------------
+static void RunThreaded(Plc *plc, bool predecode)
 {
-    int rc;
+    if(predecode) {
+        const uint8_t *          Program = plc->Program;
+        int                      ProgramLength = plc->ProgramLength;
+        int                      OperandSize = plc->OperandSize;
+        std::vector<ThreadedOp> &ThreadedProgram = plc->ThreadedProgram;
+
+        // Byte address -> index in ThreadedProgram[], for the jump targets
+        std::vector<int> index(ProgramLength, -1);
+        std::vector<int> jump;
+        int              n = 0;
+        int              at;
+
+        ThreadedProgram.clear();
+        // VerifyProgram() checked the ops, their addresses and jump targets
+        for(at = 0; Program[at] != INT_END_OF_PROGRAM; n++) {
+            int  next = at + OpLength(plc, at);
+            bool wide = (Program[at] == INT_WIDE_LITERAL);
+            int  pc = at + wide;
+            int  addrs;
+            bool literal, hasJump, width;
+            OpOperands(Program[pc], &addrs, &literal, &hasJump, &width);
+            ThreadedProgram.emplace_back();
+            ThreadedOp *t = &ThreadedProgram[n];
+            index[at] = n;
+            t->a = (addrs > 0) ? ADDR(0) : 0;
+            t->b = (addrs > 1) ? ADDR(1) : 0;
+            t->c = (addrs > 2) ? ADDR(2) : 0;
+            t->d = (addrs > 3) ? ADDR(3) : 0;
+            t->literal = literal ? LITERAL() : width ? 8 * WIDTH(next) : 0;
+            t->target = nullptr;
+            // the jump offset is the last operand of the op, relative to the
+            // op that follows
+            jump.push_back(hasJump ? next + JUMP(next) : -1);
+            switch(Program[pc]) {
+                // clang-format off
+                case INT_SET_BIT:                     t->handler = &&set_bit; break;
+                case INT_CLEAR_BIT:                   t->handler = &&clear_bit; break;
+                case INT_COPY_BIT_TO_BIT:             t->handler = &&copy_bit; break;
+                case INT_COPY_INVERTED_BIT:           t->handler = &&copy_inverted_bit; break;
+                case INT_COPY_BIT_TO_TWO_BITS:        t->handler = &&copy_bit_to_two; break;
+                case INT_IF_BIT_SET_THEN_SET_BIT:     t->handler = &&if_set_then_set; break;
+                case INT_IF_BIT_SET_THEN_CLEAR_BIT:   t->handler = &&if_set_then_clear; break;
+                case INT_IF_BIT_CLEAR_THEN_SET_BIT:   t->handler = &&if_clear_then_set; break;
+                case INT_IF_BIT_CLEAR_THEN_CLEAR_BIT: t->handler = &&if_clear_then_clear; break;
+                case INT_SET_VARIABLE_TO_LITERAL:     t->handler = &&set_literal; break;
+                case INT_SET_VARIABLE_TO_VARIABLE:    t->handler = &&set_variable; break;
+                case INT_SET_VARIABLE_NEG:            t->handler = &&neg; break;
+                case INT_SET_VARIABLE_NOT:            t->handler = &&not_; break;
+                case INT_DECREMENT_VARIABLE & 0xFF:   t->handler = &&decrement; break;
+                case INT_INCREMENT_VARIABLE:          t->handler = &&increment; break;
+                case INT_SET_VARIABLE_ADD:            t->handler = &&add; break;
+                case INT_SET_VARIABLE_SUBTRACT:       t->handler = &&subtract; break;
+                case INT_SET_VARIABLE_MULTIPLY:       t->handler = &&multiply; break;
+                case INT_SET_VARIABLE_DIVIDE:         t->handler = &&divide; break;
+                case INT_SET_VARIABLE_MOD & 0xFF:     t->handler = &&mod; break;
+                case INT_SET_VARIABLE_AND:            t->handler = &&and_; break;
+                case INT_SET_VARIABLE_OR:             t->handler = &&or_; break;
+                case INT_SET_VARIABLE_XOR:            t->handler = &&xor_; break;
+                case INT_SET_VARIABLE_SHL:            t->handler = &&shl; break;
+                case INT_SET_VARIABLE_SHR:            t->handler = &&shr; break;
+                case INT_SET_VARIABLE_SR0 & 0xFF:     t->handler = &&sr0; break;
+                case INT_SET_VARIABLE_ROL:            t->handler = &&rol; break;
+                case INT_SET_VARIABLE_ROR:            t->handler = &&ror; break;
+                case INT_SET_PWM:                     t->handler = &&nop; break;
+                case INT_READ_ADC:                    t->handler = &&nop; break;
+                case INT_IF_BIT_SET:                  t->handler = &&if_bit_set; break;
+                case INT_IF_BIT_CLEAR:                t->handler = &&if_bit_clear; break;
+                case INT_IF_VARIABLE_EQU_LITERAL:     t->handler = &&if_equ_literal; break;
+                case INT_IF_VARIABLE_NEQ_LITERAL:     t->handler = &&if_neq_literal; break;
+                case INT_IF_VARIABLE_LES_LITERAL:     t->handler = &&if_les_literal; break;
+                case INT_IF_VARIABLE_LEQ_LITERAL:     t->handler = &&if_leq_literal; break;
+                case INT_IF_VARIABLE_GRT_LITERAL:     t->handler = &&if_grt_literal; break;
+                case INT_IF_VARIABLE_GEQ_LITERAL:     t->handler = &&if_geq_literal; break;
+                case INT_IF_VARIABLE_EQU_VARIABLE:    t->handler = &&if_equ; break;
+                case INT_IF_VARIABLE_NEQ_VARIABLE:    t->handler = &&if_neq; break;
+                case INT_IF_VARIABLE_LES_VARIABLE:    t->handler = &&if_les; break;
+                case INT_IF_VARIABLE_LEQ_VARIABLE:    t->handler = &&if_leq; break;
+                case INT_IF_VARIABLE_GRT_VARIABLE:    t->handler = &&if_grt; break;
+                case INT_IF_VARIABLE_GEQ_VARIABLE:    t->handler = &&if_geq; break;
+                case INT_ELSE:                        t->handler = &&jump; break;
+                // clang-format on
+            }
+            at = next;
+        }
+        index[at] = n;
+        ThreadedProgram.emplace_back();
+        ThreadedProgram[n].handler = &&end;
+        n++;
+        for(int i = 0; i < n - 1; i++) {
+            if(jump[i] >= 0)
+                ThreadedProgram[i].target = &ThreadedProgram[index[jump[i]]];
+        }
+        return;
+    }
 
-    if(argc != 2) {
-        fprintf(stderr, "usage: %s xxx.xint\n", argv[0]);
-        return -1;
+#define DISPATCH() goto *t->handler
+#define NEXT()      \
+    do {            \
+        t++;        \
+        DISPATCH(); \
+    } while(0)
+#define JUMP_UNLESS(cond)  \
+    do {                   \
+        if(!(cond)) {      \
+            t = t->target; \
+            DISPATCH();    \
+        }                  \
+        NEXT();            \
+    } while(0)
+
+    BYTE *      Bits = plc->Bits.data();
+    int32_t *   Integers = plc->Integers.data();
+    ThreadedOp *t = plc->ThreadedProgram.data();
+    DISPATCH();
+
+set_bit:
+    WRITE_BIT(t->a, 1);
+    NEXT();
+clear_bit:
+    WRITE_BIT(t->a, 0);
+    NEXT();
+copy_bit:
+    WRITE_BIT(t->a, READ_BIT(t->b));
+    NEXT();
+copy_inverted_bit:
+    WRITE_BIT(t->a, !READ_BIT(t->b));
+    NEXT();
+copy_bit_to_two:
+    WRITE_BIT(t->a, READ_BIT(t->b));
+    WRITE_BIT(t->c, READ_BIT(t->b));
+    NEXT();
+if_set_then_set:
+    if(READ_BIT(t->a))
+        WRITE_BIT(t->b, 1);
+    NEXT();
+if_set_then_clear:
+    if(READ_BIT(t->a))
+        WRITE_BIT(t->b, 0);
+    NEXT();
+if_clear_then_set:
+    if(!READ_BIT(t->a))
+        WRITE_BIT(t->b, 1);
+    NEXT();
+if_clear_then_clear:
+    if(!READ_BIT(t->a))
+        WRITE_BIT(t->b, 0);
+    NEXT();
+set_literal:
+    WRITE_INT(t->a, t->literal);
+    NEXT();
+set_variable:
+    WRITE_INT(t->a, READ_INT(t->b));
+    NEXT();
+neg:
+    WRITE_INT(t->a, -READ_INT(t->b));
+    NEXT();
+not_:
+    WRITE_INT(t->a, ~READ_INT(t->b));
+    NEXT();
+decrement:
+    WRITE_INT(t->a, READ_INT(t->a) - 1);
+    NEXT();
+increment:
+    WRITE_INT(t->a, READ_INT(t->a) + 1);
+    NEXT();
+add:
+    WRITE_INT(t->a, READ_INT(t->b) + READ_INT(t->c));
+    NEXT();
+subtract:
+    WRITE_INT(t->a, READ_INT(t->b) - READ_INT(t->c));
+    NEXT();
+multiply:
+    WRITE_INT(t->a, READ_INT(t->b) * READ_INT(t->c));
+    NEXT();
+divide:
+    if(READ_INT(t->c) != 0)
+        WRITE_INT(t->a, READ_INT(t->b) / READ_INT(t->c));
+    NEXT();
+mod:
+    if(READ_INT(t->c) != 0)
+        WRITE_INT(t->a, READ_INT(t->b) % READ_INT(t->c));
+    NEXT();
+and_:
+    WRITE_INT(t->a, READ_INT(t->b) & READ_INT(t->c));
+    NEXT();
+or_:
+    WRITE_INT(t->a, READ_INT(t->b) | READ_INT(t->c));
+    NEXT();
+xor_:
+    WRITE_INT(t->a, READ_INT(t->b) ^ READ_INT(t->c));
+    NEXT();
+shl:
+    WRITE_INT(t->a, Shl(READ_INT(t->b), READ_INT(t->c), t->literal, &Bits[t->d]));
+    NEXT();
+shr:
+    WRITE_INT(t->a, Shr(READ_INT(t->b), READ_INT(t->c), t->literal, &Bits[t->d]));
+    NEXT();
+sr0:
+    WRITE_INT(t->a, Sr0(READ_INT(t->b), READ_INT(t->c), t->literal, &Bits[t->d]));
+    NEXT();
+rol:
+    WRITE_INT(t->a, Rol(READ_INT(t->b), READ_INT(t->c), t->literal, &Bits[t->d]));
+    NEXT();
+ror:
+    WRITE_INT(t->a, Ror(READ_INT(t->b), READ_INT(t->c), t->literal, &Bits[t->d]));
+    NEXT();
+if_bit_set:
+    JUMP_UNLESS(READ_BIT(t->a));
+if_bit_clear:
+    JUMP_UNLESS(!READ_BIT(t->a));
+if_equ_literal:
+    JUMP_UNLESS(READ_INT(t->a) == t->literal);
+if_neq_literal:
+    JUMP_UNLESS(READ_INT(t->a) != t->literal);
+if_les_literal:
+    JUMP_UNLESS(READ_INT(t->a) < t->literal);
+if_leq_literal:
+    JUMP_UNLESS(READ_INT(t->a) <= t->literal);
+if_grt_literal:
+    JUMP_UNLESS(READ_INT(t->a) > t->literal);
+if_geq_literal:
+    JUMP_UNLESS(READ_INT(t->a) >= t->literal);
+if_equ:
+    JUMP_UNLESS(READ_INT(t->a) == READ_INT(t->b));
+if_neq:
+    JUMP_UNLESS(READ_INT(t->a) != READ_INT(t->b));
+if_les:
+    JUMP_UNLESS(READ_INT(t->a) < READ_INT(t->b));
+if_leq:
+    JUMP_UNLESS(READ_INT(t->a) <= READ_INT(t->b));
+if_grt:
+    JUMP_UNLESS(READ_INT(t->a) > READ_INT(t->b));
+if_geq:
+    JUMP_UNLESS(READ_INT(t->a) >= READ_INT(t->b));
+jump:
+    t = t->target;
+    DISPATCH();
+nop:
+    NEXT();
+end:
+    return;
+
+#undef DISPATCH
+#undef NEXT
+#undef JUMP_UNLESS
+}
+
+void Predecode(Plc *plc)
+{
+    RunThreaded(plc, true);
+}
+
+void InterpretOneCycleThreaded(Plc *plc)
+{
+    RunThreaded(plc, false);
+}
+#endif
+
+//-----------------------------------------------------------------------------
+// Run one core for the given number of cycles from a cleared state and print
+// the time per cycle and per op of the program.
+//-----------------------------------------------------------------------------
+static void BenchmarkCore(Plc *plc, const char *name, void (*cycle)(Plc *), long cycles, int ops)
+{
+    std::fill(plc->Integers.begin(), plc->Integers.end(), 0);
+    std::fill(plc->Bits.begin(), plc->Bits.end(), 0);
+
+    auto start = std::chrono::steady_clock::now();
+    for(long i = 0; i < cycles; i++)
+        cycle(plc);
+    double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+
+    printf("%-8s %ld cycles, %.1f ns/cycle, %.2f ns/op (%d ops)\n", name, cycles, ns / cycles, ns / cycles / (ops ? ops : 1), ops);
+}
+
+void Benchmark(Plc *plc, long cycles)
+{
+    int ops = 0;
+    for(int pc = 0; plc->Program[pc] != INT_END_OF_PROGRAM; pc += OpLength(plc, pc))
+        ops++;
+
+    BenchmarkCore(plc, "switch", InterpretOneCycle, cycles, ops);
+#ifdef THREADED_DISPATCH
+    BenchmarkCore(plc, "threaded", InterpretOneCycleThreaded, cycles, ops);
+#endif
+}
+
+//-----------------------------------------------------------------------------
+// The host: runs any number of programs in one process. The programs that
+// are pinned to a CPU get a thread of their own, bound to that CPU; the
+// others are spread over a pool of worker threads, by their ops per second.
+// Each thread runs its programs on their own cycle times, the one with the
+// earliest deadline first. A stop request takes effect once the sleeping
+// threads wake up for their next cycle.
+//-----------------------------------------------------------------------------
+static std::atomic<unsigned> ReportRequests; // the workers print the statistics when it changes
+static std::atomic<int>      Running;        // worker threads
+static std::mutex            ReportLock;
+
+static void RunCycle(Plc *plc)
+{
+    if(plc->Shm) {
+        // the writes of the other processes, before the program reads them
+        LdShmWrite writes[LDSHM_WRITES];
+        uint32_t   n = LdShmTake(plc->Shm, writes);
+        for(uint32_t i = 0; i < n; i++) {
+            if(writes[i].Addr >= plc->Bits.size())
+                continue;
+            if(writes[i].Type == LDIMAGE_SYMBOL_BIT)
+                plc->Bits[writes[i].Addr] = (writes[i].Value != 0);
+            else
+                plc->Integers[writes[i].Addr] = writes[i].Value;
+        }
     }
+#ifdef THREADED_DISPATCH
+    InterpretOneCycleThreaded(plc);
+#else
+    InterpretOneCycle(plc);
+#endif
+    if(plc->Shm)
+        LdShmPublish(plc->Shm, plc->Integers.data(), plc->Bits.data());
+}
 
-    rc = LoadProgram(argv[1]);
-    memset(Integers, 0, sizeof(Integers));
-    memset(Bits, 0, sizeof(Bits));
+static void PrintCycles(const Plc *plc)
+{
+    fprintf(stderr, "%s: ", plc->Name.c_str());
+    LdCyclePrint(&plc->Cycle, stderr);
+}
 
-    Disassemble();
-    if(rc)
-        exit(rc);
+static void Worker(std::vector<Plc *> plcs, long cycles)
+{
+    unsigned reported = ReportRequests;
+    while(!LdCycleStop) {
+        Plc *next = nullptr;
+        for(Plc *plc : plcs) {
+            if((cycles != 0) && ((long)plc->Cycle.cycles >= cycles))
+                continue;
+            if(!next || (plc->Cycle.deadline < next->Cycle.deadline))
+                next = plc;
+        }
+        if(!next)
+            break;
+        LdCycleWait(&next->Cycle);
+        RunCycle(next);
+        LdCycleDone(&next->Cycle);
+
+        if(ReportRequests != reported) {
+            reported = ReportRequests;
+            std::lock_guard<std::mutex> lock(ReportLock);
+            for(Plc *plc : plcs)
+                PrintCycles(plc);
+        }
+    }
+    Running--;
+}
 
-    // 1000 cycles times 10 ms gives 10 seconds execution
-    for(int i = 0; i < 1000; i++) {
-        InterpretOneCycle();
-        Sleep(10);
+static void Pin(std::thread &thread, int cpu)
+{
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if(pthread_setaffinity_np(thread.native_handle(), sizeof(set), &set) != 0)
+        fprintf(stderr, "couldn't pin to CPU %d\n", cpu);
+#else
+    fprintf(stderr, "pinning to CPU %d is not supported here\n", cpu);
+#endif
+}
+
+//-----------------------------------------------------------------------------
+// Expose the process image of plc in the shared memory segment name, with
+// the addresses of the $$IO symbol table; see ldshm.h for the readers.
+//-----------------------------------------------------------------------------
+static void Share(Plc *plc, const std::string &name)
+{
+    std::vector<LdImageSymbol> symbols(plc->Symbols.size());
+    for(size_t i = 0; i < symbols.size(); i++) {
+        memset(&symbols[i], 0, sizeof(symbols[i]));
+        symbols[i].Addr = i;
+        symbols[i].Type = LDIMAGE_SYMBOL_ANY;
+        strncpy(symbols[i].Name, plc->Symbols[i].c_str(), LDIMAGE_NAME_LEN - 1);
     }
+    plc->ShmName = name;
+    plc->Shm = LdShmCreate(name.c_str(), plc->CycleTime, plc->Integers.size(), plc->Bits.size(), symbols.data(), symbols.size());
+    if(!plc->Shm) {
+        fprintf(stderr, "couldn't create the shared memory '%s'\n", name.c_str());
+        exit(-1);
+    }
+}
 
+int Host(std::vector<Plc> &plcs, int workers, long cycles)
+{
+    std::vector<std::vector<Plc *>> pool(workers);
+    std::vector<double>             load(workers, 0);
+    std::vector<std::thread>        threads;
+
+    LdCycleSignals();
+    for(Plc &plc : plcs) {
+#ifdef THREADED_DISPATCH
+        Predecode(&plc);
+#endif
+        LdCycleInit(&plc.Cycle, plc.CycleTime);
+    }
+    Running = 0;
+    for(Plc &plc : plcs) {
+        if(plc.Cpu >= 0) {
+            Running++;
+            threads.emplace_back(Worker, std::vector<Plc *>{&plc}, cycles);
+            Pin(threads.back(), plc.Cpu);
+        } else {
+            int w = std::min_element(load.begin(), load.end()) - load.begin();
+            pool[w].push_back(&plc);
+            load[w] += (double)plc.ProgramLength / plc.CycleTime;
+        }
+    }
+    for(std::vector<Plc *> &p : pool) {
+        if(!p.empty()) {
+            Running++;
+            threads.emplace_back(Worker, p, cycles);
+        }
+    }
+
+    while((Running > 0) && !LdCycleStop) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        if(LdCycleReport) {
+            LdCycleReport = 0;
+            ReportRequests++;
+        }
+    }
+    for(std::thread &t : threads)
+        t.join();
+    for(const Plc &plc : plcs) {
+        PrintCycles(&plc);
+        if(plc.Shm)
+            LdShmDestroy(plc.Shm, plc.ShmName.c_str());
+    }
     return 0;
 }
+
+int main(int argc, char **argv)
+{
+    if((argc == 4) && (strcmp(argv[1], "-b") == 0)) {
+        // ldxinterpret -b cycles xxx.xint: compare the interpreter cores
+        Plc plc;
+        LoadProgram(&plc, argv[3]);
+#ifdef THREADED_DISPATCH
+        Predecode(&plc);
+#endif
+        Benchmark(&plc, atol(argv[2]));
+        return 0;
+    }
+
+    // ldxinterpret [-n cycles] [-w workers] [-s /shm] xxx.xint[@cpu] ...: run the
+    // programs the given number of cycles, by default until SIGINT or SIGTERM
+    long        cycles = 0;
+    int         workers = 0;
+    const char *shm = nullptr;
+    int         i;
+    for(i = 1; (i + 1 < argc) && (argv[i][0] == '-'); i += 2) {
+        if(strcmp(argv[i], "-n") == 0)
+            cycles = atol(argv[i + 1]);
+        else if(strcmp(argv[i], "-w") == 0)
+            workers = atoi(argv[i + 1]);
+        else if(strcmp(argv[i], "-s") == 0)
+            shm = argv[i + 1];
+        else
+            break;
+    }
+    if((i >= argc) || (argv[i][0] == '-')) {
+        fprintf(stderr,
+                "usage: %s [-n cycles] [-w workers] [-s /shm] xxx.xint[@cpu] ...\n"
+                "       %s -b cycles xxx.xint\n",
+                argv[0], argv[0]);
+        return -1;
+    }
+
+    std::vector<Plc> plcs(argc - i);
+    int              unpinned = 0;
+    for(Plc &plc : plcs) {
+        std::string file = argv[i++];
+        size_t      at = file.rfind('@');
+        if(at != std::string::npos) {
+            plc.Cpu = atoi(file.c_str() + at + 1);
+            file.resize(at);
+        } else {
+            unpinned++;
+        }
+        LoadProgram(&plc, file.c_str());
+    }
+    if(plcs.size() == 1)
+        Disassemble(&plcs[0]);
+    // -s /name: the process image in shared memory, /name.1, /name.2, ...
+    // if there are several programs
+    for(size_t k = 0; shm && (k < plcs.size()); k++)
+        Share(&plcs[k], (plcs.size() == 1) ? shm : std::string(shm) + "." + std::to_string(k + 1));
+    if(workers <= 0)
+        workers = std::max(1, std::min<int>(unpinned, std::thread::hardware_concurrency()));
+
+    // The cycles start every CycleTime us of each program, however long they
+    // take; the statistics of the timing go to stderr at the end and on
+    // SIGUSR1.
+    return Host(plcs, workers, cycles);
+}
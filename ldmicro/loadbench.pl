@@ -0,0 +1,89 @@
+#!/usr/bin/perl
+#
+# Benchmark of the .ld loader: writes a synthetic project of 20000 rungs
+# (or -n rungs) with a mix of all the common elements, and times
+# 'ldmicro /t', which loads it and exports it as text, for the ldmicro.exe
+# of this tree and, if LDMICRO_OLD names one, for an older build. The export
+# is the same work for both, so the difference is the loader; the two text
+# exports must also be the same, which checks that both load the same
+# program.
+#
+# With /ldc a project that big leaves a binary cache of its rungs,
+# bench/load20000.ldc, which the next load reads instead of the text; it is
+# removed before every run of the text loader, and the load from it is timed
+# on its own.
+#
+# usage: perl loadbench.pl [-n rungs] [-r runs]
+# LDMICRO and LDMICRO_OLD can be overridden from the environment.
+
+use Time::HiRes qw(time);
+
+$rungs = 20000;
+$runs = 3;
+while ($ARGV[0] =~ /^-/) {
+    $opt = shift @ARGV;
+    $rungs = shift @ARGV if $opt eq '-n';
+    $runs = shift @ARGV if $opt eq '-r';
+}
+
+$ldmicro = $ENV{'LDMICRO'} || './ldmicro.exe';
+$old = $ENV{'LDMICRO_OLD'};
+
+if (not -d 'bench/') {
+    mkdir 'bench';
+}
+
+# One rung of every kind, $n makes the names of every rung different.
+sub rung {
+    my ($i) = @_;
+    my $n = $i % 500;
+    my $k = $i % 8;
+    return "RUNG\n  CONTACTS Xin$n 0 0\n  CONTACTS Rrel$n 1 0\n  COIL Yout$n 0 0 0 0\nEND\n" if $k == 0;
+    return "RUNG\n  PARALLEL\n    CONTACTS Xa$n 0 0\n    SERIES\n      CONTACTS Xb$n 0 0\n      CONTACTS Rc$n 1 0\n    END\n  END\n  TON Tdel$n 100000 0\n  COIL Rrel$n 0 0 0 0\nEND\n" if $k == 1;
+    return "RUNG\n  CONTACTS Rrel$n 0 0\n  CTU Ccnt$n 10 0 /\n  COIL Ydone$n 0 1 0 0\nEND\n" if $k == 2;
+    return "RUNG\n  GEQ Ccnt$n 5\n  ADD value$n value$n 1\n  MOVE out$n value$n\nEND\n" if $k == 3;
+    return "RUNG\n  CONTACTS Xrst$n 0 0\n  RES Ccnt$n\nEND\n" if $k == 4;
+    return "RUNG\n  COMMENT synthetic rung $i\\r\\nof the load benchmark\nEND\n" if $k == 5;
+    return "RUNG\n  OSR\n  TOF Toff$n 250000 0\n  SUB value$n value$n 1\n  COIL Rflag$n 0 0 0 0\nEND\n" if $k == 6;
+    return "RUNG\n  EQU value$n 0\n  PARALLEL\n    COIL Ya$n 0 0 0 0\n    COIL Yb$n 0 0 1 0\n  END\nEND\n";
+}
+
+$file = "bench/load$rungs.ld";
+$cache = "bench/load$rungs.ldc";
+open(OUT, ">$file") or die "couldn't write $file";
+print OUT "LDmicro0.2\nCYCLE=10000 us at Timer1, YPlcCycleDuty:0, ConfigurationWord(s):0x0\n";
+print OUT "CRYSTAL=16000000 Hz\nBAUD=2400 Hz, RATE=0 Hz, SPEED=0 Hz\n\nPROGRAM\n";
+for ($i = 0; $i < $rungs; $i++) {
+    print OUT rung($i);
+}
+close(OUT);
+
+# Best time of $runs loads of $file by the ldmicro $exe, from the text or,
+# if $cached, from the cache that the first load leaves.
+sub bench {
+    my ($exe, $txt, $cached) = @_;
+    my $best;
+    unlink $cache;
+    system "$exe /ldc /t $file $txt" if $cached;
+    for (1 .. $runs) {
+        unlink $txt;
+        unlink $cache if not $cached;
+        my $t = time;
+        system "$exe /t $file $txt";
+        $t = time - $t;
+        die "$exe didn't load $file" if not -s $txt;
+        $best = $t if not defined $best or $t < $best;
+    }
+    printf "%-30s %8.3f s%s\n", $exe, $best, $cached ? ', cached' : '';
+    return $best;
+}
+
+print "$rungs rungs, best of $runs:\n";
+$new = bench($ldmicro, 'bench/load-new.txt');
+bench($ldmicro, 'bench/load-cached.txt', 1);
+system('cmp', '-s', 'bench/load-new.txt', 'bench/load-cached.txt') == 0 or print "the export from the cache differs!\n";
+if ($old) {
+    $was = bench($old, 'bench/load-old.txt');
+    printf "%.1fx faster\n", $was / $new;
+    system('cmp', '-s', 'bench/load-new.txt', 'bench/load-old.txt') == 0 or print "the text exports differ!\n";
+}
@@ -23,6 +23,7 @@
 #include "stdafx.h"
 
 #include "ldmicro.h"
+#include "ldversion.h"
 #include "pcports.h"
 
 char *FrmStrToStr(char *dest);
@@ -33,585 +34,582 @@ char *DelFramingDoubleQuotes(char *str);
 
 ElemSubcktSeries *LoadSeriesFromFile(FileTracker &f);
 
+//-----------------------------------------------------------------------------
+// Scanner of the fields of a line from a saved project file. word(),
+// number() and letter() read the next field like the "%s", "%d" and " %c"
+// of sscanf(), but without parsing a format for every field, and a word is
+// cut to the size of its destination.
+//-----------------------------------------------------------------------------
+class LineScanner {
+  public:
+    LineScanner(const char *line) : p_(line)
+    {
+    }
+    bool word(char *dest, size_t size)
+    {
+        skip();
+        if(!*p_)
+            return false;
+        size_t n = 0;
+        while(*p_ && !isspace((unsigned char)*p_)) {
+            if(n < size - 1)
+                dest[n++] = *p_;
+            p_++;
+        }
+        dest[n] = '\0';
+        return true;
+    }
+    template <size_t N> bool word(char (&dest)[N])
+    {
+        return word(dest, N);
+    }
+    template <typename T> bool number(T *dest)
+    {
+        char *end;
+        long  v = strtol(p_, &end, 10);
+        if(end == p_)
+            return false;
+        *dest = static_cast<T>(v);
+        p_ = end;
+        return true;
+    }
+    bool letter(char *dest)
+    {
+        skip();
+        if(!*p_)
+            return false;
+        *dest = *p_++;
+        return true;
+    }
+
+  private:
+    void skip()
+    {
+        while(isspace((unsigned char)*p_))
+            p_++;
+    }
+    const char *p_;
+};
+
+// The first word of every line of a leaf element, and its type. Some of
+// them are the names of old versions.
+static const std::unordered_map<std::string, int> LeafKeywords = {
+    // clang-format off
+    {"COMMENT",          ELEM_COMMENT},
+    {"CONTACTS",         ELEM_CONTACTS},
+    {"COIL",             ELEM_COIL},
+    {"PLACEHOLDER",      ELEM_PLACEHOLDER},
+    {"SHORT",            ELEM_SHORT},
+    {"OPEN",             ELEM_OPEN},
+    {"MASTER_RELAY",     ELEM_MASTER_RELAY},
+    {"DELAY",            ELEM_DELAY},
+    {"SLEEP",            ELEM_SLEEP},
+    {"CLRWDT",           ELEM_CLRWDT},
+    {"LOCK",             ELEM_LOCK},
+    {"GOTO",             ELEM_GOTO},
+    {"GOSUB",            ELEM_GOSUB},
+    {"RETURN",           ELEM_RETURN},
+    {"LABEL",            ELEM_LABEL},
+    {"SUBPROG",          ELEM_SUBPROG},
+    {"ENDSUB",           ELEM_ENDSUB},
+    {"SHIFT_REGISTER",   ELEM_SHIFT_REGISTER},
+    {"OSR",              ELEM_ONE_SHOT_RISING},
+    {"OSF",              ELEM_ONE_SHOT_FALLING},
+    {"OSL",              ELEM_ONE_DROP_FALLING},
+    {"ODF",              ELEM_ONE_DROP_FALLING},
+    {"ODR",              ELEM_ONE_DROP_RISING},
+    {"OSC",              ELEM_OSC},
+    {"NPULSE_OFF",       ELEM_NPULSE_OFF},
+    {"TIME2COUNT",       ELEM_TIME2COUNT},
+    {"TIME2DELAY",       ELEM_TIME2DELAY},
+    {"TON",              ELEM_TON},
+    {"TOF",              ELEM_TOF},
+    {"RTO",              ELEM_RTO},
+    {"RTL",              ELEM_RTL},
+    {"TCY",              ELEM_TCY},
+    {"THI",              ELEM_THI},
+    {"TLO",              ELEM_TLO},
+    {"CTR",              ELEM_CTR},
+    {"CTC",              ELEM_CTC},
+    {"CTU",              ELEM_CTU},
+    {"CTD",              ELEM_CTD},
+    {"RES",              ELEM_RES},
+    {"MOVE",             ELEM_MOVE},
+    {"BIN2BCD",          ELEM_BIN2BCD},
+    {"BCD2BIN",          ELEM_BCD2BIN},
+    {"OPPOSITE",         ELEM_OPPOSITE},
+    {"SWAP",             ELEM_SWAP},
+    {"BUS",              ELEM_BUS},
+    {"SPI",              ELEM_SPI},
+    {"SPI_WR",           ELEM_SPI_WR},
+    {"I2C_RD",           ELEM_I2C_RD},
+    {"I2C_WR",           ELEM_I2C_WR},
+    {"7SEGMENTS",        ELEM_7SEG},
+    {"9SEGMENTS",        ELEM_9SEG},
+    {"14SEGMENTS",       ELEM_14SEG},
+    {"16SEGMENTS",       ELEM_16SEG},
+    {"STEPPER",          ELEM_STEPPER},
+    {"PULSER",           ELEM_PULSER},
+    {"NPULSE",           ELEM_NPULSE},
+    {"QUAD_ENCOD",       ELEM_QUAD_ENCOD},
+    {"ADD",              ELEM_ADD},
+    {"SUB",              ELEM_SUB},
+    {"MUL",              ELEM_MUL},
+    {"DIV",              ELEM_DIV},
+    {"MOD",              ELEM_MOD},
+    {"SHL",              ELEM_SHL},
+    {"SHR",              ELEM_SHR},
+    {"SR0",              ELEM_SR0},
+    {"ROL",              ELEM_ROL},
+    {"ROR",              ELEM_ROR},
+    {"AND",              ELEM_AND},
+    {"OR",               ELEM_OR},
+    {"XOR",              ELEM_XOR},
+    {"NOT",              ELEM_NOT},
+    {"NEG",              ELEM_NEG},
+    {"SET_BIT",          ELEM_SET_BIT},
+    {"CLEAR_BIT",        ELEM_CLEAR_BIT},
+    {"IF_BIT_SET",       ELEM_IF_BIT_SET},
+    {"IF_BIT_CLEAR",     ELEM_IF_BIT_CLEAR},
+#ifdef USE_SFR
+    {"RSFR",             ELEM_RSFR},
+    {"WSFR",             ELEM_WSFR},
+    {"SSFR",             ELEM_SSFR},
+    {"CSFR",             ELEM_CSFR},
+    {"TSFR",             ELEM_TSFR},
+    {"TCSFR",            ELEM_T_C_SFR},
+#endif
+    {"EQU",              ELEM_EQU},
+    {"NEQ",              ELEM_NEQ},
+    {"GRT",              ELEM_GRT},
+    {"GEQ",              ELEM_GEQ},
+    {"LEQ",              ELEM_LEQ},
+    {"LES",              ELEM_LES},
+    {"READ_ADC",         ELEM_READ_ADC},
+    {"RANDOM",           ELEM_RANDOM},
+    {"SEED_RANDOM",      ELEM_SEED_RANDOM},
+    {"SET_PWM",          ELEM_SET_PWM},
+    {"UART_RECV_AVAIL",  ELEM_UART_RECV_AVAIL},
+    {"UART_SEND_READY",  ELEM_UART_SEND_READY},
+    {"UART_SEND_BUSY",   ELEM_UART_SEND_READY},
+    {"UART_UDRE",        ELEM_UART_SEND_READY},
+    {"UART_RECV",        ELEM_UART_RECV},
+    {"UART_SEND",        ELEM_UART_SEND},
+    {"PERSIST",          ELEM_PERSIST},
+    {"FORMATTED_STRING", ELEM_FORMATTED_STRING},
+    {"STRING",           ELEM_STRING},
+    {"LOOK_UP_TABLE",    ELEM_LOOK_UP_TABLE},
+    {"PIECEWISE_LINEAR", ELEM_PIECEWISE_LINEAR},
+    // clang-format on
+};
+
 //-----------------------------------------------------------------------------
 // Check a line of text from a saved project file to determine whether it
 // contains a leaf element (coil, contacts, etc.). If so, create an element
 // for and save that in *any and *which, and return true, else return false.
+// The first word of the line gives the type, the fields that follow are
+// read by a LineScanner; the fields that old versions didn't write get
+// their defaults.
 //-----------------------------------------------------------------------------
 static bool LoadLeafFromFile(char *line, void **any, int *which)
 {
-    ElemLeaf *l = AllocLeaf();
-    int       x;
-
-    auto scan_contact_3 = [&]() -> int {
-        int negated, set1;
-        int res = sscanf(line, "CONTACTS %s %d %d", l->d.contacts.name, &negated, &set1);
-        if(res == 3) {
-            l->d.contacts.negated = negated != 0;
-            l->d.contacts.set1 = set1 != 0;
-        }
-        return res;
-    };
-    auto scan_contact_2 = [&]() -> int {
-        int negated;
-        int res = sscanf(line, "CONTACTS %s %d ", l->d.contacts.name, &negated);
-        if(res == 2) {
-            l->d.contacts.negated = negated != 0;
-        }
-        return res;
-    };
-
-    auto scan_coil_5 = [&]() -> int {
-        int negated, setOnly, resetOnly, ttrigger;
-        int res = sscanf(line, "COIL %s %d %d %d %d", l->d.coil.name, &negated, &setOnly, &resetOnly, &ttrigger);
-        if(res == 5) {
-            l->d.coil.negated = negated != 0;
-            l->d.coil.setOnly = setOnly != 0;
-            l->d.coil.resetOnly = resetOnly != 0;
-            l->d.coil.ttrigger = ttrigger != 0;
+    // parsed into a whole ElemLeaf, then copied into a leaf of its size
+    static ElemLeaf leaf;
+    ElemLeaf *      l = &leaf;
+    memset(l, 0, sizeof(leaf));
+
+    char *p = line;
+    while(*p && !isspace((unsigned char)*p))
+        p++;
+    auto k = LeafKeywords.find(std::string(line, p - line));
+    if(k == LeafKeywords.end())
+        return false;
+    *which = k->second;
+
+    LineScanner s(p);
+    bool        ok = true;
+    switch(*which) {
+        case ELEM_COMMENT:
+            FrmStrToStr(l->d.comment.str, *p ? p + 1 : p);
+            break;
+
+        case ELEM_CONTACTS: {
+            int negated, set1;
+            ok = s.word(l->d.contacts.name) && s.number(&negated);
+            if(ok) {
+                l->d.contacts.negated = negated != 0;
+                l->d.contacts.set1 = s.number(&set1) && (set1 != 0);
+            }
+            break;
         }
-        return res;
-    };
-
-    auto scan_coil_4 = [&]() -> int {
-        int negated, setOnly, resetOnly;
-        int res = sscanf(line, "COIL %s %d %d %d", l->d.coil.name, &negated, &setOnly, &resetOnly);
-        if(res == 4) {
-            l->d.coil.negated = negated != 0;
-            l->d.coil.setOnly = setOnly != 0;
-            l->d.coil.resetOnly = resetOnly != 0;
+        case ELEM_COIL: {
+            int negated, setOnly, resetOnly, ttrigger;
+            ok = s.word(l->d.coil.name) && s.number(&negated) && s.number(&setOnly) && s.number(&resetOnly);
+            if(ok) {
+                l->d.coil.negated = negated != 0;
+                l->d.coil.setOnly = setOnly != 0;
+                l->d.coil.resetOnly = resetOnly != 0;
+                l->d.coil.ttrigger = s.number(&ttrigger) && (ttrigger != 0);
+            }
+            break;
         }
-        return res;
-    };
-    bool scanned = true;
-    if(memcmp(line, "COMMENT", 7) == 0) {
-        FrmStrToStr(l->d.comment.str, &line[8]);
-        *which = ELEM_COMMENT;
-    } else if(scan_contact_3() == 3) {
-        *which = ELEM_CONTACTS;
-    } else if(scan_contact_2() == 2) {
-        *which = ELEM_CONTACTS;
-    } else if(scan_coil_5() == 5) {
-        *which = ELEM_COIL;
-    } else if(scan_coil_4() == 4) {
-        *which = ELEM_COIL;
-    } else if(memcmp(line, "PLACEHOLDER", 11) == 0) {
-        *which = ELEM_PLACEHOLDER;
-    } else if(memcmp(line, "SHORT", 5) == 0) {
-        *which = ELEM_SHORT;
-    } else if(memcmp(line, "OPEN", 4) == 0) {
-        *which = ELEM_OPEN;
-    } else if(memcmp(line, "MASTER_RELAY", 12) == 0) {
-        *which = ELEM_MASTER_RELAY;
-    } else if((sscanf(line, "DELAY %s", l->d.timer.name) == 1)) {
-        *which = ELEM_DELAY;
-    } else if((sscanf(line, "SLEEP %s %s", l->d.timer.name, l->d.timer.delay) == 2)) {
-        *which = ELEM_SLEEP;
-    } else if(memcmp(line, "SLEEP", 5) == 0) {
-        *which = ELEM_SLEEP;
-    } else if(memcmp(line, "CLRWDT", 6) == 0) {
-        *which = ELEM_CLRWDT;
-    } else if(memcmp(line, "LOCK", 4) == 0) {
-        *which = ELEM_LOCK;
-    } else if(sscanf(line, "GOTO %s", l->d.doGoto.label) == 1) {
-        *which = ELEM_GOTO;
-    } else if(sscanf(line, "GOSUB %s", l->d.doGoto.label) == 1) {
-        *which = ELEM_GOSUB;
-    } else if(memcmp(line, "RETURN", 6) == 0) {
-        *which = ELEM_RETURN;
-    } else if(sscanf(line, "LABEL %s", l->d.doGoto.label) == 1) {
-        *which = ELEM_LABEL;
-    } else if(sscanf(line, "SUBPROG %s", l->d.doGoto.label) == 1) {
-        *which = ELEM_SUBPROG;
-    } else if(sscanf(line, "ENDSUB %s", l->d.doGoto.label) == 1) {
-        *which = ELEM_ENDSUB;
-    } else if(sscanf(line, "SHIFT_REGISTER %s %d", l->d.shiftRegister.name, &(l->d.shiftRegister.stages)) == 2) {
-        *which = ELEM_SHIFT_REGISTER;
-    } else if(memcmp(line, "OSR", 3) == 0) {
-        *which = ELEM_ONE_SHOT_RISING;
-    } else if(memcmp(line, "OSF", 3) == 0) {
-        *which = ELEM_ONE_SHOT_FALLING;
-    } else if(memcmp(line, "OSL", 3) == 0) {
-        *which = ELEM_ONE_DROP_FALLING;
-    } else if(memcmp(line, "ODF", 3) == 0) {
-        *which = ELEM_ONE_DROP_FALLING;
-    } else if(memcmp(line, "ODR", 3) == 0) {
-        *which = ELEM_ONE_DROP_RISING;
-    } else if(memcmp(line, "OSC", 3) == 0) {
-        *which = ELEM_OSC;
-    } else if(memcmp(line, "NPULSE_OFF", 10) == 0) {
-        *which = ELEM_NPULSE_OFF;
-    } else if((sscanf(line, "TIME2COUNT %s %s", l->d.timer.name, l->d.timer.delay) == 2)) {
-        *which = ELEM_TIME2COUNT;
-    } else if((sscanf(line, "TIME2DELAY %s %s", l->d.timer.name, l->d.timer.delay) == 2)) {
-        *which = ELEM_TIME2DELAY;
-
-    } else if((sscanf(line, "TON %s %s %d", l->d.timer.name, l->d.timer.delay, &l->d.timer.adjust) == 3)) {
-        *which = ELEM_TON;
-    } else if((sscanf(line, "TOF %s %s %d", l->d.timer.name, l->d.timer.delay, &l->d.timer.adjust) == 3)) {
-        *which = ELEM_TOF;
-    } else if((sscanf(line, "RTO %s %s %d", l->d.timer.name, l->d.timer.delay, &l->d.timer.adjust) == 3)) {
-        *which = ELEM_RTO;
-    } else if((sscanf(line, "RTL %s %s %d", l->d.timer.name, l->d.timer.delay, &l->d.timer.adjust) == 3)) {
-        *which = ELEM_RTL;
-    } else if((sscanf(line, "TCY %s %s %d", l->d.timer.name, l->d.timer.delay, &l->d.timer.adjust) == 3)) {
-        *which = ELEM_TCY;
-    } else if((sscanf(line, "THI %s %s %d", l->d.timer.name, l->d.timer.delay, &l->d.timer.adjust) == 3)) {
-        *which = ELEM_THI;
-    } else if((sscanf(line, "TLO %s %s %d", l->d.timer.name, l->d.timer.delay, &l->d.timer.adjust) == 3)) {
-        *which = ELEM_TLO;
-
-    } else if((sscanf(line, "TON %s %s", l->d.timer.name, l->d.timer.delay) == 2)) {
-        *which = ELEM_TON;
-        if(Prog.LDversion == "0.1")
-            l->d.timer.adjust = -1;
-        else
-            l->d.timer.adjust = 0;
-    } else if((sscanf(line, "TOF %s %s", l->d.timer.name, l->d.timer.delay) == 2)) {
-        *which = ELEM_TOF;
-        if(Prog.LDversion == "0.1")
-            l->d.timer.adjust = -1;
-        else
-            l->d.timer.adjust = 0;
-    } else if((sscanf(line, "RTO %s %s", l->d.timer.name, l->d.timer.delay) == 2)) {
-        *which = ELEM_RTO;
-        if(Prog.LDversion == "0.1")
-            l->d.timer.adjust = -1;
-        else
-            l->d.timer.adjust = 0;
-    } else if((sscanf(line, "RTL %s %s", l->d.timer.name, l->d.timer.delay) == 2)) {
-        *which = ELEM_RTL;
-        l->d.timer.adjust = 0;
-    } else if((sscanf(line, "TCY %s %s", l->d.timer.name, l->d.timer.delay) == 2)) {
-        *which = ELEM_TCY;
-        l->d.timer.adjust = 0;
-    } else if((sscanf(line, "THI %s %s", l->d.timer.name, l->d.timer.delay) == 2)) {
-        *which = ELEM_THI;
-        l->d.timer.adjust = 0;
-    } else if((sscanf(line, "TLO %s %s", l->d.timer.name, l->d.timer.delay) == 2)) {
-        *which = ELEM_TLO;
-        l->d.timer.adjust = 0;
-
-    } else if((sscanf(line, "CTR %s %s %s %c", l->d.counter.name, l->d.counter.max, l->d.counter.init, &l->d.counter.inputKind) == 4)) {
-        *which = ELEM_CTR;
-    } else if((sscanf(line, "CTC %s %s %s %c", l->d.counter.name, l->d.counter.max, l->d.counter.init, &l->d.counter.inputKind) == 4)) {
-        *which = ELEM_CTC;
-    } else if((sscanf(line, "CTU %s %s %s %c", l->d.counter.name, l->d.counter.max, l->d.counter.init, &l->d.counter.inputKind) == 4)) {
-        *which = ELEM_CTU;
-    } else if((sscanf(line, "CTD %s %s %s %c", l->d.counter.name, l->d.counter.max, l->d.counter.init, &l->d.counter.inputKind) == 4)) {
-        *which = ELEM_CTD;
-
-    } else if((sscanf(line, "CTR %s %s %s", l->d.counter.name, l->d.counter.max, l->d.counter.init) == 3)) {
-        *which = ELEM_CTR;
-        l->d.counter.inputKind = '/';
-    } else if((sscanf(line, "CTC %s %s %s", l->d.counter.name, l->d.counter.max, l->d.counter.init) == 3)) {
-        *which = ELEM_CTC;
-        l->d.counter.inputKind = '/';
-    } else if((sscanf(line, "CTU %s %s %s", l->d.counter.name, l->d.counter.max, l->d.counter.init) == 3)) {
-        *which = ELEM_CTU;
-        l->d.counter.inputKind = '/';
-    } else if((sscanf(line, "CTD %s %s %s", l->d.counter.name, l->d.counter.max, l->d.counter.init) == 3)) {
-        l->d.counter.inputKind = '/';
-        *which = ELEM_CTD;
-
-    } else if((sscanf(line, "CTD %s %s", l->d.counter.name, l->d.counter.max) == 2)) {
-        strcpy(l->d.counter.init, "0");
-        l->d.counter.inputKind = '/';
-        *which = ELEM_CTD;
-    } else if((sscanf(line, "CTU %s %s", l->d.counter.name, l->d.counter.max) == 2)) {
-        strcpy(l->d.counter.init, "0");
-        l->d.counter.inputKind = '/';
-        *which = ELEM_CTU;
-    } else if((sscanf(line, "CTC %s %s", l->d.counter.name, l->d.counter.max) == 2)) {
-        strcpy(l->d.counter.init, "0");
-        l->d.counter.inputKind = '/';
-        *which = ELEM_CTC;
-
-    } else if(sscanf(line, "RES %s", l->d.reset.name) == 1) {
-        *which = ELEM_RES;
-
-    } else if(sscanf(line, "MOVE %s %s", l->d.move.dest, l->d.move.src) == 2) {
-        *which = ELEM_MOVE;
-
-    } else if(sscanf(line, "BIN2BCD %s %s", l->d.move.dest, l->d.move.src) == 2) {
-        *which = ELEM_BIN2BCD;
-
-    } else if(sscanf(line, "BCD2BIN %s %s", l->d.move.dest, l->d.move.src) == 2) {
-        *which = ELEM_BCD2BIN;
-
-    } else if(sscanf(line, "OPPOSITE %s %s", l->d.move.dest, l->d.move.src) == 2) {
-        *which = ELEM_OPPOSITE;
-
-    } else if(sscanf(line, "SWAP %s %s", l->d.move.dest, l->d.move.src) == 2) {
-        *which = ELEM_SWAP;
-
-    } else if(sscanf(line,
-                     "BUS %s %s %d %d %d %d %d %d %d %d",
-                     l->d.bus.dest,
-                     l->d.bus.src,
-                     &l->d.bus.PCBbit[7],
-                     &l->d.bus.PCBbit[6],
-                     &l->d.bus.PCBbit[5],
-                     &l->d.bus.PCBbit[4],
-                     &l->d.bus.PCBbit[3],
-                     &l->d.bus.PCBbit[2],
-                     &l->d.bus.PCBbit[1],
-                     &l->d.bus.PCBbit[0])
-              == (2 + 8)) {
-        *which = ELEM_BUS;
-
-    } else if(sscanf(line, "SPI_WR %s %s %s %s %s %s %s %s", l->d.spi.name, l->d.spi.send, l->d.spi.recv, l->d.spi.mode, l->d.spi.modes, l->d.spi.size, l->d.spi.first, l->d.spi.bitrate) == 8) {
-        l->d.spi.which = ELEM_SPI_WR;
-        *which = ELEM_SPI_WR;
-
-    } else if(sscanf(line, "SPI %s %s %s %s %s %s %s %s", l->d.spi.name, l->d.spi.send, l->d.spi.recv, l->d.spi.mode, l->d.spi.modes, l->d.spi.size, l->d.spi.first, l->d.spi.bitrate) == 8) {
-        l->d.spi.which = ELEM_SPI;
-        *which = ELEM_SPI;
+        case ELEM_PLACEHOLDER:
+        case ELEM_SHORT:
+        case ELEM_OPEN:
+        case ELEM_MASTER_RELAY:
+        case ELEM_CLRWDT:
+        case ELEM_LOCK:
+        case ELEM_RETURN:
+        case ELEM_ONE_SHOT_RISING:
+        case ELEM_ONE_SHOT_FALLING:
+        case ELEM_ONE_DROP_FALLING:
+        case ELEM_ONE_DROP_RISING:
+        case ELEM_OSC:
+        case ELEM_NPULSE_OFF:
+        case ELEM_UART_RECV_AVAIL:
+        case ELEM_UART_SEND_READY:
+            break;
+
+        case ELEM_DELAY:
+            ok = s.word(l->d.timer.name);
+            break;
+
+        case ELEM_SLEEP:
+            // both are optional
+            if(s.word(l->d.timer.name))
+                s.word(l->d.timer.delay);
+            break;
+
+        case ELEM_GOTO:
+        case ELEM_GOSUB:
+        case ELEM_LABEL:
+        case ELEM_SUBPROG:
+        case ELEM_ENDSUB:
+            ok = s.word(l->d.doGoto.label);
+            break;
+
+        case ELEM_SHIFT_REGISTER:
+            ok = s.word(l->d.shiftRegister.name) && s.number(&l->d.shiftRegister.stages);
+            break;
+
+        case ELEM_TIME2COUNT:
+        case ELEM_TIME2DELAY:
+            ok = s.word(l->d.timer.name) && s.word(l->d.timer.delay);
+            break;
+
+        case ELEM_TON:
+        case ELEM_TOF:
+        case ELEM_RTO:
+        case ELEM_RTL:
+        case ELEM_TCY:
+        case ELEM_THI:
+        case ELEM_TLO:
+            ok = s.word(l->d.timer.name) && s.word(l->d.timer.delay);
+            if(ok && !s.number(&l->d.timer.adjust)) {
+                if((Prog.LDversion == "0.1") && ((*which == ELEM_TON) || (*which == ELEM_TOF) || (*which == ELEM_RTO)))
+                    l->d.timer.adjust = -1;
+                else
+                    l->d.timer.adjust = 0;
+            }
+            break;
+
+        case ELEM_CTR:
+        case ELEM_CTC:
+        case ELEM_CTU:
+        case ELEM_CTD:
+            ok = s.word(l->d.counter.name) && s.word(l->d.counter.max);
+            if(ok) {
+                if(s.word(l->d.counter.init)) {
+                    if(!s.letter(&l->d.counter.inputKind))
+                        l->d.counter.inputKind = '/';
+                } else if(*which != ELEM_CTR) {
+                    strcpy(l->d.counter.init, "0");
+                    l->d.counter.inputKind = '/';
+                } else {
+                    ok = false;
+                }
+            }
+            break;
+
+        case ELEM_RES:
+            ok = s.word(l->d.reset.name);
+            break;
+
+        case ELEM_MOVE:
+        case ELEM_BIN2BCD:
+        case ELEM_BCD2BIN:
+        case ELEM_OPPOSITE:
+        case ELEM_SWAP:
+        case ELEM_SET_BIT:
+        case ELEM_CLEAR_BIT:
+        case ELEM_IF_BIT_SET:
+        case ELEM_IF_BIT_CLEAR:
+        case ELEM_SEED_RANDOM:
+            ok = s.word(l->d.move.dest) && s.word(l->d.move.src);
+            break;
+
+        case ELEM_BUS:
+            ok = s.word(l->d.bus.dest) && s.word(l->d.bus.src);
+            for(int i = 7; ok && (i >= 0); i--)
+                ok = s.number(&l->d.bus.PCBbit[i]);
+            break;
+
+        case ELEM_SPI:
+        case ELEM_SPI_WR:
+            ok = s.word(l->d.spi.name) && s.word(l->d.spi.send) && s.word(l->d.spi.recv) && s.word(l->d.spi.mode) && s.word(l->d.spi.modes)
+                 && s.word(l->d.spi.size) && s.word(l->d.spi.first) && s.word(l->d.spi.bitrate);
+            l->d.spi.which = *which;
+            break;
+
+        ///// Added by JG
+        case ELEM_I2C_RD:
+        case ELEM_I2C_WR:
+            ok = s.word(l->d.i2c.name) && s.word(l->d.i2c.send) && s.word(l->d.i2c.recv) && s.word(l->d.i2c.mode) && s.word(l->d.i2c.address)
+                 && s.word(l->d.i2c.registr) && s.word(l->d.i2c.first) && s.word(l->d.i2c.bitrate);
+            l->d.i2c.which = *which;
+            break;
+        /////
+
+        case ELEM_7SEG:
+        case ELEM_9SEG:
+        case ELEM_14SEG:
+        case ELEM_16SEG:
+            ok = s.word(l->d.segments.dest) && s.word(l->d.segments.src) && s.letter(&l->d.segments.common);
+            l->d.segments.which = *which;
+            break;
+
+        case ELEM_STEPPER:
+            ok = s.word(l->d.stepper.name) && s.word(l->d.stepper.max) && s.word(l->d.stepper.P) && s.number(&l->d.stepper.nSize)
+                 && s.number(&l->d.stepper.graph) && s.word(l->d.stepper.coil);
+            break;
+
+        case ELEM_PULSER:
+            ok = s.word(l->d.pulser.P1) && s.word(l->d.pulser.P0) && s.word(l->d.pulser.accel) && s.word(l->d.pulser.counter) && s.word(l->d.pulser.coil);
+            break;
+
+        case ELEM_NPULSE:
+            ok = s.word(l->d.Npulse.counter) && s.word(l->d.Npulse.targetFreq) && s.word(l->d.Npulse.coil);
+            break;
+
+        case ELEM_QUAD_ENCOD:
+            ok = s.word(l->d.QuadEncod.counter) && s.number(&l->d.QuadEncod.int01) && s.word(l->d.QuadEncod.inputA) && s.word(l->d.QuadEncod.inputB)
+                 && s.word(l->d.QuadEncod.inputZ) && s.word(l->d.QuadEncod.dir) && s.letter(&l->d.QuadEncod.inputZKind)
+                 && s.number(&l->d.QuadEncod.countPerRevol);
+            if(ok) {
+                FrmStrToStr(l->d.QuadEncod.inputZ, l->d.QuadEncod.inputZ);
+                FrmStrToStr(l->d.QuadEncod.dir, l->d.QuadEncod.dir);
+            }
+            break;
+
+        case ELEM_ADD:
+        case ELEM_SUB:
+        case ELEM_MUL:
+        case ELEM_DIV:
+        case ELEM_MOD:
+        case ELEM_SHL:
+        case ELEM_SHR:
+        case ELEM_SR0:
+        case ELEM_ROL:
+        case ELEM_ROR:
+        case ELEM_AND:
+        case ELEM_OR:
+        case ELEM_XOR:
+            ok = s.word(l->d.math.dest) && s.word(l->d.math.op1) && s.word(l->d.math.op2);
+            break;
+
+        case ELEM_NOT:
+        case ELEM_NEG:
+            ok = s.word(l->d.math.dest) && s.word(l->d.math.op1);
+            break;
 
-    }
-    ///// Added by JG
-    else if(sscanf(line, "I2C_RD %s %s %s %s %s %s %s %s", l->d.i2c.name, l->d.i2c.send, l->d.i2c.recv, l->d.i2c.mode, l->d.i2c.address, l->d.i2c.registr, l->d.i2c.first, l->d.i2c.bitrate) == 8) {
-        l->d.i2c.which = ELEM_I2C_RD;
-        *which = ELEM_I2C_RD;
-    } else if(sscanf(line, "I2C_WR %s %s %s %s %s %s %s %s", l->d.i2c.name, l->d.i2c.send, l->d.i2c.recv, l->d.i2c.mode, l->d.i2c.address, l->d.i2c.registr, l->d.i2c.first, l->d.i2c.bitrate) == 8) {
-        l->d.i2c.which = ELEM_I2C_WR;
-        *which = ELEM_I2C_WR;
-    }
-    /////
-
-    else if(sscanf(line, "7SEGMENTS %s %s %c", l->d.segments.dest, l->d.segments.src, &l->d.segments.common) == 3) {
-        l->d.segments.which = ELEM_7SEG;
-        *which = ELEM_7SEG;
-
-    } else if(sscanf(line, "9SEGMENTS %s %s %c", l->d.segments.dest, l->d.segments.src, &l->d.segments.common) == 3) {
-        l->d.segments.which = ELEM_9SEG;
-        *which = ELEM_9SEG;
-
-    } else if(sscanf(line, "14SEGMENTS %s %s %c", l->d.segments.dest, l->d.segments.src, &l->d.segments.common) == 3) {
-        l->d.segments.which = ELEM_14SEG;
-        *which = ELEM_14SEG;
-
-    } else if(sscanf(line, "16SEGMENTS %s %s %c", l->d.segments.dest, l->d.segments.src, &l->d.segments.common) == 3) {
-        l->d.segments.which = ELEM_16SEG;
-        *which = ELEM_16SEG;
-
-    } else if(sscanf(line, "STEPPER %s %s %s %d %d %s", l->d.stepper.name, l->d.stepper.max, l->d.stepper.P, &l->d.stepper.nSize, &l->d.stepper.graph, l->d.stepper.coil) == 6) {
-        *which = ELEM_STEPPER;
-    } else if(sscanf(line, "PULSER %s %s %s %s %s", l->d.pulser.P1, l->d.pulser.P0, l->d.pulser.accel, l->d.pulser.counter, l->d.pulser.coil) == 5) {
-        *which = ELEM_PULSER;
-    } else if(sscanf(line, "NPULSE %s %s %s", l->d.Npulse.counter, l->d.Npulse.targetFreq, l->d.Npulse.coil) == 3) {
-        *which = ELEM_NPULSE;
-    } else if(sscanf(line,
-                     "QUAD_ENCOD %s %d %s %s %s %s %c %d",
-                     l->d.QuadEncod.counter,
-                     &l->d.QuadEncod.int01,
-                     l->d.QuadEncod.inputA,
-                     l->d.QuadEncod.inputB,
-                     l->d.QuadEncod.inputZ,
-                     l->d.QuadEncod.dir,
-                     &l->d.QuadEncod.inputZKind,
-                     &l->d.QuadEncod.countPerRevol)
-              == 8) {
-        FrmStrToStr(l->d.QuadEncod.inputZ, l->d.QuadEncod.inputZ);
-        FrmStrToStr(l->d.QuadEncod.dir, l->d.QuadEncod.dir);
-        *which = ELEM_QUAD_ENCOD;
-    } else if(sscanf(line, "MOD %s %s %s", l->d.math.dest, l->d.math.op1, l->d.math.op2) == 3) {
-        *which = ELEM_MOD;
-    } else if(sscanf(line, "SHL %s %s %s", l->d.math.dest, l->d.math.op1, l->d.math.op2) == 3) {
-        *which = ELEM_SHL;
-    } else if(sscanf(line, "SHR %s %s %s", l->d.math.dest, l->d.math.op1, l->d.math.op2) == 3) {
-        *which = ELEM_SHR;
-    } else if(sscanf(line, "SR0 %s %s %s", l->d.math.dest, l->d.math.op1, l->d.math.op2) == 3) {
-        *which = ELEM_SR0;
-    } else if(sscanf(line, "ROL %s %s %s", l->d.math.dest, l->d.math.op1, l->d.math.op2) == 3) {
-        *which = ELEM_ROL;
-    } else if(sscanf(line, "ROR %s %s %s", l->d.math.dest, l->d.math.op1, l->d.math.op2) == 3) {
-        *which = ELEM_ROR;
-    } else if(sscanf(line, "AND %s %s %s", l->d.math.dest, l->d.math.op1, l->d.math.op2) == 3) {
-        *which = ELEM_AND;
-    } else if(sscanf(line, "OR %s %s %s", l->d.math.dest, l->d.math.op1, l->d.math.op2) == 3) {
-        *which = ELEM_OR;
-    } else if(sscanf(line, "XOR %s %s %s", l->d.math.dest, l->d.math.op1, l->d.math.op2) == 3) {
-        *which = ELEM_XOR;
-    } else if(sscanf(line, "NOT %s %s", l->d.math.dest, l->d.math.op1) == 2) {
-        *which = ELEM_NOT;
-    } else if(sscanf(line, "NEG %s %s", l->d.math.dest, l->d.math.op1) == 2) {
-        *which = ELEM_NEG;
-    } else if(sscanf(line, "ADD %s %s %s", l->d.math.dest, l->d.math.op1, l->d.math.op2) == 3) {
-        *which = ELEM_ADD;
-    } else if(sscanf(line, "SUB %s %s %s", l->d.math.dest, l->d.math.op1, l->d.math.op2) == 3) {
-        *which = ELEM_SUB;
-    } else if(sscanf(line, "MUL %s %s %s", l->d.math.dest, l->d.math.op1, l->d.math.op2) == 3) {
-        *which = ELEM_MUL;
-    } else if(sscanf(line, "DIV %s %s %s", l->d.math.dest, l->d.math.op1, l->d.math.op2) == 3) {
-        *which = ELEM_DIV;
-    } else
-        scanned = false;
-    if(scanned) {
-        ; //
-    } else if(sscanf(line, "SET_BIT %s %s", l->d.move.dest, l->d.move.src) == 2) {
-        *which = ELEM_SET_BIT;
-    } else if(sscanf(line, "CLEAR_BIT %s %s", l->d.move.dest, l->d.move.src) == 2) {
-        *which = ELEM_CLEAR_BIT;
-    } else if(sscanf(line, "IF_BIT_SET %s %s", l->d.move.dest, l->d.move.src) == 2) {
-        *which = ELEM_IF_BIT_SET;
-    } else if(sscanf(line, "IF_BIT_CLEAR %s %s", l->d.move.dest, l->d.move.src) == 2) {
-        *which = ELEM_IF_BIT_CLEAR;
 #ifdef USE_SFR
-    } else if(sscanf(line, "RSFR %s %s", l->d.cmp.op1, l->d.cmp.op2) == 2) {
-        *which = ELEM_RSFR;
-    } else if(sscanf(line, "WSFR %s %s", l->d.cmp.op1, l->d.cmp.op2) == 2) {
-        *which = ELEM_WSFR;
-    } else if(sscanf(line, "SSFR %s %s", l->d.cmp.op1, l->d.cmp.op2) == 2) {
-        *which = ELEM_SSFR;
-    } else if(sscanf(line, "CSFR %s %s", l->d.cmp.op1, l->d.cmp.op2) == 2) {
-        *which = ELEM_CSFR;
-    } else if(sscanf(line, "TSFR %s %s", l->d.cmp.op1, l->d.cmp.op2) == 2) {
-        *which = ELEM_TSFR;
-    } else if(sscanf(line, "TCSFR %s %s", l->d.cmp.op1, l->d.cmp.op2) == 2) {
-        *which = ELEM_T_C_SFR;
+        case ELEM_RSFR:
+        case ELEM_WSFR:
+        case ELEM_SSFR:
+        case ELEM_CSFR:
+        case ELEM_TSFR:
+        case ELEM_T_C_SFR:
 #endif
-    } else if(sscanf(line, "EQU %s %s", l->d.cmp.op1, l->d.cmp.op2) == 2) {
-        *which = ELEM_EQU;
-    } else if(sscanf(line, "NEQ %s %s", l->d.cmp.op1, l->d.cmp.op2) == 2) {
-        *which = ELEM_NEQ;
-    } else if(sscanf(line, "GRT %s %s", l->d.cmp.op1, l->d.cmp.op2) == 2) {
-        *which = ELEM_GRT;
-    } else if(sscanf(line, "GEQ %s %s", l->d.cmp.op1, l->d.cmp.op2) == 2) {
-        *which = ELEM_GEQ;
-    } else if(sscanf(line, "LEQ %s %s", l->d.cmp.op1, l->d.cmp.op2) == 2) {
-        *which = ELEM_LEQ;
-    } else if(sscanf(line, "LES %s %s", l->d.cmp.op1, l->d.cmp.op2) == 2) {
-        *which = ELEM_LES;
-    } else if(sscanf(line, "READ_ADC %s %d", l->d.readAdc.name, &l->d.readAdc.refs) == 2) {
-        *which = ELEM_READ_ADC;
-    } else if(sscanf(line, "READ_ADC %s", l->d.readAdc.name) == 1) {
-        l->d.readAdc.refs = 0;
-        *which = ELEM_READ_ADC;
-    } else if(sscanf(line, "RANDOM %s", l->d.readAdc.name) == 1) {
-        *which = ELEM_RANDOM;
-    } else if(sscanf(line, "SEED_RANDOM %s %s", l->d.move.dest, l->d.move.src) == 2) {
-        *which = ELEM_SEED_RANDOM;
-    } else if(sscanf(line, "SET_PWM %s %s %s %s", l->d.setPwm.duty_cycle, l->d.setPwm.targetFreq, l->d.setPwm.name, l->d.setPwm.resolution) == 4) {
-        *which = ELEM_SET_PWM;
-    } else if(sscanf(line, "SET_PWM %s %s %s", l->d.setPwm.duty_cycle, l->d.setPwm.targetFreq, l->d.setPwm.name) == 3) {
-        *which = ELEM_SET_PWM;
-    } else if(sscanf(line, "SET_PWM %s %s", l->d.setPwm.duty_cycle, l->d.setPwm.targetFreq) == 2) {
-        *which = ELEM_SET_PWM;
-    } else if(memcmp(line, "UART_RECV_AVAIL", 15) == 0) {
-        *which = ELEM_UART_RECV_AVAIL;
-    } else if(memcmp(line, "UART_SEND_READY", 15) == 0) {
-        *which = ELEM_UART_SEND_READY;
-    } else if(memcmp(line, "UART_SEND_BUSY", 14) == 0) {
-        *which = ELEM_UART_SEND_READY;
-    } else if(memcmp(line, "UART_UDRE", 9) == 0) {
-        *which = ELEM_UART_SEND_READY;
-        /*
-    } else if(sscanf(line, "UART_RECVn %s", l->d.uart.name) == 1) {
-        l->d.uart.bytes = SizeOfVar(l->d.uart.name);
-        *which = ELEM_UART_RECVn;
-*/
-    } else if([&]() -> int {
-                  int  tmp_bool;
-                  auto res = sscanf(line, "UART_RECV %s %d %d", l->d.uart.name, &(l->d.uart.bytes), &tmp_bool);
-                  l->d.uart.wait = tmp_bool != 0;
-                  return res;
-              }() == 3) {
-        *which = ELEM_UART_RECV;
-    } else if(sscanf(line, "UART_RECV %s", l->d.uart.name) == 1) {
-        l->d.uart.bytes = 1;
-        l->d.uart.wait = false;
-        *which = ELEM_UART_RECV;
-        /*
-    } else if(sscanf(line, "UART_SENDn %s", l->d.uart.name) == 1) {
-        l->d.uart.bytes = SizeOfVar(l->d.uart.name);
-        *which = ELEM_UART_SENDn;
-*/
-    } else if([&]() -> int {
-                  int  tmp_bool;
-                  auto res = sscanf(line, "UART_SEND %s %d %d", l->d.uart.name, &(l->d.uart.bytes), &tmp_bool);
-                  l->d.uart.wait = tmp_bool != 0;
-                  return res;
-              }() == 3) {
-        *which = ELEM_UART_SEND;
-    } else if(sscanf(line, "UART_SEND %s", l->d.uart.name) == 1) {
-        l->d.uart.bytes = 1;
-        l->d.uart.wait = false;
-        *which = ELEM_UART_SEND;
-    } else if(sscanf(line, "PERSIST %s", l->d.persist.var) == 1) {
-        *which = ELEM_PERSIST;
-    } else if(sscanf(line, "FORMATTED_STRING %s %d", l->d.fmtdStr.var, &x) == 2) {
-        if(strcmp(l->d.fmtdStr.var, "(none)") == 0) {
-            strcpy(l->d.fmtdStr.var, "");
-        }
+        case ELEM_EQU:
+        case ELEM_NEQ:
+        case ELEM_GRT:
+        case ELEM_GEQ:
+        case ELEM_LEQ:
+        case ELEM_LES:
+            ok = s.word(l->d.cmp.op1) && s.word(l->d.cmp.op2);
+            break;
 
-        char *p = line;
-        int   i;
-        for(i = 0; i < 3; i++) {
-            while(!isspace(*p))
-                p++;
-            while(isspace(*p))
-                p++;
-        }
-        for(i = 0; i < x; i++) {
-            l->d.fmtdStr.string[i] = static_cast<char>(atoi(p));
-            if(l->d.fmtdStr.string[i] < 32) {
-                l->d.fmtdStr.string[i] = 'X';
+        case ELEM_READ_ADC:
+            ok = s.word(l->d.readAdc.name);
+            if(ok && !s.number(&l->d.readAdc.refs))
+                l->d.readAdc.refs = 0;
+            break;
+
+        case ELEM_RANDOM:
+            ok = s.word(l->d.readAdc.name);
+            break;
+
+        case ELEM_SET_PWM:
+            ok = s.word(l->d.setPwm.duty_cycle) && s.word(l->d.setPwm.targetFreq);
+            if(ok && s.word(l->d.setPwm.name))
+                s.word(l->d.setPwm.resolution);
+            if(l->d.setPwm.name[0] != 'P') { // Fix the name, this case will occur when reading old LD files
+                memmove(l->d.setPwm.name + 1, l->d.setPwm.name, strlen(l->d.setPwm.name) + 1);
+                l->d.setPwm.name[0] = 'P';
             }
-            while(!isspace(*p) && *p)
-                p++;
-            while(isspace(*p) && *p)
-                p++;
-        }
-        l->d.fmtdStr.string[i] = '\0';
-
-        *which = ELEM_FORMATTED_STRING;
-        //  } else if(sscanf(line, "UART_WR %d %s", &l->d.fmtdStr.wait, l->d.fmtdStr.string) == 2) {
-        /*
-        int i = strlen("UART_WR") + 1;
-        if(strcmp(l->d.fmtdStr.var, "(none)") == 0) {
-            strcpy(l->d.fmtdStr.var, "");
-        }
-        */
-        //      FrmStrToStr(l->d.fmtdStr.string);
-        /*
-        //DelFramingDoubleQuotes(l->d.fmtdStr.string);
-        DelNL(l->d.fmtdStr.string);
-        if(strcmp(l->d.fmtdStr.string, "(none)") == 0) {
-            strcpy(l->d.fmtdStr.string, "");
-        }
-        */
-        //      *which = ELEM_UART_WR;
-    } else if(sscanf(line, "FORMATTED_STRING %s %s", l->d.fmtdStr.var, l->d.fmtdStr.string) == 2) {
-        size_t i = strlen("FORMATTED_STRING") + 1 + strlen(l->d.fmtdStr.var) + 1;
+            if((p = strchr(l->d.setPwm.targetFreq, '.')) != nullptr) {
+                *p = '\0';
+            }
+            break;
 
-        if(strcmp(l->d.fmtdStr.var, "(none)") == 0) {
-            strcpy(l->d.fmtdStr.var, "");
-        }
-        FrmStrToStr(l->d.fmtdStr.string, &line[i]);
-        DelNL(l->d.fmtdStr.string);
-        if(strcmp(l->d.fmtdStr.string, "(none)") == 0) {
-            strcpy(l->d.fmtdStr.string, "");
-        }
-        *which = ELEM_FORMATTED_STRING;
-        /*
-    } else if(sscanf(line, "STRING %s %s %d", l->d.fmtdStr.dest, l->d.fmtdStr.var, &x) == 3) {
-        if(strcmp(l->d.fmtdStr.dest, "(none)") == 0) {
-            strcpy(l->d.fmtdStr.dest, "");
-        }
-        if(strcmp(l->d.fmtdStr.var, "(none)") == 0) {
-            strcpy(l->d.fmtdStr.var, "");
+        case ELEM_UART_RECV:
+        case ELEM_UART_SEND: {
+            int wait;
+            ok = s.word(l->d.uart.name);
+            if(ok && s.number(&l->d.uart.bytes) && s.number(&wait)) {
+                l->d.uart.wait = wait != 0;
+            } else {
+                l->d.uart.bytes = 1;
+                l->d.uart.wait = false;
+            }
+            break;
         }
+        case ELEM_PERSIST:
+            ok = s.word(l->d.persist.var);
+            break;
 
-        char *p = line;
-        int   i;
-        for(i = 0; i < 4; i++) {
-            while(!isspace(*p))
-                p++;
-            while(isspace(*p))
-                p++;
-        }
-        for(i = 0; i < x; i++) {
-            l->d.fmtdStr.string[i] = static_cast<char>(atoi(p));
-            if(l->d.fmtdStr.string[i] < 32) {
-                l->d.fmtdStr.string[i] = 'X';
+        case ELEM_FORMATTED_STRING: {
+            int x;
+            ok = s.word(l->d.fmtdStr.var);
+            if(ok && s.number(&x)) {
+                if(strcmp(l->d.fmtdStr.var, "(none)") == 0) {
+                    strcpy(l->d.fmtdStr.var, "");
+                }
+                p = line;
+                int i;
+                for(i = 0; i < 3; i++) {
+                    while(!isspace(*p))
+                        p++;
+                    while(isspace(*p))
+                        p++;
+                }
+                for(i = 0; i < x; i++) {
+                    l->d.fmtdStr.string[i] = static_cast<char>(atoi(p));
+                    if(l->d.fmtdStr.string[i] < 32) {
+                        l->d.fmtdStr.string[i] = 'X';
+                    }
+                    while(!isspace(*p) && *p)
+                        p++;
+                    while(isspace(*p) && *p)
+                        p++;
+                }
+                l->d.fmtdStr.string[i] = '\0';
+            } else if(ok && s.word(l->d.fmtdStr.string)) {
+                size_t i = strlen("FORMATTED_STRING") + 1 + strlen(l->d.fmtdStr.var) + 1;
+
+                if(strcmp(l->d.fmtdStr.var, "(none)") == 0) {
+                    strcpy(l->d.fmtdStr.var, "");
+                }
+                FrmStrToStr(l->d.fmtdStr.string, &line[i]);
+                DelNL(l->d.fmtdStr.string);
+                if(strcmp(l->d.fmtdStr.string, "(none)") == 0) {
+                    strcpy(l->d.fmtdStr.string, "");
+                }
+            } else {
+                ok = false;
             }
-            while(!isspace(*p) && *p)
-                p++;
-            while(isspace(*p) && *p)
-                p++;
+            break;
         }
-        l->d.fmtdStr.string[i] = '\0';
+        case ELEM_STRING:
+            ok = s.word(l->d.fmtdStr.dest) && s.word(l->d.fmtdStr.var) && s.word(l->d.fmtdStr.string);
+            if(ok) {
+                size_t i = strlen("STRING") + 1 + strlen(l->d.fmtdStr.dest) + 1 + strlen(l->d.fmtdStr.var) + 1;
+                FrmStrToStr(l->d.fmtdStr.string, &line[i]);
+                DelNL(l->d.fmtdStr.string);
+                if(strcmp(l->d.fmtdStr.string, "(none)") == 0) {
+                    strcpy(l->d.fmtdStr.string, "");
+                }
+                if(strcmp(l->d.fmtdStr.dest, "(none)") == 0) {
+                    strcpy(l->d.fmtdStr.dest, "");
+                }
+                if(strcmp(l->d.fmtdStr.var, "(none)") == 0) {
+                    strcpy(l->d.fmtdStr.var, "");
+                }
+            }
+            break;
 
-        *which = ELEM_STRING;
-*/
-    } else if(sscanf(line, "STRING %s %s %s", l->d.fmtdStr.dest, l->d.fmtdStr.var, l->d.fmtdStr.string) == 3) {
-        size_t i = strlen("STRING") + 1 + strlen(l->d.fmtdStr.dest) + 1 + strlen(l->d.fmtdStr.var) + 1;
-        FrmStrToStr(l->d.fmtdStr.string, &line[i]);
-        DelNL(l->d.fmtdStr.string);
-        if(strcmp(l->d.fmtdStr.string, "(none)") == 0) {
-            strcpy(l->d.fmtdStr.string, "");
-        }
-        if(strcmp(l->d.fmtdStr.dest, "(none)") == 0) {
-            strcpy(l->d.fmtdStr.dest, "");
-        }
-        if(strcmp(l->d.fmtdStr.var, "(none)") == 0) {
-            strcpy(l->d.fmtdStr.var, "");
-        }
-        *which = ELEM_STRING;
-    } else if([&]() -> int {
-                  int editAsString;
-                  int res = sscanf(line, "LOOK_UP_TABLE %s %s %d %d", l->d.lookUpTable.dest, l->d.lookUpTable.index, &(l->d.lookUpTable.count), &editAsString);
-                  l->d.lookUpTable.editAsString = editAsString != 0;
-                  return res;
-              }() == 4) {
-        char *p = line;
-        int   i;
-        // First skip over the parts that we already sscanf'd.
-        for(i = 0; i < 5; i++) {
-            while((!isspace(*p)) && *p)
-                p++;
-            while(isspace(*p) && *p)
-                p++;
-        }
-        // Then copy over the look-up table entries.
-        for(i = 0; i < l->d.lookUpTable.count; i++) {
-            l->d.lookUpTable.vals[i] = hobatoi(p);
-            while((!isspace(*p)) && *p)
-                p++;
-            while(isspace(*p) && *p)
-                p++;
-        }
-        sscanf(p, "%s", l->d.lookUpTable.name);
-        if(!strlen(l->d.lookUpTable.name))
-            sprintf(l->d.lookUpTable.name, "%s%d", l->d.lookUpTable.dest, l->d.lookUpTable.count);
-        *which = ELEM_LOOK_UP_TABLE;
-    } else if(sscanf(line, "PIECEWISE_LINEAR %s %s %d", l->d.piecewiseLinear.dest, l->d.piecewiseLinear.index, &(l->d.piecewiseLinear.count)) == 3) {
-        char *p = line;
-        int   i;
-        // First skip over the parts that we already sscanf'd.
-        for(i = 0; i < 4; i++) {
-            while((!isspace(*p)) && *p)
-                p++;
-            while(isspace(*p) && *p)
-                p++;
-        }
-        // Then copy over the piecewise linear points.
-        for(i = 0; i < l->d.piecewiseLinear.count * 2; i++) {
-            l->d.piecewiseLinear.vals[i] = hobatoi(p);
-            while((!isspace(*p)) && *p)
-                p++;
-            while(isspace(*p) && *p)
-                p++;
+        case ELEM_LOOK_UP_TABLE: {
+            int editAsString;
+            ok = s.word(l->d.lookUpTable.dest) && s.word(l->d.lookUpTable.index) && s.number(&l->d.lookUpTable.count) && s.number(&editAsString);
+            if(ok) {
+                l->d.lookUpTable.editAsString = editAsString != 0;
+                p = line;
+                int i;
+                // First skip over the parts that we already scanned.
+                for(i = 0; i < 5; i++) {
+                    while((!isspace(*p)) && *p)
+                        p++;
+                    while(isspace(*p) && *p)
+                        p++;
+                }
+                // Then copy over the look-up table entries.
+                for(i = 0; i < l->d.lookUpTable.count; i++) {
+                    l->d.lookUpTable.vals[i] = hobatoi(p);
+                    while((!isspace(*p)) && *p)
+                        p++;
+                    while(isspace(*p) && *p)
+                        p++;
+                }
+                LineScanner(p).word(l->d.lookUpTable.name);
+                if(!strlen(l->d.lookUpTable.name))
+                    sprintf(l->d.lookUpTable.name, "%s%d", l->d.lookUpTable.dest, l->d.lookUpTable.count);
+            }
+            break;
         }
-        sscanf(p, "%s", l->d.piecewiseLinear.name);
-        *which = ELEM_PIECEWISE_LINEAR;
-    } else {
-        // that's odd; nothing matched
-        CheckFree(l);
-        return false;
+        case ELEM_PIECEWISE_LINEAR:
+            ok = s.word(l->d.piecewiseLinear.dest) && s.word(l->d.piecewiseLinear.index) && s.number(&l->d.piecewiseLinear.count);
+            if(ok) {
+                p = line;
+                int i;
+                // First skip over the parts that we already scanned.
+                for(i = 0; i < 4; i++) {
+                    while((!isspace(*p)) && *p)
+                        p++;
+                    while(isspace(*p) && *p)
+                        p++;
+                }
+                // Then copy over the piecewise linear points.
+                for(i = 0; i < l->d.piecewiseLinear.count * 2; i++) {
+                    l->d.piecewiseLinear.vals[i] = hobatoi(p);
+                    while((!isspace(*p)) && *p)
+                        p++;
+                    while(isspace(*p) && *p)
+                        p++;
+                }
+                LineScanner(p).word(l->d.piecewiseLinear.name);
+            }
+            break;
+
+        default:
+            ok = false;
+            break;
     }
-    *any = l;
-    if(*which == ELEM_SET_PWM) {
-        if(l->d.setPwm.name[0] != 'P') { // Fix the name, this case will occur when reading old LD files
-            memmove(l->d.setPwm.name + 1, l->d.setPwm.name, strlen(l->d.setPwm.name) + 1);
-            l->d.setPwm.name[0] = 'P';
-        }
-        char *s;
-        if((s = strchr(l->d.setPwm.targetFreq, '.')) != nullptr) {
-            *s = '\0';
-        }
+    if(!ok) {
+        // that's odd; the fields don't match
+        return false;
     }
+    *any = CopyLeaf(*which, l);
     return true;
 }
 
 //-----------------------------------------------------------------------------
 char *strspace(char *str)
 {
-    while(strlen(str) && isspace(str[0]))
+    while(isspace(str[0]))
         str++;
-    while(strlen(str) && isspace(str[strlen(str) - 1]))
-        str[strlen(str) - 1] = '\0';
+    size_t n = strlen(str);
+    while(n && isspace(str[n - 1]))
+        str[--n] = '\0';
     return str;
 }
 //-----------------------------------------------------------------------------
@@ -666,6 +664,7 @@ static ElemSubcktParallel *LoadParallelFromFile(FileTracker &f)
         } else {
             return nullptr;
         }
+        GrowSubckt(ret, cnt + 1);
         ret->contents[cnt].which = which;
         ret->contents[cnt].data.any = any;
         cnt++;
@@ -715,6 +714,7 @@ ElemSubcktSeries *LoadSeriesFromFile(FileTracker &f)
         } else {
             return nullptr;
         }
+        GrowSubckt(ret, cnt + 1);
         ret->contents[cnt].which = which;
         ret->contents[cnt].data.any = any;
         cnt++;
@@ -789,6 +789,227 @@ bool LoadPullUpListFromFile(FileTracker &f)
     }
     return false;
 }
+
+//-----------------------------------------------------------------------------
+// Binary cache of the rungs of a big project, in a .ldc file next to the .ld.
+// Parsing the text of some thousands of rungs takes a while, reading the
+// leaves back as they were parsed doesn't. The cache is only good for the
+// .ld of the same size and hash, written by the same build of LDmicro (the
+// leaves are stored as they are in memory); anything else and the .ld is
+// parsed again, and the cache rewritten. The header of the .ld, with the
+// settings and the I/O and var lists, is always parsed from the text.
+// A cache is written only if CacheBigProjects, set by Settings > Cache Big
+// Projects; the .ld is hashed only if there is a cache to read or write.
+//-----------------------------------------------------------------------------
+#define PROJECT_CACHE_MAGIC "LDCC"
+#define PROJECT_CACHE_VERSION 1
+#define PROJECT_CACHE_MIN_RUNGS 500 // smaller projects load fast enough
+
+typedef struct ProjectCacheHeaderTag {
+    char     magic[4];
+    uint32_t version;
+    char     build[32]; // of the LDmicro that wrote it
+    uint32_t numRungs;
+    uint32_t reserved;
+    uint64_t ldSize;
+    uint64_t ldHash;
+    uint64_t bodySize; // of the rungs that follow the header
+    uint64_t bodyHash;
+} ProjectCacheHeader;
+
+static const char ProjectCacheBuild[32] = LDMICRO_VER_STR " " __DATE__ " " __TIME__;
+
+int CacheBigProjects = 0;
+
+// FNV-1a
+static uint64_t HashBytes(const uint8_t *p, size_t n)
+{
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for(size_t i = 0; i < n; i++) {
+        h ^= p[i];
+        h *= 0x100000001b3ULL;
+    }
+    return h;
+}
+
+// Read all of the file name into buf. Returns false if it can't.
+static bool ReadWholeFile(const char *name, std::vector<uint8_t> &buf)
+{
+    FileTracker f(name, "rb");
+    if(!f.is_open())
+        return false;
+    fseek(f, 0, SEEK_END);
+    long n = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    if(n < 0)
+        return false;
+    buf.resize(n);
+    return fread(buf.data(), 1, n, f) == (size_t)n;
+}
+
+static void SaveCircuitToCache(std::vector<uint8_t> &out, int which, const void *any)
+{
+    auto put = [&out](const void *p, size_t n) { out.insert(out.end(), (const uint8_t *)p, (const uint8_t *)p + n); };
+    int32_t w = which;
+    put(&w, sizeof(w));
+    switch(which) {
+        case ELEM_SERIES_SUBCKT:
+        case ELEM_PARALLEL_SUBCKT: {
+            // the same layout for both
+            const ElemSubcktSeries *s = (const ElemSubcktSeries *)any;
+            int32_t                 count = s->count;
+            put(&count, sizeof(count));
+            for(int i = 0; i < s->count; i++)
+                SaveCircuitToCache(out, s->contents[i].which, s->contents[i].data.any);
+            break;
+        }
+            CASE_LEAF
+            put(&((const ElemLeaf *)any)->d, LeafSize(which) - offsetof(ElemLeaf, d));
+            break;
+
+        default:
+            oops();
+            break;
+    }
+}
+
+// The circuit at *p, before end, or nullptr if the cache is bad.
+static void *LoadCircuitFromCache(const uint8_t *&p, const uint8_t *end, int *which)
+{
+    int32_t w;
+    if(end - p < (ptrdiff_t)sizeof(w))
+        return nullptr;
+    memcpy(&w, p, sizeof(w));
+    p += sizeof(w);
+    *which = w;
+    switch(w) {
+        case ELEM_SERIES_SUBCKT:
+        case ELEM_PARALLEL_SUBCKT: {
+            int32_t count;
+            if(end - p < (ptrdiff_t)sizeof(count))
+                return nullptr;
+            memcpy(&count, p, sizeof(count));
+            p += sizeof(count);
+            if((count < 0) || (count >= MAX_ELEMENTS_IN_SUBCKT))
+                return nullptr;
+            ElemSubcktSeries *  s = nullptr;
+            ElemSubcktParallel *q = nullptr;
+            if(w == ELEM_SERIES_SUBCKT) {
+                s = AllocSubcktSeries();
+                GrowSubckt(s, count);
+            } else {
+                q = AllocSubcktParallel();
+                GrowSubckt(q, count);
+            }
+            SeriesNode *contents = s ? s->contents : q->contents;
+            int         i;
+            for(i = 0; i < count; i++) {
+                contents[i].data.any = LoadCircuitFromCache(p, end, &contents[i].which);
+                if(!contents[i].data.any)
+                    break;
+            }
+            if(s)
+                s->count = i;
+            else
+                q->count = i;
+            if(i < count) {
+                FreeCircuit(w, s ? (void *)s : (void *)q);
+                return nullptr;
+            }
+            return s ? (void *)s : (void *)q;
+        }
+            CASE_LEAF
+            {
+                size_t n = LeafSize(w) - offsetof(ElemLeaf, d);
+                if(end - p < (ptrdiff_t)n)
+                    return nullptr;
+                ElemLeaf *l = AllocLeaf(w);
+                memcpy(&l->d, p, n);
+                p += n;
+                return l;
+            }
+
+        default:
+            return nullptr;
+    }
+}
+
+// Load the rungs of the .ld ld (of the given size and hash) from its cache
+// file. Returns false, with no rungs, if the cache isn't there or not for
+// this .ld.
+static bool LoadRungsFromCache(const char *cacheFile, uint64_t ldSize, uint64_t ldHash)
+{
+    std::vector<uint8_t> buf;
+    if(!ReadWholeFile(cacheFile, buf))
+        return false;
+    ProjectCacheHeader h;
+    if(buf.size() < sizeof(h))
+        return false;
+    memcpy(&h, buf.data(), sizeof(h));
+    // clang-format off
+    if((memcmp(h.magic, PROJECT_CACHE_MAGIC, 4) != 0) ||
+       (h.version != PROJECT_CACHE_VERSION) ||
+       (memcmp(h.build, ProjectCacheBuild, sizeof(h.build)) != 0) ||
+       (h.ldSize != ldSize) || (h.ldHash != ldHash) ||
+       (h.numRungs > MAX_RUNGS) ||
+       (h.bodySize != buf.size() - sizeof(h)))
+        return false;
+    // clang-format on
+    const uint8_t *p = buf.data() + sizeof(h);
+    const uint8_t *end = p + h.bodySize;
+    if(HashBytes(p, h.bodySize) != h.bodyHash)
+        return false;
+
+    uint32_t rung;
+    for(rung = 0; rung < h.numRungs; rung++) {
+        int   which;
+        void *any = LoadCircuitFromCache(p, end, &which);
+        if(any && (which != ELEM_SERIES_SUBCKT)) {
+            FreeCircuit(which, any);
+            any = nullptr;
+        }
+        if(!any)
+            break;
+        Prog.rungs_[rung] = (ElemSubcktSeries *)any;
+    }
+    if((rung < h.numRungs) || (p != end)) {
+        while(rung > 0) {
+            rung--;
+            FreeCircuit(ELEM_SERIES_SUBCKT, Prog.rungs_[rung]);
+            Prog.rungs_[rung] = nullptr;
+        }
+        return false;
+    }
+    Prog.numRungs = h.numRungs;
+    return true;
+}
+
+// Write the cache of the rungs just parsed from the .ld.
+static void SaveRungsToCache(const char *cacheFile, uint64_t ldSize, uint64_t ldHash)
+{
+    std::vector<uint8_t> body;
+    for(int i = 0; i < Prog.numRungs; i++)
+        SaveCircuitToCache(body, ELEM_SERIES_SUBCKT, Prog.rungs(i));
+
+    ProjectCacheHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, PROJECT_CACHE_MAGIC, 4);
+    h.version = PROJECT_CACHE_VERSION;
+    memcpy(h.build, ProjectCacheBuild, sizeof(h.build));
+    h.numRungs = Prog.numRungs;
+    h.ldSize = ldSize;
+    h.ldHash = ldHash;
+    h.bodySize = body.size();
+    h.bodyHash = HashBytes(body.data(), body.size());
+
+    // a cache that couldn't be written whole fails its hash, and is parsed again
+    FileTracker f(cacheFile, "wb");
+    if(!f.is_open())
+        return;
+    fwrite(&h, sizeof(h), 1, f);
+    fwrite(body.data(), 1, body.size(), f);
+}
+
 //-----------------------------------------------------------------------------
 // Load a project from a saved project description files. This describes the
 // program, the target processor, plus certain configuration settings (cycle
@@ -803,6 +1024,8 @@ bool LoadProjectFromFile(const char *filename)
     FileTracker f(filename, "r");
     if(!f.is_open())
         return false;
+    // read the file in a few big blocks, fgets() then only copies the lines
+    setvbuf(f, nullptr, _IOFBF, 1 << 20);
 
     strcpy(CurrentLdPath, filename);
     ExtractFileDir(CurrentLdPath);
@@ -814,6 +1037,12 @@ bool LoadProjectFromFile(const char *filename)
     long                   rate, speed; ///// Added by JG
     int                    cycleTimer, cycleDuty, wdte;
     unsigned long long int configWord = 0;
+    std::vector<uint8_t>   ldText;
+    uint64_t               ldHash = 0;
+    bool                   hashed = false;
+    char                   cacheFile[MAX_PATH];
+    bool                   cached;
+    bool                   complete = true;
     Prog.configurationWord = 0;
     while(fgets(line, sizeof(line), f)) {
         if(!strlen(strspace(line)))
@@ -830,55 +1059,62 @@ bool LoadProjectFromFile(const char *filename)
             if(!LoadPullUpListFromFile(f)) {
                 return false;
             }
-        } else if(sscanf(line, "LDmicro%s", &version[0])) {
+        } else if(memcmp(line, "LDmicro", 7) == 0) {
+            version[0] = '\0';
+            sscanf(line, "LDmicro%s", &version[0]);
             Prog.LDversion = version;
             if((Prog.LDversion != "0.1"))
                 Prog.LDversion = "0.2";
-        } else if(sscanf(line, "CRYSTAL=%d", &crystal)) {
-            Prog.mcuClock = crystal;
-        } else if(sscanf(line, "CYCLE=%lld us at Timer%d, YPlcCycleDuty:%d, ConfigurationWord(s):%llx", &cycle, &cycleTimer, &cycleDuty, &configWord) == 4) {
-            Prog.cycleTime = cycle;
-            if((cycleTimer != 0) && (cycleTimer != 1) && (cycleTimer != 3))
-                cycleTimer = 1;
-            Prog.cycleTimer = cycleTimer;
-            Prog.cycleDuty = cycleDuty;
-            Prog.configurationWord = configWord;
-            if(Prog.cycleTime == 0)
-                Prog.cycleTimer = -1;
-        } else if(sscanf(line, "CYCLE=%lld us at Timer%d, YPlcCycleDuty:%d, WDTE:%d", &cycle, &cycleTimer, &cycleDuty, &wdte) == 4) {
-            Prog.cycleTime = cycle;
-            if((cycleTimer != 0) && (cycleTimer != 1) && (cycleTimer != 3))
-                cycleTimer = 1;
-            Prog.cycleTimer = cycleTimer;
-            Prog.cycleDuty = cycleDuty;
-            if(Prog.cycleTime == 0)
-                Prog.cycleTimer = -1;
-        } else if(sscanf(line, "CYCLE=%lld us at Timer%d, YPlcCycleDuty:%d", &cycle, &cycleTimer, &cycleDuty) == 3) {
-            Prog.cycleTime = cycle;
-            if((cycleTimer != 0) && (cycleTimer != 1) && (cycleTimer != 3))
-                cycleTimer = 1;
-            Prog.cycleTimer = cycleTimer;
-            Prog.cycleDuty = cycleDuty;
-            if(Prog.cycleTime == 0)
-                Prog.cycleTimer = -1;
-        } else if(sscanf(line, "CYCLE=%lld", &cycle)) {
-            Prog.cycleTime = cycle;
-            Prog.cycleTimer = 1;
-            Prog.cycleDuty = 0;
-            if(Prog.cycleTime == 0)
-                Prog.cycleTimer = -1;
-        } else if(sscanf(line, "BAUD=%d Hz, RATE=%ld Hz, SPEED=%ld Hz", &baud, &rate, &speed) == 3) { ///// RATE + SPEED created by JG for SPI & I2C
-            Prog.baudRate = baud;
-            Prog.spiRate = rate;
-            Prog.i2cRate = speed;
-        } else if(sscanf(line, "BAUD=%d Hz, RATE=%ld Hz", &baud, &rate) == 2) { ///// RATE created by JG for SPI
-            Prog.baudRate = baud;
-            Prog.spiRate = rate;
-            Prog.i2cRate = 0;
-        } else if(sscanf(line, "BAUD=%d Hz", &baud) == 1) {
-            Prog.baudRate = baud;
-            Prog.spiRate = 0;
-            Prog.i2cRate = 0;
+        } else if(memcmp(line, "CRYSTAL=", 8) == 0) {
+            if(sscanf(line, "CRYSTAL=%d", &crystal) == 1)
+                Prog.mcuClock = crystal;
+        } else if(memcmp(line, "CYCLE=", 6) == 0) {
+            if(sscanf(line, "CYCLE=%lld us at Timer%d, YPlcCycleDuty:%d, ConfigurationWord(s):%llx", &cycle, &cycleTimer, &cycleDuty, &configWord) == 4) {
+                Prog.cycleTime = cycle;
+                if((cycleTimer != 0) && (cycleTimer != 1) && (cycleTimer != 3))
+                    cycleTimer = 1;
+                Prog.cycleTimer = cycleTimer;
+                Prog.cycleDuty = cycleDuty;
+                Prog.configurationWord = configWord;
+                if(Prog.cycleTime == 0)
+                    Prog.cycleTimer = -1;
+            } else if(sscanf(line, "CYCLE=%lld us at Timer%d, YPlcCycleDuty:%d, WDTE:%d", &cycle, &cycleTimer, &cycleDuty, &wdte) == 4) {
+                Prog.cycleTime = cycle;
+                if((cycleTimer != 0) && (cycleTimer != 1) && (cycleTimer != 3))
+                    cycleTimer = 1;
+                Prog.cycleTimer = cycleTimer;
+                Prog.cycleDuty = cycleDuty;
+                if(Prog.cycleTime == 0)
+                    Prog.cycleTimer = -1;
+            } else if(sscanf(line, "CYCLE=%lld us at Timer%d, YPlcCycleDuty:%d", &cycle, &cycleTimer, &cycleDuty) == 3) {
+                Prog.cycleTime = cycle;
+                if((cycleTimer != 0) && (cycleTimer != 1) && (cycleTimer != 3))
+                    cycleTimer = 1;
+                Prog.cycleTimer = cycleTimer;
+                Prog.cycleDuty = cycleDuty;
+                if(Prog.cycleTime == 0)
+                    Prog.cycleTimer = -1;
+            } else if(sscanf(line, "CYCLE=%lld", &cycle) == 1) {
+                Prog.cycleTime = cycle;
+                Prog.cycleTimer = 1;
+                Prog.cycleDuty = 0;
+                if(Prog.cycleTime == 0)
+                    Prog.cycleTimer = -1;
+            }
+        } else if(memcmp(line, "BAUD=", 5) == 0) {
+            if(sscanf(line, "BAUD=%d Hz, RATE=%ld Hz, SPEED=%ld Hz", &baud, &rate, &speed) == 3) { ///// RATE + SPEED created by JG for SPI & I2C
+                Prog.baudRate = baud;
+                Prog.spiRate = rate;
+                Prog.i2cRate = speed;
+            } else if(sscanf(line, "BAUD=%d Hz, RATE=%ld Hz", &baud, &rate) == 2) { ///// RATE created by JG for SPI
+                Prog.baudRate = baud;
+                Prog.spiRate = rate;
+                Prog.i2cRate = 0;
+            } else if(sscanf(line, "BAUD=%d Hz", &baud) == 1) {
+                Prog.baudRate = baud;
+                Prog.spiRate = 0;
+                Prog.i2cRate = 0;
+            }
         } else if(memcmp(line, "COMPILED=", 9) == 0) {
             strcpy(CurrentCompileFile, line + 9);
 
@@ -888,6 +1124,13 @@ bool LoadProjectFromFile(const char *filename)
             int i = GetMnu(line + 9);
             if(i > 0)
                 compile_MNU = i;
+        } else if(memcmp(line, "OPTIMIZE=", 9) == 0) {
+            if(strcmp(line + 9, "SPEED") == 0)
+                Prog.optimize = OPTIMIZE_SPEED;
+            else if(strcmp(line + 9, "SIZE") == 0)
+                Prog.optimize = OPTIMIZE_SIZE;
+            else
+                Prog.optimize = OPTIMIZE_DEFAULT;
         } else if(memcmp(line, "MICRO=", 6) == 0) {
             if(strlen(line) > 6) {
                 auto &mcus = supportedMcus();
@@ -911,6 +1154,18 @@ bool LoadProjectFromFile(const char *filename)
     if(strcmp(line, "PROGRAM") != 0)
         goto failed;
 
+    SetExt(cacheFile, filename, "ldc");
+    cached = ExistFile(cacheFile);
+    if(cached && ReadWholeFile(filename, ldText)) {
+        ldHash = HashBytes(ldText.data(), ldText.size());
+        hashed = true;
+        if(LoadRungsFromCache(cacheFile, ldText.size(), ldHash)) {
+            // the cached rungs are collapsed already, the rest is as below
+            ProgramChanged();
+            goto loaded;
+        }
+    }
+
     for(rung = 0;;) {
         if(!fgets(line, sizeof(line), f))
             break;
@@ -924,6 +1179,7 @@ bool LoadProjectFromFile(const char *filename)
             goto failed;
         if(rung >= MAX_RUNGS) {
             Error(_("Too many rungs in input file!\nSame rungs not loaded!"));
+            complete = false;
             break;
         }
         Prog.rungs_[rung] = s;
@@ -935,7 +1191,21 @@ bool LoadProjectFromFile(const char *filename)
         while(CollapseUnnecessarySubckts(ELEM_SERIES_SUBCKT, Prog.rungs_[rung]))
             ProgramChanged();
     }
+    if(complete) {
+        if(CacheBigProjects && (Prog.numRungs >= PROJECT_CACHE_MIN_RUNGS)) {
+            if(!hashed && ReadWholeFile(filename, ldText)) {
+                ldHash = HashBytes(ldText.data(), ldText.size());
+                hashed = true;
+            }
+            if(hashed)
+                SaveRungsToCache(cacheFile, ldText.size(), ldHash);
+        } else if(cached) {
+            // of a project that became too small for it, or no longer asked for
+            remove(cacheFile);
+        }
+    }
 
+loaded:
     f.close();
     tGetLastWriteTime(filename, (PFILETIME)&LastWriteTime, 1);
     PrevWriteTime = LastWriteTime;
@@ -953,13 +1223,11 @@ failed:
 
 //-----------------------------------------------------------------------------
 // Helper routine for outputting hierarchical representation of the ladder
-// logic: indent on file f, by depth*4 spaces.
+// logic: indent on file f, by depth*2 spaces.
 //-----------------------------------------------------------------------------
 static void Indent(FileTracker &f, int depth)
 {
-    for(int i = 0; i < depth; i++) {
-        fprintf(f, "  ");
-    }
+    fprintf(f, "%*s", 2 * depth, "");
 }
 
 //-----------------------------------------------------------------------------
@@ -1487,7 +1755,9 @@ void SaveElemToFile(FileTracker &f, int which, void *any, int depth, int rung)
 
 //-----------------------------------------------------------------------------
 // Save the program in memory to the given file. Returns true for success,
-// false otherwise.
+// false otherwise. The program goes to filename.tmp through a big buffer,
+// so in a few writes, and that replaces the file only once it is all
+// written; a save that fails (disk full, ...) leaves the old file as it was.
 //-----------------------------------------------------------------------------
 bool SaveProjectToFile(char *filename, int code)
 {
@@ -1496,9 +1766,12 @@ bool SaveProjectToFile(char *filename, int code)
     else if(code == MNU_SAVE_01)
         Prog.LDversion = "0.1";
 
-    FileTracker f(filename, "w");
+    char tempFile[MAX_PATH + 4];
+    sprintf(tempFile, "%s.tmp", filename);
+    FileTracker f(tempFile, "w");
     if(!f)
         return false;
+    setvbuf(f, nullptr, _IOFBF, 1 << 20);
 
     fprintf(f, "LDmicro%s\n", Prog.LDversion.c_str());
     if(Prog.mcu()) {
@@ -1513,6 +1786,8 @@ bool SaveProjectToFile(char *filename, int code)
     if(Prog.LDversion != "0.1") {
         if(compile_MNU > 0)
             fprintf(f, "COMPILER=%s\n", GetMnuCompilerName(compile_MNU));
+        if(Prog.optimize != OPTIMIZE_DEFAULT)
+            fprintf(f, "OPTIMIZE=%s\n", (Prog.optimize == OPTIMIZE_SPEED) ? "SPEED" : "SIZE");
 
         fprintf(f, "\n");
         fprintf(f, "PULL-UP LIST\n");
@@ -1538,8 +1813,13 @@ bool SaveProjectToFile(char *filename, int code)
         SaveElemToFile(f, ELEM_SERIES_SUBCKT, Prog.rungs(i), 0, i + 1);
     }
 
-    fflush(f);
-    f.close();
+    // fclose() flushes the last buffer, so a full disk may show up only there
+    bool ok = (fflush(f) == 0) && !ferror(f);
+    ok = (f.close() == 0) && ok;
+    if(!ok || !MoveFileEx(tempFile, filename, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH)) {
+        remove(tempFile);
+        return false;
+    }
     tGetLastWriteTime(filename, (PFILETIME)&LastWriteTime, 1);
     PrevWriteTime = LastWriteTime;
     return true;
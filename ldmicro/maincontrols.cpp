@@ -103,7 +103,7 @@ void MakeMainWindowControls()
     } while(0)
     // create child window for IO list
     IoList = CreateWindowEx(
-        WS_EX_CLIENTEDGE, WC_LISTVIEW, "", WS_CHILD | LVS_REPORT | LVS_NOSORTHEADER | LVS_SHOWSELALWAYS | WS_TABSTOP | LVS_SINGLESEL | WS_CLIPSIBLINGS, 12, 25, 300, 300, MainWindow, nullptr, Instance, nullptr);
+        WS_EX_CLIENTEDGE, WC_LISTVIEW, "", WS_CHILD | LVS_REPORT | LVS_OWNERDATA | LVS_NOSORTHEADER | LVS_SHOWSELALWAYS | WS_TABSTOP | LVS_SINGLESEL | WS_CLIPSIBLINGS, 12, 25, 300, 300, MainWindow, nullptr, Instance, nullptr);
     ListView_SetExtendedListViewStyle(IoList, LVS_EX_FULLROWSELECT);
 
     int typeWidth = 110;
@@ -682,6 +682,9 @@ HMENU MakeMainWindowMenus()
     AppendMenu(ProcessorMenu, MF_STRING, MNU_PROCESSOR_0 + supportedMcus().size(), _("(no microcontroller)"));
     AppendMenu(settings, MF_STRING | MF_POPUP, (UINT_PTR)ProcessorMenu, _("&Microcontroller"));
     AppendMenu(settings, MF_STRING, MNU_MCU_SETTINGS, _("&MCU Parameters...\tCtrl+F5"));
+    AppendMenu(settings, MF_STRING, MNU_OPTIMIZE_SPEED, _("&Optimize for Speed"));
+    AppendMenu(settings, MF_STRING, MNU_BINARY_IMAGE, _("Write &Binary Image (.intb, .xintb)"));
+    AppendMenu(settings, MF_STRING, MNU_CACHE_PROJECTS, _("&Cache Big Projects (.ldc)"));
 //    AppendMenu(settings, MF_STRING, MNU_PULL_UP_RESISTORS, _("Set Pull-up input resistors"));
 
 #if 0
@@ -959,45 +962,23 @@ void RefreshStatusBar()
 //-----------------------------------------------------------------------------
 // Cause the status bar and the list view to be in sync with the actual data
 // structures describing the settings and the I/O configuration. Listview
-// does callbacks to get the strings it displays, so it just needs to know
-// how many elements to populate.
+// is virtual and does callbacks to get the strings it displays, so it just
+// needs to know how many elements there are.
 //-----------------------------------------------------------------------------
 void RefreshControlsToSettings()
 {
     if(!IoListOutOfSync) {
-        IoListSelectionPoint = -1;
-        for(int i = 0; i < Prog.io.count; i++) {
-            if(ListView_GetItemState(IoList, i, LVIS_SELECTED)) {
-                IoListSelectionPoint = i;
-                break;
-            }
-        }
         IoListSelectionPoint = SendMessage(IoList, LVM_GETNEXTITEM, (WPARAM)-1, LVNI_SELECTED);
     }
 
-    ListView_DeleteAllItems(IoList);
-    for(int i = 0; i < Prog.io.count; i++) {
-        LVITEM lvi;
-        lvi.mask = LVIF_TEXT | LVIF_PARAM | LVIF_STATE;
-        lvi.state = lvi.stateMask = 0;
-        lvi.iItem = i;
-        lvi.iSubItem = 0;
-        lvi.pszText = LPSTR_TEXTCALLBACK;
-        lvi.lParam = i;
-
-        if(ListView_InsertItem(IoList, &lvi) < 0)
-            oops();
-    }
+    ListView_SetItemCountEx(IoList, Prog.io.count, LVSICF_NOSCROLL);
+    RedrawIoListRows(0, Prog.io.count - 1);
 
     if(IoListSelectionPoint < 0)
         IoListSelectionPoint = 0;
     if(IoListSelectionPoint >= 0) {
-        for(int i = 0; i < Prog.io.count; i++) {
-            ListView_SetItemState(IoList, i, 0, LVIS_SELECTED);
-            ListView_SetItemState(IoList, i, 0, LVIS_FOCUSED);
-        }
-        ListView_SetItemState(IoList, IoListSelectionPoint, LVIS_SELECTED, LVIS_SELECTED);
-        ListView_SetItemState(IoList, IoListSelectionPoint, LVIS_FOCUSED, LVIS_FOCUSED);
+        ListView_SetItemState(IoList, -1, 0, LVIS_SELECTED | LVIS_FOCUSED);
+        ListView_SetItemState(IoList, IoListSelectionPoint, LVIS_SELECTED | LVIS_FOCUSED, LVIS_SELECTED | LVIS_FOCUSED);
         ListView_EnsureVisible(IoList, IoListSelectionPoint, false);
     }
     IoListOutOfSync = false;
@@ -1020,6 +1001,10 @@ void RefreshControlsToSettings()
 
     for(uint32_t i = 0; i < NUM_SUPPORTED_SCHEMES; i++)
         CheckMenuItem(SchemeMenu, MNU_SCHEME_BLACK + i, (i == scheme) ? MF_CHECKED : MF_UNCHECKED);
+
+    CheckMenuItem(settings, MNU_OPTIMIZE_SPEED, (Prog.optimize == OPTIMIZE_SPEED) ? MF_CHECKED : MF_UNCHECKED);
+    CheckMenuItem(settings, MNU_BINARY_IMAGE, WriteBinaryImage ? MF_CHECKED : MF_UNCHECKED);
+    CheckMenuItem(settings, MNU_CACHE_PROJECTS, CacheBigProjects ? MF_CHECKED : MF_UNCHECKED);
 }
 
 //-----------------------------------------------------------------------------
@@ -1029,13 +1014,7 @@ void RefreshControlsToSettings()
 void GenerateIoListDontLoseSelection()
 {
     int SaveIoListSelectionPoint = IoListSelectionPoint;
-    IoListSelectionPoint = -1;
-    for(int i = 0; i < Prog.io.count; i++) {
-        if(ListView_GetItemState(IoList, i, LVIS_SELECTED)) {
-            IoListSelectionPoint = i;
-            break;
-        }
-    }
+    IoListSelectionPoint = SendMessage(IoList, LVM_GETNEXTITEM, (WPARAM)-1, LVNI_SELECTED);
     IoListSelectionPoint = GenerateIoList(IoListSelectionPoint);
 
     // can't just update the listview index; if I/O has been added then the
@@ -1166,7 +1145,7 @@ void ToggleSimulationMode(bool doSimulateOneRung)
 
     DrawMenuBar(MainWindow);
     InvalidateRect(MainWindow, nullptr, false);
-    ListView_RedrawItems(IoList, 0, Prog.io.count - 1);
+    RedrawIoListRows(0, Prog.io.count - 1);
 }
 
 void ToggleSimulationMode()
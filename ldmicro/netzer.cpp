@@ -58,48 +58,44 @@ static int           RelaysCount;
 static char Strings[MAX_IO][MAX_NAME_LEN];
 static int  StringsCount;
 
-static void    generateNetzerOpcodes(BinOp *Program, int MaxLabel, OpcodeMeta *pOpcodeMeta, FILE *f = nullptr);
+// The image is built in memory and written to the file at once.
+typedef std::vector<uint8_t> NetzerImage;
+
+static void emit(NetzerImage *img, std::initializer_list<int> bytes)
+{
+    for(int b : bytes)
+        img->push_back((uint8_t)b);
+}
+
+static void    generateNetzerOpcodes(BinOp *Program, int MaxLabel, OpcodeMeta *pOpcodeMeta, NetzerImage *img);
 static uint8_t getInternalIntegerAddress(uint16_t Address);
 
-static int GetLocalVariablesAsMetaTags(FILE *f = nullptr)
+static void GetLocalVariablesAsMetaTags(NetzerImage *img)
 {
-    int metas = 0;
     for(int i = 0; i < VariablesCount; i++) {
         if((Variables[i].Name[0] != '$') && !(Variables[i].Address & MAPPED_TO_IO)) {
             int name_len = strlen(Variables[i].Name);
-            metas += name_len + 3;
-            if(f) {
-                // File handle is given. Write the tag directly to the file.
-                fputc(MTT_LOCAL_VARIABLE, f); // Type tag.
-                fputc(name_len + 1, f);       // Tag length.
-
-                fputc(getInternalIntegerAddress(Variables[i].Address), f); // Write address of register.
-                fwrite(Variables[i].Name, 1, name_len, f);                 // Write name.
-            }
+            emit(img,
+                 {MTT_LOCAL_VARIABLE,                                // Type tag.
+                  name_len + 1,                                      // Tag length.
+                  getInternalIntegerAddress(Variables[i].Address)}); // Write address of register.
+            img->insert(img->end(), Variables[i].Name, Variables[i].Name + name_len); // Write name.
         }
     }
-
-    return metas;
 }
 
-static int GetLocalRelaysAsMetaTags(FILE *f = nullptr)
+static void GetLocalRelaysAsMetaTags(NetzerImage *img)
 {
-    int metas = 0;
     for(int i = 0; i < RelaysCount; i++) {
         if((Relays[i].Name[0] != '$') && !(Relays[i].Address & MAPPED_TO_IO)) {
             int name_len = strlen(Relays[i].Name);
-            metas += name_len + 3;
-            if(f) {
-                // File handle is given. Write the tag directly to the file.
-                fputc(MTT_LOCAL_VARIABLE, f);           // Type tag.
-                fputc(name_len + 1, f);                 // Tag length.
-                fputc(Relays[i].Address & 0xFF, f);     // Write address of register.
-                fwrite(Relays[i].Name, 1, name_len, f); // Write name.
-            }
+            emit(img,
+                 {MTT_LOCAL_VARIABLE,         // Type tag.
+                  name_len + 1,               // Tag length.
+                  Relays[i].Address & 0xFF}); // Write address of register.
+            img->insert(img->end(), Relays[i].Name, Relays[i].Name + name_len); // Write name.
         }
     }
-
-    return metas;
 }
 
 static uint16_t AddrForString(const NameArray &name)
@@ -514,31 +510,62 @@ int GenerateIntOpcodes()
 ///////////////////////////////////////////////////////////////////////////////
 ///////////////////////////////////////////////////////////////////////////////
 
-static uint16_t calculateCRC(FILE *f, uint16_t Size)
+// CRC-16/CCITT (polynomial 0x1021, start 0xffff) of the image, eight bytes
+// per step: CrcTable[k][b] is the CRC of byte b followed by k zero bytes.
+static uint16_t CrcTable[8][256];
+
+static void makeCRCTable()
 {
-    uint16_t crc = 0xffff;
+    for(int i = 0; i < 256; i++) {
+        uint16_t crc = i << 8;
+        for(int k = 0; k < 8; k++)
+            crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : (crc << 1);
+        CrcTable[0][i] = crc;
+    }
+    for(int k = 1; k < 8; k++) {
+        for(int i = 0; i < 256; i++)
+            CrcTable[k][i] = (CrcTable[k - 1][i] << 8) ^ CrcTable[0][CrcTable[k - 1][i] >> 8];
+    }
+}
 
-    while(Size--) {
-        uint8_t tmp = (uint8_t)fgetc(f);
-        crc = (uint8_t)(crc >> 8) | (crc << 8);
-        crc ^= tmp;
-        crc ^= (uint8_t)(crc & 0xff) >> 4;
-        crc ^= crc << 12;
-        crc ^= (crc & 0xff) << 5;
+static uint16_t calculateCRC(const uint8_t *data, size_t Size)
+{
+    if(CrcTable[0][1] == 0)
+        makeCRCTable();
+
+    uint16_t crc = 0xffff;
+    for(; Size >= 8; Size -= 8, data += 8) {
+        crc = CrcTable[7][data[0] ^ (crc >> 8)] ^ CrcTable[6][data[1] ^ (crc & 0xff)] //
+              ^ CrcTable[5][data[2]] ^ CrcTable[4][data[3]] ^ CrcTable[3][data[4]]    //
+              ^ CrcTable[2][data[5]] ^ CrcTable[1][data[6]] ^ CrcTable[0][data[7]];
     }
+    while(Size--)
+        crc = (crc << 8) ^ CrcTable[0][(crc >> 8) ^ *data++];
     return crc;
 }
 
 ///////////////////////////////////////////////////////////////////////////////
 
-static uint16_t calculateJumpLabel(int16_t DestinationLabel)
+// The jump labels are written as placeholders and patched at the end of
+// generateNetzerOpcodes(), once the byte offset of every op is known, so
+// the program is generated only once.
+typedef struct JumpFixupTag {
+    size_t  At;    // of the label in the image
+    int16_t Label; // jump to the op after this one
+} JumpFixup;
+
+static std::vector<int>       OpOffset; // OpOffset[i]: where op i of OutProg starts in the opcodes
+static std::vector<JumpFixup> JumpFixups;
+
+static void emitJumpLabel(NetzerImage *img, int16_t DestinationLabel)
 {
-    OpcodeMeta opcodeMeta;
-    opcodeMeta.BytesConsumed = 0;
-    opcodeMeta.Opcodes = 0;
+    JumpFixups.push_back({img->size(), DestinationLabel});
+    emit(img, {0, 0});
+}
 
-    generateNetzerOpcodes(OutProg, DestinationLabel + 1, &opcodeMeta);
-    return (uint16_t)opcodeMeta.BytesConsumed;
+static uint16_t calculateJumpLabel(int16_t DestinationLabel)
+{
+    return (uint16_t)OpOffset[DestinationLabel + 1];
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -550,15 +577,13 @@ static uint8_t getIOAddress(int16_t Address)
 
 ///////////////////////////////////////////////////////////////////////////////
 
-static void clearBit(BinOp *Op, OpcodeMeta *pMeta, FILE *f = nullptr)
+static void clearBit(BinOp *Op, OpcodeMeta *pMeta, NetzerImage *img)
 {
     if(Op->name1 & MAPPED_TO_IO) {
-        if(f)
-            fprintf(f, "%c%c", OP_BIT_CLEAR_IO, getIOAddress(Op->name1));
+        emit(img, {OP_BIT_CLEAR_IO, getIOAddress(Op->name1)});
         pMeta->BytesConsumed += 2;
     } else {
-        if(f)
-            fprintf(f, "%c%c%c", OP_BIT_CLEAR, Op->name1 / 8, 1 << (Op->name1 % 8));
+        emit(img, {OP_BIT_CLEAR, Op->name1 / 8, 1 << (Op->name1 % 8)});
         pMeta->BytesConsumed += 3;
     }
 
@@ -567,15 +592,13 @@ static void clearBit(BinOp *Op, OpcodeMeta *pMeta, FILE *f = nullptr)
 
 ///////////////////////////////////////////////////////////////////////////////
 
-static void setBit(BinOp *Op, OpcodeMeta *pMeta, FILE *f = nullptr)
+static void setBit(BinOp *Op, OpcodeMeta *pMeta, NetzerImage *img)
 {
     if(Op->name1 & MAPPED_TO_IO) {
-        if(f)
-            fprintf(f, "%c%c", OP_BIT_SET_IO, getIOAddress(Op->name1));
+        emit(img, {OP_BIT_SET_IO, getIOAddress(Op->name1)});
         pMeta->BytesConsumed += 2;
     } else {
-        if(f)
-            fprintf(f, "%c%c%c", OP_BIT_SET, Op->name1 / 8, 1 << (Op->name1 % 8));
+        emit(img, {OP_BIT_SET, Op->name1 / 8, 1 << (Op->name1 % 8)});
         pMeta->BytesConsumed += 3;
     }
 
@@ -584,53 +607,44 @@ static void setBit(BinOp *Op, OpcodeMeta *pMeta, FILE *f = nullptr)
 
 ///////////////////////////////////////////////////////////////////////////////
 
-static void copyBit(BinOp *Op, OpcodeMeta *pMeta, FILE *f = nullptr)
+static void copyBit(BinOp *Op, OpcodeMeta *pMeta, NetzerImage *img)
 {
     int src_relay = Op->name2;
     int dst_relay = Op->name1;
 
     if(((src_relay & MAPPED_TO_IO) == 0) && ((dst_relay & MAPPED_TO_IO) == 0)) {
         if((src_relay / 8) == (dst_relay / 8)) {
-            if(f)
-                fprintf(f,
-                        "%c%c%c%c",
-                        OP_COPY_BITS_SAME_REGISTER,
-                        src_relay / 8,         // Register (byte address)
-                        1 << (src_relay % 8),  // Source mask
-                        1 << (dst_relay % 8)); // Destination mask
+            emit(img,
+                 {OP_COPY_BITS_SAME_REGISTER,
+                  src_relay / 8,         // Register (byte address)
+                  1 << (src_relay % 8),  // Source mask
+                  1 << (dst_relay % 8)}); // Destination mask
             pMeta->BytesConsumed += 4;
         } else {
-            if(f)
-                fprintf(f,
-                        "%c%c%c%c%c",
-                        OP_COPY_BITS,
-                        src_relay / 8,         // Source register (byte address)
-                        1 << (src_relay % 8),  // Source mask
-                        dst_relay / 8,         // Destination register (byte address)
-                        1 << (dst_relay % 8)); // Destination mask
+            emit(img,
+                 {OP_COPY_BITS,
+                  src_relay / 8,         // Source register (byte address)
+                  1 << (src_relay % 8),  // Source mask
+                  dst_relay / 8,         // Destination register (byte address)
+                  1 << (dst_relay % 8)}); // Destination mask
             pMeta->BytesConsumed += 5;
         }
     } else if((src_relay & MAPPED_TO_IO) && (dst_relay & MAPPED_TO_IO)) {
-        if(f)
-            fprintf(f, "%c%c%c", OP_COPY_BITS_IO, getIOAddress(src_relay), getIOAddress(dst_relay));
+        emit(img, {OP_COPY_BITS_IO, getIOAddress(src_relay), getIOAddress(dst_relay)});
         pMeta->BytesConsumed += 3;
     } else if(((src_relay & MAPPED_TO_IO) == 0) && (dst_relay & MAPPED_TO_IO)) {
-        if(f)
-            fprintf(f,
-                    "%c%c%c%c",
-                    OP_COPY_BIT_TO_IO,
-                    src_relay / 8,            // Source register (byte address)
-                    1 << (src_relay % 8),     // Source mask
-                    getIOAddress(dst_relay)); // destination io
+        emit(img,
+             {OP_COPY_BIT_TO_IO,
+              src_relay / 8,             // Source register (byte address)
+              1 << (src_relay % 8),      // Source mask
+              getIOAddress(dst_relay)}); // destination io
         pMeta->BytesConsumed += 4;
     } else if((src_relay & MAPPED_TO_IO) && ((dst_relay & MAPPED_TO_IO) == 0)) {
-        if(f)
-            fprintf(f,
-                    "%c%c%c%c",
-                    OP_COPY_BIT_FROM_IO,
-                    getIOAddress(src_relay), // Source io
-                    dst_relay / 8,           // Destination register (byte address)
-                    1 << (dst_relay % 8));   // Destination mask
+        emit(img,
+             {OP_COPY_BIT_FROM_IO,
+              getIOAddress(src_relay), // Source io
+              dst_relay / 8,           // Destination register (byte address)
+              1 << (dst_relay % 8)});  // Destination mask
         pMeta->BytesConsumed += 4;
     }
 
@@ -639,52 +653,38 @@ static void copyBit(BinOp *Op, OpcodeMeta *pMeta, FILE *f = nullptr)
 
 ///////////////////////////////////////////////////////////////////////////////
 
-static void ifBitSet(BinOp *Op, OpcodeMeta *pMeta, FILE *f = nullptr)
+static void ifBitSet(BinOp *Op, OpcodeMeta *pMeta, NetzerImage *img)
 {
-    uint16_t labelAddress = 0;
-    if(f)
-        labelAddress = calculateJumpLabel(Op->name3);
     if(Op->name1 & MAPPED_TO_IO) {
-        if(f)
-            fprintf(f, "%c%c%c%c", OP_IF_BIT_SET_IO, getIOAddress(Op->name1), (uint8_t)(labelAddress), (uint8_t)(labelAddress >> 8));
+        emit(img, {OP_IF_BIT_SET_IO, getIOAddress(Op->name1)});
         pMeta->BytesConsumed += 4;
     } else {
-        if(f)
-            fprintf(f,
-                    "%c%c%c%c%c",
-                    OP_IF_BIT_SET,
-                    Op->name1 / 8,        // Register (byte address)
-                    1 << (Op->name1 % 8), // Mask
-                    (uint8_t)(labelAddress),
-                    (uint8_t)(labelAddress >> 8));
+        emit(img,
+             {OP_IF_BIT_SET,
+              Op->name1 / 8,          // Register (byte address)
+              1 << (Op->name1 % 8)}); // Mask
         pMeta->BytesConsumed += 5;
     }
+    emitJumpLabel(img, Op->name3);
 
     pMeta->Opcodes += 1; // One opcode generated.
 }
 
 ///////////////////////////////////////////////////////////////////////////////
 
-static void ifBitCleared(BinOp *Op, OpcodeMeta *pMeta, FILE *f = nullptr)
+static void ifBitCleared(BinOp *Op, OpcodeMeta *pMeta, NetzerImage *img)
 {
-    uint16_t labelAddress = 0;
-    if(f)
-        labelAddress = calculateJumpLabel(Op->name3);
     if(Op->name1 & MAPPED_TO_IO) {
-        if(f)
-            fprintf(f, "%c%c%c%c", OP_IF_BIT_CLEARED_IO, getIOAddress(Op->name1), (uint8_t)(labelAddress), (uint8_t)(labelAddress >> 8));
+        emit(img, {OP_IF_BIT_CLEARED_IO, getIOAddress(Op->name1)});
         pMeta->BytesConsumed += 4;
     } else {
-        if(f)
-            fprintf(f,
-                    "%c%c%c%c%c",
-                    OP_IF_BIT_CLEARED,
-                    Op->name1 / 8,        // Register (byte address)
-                    1 << (Op->name1 % 8), // Mask
-                    (uint8_t)(labelAddress),
-                    (uint8_t)(labelAddress >> 8));
+        emit(img,
+             {OP_IF_BIT_CLEARED,
+              Op->name1 / 8,          // Register (byte address)
+              1 << (Op->name1 % 8)}); // Mask
         pMeta->BytesConsumed += 5;
     }
+    emitJumpLabel(img, Op->name3);
 
     pMeta->Opcodes += 1; // One opcode generated.
 }
@@ -702,7 +702,7 @@ static uint8_t getInternalIntegerAddress(uint16_t Address)
 
 ///////////////////////////////////////////////////////////////////////////////
 
-static void setVariableToLiteral(BinOp *Op, OpcodeMeta *pMeta, FILE *f = nullptr)
+static void setVariableToLiteral(BinOp *Op, OpcodeMeta *pMeta, NetzerImage *img)
 {
     uint8_t        address;
     NetzerIntCodes op;
@@ -716,31 +716,26 @@ static void setVariableToLiteral(BinOp *Op, OpcodeMeta *pMeta, FILE *f = nullptr
     }
 
     // Write register address and literal
-    if(f)
-        fprintf(f, "%c%c%c%c", op, address, (uint8_t)Op->literal1, (uint8_t)(Op->literal1 >> 8));
+    emit(img, {op, address, (uint8_t)Op->literal1, (uint8_t)(Op->literal1 >> 8)});
     pMeta->BytesConsumed += 4;
     pMeta->Opcodes += 1; // One opcode generated.
 }
 
 ///////////////////////////////////////////////////////////////////////////////
 
-static void setVariableToVariable(BinOp *Op, OpcodeMeta *pMeta, FILE *f = nullptr)
+static void setVariableToVariable(BinOp *Op, OpcodeMeta *pMeta, NetzerImage *img)
 {
     int src_var = Op->name2;
     int dst_var = Op->name1;
 
     if((src_var & MAPPED_TO_IO) && (dst_var & MAPPED_TO_IO)) {
-        if(f)
-            fprintf(f, "%c%c%c", OP_SET_VARIABLE_IO_TO_VARIABLE_IO, getIOAddress(src_var), getIOAddress(dst_var));
+        emit(img, {OP_SET_VARIABLE_IO_TO_VARIABLE_IO, getIOAddress(src_var), getIOAddress(dst_var)});
     } else if((src_var & MAPPED_TO_IO) && ((dst_var & MAPPED_TO_IO) == 0)) {
-        if(f)
-            fprintf(f, "%c%c%c", OP_SET_VARIABLE_TO_VARIABLE_IO, getIOAddress(src_var), getInternalIntegerAddress(dst_var));
+        emit(img, {OP_SET_VARIABLE_TO_VARIABLE_IO, getIOAddress(src_var), getInternalIntegerAddress(dst_var)});
     } else if(((src_var & MAPPED_TO_IO) == 0) && (dst_var & MAPPED_TO_IO)) {
-        if(f)
-            fprintf(f, "%c%c%c", OP_SET_VARIABLE_IO_TO_VARIABLE, getInternalIntegerAddress(src_var), getIOAddress(dst_var));
+        emit(img, {OP_SET_VARIABLE_IO_TO_VARIABLE, getInternalIntegerAddress(src_var), getIOAddress(dst_var)});
     } else if(((src_var & MAPPED_TO_IO) == 0) && ((dst_var & MAPPED_TO_IO) == 0)) {
-        if(f)
-            fprintf(f, "%c%c%c", OP_SET_VARIABLE_TO_VARIABLE, getInternalIntegerAddress(src_var), getInternalIntegerAddress(dst_var));
+        emit(img, {OP_SET_VARIABLE_TO_VARIABLE, getInternalIntegerAddress(src_var), getInternalIntegerAddress(dst_var)});
     }
     pMeta->BytesConsumed += 3;
     pMeta->Opcodes += 1; // One opcode generated.
@@ -748,14 +743,12 @@ static void setVariableToVariable(BinOp *Op, OpcodeMeta *pMeta, FILE *f = nullpt
 
 ///////////////////////////////////////////////////////////////////////////////
 
-static void incrementVariable(BinOp *Op, OpcodeMeta *pMeta, FILE *f = nullptr)
+static void incrementVariable(BinOp *Op, OpcodeMeta *pMeta, NetzerImage *img)
 {
     if(Op->name1 & MAPPED_TO_IO) {
-        if(f)
-            fprintf(f, "%c%c", OP_INCREMENT_VARIABLE_IO, getIOAddress(Op->name1));
+        emit(img, {OP_INCREMENT_VARIABLE_IO, getIOAddress(Op->name1)});
     } else {
-        if(f)
-            fprintf(f, "%c%c", OP_INCREMENT_VARIABLE, getInternalIntegerAddress(Op->name1));
+        emit(img, {OP_INCREMENT_VARIABLE, getInternalIntegerAddress(Op->name1)});
     }
     pMeta->BytesConsumed += 2;
     pMeta->Opcodes += 1; // One opcode generated.
@@ -763,14 +756,12 @@ static void incrementVariable(BinOp *Op, OpcodeMeta *pMeta, FILE *f = nullptr)
 
 ///////////////////////////////////////////////////////////////////////////////
 
-static void decrementVariable(BinOp *Op, OpcodeMeta *pMeta, FILE *f = nullptr)
+static void decrementVariable(BinOp *Op, OpcodeMeta *pMeta, NetzerImage *img)
 {
     if(Op->name1 & MAPPED_TO_IO) {
-        if(f)
-            fprintf(f, "%c%c", OP_DECREMENT_VARIABLE_IO, getIOAddress(Op->name1));
+        emit(img, {OP_DECREMENT_VARIABLE_IO, getIOAddress(Op->name1)});
     } else {
-        if(f)
-            fprintf(f, "%c%c", OP_DECREMENT_VARIABLE, getInternalIntegerAddress(Op->name1));
+        emit(img, {OP_DECREMENT_VARIABLE, getInternalIntegerAddress(Op->name1)});
     }
     pMeta->BytesConsumed += 2;
     pMeta->Opcodes += 1; // One opcode generated.
@@ -778,83 +769,42 @@ static void decrementVariable(BinOp *Op, OpcodeMeta *pMeta, FILE *f = nullptr)
 
 ///////////////////////////////////////////////////////////////////////////////
 
-static void ifVariableLesLiteral(BinOp *Op, OpcodeMeta *pMeta, FILE *f = nullptr)
+static void ifVariableLiteral(NetzerIntCodes Opcode, NetzerIntCodes OpcodeIO, BinOp *Op, OpcodeMeta *pMeta, NetzerImage *img)
 {
-    uint16_t labelAddress = 0;
-    if(f)
-        labelAddress = calculateJumpLabel(Op->name3);
     if(Op->name1 & MAPPED_TO_IO) {
-        if(f)
-            fprintf(f, "%c%c%c%c%c%c", OP_IF_VARIABLE_IO_LES_LITERAL, getIOAddress(Op->name1), (uint8_t)(Op->literal1), (uint8_t)(Op->literal1 >> 8), (uint8_t)(labelAddress), (uint8_t)(labelAddress >> 8));
+        emit(img, {OpcodeIO, getIOAddress(Op->name1), (uint8_t)(Op->literal1), (uint8_t)(Op->literal1 >> 8)});
     } else {
-        if(f)
-            fprintf(f, "%c%c%c%c%c%c", OP_IF_VARIABLE_LES_LITERAL, getInternalIntegerAddress(Op->name1), (uint8_t)(Op->literal1), (uint8_t)(Op->literal1 >> 8), (uint8_t)(labelAddress), (uint8_t)(labelAddress >> 8));
+        emit(img, {Opcode, getInternalIntegerAddress(Op->name1), (uint8_t)(Op->literal1), (uint8_t)(Op->literal1 >> 8)});
     }
+    emitJumpLabel(img, Op->name3);
 
     pMeta->BytesConsumed += 6;
     pMeta->Opcodes += 1; // One opcode generated.
 }
 
-///////////////////////////////////////////////////////////////////////////////
-
-static void ifVariableGeqLiteral(BinOp *Op, OpcodeMeta *pMeta, FILE *f = nullptr)
+static void ifVariableLesLiteral(BinOp *Op, OpcodeMeta *pMeta, NetzerImage *img)
 {
-    uint16_t labelAddress;
-    if(f)
-        labelAddress = calculateJumpLabel(Op->name3);
-    if(Op->name1 & MAPPED_TO_IO) {
-        if(f)
-            fprintf(f, "%c%c%c%c%c%c", OP_IF_VARIABLE_IO_GRT_LITERAL, getIOAddress(Op->name1), (uint8_t)(Op->literal1), (uint8_t)(Op->literal1 >> 8), (uint8_t)(labelAddress), (uint8_t)(labelAddress >> 8));
-    } else {
-        if(f)
-            fprintf(f, "%c%c%c%c%c%c", OP_IF_VARIABLE_GRT_LITERAL, getInternalIntegerAddress(Op->name1), (uint8_t)(Op->literal1), (uint8_t)(Op->literal1 >> 8), (uint8_t)(labelAddress), (uint8_t)(labelAddress >> 8));
-    }
-
-    pMeta->BytesConsumed += 6;
-    pMeta->Opcodes += 1; // One opcode generated.
+    ifVariableLiteral(OP_IF_VARIABLE_LES_LITERAL, OP_IF_VARIABLE_IO_LES_LITERAL, Op, pMeta, img);
 }
 
-///////////////////////////////////////////////////////////////////////////////
-
-static void ifVariableEquLiteral(BinOp *Op, OpcodeMeta *pMeta, FILE *f = nullptr)
+static void ifVariableGeqLiteral(BinOp *Op, OpcodeMeta *pMeta, NetzerImage *img)
 {
-    uint16_t labelAddress;
-    if(f)
-        labelAddress = calculateJumpLabel(Op->name3);
-    if(Op->name1 & MAPPED_TO_IO) {
-        if(f)
-            fprintf(f, "%c%c%c%c%c%c", OP_IF_VARIABLE_IO_EQU_LITERAL, getIOAddress(Op->name1), (uint8_t)(Op->literal1), (uint8_t)(Op->literal1 >> 8), (uint8_t)(labelAddress), (uint8_t)(labelAddress >> 8));
-    } else {
-        if(f)
-            fprintf(f, "%c%c%c%c%c%c", OP_IF_VARIABLE_EQU_LITERAL, getInternalIntegerAddress(Op->name1), (uint8_t)(Op->literal1), (uint8_t)(Op->literal1 >> 8), (uint8_t)(labelAddress), (uint8_t)(labelAddress >> 8));
-    }
-
-    pMeta->BytesConsumed += 6;
-    pMeta->Opcodes += 1; // One opcode generated.
+    ifVariableLiteral(OP_IF_VARIABLE_GRT_LITERAL, OP_IF_VARIABLE_IO_GRT_LITERAL, Op, pMeta, img);
 }
 
-///////////////////////////////////////////////////////////////////////////////
-
-static void ifVariableNeqLiteral(BinOp *Op, OpcodeMeta *pMeta, FILE *f = nullptr)
+static void ifVariableEquLiteral(BinOp *Op, OpcodeMeta *pMeta, NetzerImage *img)
 {
-    uint16_t labelAddress;
-    if(f)
-        labelAddress = calculateJumpLabel(Op->name3);
-    if(Op->name1 & MAPPED_TO_IO) {
-        if(f)
-            fprintf(f, "%c%c%c%c%c%c", OP_IF_VARIABLE_IO_NEQ_LITERAL, getIOAddress(Op->name1), (uint8_t)(Op->literal1), (uint8_t)(Op->literal1 >> 8), (uint8_t)(labelAddress), (uint8_t)(labelAddress >> 8));
-    } else {
-        if(f)
-            fprintf(f, "%c%c%c%c%c%c", OP_IF_VARIABLE_NEQ_LITERAL, getInternalIntegerAddress(Op->name1), (uint8_t)(Op->literal1), (uint8_t)(Op->literal1 >> 8), (uint8_t)(labelAddress), (uint8_t)(labelAddress >> 8));
-    }
+    ifVariableLiteral(OP_IF_VARIABLE_EQU_LITERAL, OP_IF_VARIABLE_IO_EQU_LITERAL, Op, pMeta, img);
+}
 
-    pMeta->BytesConsumed += 6;
-    pMeta->Opcodes += 1; // One opcode generated.
+static void ifVariableNeqLiteral(BinOp *Op, OpcodeMeta *pMeta, NetzerImage *img)
+{
+    ifVariableLiteral(OP_IF_VARIABLE_NEQ_LITERAL, OP_IF_VARIABLE_IO_NEQ_LITERAL, Op, pMeta, img);
 }
 
 ///////////////////////////////////////////////////////////////////////////////
 
-static void math(NetzerIntCodes Opcode, BinOp *Op, OpcodeMeta *pMeta, FILE *f = nullptr)
+static void math(NetzerIntCodes Opcode, BinOp *Op, OpcodeMeta *pMeta, NetzerImage *img)
 {
     uint16_t dst = Op->name1;
     auto     src1 = Op->name2;
@@ -864,30 +814,31 @@ static void math(NetzerIntCodes Opcode, BinOp *Op, OpcodeMeta *pMeta, FILE *f =
         BinOp load;
         load.name1 = AddrForVariable("$dummy2");
         load.name2 = src1;
-        setVariableToVariable(&load, pMeta, f);
+        setVariableToVariable(&load, pMeta, img);
         src1 = load.name1;
     }
 
-    if(src2 & MAPPED_TO_IO) {
+    if(src2 == Op->name2) {
+        // Same register twice, an IO register is loaded only once.
+        src2 = src1;
+    } else if(src2 & MAPPED_TO_IO) {
         BinOp load;
         load.name1 = AddrForVariable("$dummy3");
         load.name2 = src2;
-        setVariableToVariable(&load, pMeta, f);
+        setVariableToVariable(&load, pMeta, img);
         src2 = load.name1;
     }
 
     if(dst & MAPPED_TO_IO) {
         BinOp load;
-        if(f)
-            fprintf(f, "%c%c%c%c", Opcode, getInternalIntegerAddress(src1), getInternalIntegerAddress(src2), getInternalIntegerAddress(AddrForVariable("$dummy1")));
+        emit(img, {Opcode, getInternalIntegerAddress(src1), getInternalIntegerAddress(src2), getInternalIntegerAddress(AddrForVariable("$dummy1"))});
 
         // Replay the calculated value.
         load.name1 = dst;
         load.name2 = AddrForVariable("$dummy1");
-        setVariableToVariable(&load, pMeta, f);
+        setVariableToVariable(&load, pMeta, img);
     } else {
-        if(f)
-            fprintf(f, "%c%c%c%c", Opcode, getInternalIntegerAddress(src1), getInternalIntegerAddress(src2), getInternalIntegerAddress(dst));
+        emit(img, {Opcode, getInternalIntegerAddress(src1), getInternalIntegerAddress(src2), getInternalIntegerAddress(dst)});
     }
 
     pMeta->BytesConsumed += 4;
@@ -896,7 +847,7 @@ static void math(NetzerIntCodes Opcode, BinOp *Op, OpcodeMeta *pMeta, FILE *f =
 
 ///////////////////////////////////////////////////////////////////////////////
 
-static void ifVariable_X_Variable(BinOp *Op, uint8_t NetzerOp, OpcodeMeta *pMeta, FILE *f = nullptr)
+static void ifVariable_X_Variable(BinOp *Op, uint8_t NetzerOp, OpcodeMeta *pMeta, NetzerImage *img)
 {
     auto src1 = Op->name1;
     auto src2 = Op->name2;
@@ -905,22 +856,23 @@ static void ifVariable_X_Variable(BinOp *Op, uint8_t NetzerOp, OpcodeMeta *pMeta
         BinOp load;
         load.name1 = AddrForVariable("$dummy1");
         load.name2 = src1;
-        setVariableToVariable(&load, pMeta, f);
+        setVariableToVariable(&load, pMeta, img);
         src1 = load.name1;
     }
 
-    if(src2 & MAPPED_TO_IO) {
+    if(src2 == Op->name1) {
+        // Same register twice, an IO register is loaded only once.
+        src2 = src1;
+    } else if(src2 & MAPPED_TO_IO) {
         BinOp load;
         load.name1 = AddrForVariable("$dummy2");
         load.name2 = src2;
-        setVariableToVariable(&load, pMeta, f);
+        setVariableToVariable(&load, pMeta, img);
         src2 = load.name1;
     }
 
-    if(f) {
-        uint16_t labelAddress = calculateJumpLabel(Op->name3);
-        fprintf(f, "%c%c%c%c%c", NetzerOp, getInternalIntegerAddress(src1), getInternalIntegerAddress(src2), (uint8_t)(labelAddress), (uint8_t)(labelAddress >> 8));
-    }
+    emit(img, {NetzerOp, getInternalIntegerAddress(src1), getInternalIntegerAddress(src2)});
+    emitJumpLabel(img, Op->name3);
 
     pMeta->BytesConsumed += 5;
     pMeta->Opcodes += 1; // One opcode generated.
@@ -928,12 +880,10 @@ static void ifVariable_X_Variable(BinOp *Op, uint8_t NetzerOp, OpcodeMeta *pMeta
 
 ///////////////////////////////////////////////////////////////////////////////
 
-static void elseOp(BinOp *Op, OpcodeMeta *pMeta, FILE *f = nullptr)
+static void elseOp(BinOp *Op, OpcodeMeta *pMeta, NetzerImage *img)
 {
-    if(f) {
-        uint16_t labelAddress = calculateJumpLabel(Op->name3);
-        fprintf(f, "%c%c%c", OP_ELSE, (uint8_t)(labelAddress), (uint8_t)(labelAddress >> 8));
-    }
+    emit(img, {OP_ELSE});
+    emitJumpLabel(img, Op->name3);
 
     pMeta->BytesConsumed += 3;
     pMeta->Opcodes += 1; // One opcode generated.
@@ -941,7 +891,7 @@ static void elseOp(BinOp *Op, OpcodeMeta *pMeta, FILE *f = nullptr)
 
 ///////////////////////////////////////////////////////////////////////////////
 
-static void writeStringOp(BinOp *Op, OpcodeMeta *pMeta, FILE *f = nullptr)
+static void writeStringOp(BinOp *Op, OpcodeMeta *pMeta, NetzerImage *img)
 {
     uint8_t        address;
     NetzerIntCodes op;
@@ -955,11 +905,8 @@ static void writeStringOp(BinOp *Op, OpcodeMeta *pMeta, FILE *f = nullptr)
     }
 
     int len = strlen(Strings[Op->name3]);
-    if(f) {
-        fprintf(f, "%c%c%c%c", op, len + 4, address, getIOAddress(Op->name1));
-        fprintf(f, "%s", Strings[Op->name3]);
-        fputc(0, f); // Terminate string.
-    }
+    emit(img, {op, len + 4, address, getIOAddress(Op->name1)});
+    img->insert(img->end(), Strings[Op->name3], Strings[Op->name3] + len + 1); // Terminated string.
 
     // Now normalize string for embedding it into image.
     pMeta->BytesConsumed += 4 + len + 1;
@@ -1015,30 +962,22 @@ void CompileNetzer(const char *outFile)
         return;
     }
 
-    FileTracker f(outFile, "w+b");
-    if(!f) {
-        Error(_("Couldn't write to '%s'"), outFile);
-        return;
-    }
-
-    // Add space for meta informations.
-    {
-        int meta_size = sizeof(meta) + strlen(projectname);
-
-        // Add space for meta tags.
-        meta_size++; // At least the end of head tag is needed.
-        meta_size += GetLocalRelaysAsMetaTags();
-        meta_size += GetLocalVariablesAsMetaTags();
-
-        // Seek after.
-        fseek(f, meta_size, SEEK_SET);
-    }
+    // Meta informations (completed below), projectname and meta tags.
+    NetzerImage image(sizeof(meta));
+    image.insert(image.end(), projectname, projectname + strlen(projectname));
+    GetLocalRelaysAsMetaTags(&image);
+    GetLocalVariablesAsMetaTags(&image);
+    image.push_back(MTT_END_OF_HEADER);
 
     OpcodeMeta opcodeMeta;
     opcodeMeta.BytesConsumed = 0;
     opcodeMeta.Opcodes = 0;
 
-    generateNetzerOpcodes(OutProg, opcodes, &opcodeMeta, f);
+    generateNetzerOpcodes(OutProg, opcodes, &opcodeMeta, &image);
+    if(image.size() > 0xFFFF) {
+        Error(_("Netzer image too large (%d bytes)."), (int)image.size());
+        return;
+    }
 
     // Complete and write meta informations.
     meta.StartTag[0] = START_TAG_BYTE1;
@@ -1046,7 +985,7 @@ void CompileNetzer(const char *outFile)
     meta.StartTag[2] = START_TAG_BYTE3;
     meta.StartTag[3] = START_TAG_BYTE4;
     meta.Opcodes = opcodeMeta.Opcodes;
-    meta.ImageLength = (int16_t)(ftell(f));
+    meta.ImageLength = (uint16_t)image.size();
 
     if(RunningInTestMode) {
         // Do not generate a time stamp in test mode (for comparing with expected results).
@@ -1063,20 +1002,20 @@ void CompileNetzer(const char *outFile)
     meta.Flags.IsCompiled = false;
     meta.ProjectID = PROJECT_ID_IO; // Only IO project is supported in the moment.
 
-    fseek(f, 0, SEEK_SET);
-    fwrite((const void *)&meta, 1, sizeof(meta), f);
-    fprintf(f, "%s", projectname);
+    // Calculate image CRC, from the image length on.
+    memcpy(image.data(), (const void *)&meta, sizeof(meta));
+    meta.ImageCRC = calculateCRC(&image[offsetof(NetzerMetaInformation_t, ImageLength)], meta.ImageLength - offsetof(NetzerMetaInformation_t, ImageLength));
+    memcpy(&image[offsetof(NetzerMetaInformation_t, ImageCRC)], (const void *)&meta.ImageCRC, sizeof(meta.ImageCRC));
 
-    // Write meta tags to file:
-    GetLocalRelaysAsMetaTags(f);
-    GetLocalVariablesAsMetaTags(f);
-    fputc(MTT_END_OF_HEADER, f);
-
-    // Calculate image CRC and write it to file.
-    fseek(f, offsetof(NetzerMetaInformation_t, ImageLength), SEEK_SET);
-    meta.ImageCRC = calculateCRC(f, meta.ImageLength - offsetof(NetzerMetaInformation_t, ImageLength));
-    fseek(f, offsetof(NetzerMetaInformation_t, ImageCRC), SEEK_SET);
-    fwrite((const void *)&meta.ImageCRC, 1, sizeof(meta.ImageCRC), f);
+    FileTracker f(outFile, "wb");
+    if(!f) {
+        Error(_("Couldn't write to '%s'"), outFile);
+        return;
+    }
+    if(fwrite(image.data(), 1, image.size(), f) != image.size()) {
+        Error(_("Couldn't write to '%s'"), outFile);
+        return;
+    }
 
     // And ready.
     char str[MAX_PATH + 500];
@@ -1086,123 +1025,150 @@ void CompileNetzer(const char *outFile)
 
 ///////////////////////////////////////////////////////////////////////////////
 
-static void generateNetzerOpcodes(BinOp *Program, int MaxLabel, OpcodeMeta *pOpcodeMeta, FILE *f)
+static bool isJump(int op)
+{
+    switch(op) {
+        case INT_IF_BIT_SET:
+        case INT_IF_BIT_CLEAR:
+        case INT_IF_VARIABLE_LES_LITERAL:
+        case INT_IF_VARIABLE_EQU_VARIABLE:
+        case INT_IF_VARIABLE_GRT_VARIABLE:
+        case INT_ELSE:
+            return true;
+        default:
+            return false;
+    }
+}
+
+static void generateNetzerOpcodes(BinOp *Program, int MaxLabel, OpcodeMeta *pOpcodeMeta, NetzerImage *img)
 {
     int idx;
 
+    OpOffset.assign(MaxLabel + 1, 0);
+    JumpFixups.clear();
     for(idx = 0; idx < MaxLabel; idx++) {
+        OpOffset[idx] = pOpcodeMeta->BytesConsumed;
+
+        // An if or else that jumps to the very next op (its branch is empty)
+        // is left out; the jumps to it land on that next op.
+        if(isJump(Program[idx].op) && (Program[idx].name3 == idx))
+            continue;
+
         switch(Program[idx].op) {
             case INT_CLEAR_BIT:
-                clearBit(&Program[idx], pOpcodeMeta, f);
+                clearBit(&Program[idx], pOpcodeMeta, img);
                 break;
 
             case INT_SET_BIT:
-                setBit(&Program[idx], pOpcodeMeta, f);
+                setBit(&Program[idx], pOpcodeMeta, img);
                 break;
 
             case INT_COPY_BIT_TO_BIT:
-                copyBit(&Program[idx], pOpcodeMeta, f);
+                // A copy of an internal relay onto itself does nothing.
+                if((Program[idx].name1 != Program[idx].name2) || (Program[idx].name1 & MAPPED_TO_IO))
+                    copyBit(&Program[idx], pOpcodeMeta, img);
                 break;
 
             case INT_SET_VARIABLE_TO_LITERAL:
-                setVariableToLiteral(&Program[idx], pOpcodeMeta, f);
+                setVariableToLiteral(&Program[idx], pOpcodeMeta, img);
                 break;
 
             case INT_SET_VARIABLE_TO_VARIABLE:
-                setVariableToVariable(&Program[idx], pOpcodeMeta, f);
+                // Nor does a move of an internal register onto itself.
+                if((Program[idx].name1 != Program[idx].name2) || (Program[idx].name1 & MAPPED_TO_IO))
+                    setVariableToVariable(&Program[idx], pOpcodeMeta, img);
                 break;
 
             case INT_INCREMENT_VARIABLE:
-                incrementVariable(&Program[idx], pOpcodeMeta, f);
+                incrementVariable(&Program[idx], pOpcodeMeta, img);
                 break;
 
             case INT_DECREMENT_VARIABLE:
-                decrementVariable(&Program[idx], pOpcodeMeta, f);
+                decrementVariable(&Program[idx], pOpcodeMeta, img);
                 break;
 
             case INT_SET_VARIABLE_SR0:
-                math(OP_SET_VARIABLE_SR0, &Program[idx], pOpcodeMeta, f);
+                math(OP_SET_VARIABLE_SR0, &Program[idx], pOpcodeMeta, img);
                 break;
 
             case INT_SET_VARIABLE_SHL:
-                math(OP_SET_VARIABLE_SHL, &Program[idx], pOpcodeMeta, f);
+                math(OP_SET_VARIABLE_SHL, &Program[idx], pOpcodeMeta, img);
                 break;
 
             case INT_SET_VARIABLE_SHR:
-                math(OP_SET_VARIABLE_SHR, &Program[idx], pOpcodeMeta, f);
+                math(OP_SET_VARIABLE_SHR, &Program[idx], pOpcodeMeta, img);
                 break;
 
             case INT_SET_VARIABLE_AND:
-                math(OP_SET_VARIABLE_AND, &Program[idx], pOpcodeMeta, f);
+                math(OP_SET_VARIABLE_AND, &Program[idx], pOpcodeMeta, img);
                 break;
 
             case INT_SET_VARIABLE_OR:
-                math(OP_SET_VARIABLE_OR, &Program[idx], pOpcodeMeta, f);
+                math(OP_SET_VARIABLE_OR, &Program[idx], pOpcodeMeta, img);
                 break;
 
             case INT_SET_VARIABLE_XOR:
-                math(OP_SET_VARIABLE_XOR, &Program[idx], pOpcodeMeta, f);
+                math(OP_SET_VARIABLE_XOR, &Program[idx], pOpcodeMeta, img);
                 break;
 
             case INT_SET_VARIABLE_NOT:
-                math(OP_SET_VARIABLE_NOT, &Program[idx], pOpcodeMeta, f);
+                math(OP_SET_VARIABLE_NOT, &Program[idx], pOpcodeMeta, img);
                 break;
 
             case INT_SET_VARIABLE_NEG:
-                math(OP_SET_VARIABLE_NEG, &Program[idx], pOpcodeMeta, f);
+                math(OP_SET_VARIABLE_NEG, &Program[idx], pOpcodeMeta, img);
                 break;
 
             case INT_SET_VARIABLE_ADD:
-                math(OP_SET_VARIABLE_ADD, &Program[idx], pOpcodeMeta, f);
+                math(OP_SET_VARIABLE_ADD, &Program[idx], pOpcodeMeta, img);
                 break;
 
             case INT_SET_VARIABLE_SUBTRACT:
-                math(OP_SET_VARIABLE_SUB, &Program[idx], pOpcodeMeta, f);
+                math(OP_SET_VARIABLE_SUB, &Program[idx], pOpcodeMeta, img);
                 break;
 
             case INT_SET_VARIABLE_MULTIPLY:
-                math(OP_SET_VARIABLE_MUL, &Program[idx], pOpcodeMeta, f);
+                math(OP_SET_VARIABLE_MUL, &Program[idx], pOpcodeMeta, img);
                 break;
 
             case INT_SET_VARIABLE_DIVIDE:
-                math(OP_SET_VARIABLE_DIV, &Program[idx], pOpcodeMeta, f);
+                math(OP_SET_VARIABLE_DIV, &Program[idx], pOpcodeMeta, img);
                 break;
 
             case INT_SET_VARIABLE_MOD:
-                math(OP_SET_VARIABLE_MOD, &Program[idx], pOpcodeMeta, f);
+                math(OP_SET_VARIABLE_MOD, &Program[idx], pOpcodeMeta, img);
                 break;
 
             case INT_IF_BIT_SET:
-                ifBitSet(&Program[idx], pOpcodeMeta, f);
+                ifBitSet(&Program[idx], pOpcodeMeta, img);
                 break;
 
             case INT_IF_BIT_CLEAR:
-                ifBitCleared(&Program[idx], pOpcodeMeta, f);
+                ifBitCleared(&Program[idx], pOpcodeMeta, img);
                 break;
 
             case INT_IF_VARIABLE_LES_LITERAL:
-                ifVariableLesLiteral(&Program[idx], pOpcodeMeta, f);
+                ifVariableLesLiteral(&Program[idx], pOpcodeMeta, img);
                 break;
 
             case INT_IF_VARIABLE_EQU_VARIABLE:
-                ifVariable_X_Variable(&Program[idx], OP_IF_VARIABLE_EQUALS_VARIABLE, pOpcodeMeta, f);
+                ifVariable_X_Variable(&Program[idx], OP_IF_VARIABLE_EQUALS_VARIABLE, pOpcodeMeta, img);
                 break;
 
             case INT_IF_VARIABLE_GRT_VARIABLE:
-                ifVariable_X_Variable(&Program[idx], OP_IF_VARIABLE_GRT_VARIABLE, pOpcodeMeta, f);
+                ifVariable_X_Variable(&Program[idx], OP_IF_VARIABLE_GRT_VARIABLE, pOpcodeMeta, img);
                 break;
 
             case INT_ELSE:
-                elseOp(&Program[idx], pOpcodeMeta, f);
+                elseOp(&Program[idx], pOpcodeMeta, img);
                 break;
 
             case INT_WRITE_STRING:
-                writeStringOp(&Program[idx], pOpcodeMeta, f);
+                writeStringOp(&Program[idx], pOpcodeMeta, img);
                 break;
 
             case INT_END_OF_PROGRAM:
-                if(f)
-                    fputc(OP_END_OF_PROGRAM, f);
+                emit(img, {OP_END_OF_PROGRAM});
                 pOpcodeMeta->BytesConsumed++;
                 pOpcodeMeta->Opcodes++;
                 break;
@@ -1211,6 +1177,13 @@ static void generateNetzerOpcodes(BinOp *Program, int MaxLabel, OpcodeMeta *pOpc
                 oops();
         } // switch(Program[idx].op)
     }
+    OpOffset[MaxLabel] = pOpcodeMeta->BytesConsumed;
+
+    for(const JumpFixup &fixup : JumpFixups) {
+        uint16_t labelAddress = calculateJumpLabel(fixup.Label);
+        (*img)[fixup.At] = (uint8_t)(labelAddress);
+        (*img)[fixup.At + 1] = (uint8_t)(labelAddress >> 8);
+    }
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -4540,42 +4540,57 @@ otherwise the result was zero or greater.
                     // start at LSB
                 }
 
-                sov3 = SizeOfVar(a->name3);
-                //if(sov3 != 1) oops();
-                sov3 = 1;
-                CopyArgToReg(true, ScratchS, sov3, a->name3, false);
-                uint32_t loop = PicProgWriteP;
-
-                if(a->op == INT_SET_VARIABLE_SR0) {
-                    ClearBit(REG_STATUS, STATUS_C);
-                } else if(a->op == INT_SET_VARIABLE_ROL) {
-                    Instruction(OP_RLF, addrA + sov1 - 1, DEST_W); // copy MSB bit 7 to Carry
-                } else if(a->op == INT_SET_VARIABLE_SHL) {
-                    ClearBit(REG_STATUS, STATUS_C);
-                } else if(a->op == INT_SET_VARIABLE_ROR) {
-                    Instruction(OP_RRF, addrA - sov1 + 1, DEST_W); // copy LSB bit 0 to Carry
-                } else if(a->op == INT_SET_VARIABLE_SHR) {
-                    Instruction(OP_RLF, addrA + sov1 - 1, DEST_W); // copy MSB bit 7 to Carry
-                } else
-                    oops();
+                // A literal shift count is unrolled when optimizing for speed,
+                // then ScratchS and the DECFSZ/GOTO loop are not needed.
+                int steps = -1;
+                if((Prog.optimize == OPTIMIZE_SPEED) && IsNumber(a->name3)) {
+                    int32_t n = hobatoi(a->name3.c_str());
+                    if((n >= 1) && (n <= 8 * sov2))
+                        steps = n;
+                }
+                uint32_t loop = 0;
+                if(steps < 0) {
+                    sov3 = SizeOfVar(a->name3);
+                    //if(sov3 != 1) oops();
+                    sov3 = 1;
+                    CopyArgToReg(true, ScratchS, sov3, a->name3, false);
+                    loop = PicProgWriteP;
+                }
 
-                for(int i = 0; i < sov2; i++) {
+                for(int n = 0; n < ((steps < 0) ? 1 : steps); n++) {
                     if(a->op == INT_SET_VARIABLE_SR0) {
-                        Instruction(OP_RRF, addrA - i, DEST_F);
+                        ClearBit(REG_STATUS, STATUS_C);
                     } else if(a->op == INT_SET_VARIABLE_ROL) {
-                        Instruction(OP_RLF, addrA + i, DEST_F);
+                        Instruction(OP_RLF, addrA + sov1 - 1, DEST_W); // copy MSB bit 7 to Carry
                     } else if(a->op == INT_SET_VARIABLE_SHL) {
-                        Instruction(OP_RLF, addrA + i, DEST_F);
+                        ClearBit(REG_STATUS, STATUS_C);
                     } else if(a->op == INT_SET_VARIABLE_ROR) {
-                        Instruction(OP_RRF, addrA - i, DEST_F);
+                        Instruction(OP_RRF, addrA - sov1 + 1, DEST_W); // copy LSB bit 0 to Carry
                     } else if(a->op == INT_SET_VARIABLE_SHR) {
-                        Instruction(OP_RRF, addrA - i, DEST_F);
+                        Instruction(OP_RLF, addrA + sov1 - 1, DEST_W); // copy MSB bit 7 to Carry
                     } else
                         oops();
+
+                    for(int i = 0; i < sov2; i++) {
+                        if(a->op == INT_SET_VARIABLE_SR0) {
+                            Instruction(OP_RRF, addrA - i, DEST_F);
+                        } else if(a->op == INT_SET_VARIABLE_ROL) {
+                            Instruction(OP_RLF, addrA + i, DEST_F);
+                        } else if(a->op == INT_SET_VARIABLE_SHL) {
+                            Instruction(OP_RLF, addrA + i, DEST_F);
+                        } else if(a->op == INT_SET_VARIABLE_ROR) {
+                            Instruction(OP_RRF, addrA - i, DEST_F);
+                        } else if(a->op == INT_SET_VARIABLE_SHR) {
+                            Instruction(OP_RRF, addrA - i, DEST_F);
+                        } else
+                            oops();
+                    }
                 }
 
-                Instruction(OP_DECFSZ, ScratchS, DEST_F);
-                Instruction(OP_GOTO, loop);
+                if(steps < 0) {
+                    Instruction(OP_DECFSZ, ScratchS, DEST_F);
+                    Instruction(OP_GOTO, loop);
+                }
 
                 if(a->name4.length()) {
                     MemForSingleBit(a->name4, true, &addr4, &bit4);
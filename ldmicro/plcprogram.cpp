@@ -10,7 +10,7 @@ static ElemSubcktSeries *AllocEmptyRung()
     ElemSubcktSeries *s = AllocSubcktSeries();
     s->count = 1;
     s->contents[0].which = ELEM_PLACEHOLDER;
-    ElemLeaf *l = AllocLeaf();
+    ElemLeaf *l = AllocLeaf(ELEM_PLACEHOLDER);
     s->contents[0].data.leaf = l;
     return s;
 }
@@ -33,6 +33,7 @@ void PlcProgram::reset()
     baudRate = 9600;
     spiRate = 1000000;
     i2cRate = 100000;
+    optimize = OPTIMIZE_DEFAULT;
     io.count = 0;
     cycleTimer = 1;
     cycleDuty = 0;
@@ -74,6 +75,7 @@ PlcProgram &PlcProgram::operator=(const PlcProgram &other)
     OPTION = other.OPTION;
     spiRate = other.spiRate;
     i2cRate = other.i2cRate;
+    optimize = other.optimize;
     LDversion = other.LDversion;
 
     io.count = other.io.count;
@@ -206,19 +208,24 @@ void PlcProgram::insertEmptyRung(uint32_t idx)
     numRungs++;
 }
 
-void *PlcProgram::deepCopy(int which, const void *any) const
+ElemSubcktSeries *PlcProgram::copyRung(const ElemSubcktSeries *rung)
+{
+    return static_cast<ElemSubcktSeries *>(deepCopy(ELEM_SERIES_SUBCKT, rung));
+}
+
+void *PlcProgram::deepCopy(int which, const void *any)
 {
     switch(which) {
         CASE_LEAF
         {
-            ElemLeaf *leaf = AllocLeaf();
-            memcpy(leaf, any, sizeof(ElemLeaf));
+            ElemLeaf *leaf = CopyLeaf(which, (const ElemLeaf *)any);
             leaf->selectedState = SELECTED_NONE;
             return leaf;
         }
         case ELEM_SERIES_SUBCKT: {
             ElemSubcktSeries *n = AllocSubcktSeries();
             ElemSubcktSeries *s = (ElemSubcktSeries *)any;
+            GrowSubckt(n, s->count);
             n->count = s->count;
             for(int i = 0; i < s->count; i++) {
                 n->contents[i].which = s->contents[i].which;
@@ -229,6 +236,7 @@ void *PlcProgram::deepCopy(int which, const void *any) const
         case ELEM_PARALLEL_SUBCKT: {
             ElemSubcktParallel *n = AllocSubcktParallel();
             ElemSubcktParallel *p = (ElemSubcktParallel *)any;
+            GrowSubckt(n, p->count);
             n->count = p->count;
             for(int i = 0; i < p->count; i++) {
                 n->contents[i].which = p->contents[i].which;
@@ -86,12 +86,13 @@ class PlcProgram {
     }
     void appendEmptyRung();
     void insertEmptyRung(uint32_t idx);
+    static ElemSubcktSeries *copyRung(const ElemSubcktSeries *rung);
 
   public:
     PlcProgram &operator=(const PlcProgram &other);
 
   private:
-    void *deepCopy(int which, const void *any) const;
+    static void *deepCopy(int which, const void *any);
 
   public:
     struct {
@@ -111,6 +112,10 @@ class PlcProgram {
     int32_t   baudRate;  // Hz
     int32_t   spiRate;   // Hz          Added by JG
     int32_t   i2cRate;   // Hz          Added by JG
+#define OPTIMIZE_DEFAULT 0
+#define OPTIMIZE_SPEED   1
+#define OPTIMIZE_SIZE    2
+    int32_t   optimize;  // OPTIMIZE_DEFAULT, _SPEED or _SIZE, used by the AVR, PIC16 and C targets
     NameArray LDversion;
 
     std::array<ElemSubcktSeries *, MAX_RUNGS> rungs_; // TODO: move to private:
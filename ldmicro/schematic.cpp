@@ -36,8 +36,8 @@ bool CanInsertComment;
 // us which leaf element is in which box on the grid, which allows us
 // to determine what element has just been selected when the user clicks
 // on something, for example.
-SeriesNode DisplayMatrix[DISPLAY_MATRIX_X_SIZE][DISPLAY_MATRIX_Y_SIZE];
-SeriesNode Selected;
+DisplayGrid DisplayMatrix;
+SeriesNode  Selected;
 
 ElemLeaf DisplayMatrixFiller;
 
@@ -47,6 +47,51 @@ ElemLeaf DisplayMatrixFiller;
 // the requested rectangle at periodic intervals.
 PlcCursor Cursor;
 
+//-----------------------------------------------------------------------------
+SeriesNode DisplayGrid::at(int gx, int gy) const
+{
+    if((gx < 0) || (gx >= DISPLAY_MATRIX_X_SIZE))
+        return SeriesNode();
+    auto row = rows_.find(gy);
+    if(row == rows_.end())
+        return SeriesNode();
+    return boxes_[row->second + gx];
+}
+
+void DisplayGrid::set(int gx, int gy, int which, ElemLeaf *leaf)
+{
+    if((gx < 0) || (gx >= DISPLAY_MATRIX_X_SIZE))
+        return;
+    auto row = rows_.find(gy);
+    if(row == rows_.end()) {
+        row = rows_.emplace(gy, boxes_.size()).first;
+        rowGy_.push_back(gy);
+        boxes_.resize(boxes_.size() + DISPLAY_MATRIX_X_SIZE);
+    }
+    SeriesNode &node = boxes_[row->second + gx];
+    node.which = which;
+    node.data.leaf = leaf;
+}
+
+void DisplayGrid::clear()
+{
+    rows_.clear();
+    rowGy_.clear();
+    boxes_.clear(); // keeps the memory for the next paint
+}
+
+bool DisplayGrid::find(const void *p, int *gx, int *gy) const
+{
+    for(size_t i = 0; i < boxes_.size(); i++) {
+        if(boxes_[i].any() == p) {
+            *gx = i % DISPLAY_MATRIX_X_SIZE;
+            *gy = rowGy_[i / DISPLAY_MATRIX_X_SIZE];
+            return true;
+        }
+    }
+    return false;
+}
+
 //-----------------------------------------------------------------------------
 // Find the address in the DisplayMatrix of the selected leaf element. Set
 // *gx and *gy if we succeed and return true, else return false.
@@ -56,17 +101,13 @@ bool FindSelected(int *gx, int *gy)
     if(!Selected.leaf())
         return false;
     int i, j;
-    for(i = 0; i < DISPLAY_MATRIX_X_SIZE; i++) {
-        for(j = 0; j < DISPLAY_MATRIX_Y_SIZE; j++) {
-            if(DisplayMatrix[i][j].leaf() == Selected.leaf()) {
-                if(Selected.which != ELEM_COMMENT)
-                    while(DisplayMatrix[i + 1][j].data.leaf == Selected.leaf())
-                        i++;
-                *gx = i;
-                *gy = j;
-                return true;
-            }
-        }
+    if(DisplayMatrix.find(Selected.leaf(), &i, &j)) {
+        if(Selected.which != ELEM_COMMENT)
+            while(DisplayMatrix[i + 1][j].data.leaf == Selected.leaf())
+                i++;
+        *gx = i;
+        *gy = j;
+        return true;
     }
     return false;
 }
@@ -308,21 +349,36 @@ void WhatCanWeDoFromCursorAndTopology()
 //-----------------------------------------------------------------------------
 void ForgetFromGrid(void *p)
 {
-    int i, j;
-    for(i = 0; i < DISPLAY_MATRIX_X_SIZE; i++) {
-        for(j = 0; j < DISPLAY_MATRIX_Y_SIZE; j++) {
-            if(DisplayMatrix[i][j].any() == p) {
-                DisplayMatrix[i][j].data.any = nullptr;
-                //              DisplayMatrixWhich[i][j] = ELEM_NULL; // ???
-            }
+    DisplayMatrix.forEach([p](SeriesNode &node) {
+        if(node.any() == p) {
+            node.data.any = nullptr;
+            //              DisplayMatrixWhich[i][j] = ELEM_NULL; // ???
         }
-    }
+    });
     if(Selected.data.any == p) {
         Selected.data.any = nullptr;
         //      SelectedWhich = ELEM_NULL; // ???
     }
 }
 
+//-----------------------------------------------------------------------------
+// Put the element q of type which everywhere that p is in the DisplayMatrix
+// and in the selection, when q takes the place of p in the program.
+//-----------------------------------------------------------------------------
+void ReplaceInGrid(void *p, int which, void *q)
+{
+    DisplayMatrix.forEach([p, which, q](SeriesNode &node) {
+        if(node.any() == p) {
+            node.which = which;
+            node.data.any = q;
+        }
+    });
+    if(Selected.data.any == p) {
+        Selected.which = which;
+        Selected.data.any = q;
+    }
+}
+
 //-----------------------------------------------------------------------------
 // Rub out everything from DisplayMatrix. If we don't do that before freeing
 // the program (e.g. when loading a new file) then there is a race condition
@@ -330,7 +386,8 @@ void ForgetFromGrid(void *p)
 //-----------------------------------------------------------------------------
 void ForgetEverything()
 {
-    memset(DisplayMatrix, 0, sizeof(DisplayMatrix));
+    DisplayMatrix.clear();
+    ForgetRungLayouts();
     Selected.data.any = nullptr;
     Selected.which = 0;
 }
@@ -919,13 +976,10 @@ void MoveCursorMouseClick(int x, int y)
     }
 
     if(VALID_LEAF(DisplayMatrix[gx][gy])) {
-        int i, j;
-        for(i = 0; i < DISPLAY_MATRIX_X_SIZE; i++) {
-            for(j = 0; j < DISPLAY_MATRIX_Y_SIZE; j++) {
-                if(DisplayMatrix[i][j].any())
-                    DisplayMatrix[i][j].leaf()->selectedState = SELECTED_NONE;
-            }
-        }
+        DisplayMatrix.forEach([](SeriesNode &node) {
+            if(node.any())
+                node.leaf()->selectedState = SELECTED_NONE;
+        });
         int dx = x - (gx0 * POS_WIDTH * FONT_WIDTH + X_PADDING);
         int dy = y - (gy0 * POS_HEIGHT * FONT_HEIGHT + Y_PADDING);
 
@@ -89,11 +89,22 @@ bool InSimulationMode;
 // changed state or a timer output switched to see if anything could have
 // changed (not just coil, as we show the intermediate steps too).
 static int NeedRedraw; // a->op used for debug
-// Have to let the effects of a coil change in cycle k appear in cycle k+1,
-// or set by the UI code to indicate that user manually changed an Xfoo
-// input.
+// Set by the UI code to indicate that user manually changed an Xfoo input,
+// to redraw everything after the next cycle.
 bool SimulateRedrawAfterNextCycle;
 
+// And to redraw only what changed: the rungs with a node that switched or an
+// op that changed something, and the rungs and rows of the I/O list that
+// show a bit or variable that changed. NameUses tells where every name is
+// shown, from the IntCode and the I/O list at the start of the simulation.
+typedef struct NameUseTag {
+    std::vector<int> rungs;
+    std::vector<int> rows;
+} NameUse;
+static std::unordered_map<std::string, NameUse> NameUses;
+static std::vector<bool>                        RungChanged;
+static std::vector<bool>                        RowChanged;
+
 // Don't want to set a timer every 100 us to simulate a 100 us cycle
 // time...but we can cycle multiple times per timer interrupt and it will
 // be almost as good, as long as everything runs fast.
@@ -193,6 +204,29 @@ template <size_t N> static bool SingleBitOn(const StringArray<N> &name)
     return false;
 }
 
+//-----------------------------------------------------------------------------
+// Mark where name is shown for a redraw after this cycle; its value changed.
+//-----------------------------------------------------------------------------
+static void NameChanged(const char *name)
+{
+    auto use = NameUses.find(name);
+    if(use == NameUses.end())
+        return;
+    NeedRedraw = true;
+    for(int rung : use->second.rungs)
+        RungChanged[rung] = true;
+    for(int row : use->second.rows)
+        RowChanged[row] = true;
+}
+
+// An op of the rung a changed something that's drawn there.
+static void OpChanged(const IntOp *a)
+{
+    NeedRedraw = a->op;
+    if((a->rung >= 0) && (a->rung < (int)RungChanged.size()))
+        RungChanged[a->rung] = true;
+}
+
 //-----------------------------------------------------------------------------
 // Set the state of a single-bit item. Adds it to the list if it is not there
 // already.
@@ -202,7 +236,10 @@ static void SetSingleBit(const char *name, bool state)
     int i;
     for(i = 0; i < SingleBitItemsCount; i++) {
         if(strcmp(SingleBitItems[i].name, name) == 0) {
-            SingleBitItems[i].powered = state;
+            if(SingleBitItems[i].powered != state) {
+                SingleBitItems[i].powered = state;
+                NameChanged(name);
+            }
             return;
         }
     }
@@ -210,6 +247,7 @@ static void SetSingleBit(const char *name, bool state)
         strcpy(SingleBitItems[i].name, name);
         SingleBitItems[i].powered = state;
         SingleBitItemsCount++;
+        NameChanged(name);
     }
 }
 
@@ -218,7 +256,10 @@ template <size_t N> static void SetSingleBit(const StringArray<N> &name, bool st
     int i;
     for(i = 0; i < SingleBitItemsCount; i++) {
         if(name == SingleBitItems[i].name) {
-            SingleBitItems[i].powered = state;
+            if(SingleBitItems[i].powered != state) {
+                SingleBitItems[i].powered = state;
+                NameChanged(name.c_str());
+            }
             return;
         }
     }
@@ -226,6 +267,7 @@ template <size_t N> static void SetSingleBit(const StringArray<N> &name, bool st
         strcpy(SingleBitItems[i].name, name.c_str());
         SingleBitItems[i].powered = state;
         SingleBitItemsCount++;
+        NameChanged(name.c_str());
     }
 }
 
@@ -407,7 +449,10 @@ void SetSimulationVariable(const char *name, int32_t val)
 {
     for(int i = 0; i < VariableCount; i++) {
         if(strcmp(Variables[i].name, name) == 0) {
-            Variables[i].val = val;
+            if(Variables[i].val != val) {
+                Variables[i].val = val;
+                NameChanged(name);
+            }
             return;
         }
     }
@@ -451,7 +496,10 @@ void SetSimulationStr(const char *name, const char *val)
 {
     for(int i = 0; i < VariableCount; i++) {
         if(strcmp(Variables[i].name, name) == 0) {
-            strcpy(Variables[i].valstr, val);
+            if(strcmp(Variables[i].valstr, val) != 0) {
+                strcpy(Variables[i].valstr, val);
+                NameChanged(name);
+            }
             return;
         }
     }
@@ -1576,13 +1624,13 @@ static void SimulateIntCode()
         switch(a->op) {
             case INT_SIMULATE_NODE_STATE:
                 if(*(a->poweredAfter) != SingleBitOn(a->name1)) {
-                    NeedRedraw = a->op;
+                    OpChanged(a);
                     *(a->poweredAfter) = SingleBitOn(a->name1);
                 }
 
                 if(a->name2.length())
                     if(*(a->workingNow) != SingleBitOn(a->name2)) {
-                        NeedRedraw = a->op;
+                        OpChanged(a);
                         *(a->workingNow) = SingleBitOn(a->name2);
                     }
                 break;
@@ -1624,7 +1672,7 @@ static void SimulateIntCode()
 
             case INT_SET_VARIABLE_TO_LITERAL:
                 if(GetSimulationVariable(a->name1) != a->literal1 && a->name1[0] != '$') {
-                    NeedRedraw = a->op;
+                    OpChanged(a);
                 }
                 SetSimulationVariable(a->name1, a->literal1);
                 break;
@@ -1664,7 +1712,7 @@ static void SimulateIntCode()
             case INT_SET_BIN2BCD: {
                 int var2 = bin2bcd(GetSimulationVariable(a->name2));
                 if(GetSimulationVariable(a->name1) != var2) {
-                    NeedRedraw = a->op;
+                    OpChanged(a);
                     SetSimulationVariable(a->name1, var2);
                 }
                 break;
@@ -1673,7 +1721,7 @@ static void SimulateIntCode()
             case INT_SET_BCD2BIN: {
                 int var2 = bcd2bin(GetSimulationVariable(a->name2));
                 if(GetSimulationVariable(a->name1) != var2) {
-                    NeedRedraw = a->op;
+                    OpChanged(a);
                     SetSimulationVariable(a->name1, var2);
                 }
                 break;
@@ -1682,7 +1730,7 @@ static void SimulateIntCode()
             case INT_SET_OPPOSITE: {
                 int var2 = opposite(GetSimulationVariable(a->name2), SizeOfVar(a->name2));
                 if(GetSimulationVariable(a->name1) != var2) {
-                    NeedRedraw = a->op;
+                    OpChanged(a);
                     SetSimulationVariable(a->name1, var2);
                 }
                 break;
@@ -1691,7 +1739,7 @@ static void SimulateIntCode()
             case INT_SET_SWAP: {
                 int var2 = swap(GetSimulationVariable(a->name2), SizeOfVar(a->name2));
                 if(GetSimulationVariable(a->name1) != var2) {
-                    NeedRedraw = a->op;
+                    OpChanged(a);
                     SetSimulationVariable(a->name1, var2);
                 }
                 break;
@@ -1699,19 +1747,19 @@ static void SimulateIntCode()
 
             case INT_SET_VARIABLE_TO_VARIABLE:
                 if(GetSimulationVariable(a->name1) != GetSimulationVariable(a->name2)) {
-                    NeedRedraw = a->op;
+                    OpChanged(a);
                     SetSimulationVariable(a->name1, GetSimulationVariable(a->name2));
                 }
                 break;
 
             case INT_INCREMENT_VARIABLE:
                 Increment(a->name1, a->name2, "ROverflowFlagV");
-                NeedRedraw = a->op;
+                OpChanged(a);
                 break;
 
             case INT_DECREMENT_VARIABLE:
                 Decrement(a->name1, a->name2, "ROverflowFlagV");
-                NeedRedraw = a->op;
+                OpChanged(a);
                 break;
 
             case INT_SET_VARIABLE_SR0:
@@ -1781,7 +1829,7 @@ static void SimulateIntCode()
                 sov = SizeOfVar(a->name1);
                 v = OverflowToVarSize(v, sov);
                 if(GetSimulationVariable(a->name1) != v) {
-                    NeedRedraw = a->op;
+                    OpChanged(a);
                     SetSimulationVariable(a->name1, v);
                 }
                 break;
@@ -1831,7 +1879,7 @@ static void SimulateIntCode()
                     oops();
                 if(GetSimulationVariable(a->name1) != v1) {
                     SetSimulationVariable(a->name1, v1);
-                    NeedRedraw = a->op;
+                    OpChanged(a);
                 }
                 break;
             }
@@ -1947,7 +1995,7 @@ static void SimulateIntCode()
                 int32_t tmp = GetSimulationVariable(a->name1);
                 SetSimulationVariable(a->name1, GetAdcShadow(a->name1));
                 if(tmp != GetSimulationVariable(a->name1)) {
-                    NeedRedraw = a->op;
+                    OpChanged(a);
                 }
                 break;
             }
@@ -2076,7 +2124,7 @@ static void SimulateIntCode()
                     strcpy(buf, a->name2.c_str());
                 }
                 SetSimulationStr(a->name1.c_str(), buf);
-                NeedRedraw = a->op;
+                OpChanged(a);
                 break;
             }
                 //#define SPINTF(buffer, format, args) sprintf(buffer, format, #args);
@@ -2111,7 +2159,7 @@ static void SimulateIntCode()
                 int32_t d = adata[index];
                 if(GetSimulationVariable(a->name1) != d) {
                     SetSimulationVariable(a->name1, d);
-                    NeedRedraw = a->op;
+                    OpChanged(a);
                 }
                 break;
             }
@@ -2121,7 +2169,7 @@ static void SimulateIntCode()
                 char d = GetSimulationStr(a->name4.c_str())[index];
                 if(GetSimulationVariable(a->name1) != d) {
                     SetSimulationVariable(a->name1, d);
-                    NeedRedraw = a->op;
+                    OpChanged(a);
                 }
                 break;
             }
@@ -2136,7 +2184,7 @@ static void SimulateIntCode()
                 char d = GetSimulationStr(a->name1.c_str())[index];
                 if(GetSimulationVariable(a->name2) != d) {
                     SetSimulationVariable(a->name2, d);
-                    NeedRedraw = a->op;
+                    OpChanged(a);
                 }
                 break;
             }
@@ -2180,6 +2228,33 @@ static void SimulateIntCode()
     }
 } // SimulateIntCode()
 
+//-----------------------------------------------------------------------------
+// Find the rungs and the rows of the I/O list where every name of the
+// program is shown, for the redraw of only what changed in a cycle.
+//-----------------------------------------------------------------------------
+static void IndexNameUses()
+{
+    NameUses.clear();
+    for(const IntOp &a : IntCode) {
+        if((a.rung < 0) || (a.rung >= Prog.numRungs))
+            continue;
+        for(const NameArray *name : {&a.name1, &a.name2, &a.name3, &a.name4, &a.name5, &a.name6}) {
+            if(name->length() == 0)
+                continue;
+            std::vector<int> &rungs = NameUses[name->c_str()].rungs;
+            if(rungs.empty() || (rungs.back() != a.rung))
+                rungs.push_back(a.rung);
+        }
+    }
+    for(int i = 0; i < Prog.io.count; i++) {
+        NameUses[Prog.io.assignment[i].name].rows.push_back(i);
+        // DescribeForIoList() shows a PWM output by its $ bit
+        NameUses[std::string("$") + Prog.io.assignment[i].name].rows.push_back(i);
+    }
+    RungChanged.assign(Prog.numRungs, false);
+    RowChanged.assign(Prog.io.count, false);
+}
+
 //-----------------------------------------------------------------------------
 // Called by the Windows timer that triggers cycles when we are running
 // in real time.
@@ -2220,6 +2295,10 @@ void SimulateOneCycle(bool forceRefresh)
     Simulating = true;
 
     NeedRedraw = 0;
+    if((RungChanged.size() != (size_t)Prog.numRungs) || (RowChanged.size() != (size_t)Prog.io.count)) {
+        IndexNameUses();
+        SimulateRedrawAfterNextCycle = true;
+    }
 
     if(SimulateUartTxCountdown > 0) {
         SimulateUartTxCountdown--;
@@ -2243,28 +2322,39 @@ void SimulateOneCycle(bool forceRefresh)
         }
     }
     for(int i = 0; i < Prog.numRungs; i++) {
-        if(!Prog.rungSimulated[i]) {
+        if(!Prog.rungSimulated[i] && Prog.rungPowered[i]) {
             Prog.rungPowered[i] = false;
+            RungChanged[i] = true;
             NeedRedraw = true;
         }
     }
 
     CyclesCount++;
 
-    if(NeedRedraw || SimulateRedrawAfterNextCycle || forceRefresh) {
-        if((updateWindow == 0) && (forceRefresh == false)) {
-            UpdateWindow(MainWindow);
-            updateWindow--;
-        } else {
-            InvalidateRect(MainWindow, nullptr, false);
+    if(SimulateRedrawAfterNextCycle || forceRefresh) {
+        InvalidateRect(MainWindow, nullptr, false);
+        RedrawIoListRows(0, Prog.io.count - 1);
+    } else if(NeedRedraw) {
+        InvalidateRungs(RungChanged);
+        for(int i = 0; i < Prog.io.count; i++) {
+            if(RowChanged[i]) {
+                int j = i;
+                while((j + 1 < Prog.io.count) && RowChanged[j + 1])
+                    j++;
+                RedrawIoListRows(i, j);
+                i = j;
+            }
         }
-        ListView_RedrawItems(IoList, 0, Prog.io.count - 1);
     }
+    if((NeedRedraw || SimulateRedrawAfterNextCycle) && (updateWindow == 0) && (forceRefresh == false)) {
+        UpdateWindow(MainWindow);
+        updateWindow--;
+    }
+    std::fill(RungChanged.begin(), RungChanged.end(), false);
+    std::fill(RowChanged.begin(), RowChanged.end(), false);
     RefreshStatusBar();
 
     SimulateRedrawAfterNextCycle = false;
-    if(NeedRedraw)
-        SimulateRedrawAfterNextCycle = true;
 
     Simulating = false;
 }
@@ -2327,6 +2417,7 @@ bool ClearSimulationData()
         ToggleSimulationMode();
         return false;
     }
+    IndexNameUses();
     return true;
 }
 
@@ -2455,7 +2546,7 @@ void SimulationToggleContact(char *name)
             }
         }
     }
-    ListView_RedrawItems(IoList, 0, Prog.io.count - 1);
+    RedrawIoListRows(0, Prog.io.count - 1);
 }
 
 //-----------------------------------------------------------------------------
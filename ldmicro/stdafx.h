@@ -38,6 +38,7 @@
 #include <vector>
 #include <algorithm>
 #include <unordered_set>
+#include <unordered_map>
 
 // TODO: reference additional headers your program requires here
 //#include "current_function.hpp"
@@ -18,8 +18,9 @@
 //------
 //
 // Routines to maintain the stack of recent versions of the program that we
-// use for the undo/redo feature. Don't be smart at all; keep deep copies of
-// the entire program at all times.
+// use for the undo/redo feature. The levels keep read-only copies of the
+// rungs, and a rung that didn't change from one level to the next is shared
+// by them, so a level costs only the rungs that were edited.
 // Jonathan Westhues, split May 2005
 //-----------------------------------------------------------------------------
 #include "stdafx.h"
@@ -27,6 +28,139 @@
 #include "ldmicro.h"
 #include "undoredo.hpp"
 
+//-----------------------------------------------------------------------------
+// The copy of the history that every rung of the program was equal to when
+// it was last pushed or popped, and the rungs edited since then. The edits
+// mark the rungs they change (UndoRungChanged()), those get a new copy, the
+// others share theirs again. A rung that is freed is marked too, in case its
+// memory comes back as a new rung.
+//-----------------------------------------------------------------------------
+static std::unordered_map<const ElemSubcktSeries *, UndoRung *> SharedRungs;
+static std::unordered_set<const void *>                         ChangedRungs;
+
+//-----------------------------------------------------------------------------
+// Mark a rung of the program as edited, so that the next level of the
+// history copies it again instead of sharing the copy it had.
+//-----------------------------------------------------------------------------
+void UndoRungChanged(const void *rung)
+{
+    ChangedRungs.insert(rung);
+}
+
+void UndoSelectedRungChanged()
+{
+    int i = RungContainingSelected();
+    if(i >= 0)
+        UndoRungChanged(Prog.rungs(i));
+}
+
+static UndoRung *HoldRung(UndoRung *r)
+{
+    r->refs++;
+    return r;
+}
+
+static void FreeCopy(int which, void *any)
+{
+    switch(which) {
+        case ELEM_SERIES_SUBCKT: {
+            ElemSubcktSeries *s = (ElemSubcktSeries *)any;
+            for(int i = 0; i < s->count; i++)
+                FreeCopy(s->contents[i].which, s->contents[i].data.any);
+            FreeSubckt(s);
+            break;
+        }
+        case ELEM_PARALLEL_SUBCKT: {
+            ElemSubcktParallel *p = (ElemSubcktParallel *)any;
+            for(int i = 0; i < p->count; i++)
+                FreeCopy(p->contents[i].which, p->contents[i].data.any);
+            FreeSubckt(p);
+            break;
+        }
+        default:
+            // a copy is never on the screen, FreeCircuit() isn't needed
+            FreeLeaf((ElemLeaf *)any);
+            break;
+    }
+}
+
+static void ReleaseRung(UndoRung *r)
+{
+    if(--r->refs == 0) {
+        FreeCopy(ELEM_SERIES_SUBCKT, r->rung);
+        delete r;
+    }
+}
+
+static void ShareRungs(std::unordered_map<const ElemSubcktSeries *, UndoRung *> &shared)
+{
+    for(auto &s : SharedRungs)
+        ReleaseRung(s.second);
+    SharedRungs.swap(shared);
+    ChangedRungs.clear();
+}
+
+static void ForgetSharedRungs()
+{
+    std::unordered_map<const ElemSubcktSeries *, UndoRung *> none;
+    ShareRungs(none);
+}
+
+//-----------------------------------------------------------------------------
+// The copies of the rungs of the program, for a level of the history. Only
+// the rungs marked as changed, and the new ones, are copied again.
+//-----------------------------------------------------------------------------
+static std::vector<UndoRung *> CopyRungs()
+{
+    std::vector<UndoRung *>                                  rungs;
+    std::unordered_map<const ElemSubcktSeries *, UndoRung *> shared;
+    for(int i = 0; i < Prog.numRungs; i++) {
+        ElemSubcktSeries *rung = Prog.rungs(i);
+        auto              s = SharedRungs.find(rung);
+        UndoRung *        r;
+        if((s != SharedRungs.end()) && !ChangedRungs.count(rung))
+            r = s->second;
+        else
+            r = new UndoRung{PlcProgram::copyRung(rung), 0};
+        rungs.push_back(HoldRung(r));
+        shared[rung] = HoldRung(r);
+    }
+    ShareRungs(shared);
+    return rungs;
+}
+
+//-----------------------------------------------------------------------------
+// Make the rungs of the program the ones of a level of the history. A rung
+// of the program that is equal to a copy is kept, instead of copying it back.
+//-----------------------------------------------------------------------------
+static void RestoreRungs(const std::vector<UndoRung *> &rungs)
+{
+    std::unordered_multimap<const UndoRung *, ElemSubcktSeries *> kept;
+    for(auto &s : SharedRungs)
+        kept.emplace(s.second, const_cast<ElemSubcktSeries *>(s.first));
+
+    std::unordered_map<const ElemSubcktSeries *, UndoRung *> shared;
+    for(size_t i = 0; i < rungs.size(); i++) {
+        auto              k = kept.find(rungs[i]);
+        ElemSubcktSeries *rung;
+        if(k != kept.end()) {
+            rung = k->second;
+            kept.erase(k);
+        } else {
+            rung = PlcProgram::copyRung(rungs[i]->rung);
+        }
+        Prog.rungs_[i] = rung;
+        shared[rung] = HoldRung(rungs[i]);
+    }
+    // the rungs of the program that aren't in the level
+    for(auto &k : kept)
+        FreeCircuit(ELEM_SERIES_SUBCKT, k.second);
+    for(int i = (int)rungs.size(); i < Prog.numRungs; i++)
+        Prog.rungs_[i] = nullptr;
+    Prog.numRungs = (int32_t)rungs.size();
+    ShareRungs(shared);
+}
+
 //-----------------------------------------------------------------------------
 // Push a copy of the PLC program onto the undo history, replacing (and
 // freeing) the oldest one if necessary.
@@ -35,7 +169,10 @@ void UndoRemember()
 {
     // can't redo after modifying the program
     Undo::emptyRedo();
+    // the rung of the selected element is about to change
+    ForgetSelectedRungLayout();
     Undo::pushUndo();
+    UndoSelectedRungChanged();
 
     SetUndoEnabled(true, false);
 }
@@ -50,6 +187,9 @@ void UndoUndo()
     if(Undo::undoSize() <= 0)
         return;
 
+    // the rungs that don't change are kept, not the selection in them
+    if(Selected.data.leaf)
+        Selected.data.leaf->selectedState = SELECTED_NONE;
     ForgetEverything();
 
     Undo::pushRedo();
@@ -74,6 +214,9 @@ void UndoRedo()
     if(Undo::redoSize() <= 0)
         return;
 
+    // the rungs that don't change are kept, not the selection in them
+    if(Selected.data.leaf)
+        Selected.data.leaf->selectedState = SELECTED_NONE;
     ForgetEverything();
 
     Undo::pushUndo();
@@ -96,6 +239,7 @@ void UndoEmpty()
 {
     Undo::emptyRedo();
     Undo::emptyUndo();
+    ForgetSharedRungs();
 }
 
 void UndoFlush()
@@ -116,8 +260,8 @@ bool CanUndo()
 }
 
 //-----------------------------------------------------------------------------
-// Push the current program onto a program stack. Can either make a deep or
-// a shallow copy of the linked data structures.
+// Push the current program onto a program stack, sharing the rungs that
+// didn't change with the level pushed before.
 //-----------------------------------------------------------------------------
 void ProgramStack::push()
 {
@@ -126,15 +270,37 @@ void ProgramStack::push()
     else
         count++;
 
-    undo[write].prog = new PlcProgram;
-    *(undo[write].prog) = Prog;
+    UndoStruct &u = undo[write];
+    u.cycleTime = Prog.cycleTime;
+    u.cycleTimer = Prog.cycleTimer;
+    u.cycleDuty = Prog.cycleDuty;
+    u.configurationWord = Prog.configurationWord;
+    u.WDTPSA = Prog.WDTPSA;
+    u.OPTION = Prog.OPTION;
+    u.mcuClock = Prog.mcuClock;
+    u.baudRate = Prog.baudRate;
+    u.spiRate = Prog.spiRate;
+    u.i2cRate = Prog.i2cRate;
+    u.optimize = Prog.optimize;
+    u.LDversion = Prog.LDversion;
+    std::copy(Prog.pullUpRegs, Prog.pullUpRegs + MAX_IO_PORTS, u.pullUpRegs);
+    u.mcu = Prog.mcu();
+    u.compiler = Prog.compiler;
+    u.compileMnu = compile_MNU;
+    u.io.assign(Prog.io.assignment, Prog.io.assignment + Prog.io.count);
+    u.rungs = CopyRungs();
+    u.rungSelected.assign(Prog.rungSelected, Prog.numRungs);
+    u.rungPowered.assign(Prog.rungPowered, Prog.rungPowered + Prog.numRungs);
+    u.rungSimulated.assign(Prog.rungSimulated, Prog.rungSimulated + Prog.numRungs);
+    u.OpsInRung.assign(Prog.OpsInRung, Prog.OpsInRung + Prog.numRungs);
+    u.HexInRung.assign(Prog.HexInRung, Prog.HexInRung + Prog.numRungs);
     int gx, gy;
     if(FindSelected(&gx, &gy)) {
-        undo[write].gx = gx;
-        undo[write].gy = gy;
+        u.gx = gx;
+        u.gy = gy;
     } else {
-        undo[write].gx = -1;
-        undo[write].gy = -1;
+        u.gx = -1;
+        u.gy = -1;
     }
 
     int a = (write + 1);
@@ -144,8 +310,9 @@ void ProgramStack::push()
 }
 
 //-----------------------------------------------------------------------------
-// Pop a program stack onto the current program. Always does a shallow copy.
-// Internal error if the stack was empty.
+// Pop a program stack onto the current program. Only the rungs that differ
+// from the current ones are copied back. Internal error if the stack was
+// empty.
 //-----------------------------------------------------------------------------
 void ProgramStack::pop()
 {
@@ -155,11 +322,36 @@ void ProgramStack::pop()
     write = a;
     count--;
 
-    Prog = *(undo[write].prog);
-    SelectedGxAfterNextPaint = undo[write].gx;
-    SelectedGyAfterNextPaint = undo[write].gy;
-
-    undo[write].reset();
+    UndoStruct &u = undo[write];
+    Prog.cycleTime = u.cycleTime;
+    Prog.cycleTimer = u.cycleTimer;
+    Prog.cycleDuty = u.cycleDuty;
+    Prog.configurationWord = u.configurationWord;
+    Prog.WDTPSA = u.WDTPSA;
+    Prog.OPTION = u.OPTION;
+    Prog.mcuClock = u.mcuClock;
+    Prog.baudRate = u.baudRate;
+    Prog.spiRate = u.spiRate;
+    Prog.i2cRate = u.i2cRate;
+    Prog.optimize = u.optimize;
+    Prog.LDversion = u.LDversion;
+    std::copy(u.pullUpRegs, u.pullUpRegs + MAX_IO_PORTS, Prog.pullUpRegs);
+    if(Prog.mcu() != u.mcu)
+        Prog.setMcu(const_cast<McuIoInfo *>(u.mcu));
+    Prog.compiler = u.compiler;
+    compile_MNU = u.compileMnu;
+    Prog.io.count = (int32_t)u.io.size();
+    std::copy(u.io.begin(), u.io.end(), Prog.io.assignment);
+    RestoreRungs(u.rungs);
+    std::copy(u.rungSelected.begin(), u.rungSelected.end(), Prog.rungSelected);
+    std::copy(u.rungPowered.begin(), u.rungPowered.end(), Prog.rungPowered);
+    std::copy(u.rungSimulated.begin(), u.rungSimulated.end(), Prog.rungSimulated);
+    std::copy(u.OpsInRung.begin(), u.OpsInRung.end(), Prog.OpsInRung);
+    std::copy(u.HexInRung.begin(), u.HexInRung.end(), Prog.HexInRung);
+    SelectedGxAfterNextPaint = u.gx;
+    SelectedGyAfterNextPaint = u.gy;
+
+    u.reset();
 }
 
 //-----------------------------------------------------------------------------
@@ -181,10 +373,18 @@ void ProgramStack::empty()
 
 void UndoStruct::reset()
 {
-    if(prog) {
-        delete prog;
-        prog = nullptr;
-    }
+    for(UndoRung *r : rungs)
+        ReleaseRung(r);
+    rungs.clear();
+    io.clear();
+    rungSelected.clear();
+    rungPowered.clear();
+    rungSimulated.clear();
+    OpsInRung.clear();
+    HexInRung.clear();
+    mcu = nullptr;
+    compiler = -1;
+    compileMnu = -1;
     gx = -1;
     gy = -1;
 }
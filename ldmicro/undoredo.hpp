@@ -7,10 +7,11 @@
 #define UNDOREDO_HPP
 
 #include <array>
+#include <string>
+#include <vector>
+#include "plcprogram.h"
 
-#define MAX_LEVELS_UNDO 32
-
-class PlcProgram;
+#define MAX_LEVELS_UNDO 256
 
 void UndoUndo();
 void UndoRedo();
@@ -18,11 +19,45 @@ void UndoRemember();
 void UndoFlush();
 void UndoEmpty();
 bool CanUndo();
+void UndoRungChanged(const void *rung);
+void UndoSelectedRungChanged();
+
+// A read-only copy of a rung, shared by all the levels of the history in
+// which the rung is the same.
+struct UndoRung {
+    ElemSubcktSeries *rung;
+    int               refs;
+};
 
+// A level of the history: the settings and the I/O list of the program by
+// value, its rungs as shared copies.
 struct UndoStruct {
-    int         gx;
-    int         gy;
-    PlcProgram *prog;
+    int gx;
+    int gy;
+
+    int64_t                         cycleTime;
+    int32_t                         cycleTimer;
+    int32_t                         cycleDuty;
+    int32_t                         configurationWord;
+    uint8_t                         WDTPSA;
+    uint8_t                         OPTION;
+    int32_t                         mcuClock;
+    int32_t                         baudRate;
+    int32_t                         spiRate;
+    int32_t                         i2cRate;
+    int32_t                         optimize;
+    NameArray                       LDversion;
+    uint32_t                        pullUpRegs[MAX_IO_PORTS];
+    const McuIoInfo *               mcu;
+    int                             compiler;
+    int                             compileMnu;
+    std::vector<PlcProgramSingleIo> io;
+    std::vector<UndoRung *>         rungs;
+    std::string                     rungSelected;
+    std::vector<bool>               rungPowered;
+    std::vector<bool>               rungSimulated;
+    std::vector<uint32_t>           OpsInRung;
+    std::vector<uint32_t>           HexInRung;
 
     UndoStruct()
     {
@@ -52,9 +87,10 @@ class ProgramStack {
     int                                     count;
 };
 
-// Store a `deep copy' of the entire program before every change, in a
-// circular buffer so that the first one scrolls out as soon as the buffer
-// is full and we try to push another one.
+// Store the program before every change, in a circular buffer so that the
+// first one scrolls out as soon as the buffer is full and we try to push
+// another one. Only the rungs that changed since the previous level are
+// copied, the others are shared with it.
 class Undo {
     Undo();
     Undo(const Undo &)
@@ -26,36 +26,73 @@
 
 #include "ldmicro.h"
 #include "intcode.h"
+#include "ldimage.h"
 
 static std::vector<uint8_t> OutProg;
 
-#define MAX_PLCIO 256
+// Addresses and jump offsets take OperandSize bytes in OutProg. A program is
+// generated with 1 first and again with 2 and 4 as long as some operand
+// doesn't fit; see ldxinterpret.cpp.
+static int  OperandSize;
+static bool OutOfRange;
 
-static const char *PlcIos[MAX_PLCIO];
-static int         PlcIos_size = 0;
+static std::vector<const char *> PlcIos;
 
 int PlcIos_AppendAndGet(const char *name)
 {
-    for(int i = 0; i < PlcIos_size; i++) {
+    for(size_t i = 0; i < PlcIos.size(); i++) {
         if(strcmp(PlcIos[i], name) == 0)
             return i;
     }
 
-    if(PlcIos_size == MAX_PLCIO)
-        return -1;
-    PlcIos[PlcIos_size++] = name;
-    return PlcIos_size - 1;
+    PlcIos.push_back(name);
+    return PlcIos.size() - 1;
 }
 
-static int CheckRange(int value, const char *name)
+static uint32_t CheckRange(int value, const char *name)
 {
-    if(value < 0 || value > 255) {
-        THROW_COMPILER_EXCEPTION_FMT(_("%s=%d: out of range for 8bits target"), name, value);
+    if((value < 0) || ((OperandSize < 4) && (value >= (1 << (8 * OperandSize))))) {
+        if(OperandSize == 4)
+            THROW_COMPILER_EXCEPTION_FMT(_("%s=%d: out of range for 32bits target"), name, value);
+        OutOfRange = true;
     }
 
     return value;
 }
 
+static void PushOperand(uint32_t value)
+{
+    for(int i = 0; i < OperandSize; i++)
+        OutProg.push_back((value >> (8 * i)) & 0xFF);
+}
+
+static void PatchOperand(size_t at, uint32_t value)
+{
+    for(int i = 0; i < OperandSize; i++)
+        OutProg[at + i] = (value >> (8 * i)) & 0xFF;
+}
+
+// The literals are 16 bits, or 32 bits if the opcode is preceded by
+// INT_WIDE_LITERAL; only the ops whose literal needs it get the prefix.
+static bool IsWideLiteral(int32_t literal)
+{
+    return (literal < INT16_MIN) || (literal > INT16_MAX);
+}
+
+static void PushOpcode(int op, int32_t literal)
+{
+    if(IsWideLiteral(literal))
+        OutProg.push_back(INT_WIDE_LITERAL);
+    OutProg.push_back(op);
+}
+
+static void PushLiteral(int32_t literal)
+{
+    int n = IsWideLiteral(literal) ? 4 : 2;
+    for(int i = 0; i < n; i++)
+        OutProg.push_back((literal >> (8 * i)) & 0xFF);
+}
+
 static int GetArduinoPinNumber(int pin)
 {
     if(Prog.mcu())
@@ -66,29 +103,42 @@ static int GetArduinoPinNumber(int pin)
     return 0;
 }
 
-static uint8_t AddrForBit(const char *name)
+static uint32_t AddrForBit(const char *name)
 {
-    return static_cast<uint8_t>(CheckRange(PlcIos_AppendAndGet(name), name));
+    return CheckRange(PlcIos_AppendAndGet(name), name);
 }
 
-static uint8_t AddrForVariable(const char *name)
+static uint32_t AddrForVariable(const char *name)
 {
-    return static_cast<uint8_t>(CheckRange(PlcIos_AppendAndGet(name), name));
+    return CheckRange(PlcIos_AppendAndGet(name), name);
 }
 
-void CompileXInterpreted(const char *outFile)
+// The math ops only take variables; a number operand is loaded into the
+// scratch variable first.
+static const char *VariableOrLoad(const NameArray &name, const char *scratch)
 {
-    FileTracker f(outFile, "w");
-    if(!f) {
-        THROW_COMPILER_EXCEPTION_FMT(_("Couldn't write to '%s'"), outFile);
-        return;
-    }
+    if(!IsNumber(name))
+        return name.c_str();
+    int32_t literal = hobatoi(name.c_str());
+    PushOpcode(INT_SET_VARIABLE_TO_LITERAL, literal);
+    PushOperand(AddrForVariable(scratch));
+    PushLiteral(literal);
+    return scratch;
+}
+
+//-----------------------------------------------------------------------------
+// Translate IntCode to OutProg with the current OperandSize. Returns false if
+// an address or a jump didn't fit.
+//-----------------------------------------------------------------------------
+static bool GenerateXInterpreted()
+{
+    OutOfRange = false;
 
     // Preload physical IOs in the table
-    PlcIos_size = 0;
+    PlcIos.clear();
 
     for(int i = 0; i < Prog.io.count; i++) {
-        PlcIos[PlcIos_size++] = Prog.io.assignment[i].name;
+        PlcIos.push_back(Prog.io.assignment[i].name);
     }
     // Convert the if/else structures in the intermediate code to absolute
     // conditional jumps, to make life a bit easier for the interpreter.
@@ -104,81 +154,140 @@ void CompileXInterpreted(const char *outFile)
     OutProg.clear();
     OutProg.reserve(IntCode.size() * 2);
     for(uint32_t ipc = 0; ipc < IntCode.size(); ipc++) {
+        int              fusedOp;
+        const NameArray *fused[3];
+        if(int n = SuperInstruction(ipc, &fusedOp, fused)) {
+            OutProg.push_back(fusedOp);
+            PushOperand(AddrForBit(fused[0]->c_str()));
+            PushOperand(AddrForBit(fused[1]->c_str()));
+            if(fusedOp == INT_COPY_BIT_TO_TWO_BITS)
+                PushOperand(AddrForBit(fused[2]->c_str()));
+            ipc += n - 1;
+            continue;
+        }
+
         switch(IntCode[ipc].op) {
             case INT_CLEAR_BIT:
             case INT_SET_BIT:
                 OutProg.push_back(IntCode[ipc].op);
-                OutProg.push_back(AddrForBit(IntCode[ipc].name1.c_str()));
+                PushOperand(AddrForBit(IntCode[ipc].name1.c_str()));
                 break;
 
             case INT_COPY_BIT_TO_BIT:
                 OutProg.push_back(IntCode[ipc].op);
-                OutProg.push_back(AddrForBit(IntCode[ipc].name1.c_str()));
-                OutProg.push_back(AddrForBit(IntCode[ipc].name2.c_str()));
+                PushOperand(AddrForBit(IntCode[ipc].name1.c_str()));
+                PushOperand(AddrForBit(IntCode[ipc].name2.c_str()));
                 break;
 
             case INT_SET_VARIABLE_TO_LITERAL:
-                OutProg.push_back(IntCode[ipc].op);
-                OutProg.push_back(AddrForVariable(IntCode[ipc].name1.c_str()));
-                OutProg.push_back((uint8_t)(IntCode[ipc].literal1 & 0xFF));
-                OutProg.push_back((uint8_t)((IntCode[ipc].literal1 >> 8) & 0xFF));
+                PushOpcode(IntCode[ipc].op, IntCode[ipc].literal1);
+                PushOperand(AddrForVariable(IntCode[ipc].name1.c_str()));
+                PushLiteral(IntCode[ipc].literal1);
                 break;
 
             case INT_SET_VARIABLE_TO_VARIABLE:
                 OutProg.push_back(IntCode[ipc].op);
-                OutProg.push_back(AddrForVariable(IntCode[ipc].name1.c_str()));
-                OutProg.push_back(AddrForVariable(IntCode[ipc].name2.c_str()));
+                PushOperand(AddrForVariable(IntCode[ipc].name1.c_str()));
+                PushOperand(AddrForVariable(IntCode[ipc].name2.c_str()));
                 break;
 
             case INT_DECREMENT_VARIABLE:
             case INT_INCREMENT_VARIABLE:
                 OutProg.push_back(IntCode[ipc].op);
-                OutProg.push_back(AddrForVariable(IntCode[ipc].name1.c_str()));
+                PushOperand(AddrForVariable(IntCode[ipc].name1.c_str()));
                 break;
 
+            case INT_SET_VARIABLE_NEG:
+            case INT_SET_VARIABLE_NOT: {
+                const char *b = VariableOrLoad(IntCode[ipc].name2, "$xintOp2");
+                OutProg.push_back(IntCode[ipc].op);
+                PushOperand(AddrForVariable(IntCode[ipc].name1.c_str()));
+                PushOperand(AddrForVariable(b));
+                break;
+            }
+
             case INT_SET_VARIABLE_ADD:
             case INT_SET_VARIABLE_SUBTRACT:
             case INT_SET_VARIABLE_MULTIPLY:
             case INT_SET_VARIABLE_DIVIDE:
             case INT_SET_VARIABLE_MOD:
+            case INT_SET_VARIABLE_AND:
+            case INT_SET_VARIABLE_OR:
+            case INT_SET_VARIABLE_XOR: {
+                const char *b = VariableOrLoad(IntCode[ipc].name2, "$xintOp2");
+                const char *c = VariableOrLoad(IntCode[ipc].name3, "$xintOp3");
                 OutProg.push_back(IntCode[ipc].op);
-                OutProg.push_back(AddrForVariable(IntCode[ipc].name1.c_str()));
-                OutProg.push_back(AddrForVariable(IntCode[ipc].name2.c_str()));
-                OutProg.push_back(AddrForVariable(IntCode[ipc].name3.c_str()));
+                PushOperand(AddrForVariable(IntCode[ipc].name1.c_str()));
+                PushOperand(AddrForVariable(b));
+                PushOperand(AddrForVariable(c));
                 break;
+            }
+
+            // The interpreter shifts in the width of the source, like the
+            // simulator, and sets the carry bit (a scratch one if the op
+            // has none).
+            case INT_SET_VARIABLE_SHL:
+            case INT_SET_VARIABLE_SHR:
+            case INT_SET_VARIABLE_SR0:
+            case INT_SET_VARIABLE_ROL:
+            case INT_SET_VARIABLE_ROR: {
+                int width = SizeOfVar(IntCode[ipc].name2);
+                if((width < 1) || (width > 4))
+                    THROW_COMPILER_EXCEPTION_FMT(_("Size %d of '%s' not supported for interpretable target."), width, IntCode[ipc].name2.c_str());
+                const char *b = VariableOrLoad(IntCode[ipc].name2, "$xintOp2");
+                const char *c = VariableOrLoad(IntCode[ipc].name3, "$xintOp3");
+                const char *carry = IntCode[ipc].name4.length() ? IntCode[ipc].name4.c_str() : "$xintCarry";
+                OutProg.push_back(IntCode[ipc].op);
+                PushOperand(AddrForVariable(IntCode[ipc].name1.c_str()));
+                PushOperand(AddrForVariable(b));
+                PushOperand(AddrForVariable(c));
+                PushOperand(AddrForBit(carry));
+                OutProg.push_back(width);
+                break;
+            }
 
             case INT_SET_PWM:
-                OutProg.push_back(IntCode[ipc].op);
-                OutProg.push_back(AddrForVariable(IntCode[ipc].name1.c_str()));
-                OutProg.push_back((uint8_t)(IntCode[ipc].literal1 & 0xFF));
-                OutProg.push_back((uint8_t)((IntCode[ipc].literal1 >> 8) & 0xFF));
+                PushOpcode(IntCode[ipc].op, IntCode[ipc].literal1);
+                PushOperand(AddrForVariable(IntCode[ipc].name1.c_str()));
+                PushLiteral(IntCode[ipc].literal1);
                 break;
 
             case INT_READ_ADC:
                 OutProg.push_back(IntCode[ipc].op);
-                OutProg.push_back(AddrForVariable(IntCode[ipc].name1.c_str()));
+                PushOperand(AddrForVariable(IntCode[ipc].name1.c_str()));
                 break;
 
             case INT_IF_BIT_SET:
             case INT_IF_BIT_CLEAR:
                 OutProg.push_back(IntCode[ipc].op);
-                OutProg.push_back(AddrForBit(IntCode[ipc].name1.c_str()));
+                PushOperand(AddrForBit(IntCode[ipc].name1.c_str()));
                 goto finishIf;
+            case INT_IF_VARIABLE_EQU_LITERAL:
+            case INT_IF_VARIABLE_NEQ_LITERAL:
             case INT_IF_VARIABLE_LES_LITERAL:
-                OutProg.push_back(IntCode[ipc].op);
-                OutProg.push_back(AddrForVariable(IntCode[ipc].name1.c_str()));
-                OutProg.push_back((uint8_t)(IntCode[ipc].literal1 & 0xFF));
-                OutProg.push_back((uint8_t)((IntCode[ipc].literal1 >> 8) & 0xFF));
+            case INT_IF_VARIABLE_LEQ_LITERAL:
+            case INT_IF_VARIABLE_GRT_LITERAL:
+            case INT_IF_VARIABLE_GEQ_LITERAL:
+                PushOpcode(IntCode[ipc].op, IntCode[ipc].literal1);
+                PushOperand(AddrForVariable(IntCode[ipc].name1.c_str()));
+                PushLiteral(IntCode[ipc].literal1);
                 goto finishIf;
             case INT_IF_VARIABLE_EQU_VARIABLE:
+            case INT_IF_VARIABLE_NEQ_VARIABLE:
+            case INT_IF_VARIABLE_LES_VARIABLE:
+            case INT_IF_VARIABLE_LEQ_VARIABLE:
             case INT_IF_VARIABLE_GRT_VARIABLE:
+            case INT_IF_VARIABLE_GEQ_VARIABLE: {
+                const char *a = VariableOrLoad(IntCode[ipc].name1, "$xintOp2");
+                const char *b = VariableOrLoad(IntCode[ipc].name2, "$xintOp3");
                 OutProg.push_back(IntCode[ipc].op);
-                OutProg.push_back(AddrForVariable(IntCode[ipc].name1.c_str()));
-                OutProg.push_back(AddrForVariable(IntCode[ipc].name2.c_str()));
+                PushOperand(AddrForVariable(a));
+                PushOperand(AddrForVariable(b));
                 goto finishIf;
+            }
             finishIf:
                 ifOpIf[ifDepth] = OutProg.size();
-                OutProg.push_back(0);
+                PushOperand(0);
                 ifOpElse[ifDepth] = 0;
                 ifDepth++;
                 // jump target will be filled in later
@@ -187,7 +296,7 @@ void CompileXInterpreted(const char *outFile)
             case INT_ELSE:
                 OutProg.push_back(IntCode[ipc].op);
                 ifOpElse[ifDepth - 1] = OutProg.size();
-                OutProg.push_back(0);
+                PushOperand(0);
                 // jump target will be filled in later
                 break;
 
@@ -196,13 +305,13 @@ void CompileXInterpreted(const char *outFile)
                 if(ifOpElse[ifDepth] == 0) {
                     // There is no else; if should jump straight to the
                     // instruction after this one if the condition is false.
-                    OutProg[ifOpIf[ifDepth]] = CheckRange(OutProg.size() - 1 - ifOpIf[ifDepth], "pc");
+                    PatchOperand(ifOpIf[ifDepth], CheckRange(OutProg.size() - OperandSize - ifOpIf[ifDepth], "pc"));
                 } else {
                     // There is an else clause; if the if is false then jump
                     // just past the else, and if the else is reached then
                     // jump to the endif.
-                    OutProg[ifOpIf[ifDepth]] = CheckRange(ifOpElse[ifDepth] - ifOpIf[ifDepth], "pc");
-                    OutProg[ifOpElse[ifDepth]] = CheckRange(OutProg.size() - 1 - ifOpElse[ifDepth], "pc");
+                    PatchOperand(ifOpIf[ifDepth], CheckRange(ifOpElse[ifDepth] - ifOpIf[ifDepth], "pc"));
+                    PatchOperand(ifOpElse[ifDepth], CheckRange(OutProg.size() - OperandSize - ifOpElse[ifDepth], "pc"));
                 }
                 // But don't generate an instruction for this.
                 continue;
@@ -239,23 +348,39 @@ void CompileXInterpreted(const char *outFile)
             case INT_STRING:
             default:
                 THROW_COMPILER_EXCEPTION_FMT(_("Unsupported op (Peripheral) for interpretable target.\nINT_%d"), IntCode[ipc].op);
-                return;
+                return false;
         }
     }
 
     OutProg.push_back(INT_END_OF_PROGRAM);
+    return !OutOfRange;
+}
+
+void CompileXInterpreted(const char *outFile)
+{
+    FileTracker f(outFile, "w");
+    if(!f) {
+        THROW_COMPILER_EXCEPTION_FMT(_("Couldn't write to '%s'"), outFile);
+        return;
+    }
+
+    for(OperandSize = 1; !GenerateXInterpreted(); OperandSize *= 2)
+        ;
 
     // Create a map of io and internal variables
     // $$IO nb_named_IO total_nb_IO
-    fprintf(f, "$$IO %d %d\n", Prog.io.count, PlcIos_size);
+    fprintf(f, "$$IO %d %d\n", Prog.io.count, (int)PlcIos.size());
 
     for(int i = 0; i < Prog.io.count; i++) {
         PlcProgramSingleIo io = Prog.io.assignment[i];
         fprintf(f, "%2d %20s %2d %2d %2d %05d\n", i, io.name, io.type, GetArduinoPinNumber(io.pin), io.modbus.Slave, io.modbus.Address);
     }
 
-    // $$LDcode program_size
-    fprintf(f, "$$LDcode %zu\n", OutProg.size());
+    // $$LDcode program_size [operand_size], the latter only if it isn't 1
+    fprintf(f, "$$LDcode %zu", OutProg.size());
+    if(OperandSize > 1)
+        fprintf(f, " %d", OperandSize);
+    fprintf(f, "\n");
     for(uint32_t i = 0; i < OutProg.size(); i++) {
         fprintf(f, "%02X", OutProg[i]);
         if((i % 16) == 15 || i == OutProg.size() - 1)
@@ -264,6 +389,33 @@ void CompileXInterpreted(const char *outFile)
 
     fprintf(f, "$$cycle %lld us\n", Prog.cycleTime);
 
+    // The same program as a binary image, that ldxinterpret maps and runs in
+    // place, if asked for.
+    if(WriteBinaryImage) {
+        std::vector<LdImageSymbol> symbols(PlcIos.size());
+        for(size_t i = 0; i < PlcIos.size(); i++) {
+            symbols[i].Addr = i;
+            symbols[i].Type = LDIMAGE_SYMBOL_ANY;
+            strncpy(symbols[i].Name, PlcIos[i], LDIMAGE_NAME_LEN - 1);
+        }
+        std::vector<LdImageIo> io(Prog.io.count);
+        for(int i = 0; i < Prog.io.count; i++) {
+            const PlcProgramSingleIo &a = Prog.io.assignment[i];
+            io[i].Addr = i;
+            io[i].Type = a.type;
+            io[i].Pin = GetArduinoPinNumber(a.pin);
+            io[i].ModbusSlave = a.modbus.Slave;
+            io[i].ModbusAddress = a.modbus.Address;
+            strncpy(io[i].Name, a.name, LDIMAGE_NAME_LEN - 1);
+        }
+        char imageFile[MAX_PATH];
+        SetExt(imageFile, outFile, ".xintb");
+        if(!WriteLdImage(imageFile, LDIMAGE_XINT, OperandSize, OutProg.data(), OutProg.size(), symbols.data(), symbols.size(), io.data(), io.size())) {
+            THROW_COMPILER_EXCEPTION_FMT(_("Couldn't write to '%s'"), imageFile);
+            return;
+        }
+    }
+
     char str[MAX_PATH + 500];
     sprintf(str,
             _("Compile successful; wrote interpretable code to '%s'.\r\n\r\n"